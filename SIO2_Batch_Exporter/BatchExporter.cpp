@@ -0,0 +1,200 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "BatchJob.h"
+#include "WorkerPool.h"
+
+// Exports many scenes with the SIO2_Exporter command, each in
+// its own Maya batch process, several at a time.
+
+#ifdef WIN32
+const char * g_cDefaultCommand =
+"mayabatch.exe -file \"%scene%\" -command \"loadPlugin \\\"SIO2_Exporter\\\"; SIO2_Exporter_1_3_5 -d \\\"%dest%\\\" -n \\\"%name%\\\" %flags% %resume%\"";
+#else
+const char * g_cDefaultCommand =
+"maya -batch -file '%scene%' -command 'loadPlugin \"SIO2_Exporter\"; SIO2_Exporter_1_3_5 -d \"%dest%\" -n \"%name%\" %flags% %resume%'";
+#endif
+
+const char * g_cUsageText =
+"\nUsage: SIO2_BatchExporter -jobs <list> -d <destination> [options]\
+\n\nThe job list has one scene file per line, optionally followed by the \
+scene folder name (the file name by default). Paths with spaces are quoted, \
+lines starting with # are skipped. Bigger scene files are started first. \
+\n\n-p <n>            processes run at the same time (default one per processor)\
+\n-retries <n>      times a failed scene is exported again (default 1), \
+retries pass -resume so they carry on from what was written\
+\n-flags \"...\"      extra SIO2_Exporter flags, such as \"-instance -lodLevels 2\"\
+\n-command \"...\"    command run for each scene. %scene%, %name%, %dest%, \
+%flags% and %resume% are replaced, the default runs Maya in batch mode\
+\n-logs <dir>       where the output of each scene goes (default the destination)\
+\n-report <file>    timings and sizes of every scene as JSON\
+\n-resume           export into scene folders already in the destination\
+\n\nA scene succeeds when its command exits with 0 and its folder is \
+left without a journal.\n";
+
+int main(int argc, char **argv)
+{
+	BatchOptions options;
+	options.commandTemplate = g_cDefaultCommand;
+	options.nProcesses = 0;
+	options.nRetries = 1;
+	options.bResume = false;
+
+	std::string jobsPath;
+	std::string reportPath;
+
+	for(int i=1; i<argc; i++)
+	{
+		std::string arg = argv[i];
+		bool bHasValue = i + 1 < argc;
+
+		if(arg == "-jobs" && bHasValue)
+			jobsPath = argv[++i];
+		else if(arg == "-d" && bHasValue)
+			options.destDir = argv[++i];
+		else if(arg == "-p" && bHasValue)
+			options.nProcesses = (unsigned int)atoi(argv[++i]);
+		else if(arg == "-retries" && bHasValue)
+			options.nRetries = (unsigned int)atoi(argv[++i]);
+		else if(arg == "-flags" && bHasValue)
+			options.exportFlags = argv[++i];
+		else if(arg == "-command" && bHasValue)
+			options.commandTemplate = argv[++i];
+		else if(arg == "-logs" && bHasValue)
+			options.logDir = argv[++i];
+		else if(arg == "-report" && bHasValue)
+			reportPath = argv[++i];
+		else if(arg == "-resume")
+			options.bResume = true;
+		else
+		{
+			if(arg != "-h" && arg != "-help")
+				fprintf(stderr, "Unknown or incomplete option: %s\n", arg.c_str());
+			printf("%s", g_cUsageText);
+			return 2;
+		}
+	}
+
+	if(jobsPath.empty() || options.destDir.empty())
+	{
+		printf("%s", g_cUsageText);
+		return 2;
+	}
+
+	// The exporter appends the scene name to it as is.
+	char last = options.destDir[options.destDir.length() - 1];
+	if(last != '/' && last != '\\')
+		options.destDir += "/";
+	if(!options.logDir.empty())
+	{
+		last = options.logDir[options.logDir.length() - 1];
+		if(last != '/' && last != '\\')
+			options.logDir += "/";
+	}
+
+	if(options.nProcesses == 0)
+		options.nProcesses = getProcessorCount();
+
+	std::vector<BatchJob> jobs;
+	std::string error;
+	if(!readJobList(jobsPath, jobs, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 2;
+	}
+	if(jobs.empty())
+	{
+		fprintf(stderr, "No scenes in %s\n", jobsPath.c_str());
+		return 2;
+	}
+
+	// Two scenes writing the same folder would overwrite each other.
+	std::set<std::string> names;
+	for(unsigned int i=0; i<jobs.size(); i++)
+	{
+		if(!names.insert(jobs[i].sceneName).second)
+		{
+			fprintf(stderr, "Scene name used twice in %s: %s\n", jobsPath.c_str(), jobs[i].sceneName.c_str());
+			return 2;
+		}
+	}
+
+	std::vector<BatchJob *> order;
+	orderJobsBySize(jobs, order);
+
+	printf("Exporting %u scenes on %u processes\n", (unsigned int)jobs.size(), options.nProcesses);
+	fflush(stdout);
+
+	Mutex outputMutex;
+	unsigned int nFinished = 0;
+	std::vector<BatchJobTask *> tasks;
+	for(unsigned int i=0; i<order.size(); i++)
+		tasks.push_back(new BatchJobTask(*order[i], options, outputMutex, nFinished, (unsigned int)order.size()));
+
+	// Each thread only waits on its process.
+	double fStart = getTimeSeconds();
+	WorkerPool pool;
+	pool.start(options.nProcesses);
+	for(unsigned int i=0; i<tasks.size(); i++)
+		pool.enqueue(tasks[i]);
+	pool.wait();
+	pool.stop();
+	double fWallSeconds = getTimeSeconds() - fStart;
+
+	for(unsigned int i=0; i<tasks.size(); i++)
+		delete tasks[i];
+
+	unsigned int nFailed = 0;
+	unsigned int nRetried = 0;
+	double fJobSeconds = 0;
+	unsigned long long nBytes = 0;
+	for(unsigned int i=0; i<jobs.size(); i++)
+	{
+		if(!jobs[i].bSuccess)
+			nFailed++;
+		if(jobs[i].nAttempts > 1)
+			nRetried++;
+		fJobSeconds += jobs[i].fSeconds;
+		nBytes += jobs[i].nOutputBytes;
+	}
+
+	printf("\nScenes: %u failed: %u retried: %u\n", (unsigned int)jobs.size(), nFailed, nRetried);
+	printf("Time (s): %.1f scene total (s): %.1f speedup: %.2f\n", fWallSeconds, fJobSeconds,
+		fWallSeconds > 0 ? fJobSeconds / fWallSeconds : 0.0);
+	printf("Written (MB): %.2f\n", nBytes / (1024.0 * 1024.0));
+
+	for(unsigned int i=0; i<jobs.size(); i++)
+	{
+		if(!jobs[i].bSuccess)
+			printf("Failed: %s (%s) exit code %d\n", jobs[i].sceneName.c_str(), jobs[i].scenePath.c_str(), jobs[i].nExitCode);
+	}
+
+	if(!reportPath.empty() && !writeBatchReport(reportPath, jobs, options, fWallSeconds))
+	{
+		fprintf(stderr, "Failed to write report: %s\n", reportPath.c_str());
+		return 1;
+	}
+
+	return nFailed > 0 ? 1 : 0;
+}
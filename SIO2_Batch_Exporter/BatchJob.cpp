@@ -0,0 +1,415 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "BatchJob.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+static std::string trim(const std::string &s)
+{
+	size_t first = s.find_first_not_of(" \t\r\n");
+	if(first == std::string::npos)
+		return "";
+	size_t last = s.find_last_not_of(" \t\r\n");
+	return s.substr(first, last - first + 1);
+}
+
+static double fileSize(const std::string &path)
+{
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+		return 0;
+	return (double)info.st_size;
+}
+
+static bool fileExists(const std::string &path)
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0;
+}
+
+// Scene file name without its folders and extension.
+static std::string sceneNameFromPath(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if(dot != std::string::npos && dot > 0)
+		name = name.substr(0, dot);
+	return name;
+}
+
+bool readJobList(const std::string &path, std::vector<BatchJob> &jobs, std::string &error)
+{
+	std::ifstream in(path.c_str());
+	if(!in.is_open())
+	{
+		error = "Could not open the job list: " + path;
+		return false;
+	}
+
+	std::string line;
+	int nLine = 0;
+	while(std::getline(in, line))
+	{
+		nLine++;
+		line = trim(line);
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		BatchJob job;
+
+		// The path may be quoted to hold spaces.
+		std::string rest;
+		if(line[0] == '"')
+		{
+			size_t end = line.find('"', 1);
+			if(end == std::string::npos)
+			{
+				std::ostringstream s;
+				s<<path<<"("<<nLine<<"): missing closing quote";
+				error = s.str();
+				return false;
+			}
+			job.scenePath = line.substr(1, end - 1);
+			rest = line.substr(end + 1);
+		}
+		else
+		{
+			size_t end = line.find_first_of(" \t");
+			job.scenePath = line.substr(0, end);
+			rest = end == std::string::npos ? "" : line.substr(end);
+		}
+
+		job.sceneName = trim(rest);
+		if(job.sceneName.empty())
+			job.sceneName = sceneNameFromPath(job.scenePath);
+
+		job.fEstimate = fileSize(job.scenePath);
+		job.nAttempts = 0;
+		job.nExitCode = 0;
+		job.bSuccess = false;
+		job.fSeconds = 0;
+		job.nOutputBytes = 0;
+		job.nOutputFiles = 0;
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+static void replaceAll(std::string &s, const std::string &from, const std::string &to)
+{
+	size_t pos = 0;
+	while((pos = s.find(from, pos)) != std::string::npos)
+	{
+		s.replace(pos, from.length(), to);
+		pos += to.length();
+	}
+}
+
+std::string expandCommand(const BatchOptions &options, const BatchJob &job, bool bRetry)
+{
+	std::string command = options.commandTemplate;
+	replaceAll(command, "%scene%", job.scenePath);
+	replaceAll(command, "%name%", job.sceneName);
+	replaceAll(command, "%dest%", options.destDir);
+	replaceAll(command, "%flags%", options.exportFlags);
+	replaceAll(command, "%resume%", bRetry || options.bResume ? "-resume" : "");
+	return command;
+}
+
+int runProcess(const std::string &command, const std::string &logPath, bool bAppendLog)
+{
+#ifdef WIN32
+	SECURITY_ATTRIBUTES security;
+	security.nLength = sizeof(security);
+	security.lpSecurityDescriptor = NULL;
+	security.bInheritHandle = TRUE;
+
+	HANDLE hLog = CreateFileA(logPath.c_str(), bAppendLog ? FILE_APPEND_DATA : GENERIC_WRITE,
+		FILE_SHARE_READ, &security, bAppendLog ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hLog == INVALID_HANDLE_VALUE)
+		return -1;
+
+	STARTUPINFOA startup;
+	ZeroMemory(&startup, sizeof(startup));
+	startup.cb = sizeof(startup);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = NULL;
+	startup.hStdOutput = hLog;
+	startup.hStdError = hLog;
+
+	PROCESS_INFORMATION process;
+	ZeroMemory(&process, sizeof(process));
+
+	// CreateProcess may write to the command line.
+	std::string shell = "cmd.exe /c " + command;
+	std::vector<char> commandLine(shell.begin(), shell.end());
+	commandLine.push_back(0);
+
+	BOOL bStarted = CreateProcessA(NULL, &commandLine[0], NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &startup, &process);
+	CloseHandle(hLog);
+	if(!bStarted)
+		return -1;
+
+	WaitForSingleObject(process.hProcess, INFINITE);
+	DWORD exitCode = 0;
+	GetExitCodeProcess(process.hProcess, &exitCode);
+	CloseHandle(process.hProcess);
+	CloseHandle(process.hThread);
+	return (int)exitCode;
+#else
+	int fd = open(logPath.c_str(), O_WRONLY | O_CREAT | (bAppendLog ? O_APPEND : O_TRUNC), 0644);
+	if(fd < 0)
+		return -1;
+
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if(pid == 0)
+	{
+		dup2(fd, 1);
+		dup2(fd, 2);
+		close(fd);
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char *)NULL);
+		_exit(127);
+	}
+	close(fd);
+
+	int status = 0;
+	while(waitpid(pid, &status, 0) < 0)
+	{
+		if(errno != EINTR)
+			return -1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+bool directorySize(const std::string &path, unsigned long long &nBytes, unsigned int &nFiles)
+{
+#ifdef WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE hFind = FindFirstFileA((path + "/*").c_str(), &data);
+	if(hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		std::string name = data.cFileName;
+		if(name == "." || name == "..")
+			continue;
+
+		if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			directorySize(path + "/" + name, nBytes, nFiles);
+		}
+		else
+		{
+			nBytes += ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+			nFiles++;
+		}
+	}
+	while(FindNextFileA(hFind, &data));
+
+	FindClose(hFind);
+	return true;
+#else
+	DIR *dir = opendir(path.c_str());
+	if(dir == NULL)
+		return false;
+
+	struct dirent *entry;
+	while((entry = readdir(dir)) != NULL)
+	{
+		std::string name = entry->d_name;
+		if(name == "." || name == "..")
+			continue;
+
+		std::string child = path + "/" + name;
+		struct stat info;
+		if(stat(child.c_str(), &info) != 0)
+			continue;
+
+		if(S_ISDIR(info.st_mode))
+		{
+			directorySize(child, nBytes, nFiles);
+		}
+		else
+		{
+			nBytes += (unsigned long long)info.st_size;
+			nFiles++;
+		}
+	}
+
+	closedir(dir);
+	return true;
+#endif
+}
+
+bool isExportComplete(const std::string &destDir, const std::string &sceneName)
+{
+	return fileExists(destDir + sceneName) && !fileExists(destDir + sceneName + ".journal");
+}
+
+BatchJobTask::BatchJobTask(BatchJob &job, const BatchOptions &options, Mutex &outputMutex, unsigned int &nFinished, unsigned int nTotal)
+	: m_job(job), m_options(options), m_outputMutex(outputMutex), m_nFinished(nFinished), m_nTotal(nTotal)
+{
+}
+
+void BatchJobTask::run()
+{
+	std::string logDir = m_options.logDir.empty() ? m_options.destDir : m_options.logDir;
+	std::string logPath = logDir + m_job.sceneName + ".log";
+
+	// The exporter will not write into an existing folder, and
+	// a finished one has no journal to tell it apart from this run.
+	if(!m_options.bResume && fileExists(m_options.destDir + m_job.sceneName))
+	{
+		ScopedLock lock(m_outputMutex);
+		m_nFinished++;
+		m_job.nExitCode = -1;
+		printf("[%u/%u] %s FAILED %s%s already exists, remove it or use -resume\n", m_nFinished, m_nTotal,
+			m_job.sceneName.c_str(), m_options.destDir.c_str(), m_job.sceneName.c_str());
+		fflush(stdout);
+		return;
+	}
+
+	for(unsigned int i=0; i<=m_options.nRetries && !m_job.bSuccess; i++)
+	{
+		bool bRetry = i > 0;
+		std::string command = expandCommand(m_options, m_job, bRetry);
+
+		if(bRetry)
+		{
+			ScopedLock lock(m_outputMutex);
+			printf("Retrying %s (exit code %d)\n", m_job.sceneName.c_str(), m_job.nExitCode);
+			fflush(stdout);
+		}
+
+		double fStart = getTimeSeconds();
+		m_job.nExitCode = runProcess(command, logPath, bRetry);
+		m_job.fSeconds += getTimeSeconds() - fStart;
+		m_job.nAttempts++;
+
+		m_job.bSuccess = m_job.nExitCode == 0 && isExportComplete(m_options.destDir, m_job.sceneName);
+	}
+
+	m_job.nOutputBytes = 0;
+	m_job.nOutputFiles = 0;
+	directorySize(m_options.destDir + m_job.sceneName, m_job.nOutputBytes, m_job.nOutputFiles);
+
+	ScopedLock lock(m_outputMutex);
+	m_nFinished++;
+	printf("[%u/%u] %s %s %.1f s %.2f MB\n", m_nFinished, m_nTotal, m_job.sceneName.c_str(),
+		m_job.bSuccess ? "ok" : "FAILED", m_job.fSeconds, m_job.nOutputBytes / (1024.0 * 1024.0));
+	fflush(stdout);
+}
+
+struct BiggerEstimate
+{
+	bool operator()(const BatchJob *a, const BatchJob *b) const { return a->fEstimate > b->fEstimate; }
+};
+
+void orderJobsBySize(std::vector<BatchJob> &jobs, std::vector<BatchJob *> &order)
+{
+	order.clear();
+	for(unsigned int i=0; i<jobs.size(); i++)
+		order.push_back(&jobs[i]);
+	std::stable_sort(order.begin(), order.end(), BiggerEstimate());
+}
+
+static std::string jsonString(const std::string &s)
+{
+	std::string out = "\"";
+	for(unsigned int i=0; i<s.length(); i++)
+	{
+		char c = s[i];
+		if(c == '"' || c == '\\')
+			out += '\\';
+		if((unsigned char)c < 0x20)
+			continue;
+		out += c;
+	}
+	return out + "\"";
+}
+
+bool writeBatchReport(const std::string &path, const std::vector<BatchJob> &jobs, const BatchOptions &options, double fWallSeconds)
+{
+	std::ofstream osf(path.c_str());
+
+	unsigned int nFailed = 0;
+	unsigned int nRetried = 0;
+	double fJobSeconds = 0;
+	unsigned long long nBytes = 0;
+	for(unsigned int i=0; i<jobs.size(); i++)
+	{
+		if(!jobs[i].bSuccess)
+			nFailed++;
+		if(jobs[i].nAttempts > 1)
+			nRetried++;
+		fJobSeconds += jobs[i].fSeconds;
+		nBytes += jobs[i].nOutputBytes;
+	}
+
+	osf<<"{"<<std::endl;
+	osf<<"\t\"processes\": "<<options.nProcesses<<","<<std::endl;
+	osf<<"\t\"seconds\": "<<fWallSeconds<<","<<std::endl;
+	osf<<"\t\"jobSeconds\": "<<fJobSeconds<<","<<std::endl;
+	osf<<"\t\"scenes\": "<<jobs.size()<<","<<std::endl;
+	osf<<"\t\"failed\": "<<nFailed<<","<<std::endl;
+	osf<<"\t\"retried\": "<<nRetried<<","<<std::endl;
+	osf<<"\t\"outputBytes\": "<<nBytes<<","<<std::endl;
+	osf<<"\t\"jobs\": ["<<std::endl;
+	for(unsigned int i=0; i<jobs.size(); i++)
+	{
+		const BatchJob &job = jobs[i];
+		osf<<"\t\t{ \"scene\": "<<jsonString(job.scenePath)
+			<<", \"name\": "<<jsonString(job.sceneName)
+			<<", \"success\": "<<(job.bSuccess ? "true" : "false")
+			<<", \"attempts\": "<<job.nAttempts
+			<<", \"exitCode\": "<<job.nExitCode
+			<<", \"seconds\": "<<job.fSeconds
+			<<", \"sceneBytes\": "<<(unsigned long long)job.fEstimate
+			<<", \"outputBytes\": "<<job.nOutputBytes
+			<<", \"outputFiles\": "<<job.nOutputFiles<<" }"
+			<<(i + 1 < jobs.size() ? "," : "")<<std::endl;
+	}
+	osf<<"\t]"<<std::endl<<"}"<<std::endl;
+
+	bool bOk = !osf.fail();
+	osf.close();
+	return bOk;
+}
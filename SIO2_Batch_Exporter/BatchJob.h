@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef BATCHJOB_H
+#define BATCHJOB_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "WorkerPool.h"
+
+// One scene of the batch and how its export went.
+struct BatchJob
+{
+	std::string scenePath;
+	// Folder written in the destination, defaults to the
+	// scene file name without its extension.
+	std::string sceneName;
+	// Size of the scene file, the biggest scenes start first.
+	double fEstimate;
+
+	int nAttempts;
+	int nExitCode;
+	bool bSuccess;
+	// Over all the attempts.
+	double fSeconds;
+	unsigned long long nOutputBytes;
+	unsigned int nOutputFiles;
+};
+
+struct BatchOptions
+{
+	// Command run for each scene, see expandCommand.
+	std::string commandTemplate;
+	// Extra SIO2_Exporter flags put in place of %flags%.
+	std::string exportFlags;
+	// Ends with a slash.
+	std::string destDir;
+	// Logs go next to the scenes written when empty.
+	std::string logDir;
+	unsigned int nProcesses;
+	unsigned int nRetries;
+	// Export into scene folders left by an earlier batch
+	// instead of failing those scenes.
+	bool bResume;
+};
+
+// Reads a job list, one scene per line followed by an optional
+// scene name. Blank lines and lines starting with # are skipped.
+bool readJobList(const std::string &path, std::vector<BatchJob> &jobs, std::string &error);
+
+// Replaces %scene%, %name%, %dest%, %flags% and %resume% in the
+// template. %resume% is -resume when retrying a failed export so
+// it carries on from what the last attempt wrote, or always
+// with bResume.
+std::string expandCommand(const BatchOptions &options, const BatchJob &job, bool bRetry);
+
+// Runs a command through the shell with its output sent to
+// logPath. Returns its exit code, -1 if it could not be started.
+int runProcess(const std::string &command, const std::string &logPath, bool bAppendLog);
+
+// Bytes and files under a directory, false if it does not exist.
+bool directorySize(const std::string &path, unsigned long long &nBytes, unsigned int &nFiles);
+
+// The exporter deletes its journal once a scene is done, so a
+// folder without one is complete.
+bool isExportComplete(const std::string &destDir, const std::string &sceneName);
+
+// Exports one scene on the worker pool, in its own process,
+// trying again up to nRetries times.
+class BatchJobTask : public WorkerTask
+{
+	public:
+		BatchJobTask(BatchJob &job, const BatchOptions &options, Mutex &outputMutex, unsigned int &nFinished, unsigned int nTotal);
+
+		virtual void run();
+
+	protected:
+		BatchJob &m_job;
+		const BatchOptions &m_options;
+		// Guards the console and the finished count.
+		Mutex &m_outputMutex;
+		unsigned int &m_nFinished;
+		unsigned int m_nTotal;
+};
+
+// The jobs from the biggest estimate to the smallest, so the
+// long scenes do not end up last on a single process.
+void orderJobsBySize(std::vector<BatchJob> &jobs, std::vector<BatchJob *> &order);
+
+// Timings and sizes of the batch as JSON.
+bool writeBatchReport(const std::string &path, const std::vector<BatchJob> &jobs, const BatchOptions &options, double fWallSeconds);
+
+#endif
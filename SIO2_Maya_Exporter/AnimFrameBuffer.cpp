@@ -0,0 +1,231 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "AnimFrameBuffer.h"
+
+#include <sstream>
+
+AnimFrameBuffer::AnimFrameBuffer()
+{
+	m_nBudget = 256 * 1024 * 1024;
+	m_nBytesInMemory = 0;
+	m_nPeakBytes = 0;
+	m_nBytesSpilled = 0;
+	m_sSpillPrefix = "sio2_anim";
+}
+
+AnimFrameBuffer::~AnimFrameBuffer()
+{
+	clear();
+}
+
+void AnimFrameBuffer::setBudget(size_t bytes)
+{
+	m_nBudget = bytes;
+}
+
+void AnimFrameBuffer::setSpillPrefix(const std::string &prefix)
+{
+	m_sSpillPrefix = prefix;
+}
+
+int AnimFrameBuffer::addMesh(unsigned int numVerts)
+{
+	MeshFrames mesh;
+	mesh.numVerts = numVerts;
+	mesh.numSpilled = 0;
+	mesh.readPos = 0;
+	mesh.spill = NULL;
+
+	m_vMeshes.push_back(mesh);
+	return (int)m_vMeshes.size() - 1;
+}
+
+bool AnimFrameBuffer::appendFrame(int mesh, double frame, const float *xyz)
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return false;
+
+	MeshFrames &m = m_vMeshes[mesh];
+	size_t nFloats = (size_t)m.numVerts * 3;
+
+	m.frames.push_back(frame);
+	m.data.insert(m.data.end(), xyz, xyz + nFloats);
+
+	m_nBytesInMemory += nFloats * sizeof(float);
+	if(m_nBytesInMemory > m_nPeakBytes)
+		m_nPeakBytes = m_nBytesInMemory;
+
+	// Keep spilling the biggest mesh until we are back
+	// under the budget. A single frame larger than the
+	// budget still has to go through memory once.
+	while(m_nBytesInMemory > m_nBudget)
+	{
+		if(!spillLargest())
+			return false;
+	}
+	return true;
+}
+
+bool AnimFrameBuffer::spillLargest()
+{
+	size_t nLargest = 0;
+	int nIndex = -1;
+
+	for(unsigned int i=0; i<m_vMeshes.size(); i++)
+	{
+		if(m_vMeshes[i].data.size() > nLargest)
+		{
+			nLargest = m_vMeshes[i].data.size();
+			nIndex = i;
+		}
+	}
+	if(nIndex < 0)
+		return false;
+
+	return spillMesh(m_vMeshes[nIndex]);
+}
+
+bool AnimFrameBuffer::spillMesh(MeshFrames &mesh)
+{
+	if(mesh.data.empty())
+		return true;
+
+	if(mesh.spill == NULL)
+	{
+		std::stringstream s;
+		s<<m_sSpillPrefix<<(&mesh - &m_vMeshes[0])<<".tmp";
+		mesh.spillName = s.str();
+
+		mesh.spill = fopen(mesh.spillName.c_str(), "w+b");
+		if(mesh.spill == NULL)
+			return false;
+	}
+	else
+	{
+		// Reads may have moved the file pointer.
+		fseek(mesh.spill, 0, SEEK_END);
+	}
+
+	size_t nWritten = fwrite(&mesh.data[0], sizeof(float), mesh.data.size(), mesh.spill);
+	if(nWritten != mesh.data.size())
+		return false;
+
+	size_t nBytes = mesh.data.size() * sizeof(float);
+	m_nBytesInMemory -= nBytes;
+	m_nBytesSpilled += nBytes;
+	mesh.numSpilled = (unsigned int)mesh.frames.size();
+
+	// Give the memory back, clear() alone keeps the capacity.
+	std::vector<float>().swap(mesh.data);
+
+	return true;
+}
+
+unsigned int AnimFrameBuffer::frameCount(int mesh) const
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return 0;
+
+	return (unsigned int)m_vMeshes[mesh].frames.size();
+}
+
+unsigned int AnimFrameBuffer::vertexCount(int mesh) const
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return 0;
+
+	return m_vMeshes[mesh].numVerts;
+}
+
+bool AnimFrameBuffer::beginRead(int mesh)
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return false;
+
+	MeshFrames &m = m_vMeshes[mesh];
+	m.readPos = 0;
+
+	if(m.spill != NULL)
+	{
+		fflush(m.spill);
+		rewind(m.spill);
+	}
+	return true;
+}
+
+bool AnimFrameBuffer::nextFrame(int mesh, double &frame, std::vector<float> &xyz)
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return false;
+
+	MeshFrames &m = m_vMeshes[mesh];
+	if(m.readPos >= m.frames.size())
+		return false;
+
+	size_t nFloats = (size_t)m.numVerts * 3;
+	xyz.resize(nFloats);
+	frame = m.frames[m.readPos];
+
+	if(m.readPos < m.numSpilled)
+	{
+		if(nFloats > 0 && fread(&xyz[0], sizeof(float), nFloats, m.spill) != nFloats)
+			return false;
+	}
+	else
+	{
+		size_t nOffset = (size_t)(m.readPos - m.numSpilled) * nFloats;
+		for(size_t i=0; i<nFloats; i++)
+			xyz[i] = m.data[nOffset + i];
+	}
+	m.readPos++;
+
+	return true;
+}
+
+void AnimFrameBuffer::release(int mesh)
+{
+	if(mesh < 0 || mesh >= (int)m_vMeshes.size())
+		return;
+
+	MeshFrames &m = m_vMeshes[mesh];
+
+	m_nBytesInMemory -= m.data.size() * sizeof(float);
+	std::vector<float>().swap(m.data);
+	std::vector<double>().swap(m.frames);
+	m.numSpilled = 0;
+	m.readPos = 0;
+
+	if(m.spill != NULL)
+	{
+		fclose(m.spill);
+		m.spill = NULL;
+		remove(m.spillName.c_str());
+	}
+}
+
+void AnimFrameBuffer::clear()
+{
+	for(unsigned int i=0; i<m_vMeshes.size(); i++)
+		release(i);
+
+	m_vMeshes.clear();
+	m_nBytesInMemory = 0;
+	m_nBytesSpilled = 0;
+	m_nPeakBytes = 0;
+}
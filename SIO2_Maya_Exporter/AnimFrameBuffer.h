@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef ANIMFRAMEBUFFER_H
+#define ANIMFRAMEBUFFER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Holds the baked vertex positions of every animated mesh while the
+// scene is sampled frame by frame. Frames are kept in RAM until the
+// budget is exceeded, at which point the mesh holding the most memory
+// has its frames moved to a temporary file. Frames are read back in the
+// order they were appended, spilled ones first.
+class AnimFrameBuffer
+{
+	public:
+		AnimFrameBuffer();
+		~AnimFrameBuffer();
+
+		// Maximum number of bytes of frame data kept in RAM.
+		void setBudget(size_t bytes);
+
+		// Spill files are named <prefix><meshId>.tmp
+		void setSpillPrefix(const std::string &prefix);
+
+		// Registers a mesh and returns its id.
+		int addMesh(unsigned int numVerts);
+
+		// Appends one frame. xyz holds 3 floats per vertex.
+		bool appendFrame(int mesh, double frame, const float *xyz);
+
+		unsigned int frameCount(int mesh) const;
+		unsigned int vertexCount(int mesh) const;
+
+		// Sequential read back of the frames of a mesh.
+		bool beginRead(int mesh);
+		bool nextFrame(int mesh, double &frame, std::vector<float> &xyz);
+
+		// Frees the memory and spill file of a mesh.
+		void release(int mesh);
+
+		// Frees everything.
+		void clear();
+
+		size_t bytesInMemory() const { return m_nBytesInMemory; }
+		size_t peakBytesInMemory() const { return m_nPeakBytes; }
+		size_t bytesSpilled() const { return m_nBytesSpilled; }
+
+	protected:
+		struct MeshFrames
+		{
+			unsigned int numVerts;
+			unsigned int numSpilled;
+			unsigned int readPos;
+			std::vector<double> frames;
+			std::vector<float> data;
+			std::string spillName;
+			FILE *spill;
+		};
+
+		bool spillLargest();
+		bool spillMesh(MeshFrames &mesh);
+
+		std::vector<MeshFrames> m_vMeshes;
+		std::string m_sSpillPrefix;
+		size_t m_nBudget;
+		size_t m_nBytesInMemory;
+		size_t m_nPeakBytes;
+		size_t m_nBytesSpilled;
+};
+
+#endif
@@ -0,0 +1,178 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "AtlasPacker.h"
+
+SkylinePacker::SkylinePacker()
+{
+	init(0, 0);
+}
+
+void SkylinePacker::init(unsigned int width, unsigned int height)
+{
+	m_nWidth = width;
+	m_nHeight = height;
+	m_nUsedArea = 0;
+
+	m_vSkyline.clear();
+	Segment ground;
+	ground.x = 0;
+	ground.y = 0;
+	ground.width = width;
+	m_vSkyline.push_back(ground);
+}
+
+bool SkylinePacker::fits(unsigned int index, unsigned int w, unsigned int h, unsigned int &y) const
+{
+	unsigned int x = m_vSkyline[index].x;
+	if(x + w > m_nWidth)
+		return false;
+
+	// The rectangle rests on the highest segment it spans.
+	int widthLeft = w;
+	y = m_vSkyline[index].y;
+	while(widthLeft > 0)
+	{
+		if(index >= m_vSkyline.size())
+			return false;
+
+		if(m_vSkyline[index].y > y)
+			y = m_vSkyline[index].y;
+		if(y + h > m_nHeight)
+			return false;
+
+		widthLeft -= m_vSkyline[index].width;
+		index++;
+	}
+	return true;
+}
+
+bool SkylinePacker::insert(unsigned int w, unsigned int h, unsigned int &x, unsigned int &y)
+{
+	unsigned int bestTop = 0xffffffff;
+	unsigned int bestWidth = 0xffffffff;
+	int bestIndex = -1;
+
+	for(unsigned int i=0; i<m_vSkyline.size(); i++)
+	{
+		unsigned int top;
+		if(!fits(i, w, h, top))
+			continue;
+
+		if(top + h < bestTop || (top + h == bestTop && m_vSkyline[i].width < bestWidth))
+		{
+			bestTop = top + h;
+			bestWidth = m_vSkyline[i].width;
+			bestIndex = i;
+			x = m_vSkyline[i].x;
+			y = top;
+		}
+	}
+
+	if(bestIndex < 0)
+		return false;
+
+	addLevel(bestIndex, x, y, w, h);
+	m_nUsedArea += (size_t)w * h;
+	return true;
+}
+
+void SkylinePacker::addLevel(unsigned int index, unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+{
+	Segment level;
+	level.x = x;
+	level.y = y + h;
+	level.width = w;
+	m_vSkyline.insert(m_vSkyline.begin() + index, level);
+
+	// Trim or remove the segments now under the new one.
+	for(unsigned int i=index+1; i<m_vSkyline.size(); i++)
+	{
+		Segment &prev = m_vSkyline[i-1];
+		Segment &seg = m_vSkyline[i];
+
+		if(seg.x >= prev.x + prev.width)
+			break;
+
+		unsigned int shrink = prev.x + prev.width - seg.x;
+		if(shrink >= seg.width)
+		{
+			m_vSkyline.erase(m_vSkyline.begin() + i);
+			i--;
+		}
+		else
+		{
+			seg.x += shrink;
+			seg.width -= shrink;
+			break;
+		}
+	}
+
+	// Merge neighbours at the same height.
+	for(unsigned int i=0; i+1<m_vSkyline.size(); i++)
+	{
+		if(m_vSkyline[i].y == m_vSkyline[i+1].y)
+		{
+			m_vSkyline[i].width += m_vSkyline[i+1].width;
+			m_vSkyline.erase(m_vSkyline.begin() + i + 1);
+			i--;
+		}
+	}
+}
+
+float SkylinePacker::occupancy() const
+{
+	if(m_nWidth == 0 || m_nHeight == 0)
+		return 0;
+
+	return (float)m_nUsedArea / ((float)m_nWidth * m_nHeight);
+}
+
+void blitWithGutter(TextureImage &dst, const TextureImage &src, unsigned int x, unsigned int y, unsigned int pad)
+{
+	int x0 = (int)x - (int)pad;
+	int y0 = (int)y - (int)pad;
+	int x1 = x + src.width + pad;
+	int y1 = y + src.height + pad;
+
+	for(int dy=y0; dy<y1; dy++)
+	{
+		if(dy < 0 || dy >= (int)dst.height)
+			continue;
+
+		// Clamp into the source to extend its edges.
+		int sy = dy - (int)y;
+		sy = sy < 0 ? 0 : (sy >= (int)src.height ? src.height - 1 : sy);
+
+		for(int dx=x0; dx<x1; dx++)
+		{
+			if(dx < 0 || dx >= (int)dst.width)
+				continue;
+
+			int sx = dx - (int)x;
+			sx = sx < 0 ? 0 : (sx >= (int)src.width ? src.width - 1 : sx);
+
+			const unsigned char *s = &src.pixels[((size_t)sy * src.width + sx) * 4];
+			unsigned char *d = &dst.pixels[((size_t)dy * dst.width + dx) * 4];
+			d[0] = s[0];
+			d[1] = s[1];
+			d[2] = s[2];
+			d[3] = s[3];
+		}
+	}
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef ATLASPACKER_H
+#define ATLASPACKER_H
+
+#include <vector>
+#include "TextureProcessor.h"
+
+// Skyline bin packer. Keeps the top edge of the packed
+// rectangles as a list of horizontal segments and puts each
+// new rectangle where its top ends up lowest (bottom left
+// rule), ties going to the narrowest segment.
+class SkylinePacker
+{
+	public:
+		SkylinePacker();
+
+		void init(unsigned int width, unsigned int height);
+
+		// Finds room for a w x h rectangle. Fails if it does not fit.
+		bool insert(unsigned int w, unsigned int h, unsigned int &x, unsigned int &y);
+
+		// Fraction of the area in use.
+		float occupancy() const;
+
+	protected:
+		struct Segment
+		{
+			unsigned int x;
+			unsigned int y;
+			unsigned int width;
+		};
+
+		bool fits(unsigned int index, unsigned int w, unsigned int h, unsigned int &y) const;
+		void addLevel(unsigned int index, unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+
+		std::vector<Segment> m_vSkyline;
+		unsigned int m_nWidth;
+		unsigned int m_nHeight;
+		size_t m_nUsedArea;
+};
+
+// Copies src into dst at x, y and repeats its border pixels
+// pad times around it so filtering does not pick up the
+// neighbouring textures.
+void blitWithGutter(TextureImage &dst, const TextureImage &src, unsigned int x, unsigned int y, unsigned int pad);
+
+#endif
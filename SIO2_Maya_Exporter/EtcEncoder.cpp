@@ -0,0 +1,572 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "EtcEncoder.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// Intensity modifiers, index 0 and 1 are added, 2 and 3
+// subtracted (pixel index order +a, +b, -a, -b).
+static const int g_etcModifiers[8][2] =
+{
+	{2, 8}, {5, 17}, {9, 29}, {13, 42},
+	{18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+static const int g_eacModifiers[16][8] =
+{
+	{-3, -6, -9, -15, 2, 5, 8, 14},
+	{-3, -7, -10, -13, 2, 6, 9, 12},
+	{-2, -5, -8, -13, 1, 4, 7, 12},
+	{-2, -4, -6, -13, 1, 3, 5, 12},
+	{-3, -6, -8, -12, 2, 5, 7, 11},
+	{-3, -7, -9, -11, 2, 6, 8, 10},
+	{-4, -7, -8, -11, 3, 6, 7, 10},
+	{-3, -5, -8, -11, 2, 4, 7, 10},
+	{-2, -6, -8, -10, 1, 5, 7, 9},
+	{-2, -5, -8, -10, 1, 4, 7, 9},
+	{-2, -4, -8, -10, 1, 3, 7, 9},
+	{-2, -5, -7, -10, 1, 4, 6, 9},
+	{-3, -4, -7, -10, 2, 3, 6, 9},
+	{-1, -2, -3, -10, 0, 1, 2, 9},
+	{-4, -6, -8, -9, 3, 5, 7, 8},
+	{-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+static inline int clamp255(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline int etcModifier(int table, int index)
+{
+	int m = g_etcModifiers[table][index & 1];
+	return (index & 2) ? -m : m;
+}
+
+static inline int expand4(int c)
+{
+	return (c << 4) | c;
+}
+
+static inline int expand5(int c)
+{
+	return (c << 3) | (c >> 2);
+}
+
+static inline bool inSubBlock(int pixel, bool bFlip, int subBlock)
+{
+	int pos = bFlip ? (pixel % 4) : (pixel / 4);
+	return (pos >= 2) == (subBlock == 1);
+}
+
+// Best table and indices for the 8 pixels of a sub block
+// drawn from base. Returns the squared error.
+static unsigned int fitSubBlock(const unsigned char block[16][4], const int pixels[8], const int base[3],
+								int &table, unsigned char indices[16], unsigned int bestSoFar)
+{
+	unsigned int bestErr = bestSoFar;
+	table = -1;
+
+	for(int t=0; t<8; t++)
+	{
+		unsigned int err = 0;
+		unsigned char idx[8];
+
+		for(int p=0; p<8 && err < bestErr; p++)
+		{
+			const unsigned char *px = block[pixels[p]];
+			unsigned int bestPixel = 0xffffffff;
+
+			for(int i=0; i<4; i++)
+			{
+				int m = etcModifier(t, i);
+				int dr = clamp255(base[0] + m) - px[0];
+				int dg = clamp255(base[1] + m) - px[1];
+				int db = clamp255(base[2] + m) - px[2];
+				unsigned int e = dr * dr + dg * dg + db * db;
+				if(e < bestPixel)
+				{
+					bestPixel = e;
+					idx[p] = (unsigned char)i;
+				}
+			}
+			err += bestPixel;
+		}
+
+		if(err < bestErr)
+		{
+			bestErr = err;
+			table = t;
+			for(int p=0; p<8; p++)
+				indices[pixels[p]] = idx[p];
+		}
+	}
+	return bestErr;
+}
+
+struct EtcCandidate
+{
+	unsigned int err;
+	bool bDiff;
+	bool bFlip;
+	// Quantized base colours, 4 or 5 bits.
+	int color[2][3];
+	int table[2];
+	unsigned char indices[16];
+};
+
+static inline void expandColor(const int q[3], bool bDiff, int out[3])
+{
+	for(int c=0; c<3; c++)
+		out[c] = bDiff ? expand5(q[c]) : expand4(q[c]);
+}
+
+static unsigned int fitCandidateSubBlock(const unsigned char block[16][4], const int pixels[8], EtcCandidate &cand, int s)
+{
+	int base[3];
+	expandColor(cand.color[s], cand.bDiff, base);
+	return fitSubBlock(block, pixels, base, cand.table[s], cand.indices, 0xffffffff);
+}
+
+static bool diffInRange(const int a[3], const int b[3])
+{
+	for(int c=0; c<3; c++)
+	{
+		int d = b[c] - a[c];
+		if(d < -4 || d > 3)
+			return false;
+	}
+	return true;
+}
+
+// Tries the 26 neighbours of the base colour of sub block s
+// and keeps the best one. In differential mode the colour has
+// to stay within reach of the other sub block.
+static void refineSubBlock(const unsigned char block[16][4], const int pixels[8], EtcCandidate &cand, int s, unsigned int &subErr)
+{
+	int maxVal = cand.bDiff ? 31 : 15;
+	int start[3] = { cand.color[s][0], cand.color[s][1], cand.color[s][2] };
+
+	for(int dr=-1; dr<=1; dr++)
+	for(int dg=-1; dg<=1; dg++)
+	for(int db=-1; db<=1; db++)
+	{
+		int q[3] = { start[0] + dr, start[1] + dg, start[2] + db };
+		if((dr == 0 && dg == 0 && db == 0) || q[0] < 0 || q[1] < 0 || q[2] < 0 || q[0] > maxVal || q[1] > maxVal || q[2] > maxVal)
+			continue;
+
+		if(cand.bDiff && !(s == 0 ? diffInRange(q, cand.color[1]) : diffInRange(cand.color[0], q)))
+			continue;
+
+		int base[3];
+		expandColor(q, cand.bDiff, base);
+		int table;
+		unsigned char indices[16];
+		unsigned int err = fitSubBlock(block, pixels, base, table, indices, subErr);
+		if(table >= 0)
+		{
+			subErr = err;
+			cand.table[s] = table;
+			for(int c=0; c<3; c++)
+				cand.color[s][c] = q[c];
+			for(int p=0; p<8; p++)
+				cand.indices[pixels[p]] = indices[pixels[p]];
+		}
+	}
+}
+
+static void evaluateCandidate(const unsigned char block[16][4], const int pixels[2][8], EtcCandidate &cand, bool bRefine)
+{
+	unsigned int err[2];
+	for(int s=0; s<2; s++)
+		err[s] = fitCandidateSubBlock(block, pixels[s], cand, s);
+
+	if(bRefine)
+	{
+		for(int s=0; s<2; s++)
+			refineSubBlock(block, pixels[s], cand, s, err[s]);
+	}
+	cand.err = err[0] + err[1];
+}
+
+static void packEtc1Block(const EtcCandidate &cand, unsigned char out[8])
+{
+	unsigned int hi = 0, lo = 0;
+
+	if(cand.bDiff)
+	{
+		for(int c=0; c<3; c++)
+		{
+			int d = cand.color[1][c] - cand.color[0][c];
+			hi |= (cand.color[0][c] << (27 - c * 8)) | ((d & 7) << (24 - c * 8));
+		}
+		hi |= 2;
+	}
+	else
+	{
+		for(int c=0; c<3; c++)
+			hi |= (cand.color[0][c] << (28 - c * 8)) | (cand.color[1][c] << (24 - c * 8));
+	}
+	hi |= (cand.table[0] << 5) | (cand.table[1] << 2);
+	if(cand.bFlip)
+		hi |= 1;
+
+	// Most significant index bits in the high half.
+	for(int i=0; i<16; i++)
+	{
+		lo |= ((cand.indices[i] >> 1) & 1) << (i + 16);
+		lo |= (cand.indices[i] & 1) << i;
+	}
+
+	for(int b=0; b<4; b++)
+	{
+		out[b] = (unsigned char)(hi >> (24 - b * 8));
+		out[b + 4] = (unsigned char)(lo >> (24 - b * 8));
+	}
+}
+
+void encodeEtc1Block(const unsigned char block[16][4], TextureQuality quality, unsigned char out[8])
+{
+	EtcCandidate best;
+	best.err = 0xffffffff;
+
+	for(int flip=0; flip<2; flip++)
+	{
+		int pixels[2][8];
+		int count[2] = {0, 0};
+		int sum[2][3] = {{0, 0, 0}, {0, 0, 0}};
+
+		for(int i=0; i<16; i++)
+		{
+			int s = inSubBlock(i, flip != 0, 1) ? 1 : 0;
+			pixels[s][count[s]++] = i;
+			for(int c=0; c<3; c++)
+				sum[s][c] += block[i][c];
+		}
+
+		// Averages quantized to both precisions.
+		EtcCandidate diff, indiv;
+		diff.bDiff = true;
+		indiv.bDiff = false;
+		diff.bFlip = indiv.bFlip = flip != 0;
+		for(int s=0; s<2; s++)
+		{
+			for(int c=0; c<3; c++)
+			{
+				diff.color[s][c] = (sum[s][c] * 31 + 1020) / 2040;
+				indiv.color[s][c] = (sum[s][c] * 15 + 1020) / 2040;
+			}
+		}
+
+		bool bDiffOk = diffInRange(diff.color[0], diff.color[1]);
+		if(bDiffOk)
+		{
+			evaluateCandidate(block, pixels, diff, false);
+			if(diff.err < best.err)
+				best = diff;
+		}
+
+		// The fast preset only falls back to individual
+		// colours when the averages are too far apart.
+		if(!bDiffOk || quality != TEXTURE_QUALITY_FAST)
+		{
+			evaluateCandidate(block, pixels, indiv, false);
+			if(indiv.err < best.err)
+				best = indiv;
+		}
+	}
+
+	if(quality == TEXTURE_QUALITY_HIGH && best.err > 0)
+	{
+		int pixels[2][8];
+		int count[2] = {0, 0};
+		for(int i=0; i<16; i++)
+		{
+			int s = inSubBlock(i, best.bFlip, 1) ? 1 : 0;
+			pixels[s][count[s]++] = i;
+		}
+		evaluateCandidate(block, pixels, best, true);
+	}
+
+	packEtc1Block(best, out);
+}
+
+void decodeEtc1Block(const unsigned char in[8], unsigned char block[16][4])
+{
+	unsigned int hi = (in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+	unsigned int lo = (in[4] << 24) | (in[5] << 16) | (in[6] << 8) | in[7];
+
+	bool bDiff = (hi & 2) != 0;
+	bool bFlip = (hi & 1) != 0;
+
+	int base[2][3];
+	for(int c=0; c<3; c++)
+	{
+		if(bDiff)
+		{
+			int c0 = (hi >> (27 - c * 8)) & 31;
+			int d = (hi >> (24 - c * 8)) & 7;
+			if(d >= 4)
+				d -= 8;
+			base[0][c] = expand5(c0);
+			base[1][c] = expand5((c0 + d) & 31);
+		}
+		else
+		{
+			base[0][c] = expand4((hi >> (28 - c * 8)) & 15);
+			base[1][c] = expand4((hi >> (24 - c * 8)) & 15);
+		}
+	}
+	int table[2] = { (int)((hi >> 5) & 7), (int)((hi >> 2) & 7) };
+
+	for(int i=0; i<16; i++)
+	{
+		int s = inSubBlock(i, bFlip, 1) ? 1 : 0;
+		int index = (((lo >> (i + 16)) & 1) << 1) | ((lo >> i) & 1);
+		int m = etcModifier(table[s], index);
+		for(int c=0; c<3; c++)
+			block[i][c] = (unsigned char)clamp255(base[s][c] + m);
+		block[i][3] = 255;
+	}
+}
+
+static unsigned int fitEac(const unsigned char block[16][4], int base, int mult, int table, unsigned char indices[16], unsigned int bestSoFar)
+{
+	unsigned int err = 0;
+	for(int i=0; i<16 && err < bestSoFar; i++)
+	{
+		int a = block[i][3];
+		unsigned int bestPixel = 0xffffffff;
+		for(int m=0; m<8; m++)
+		{
+			int d = clamp255(base + g_eacModifiers[table][m] * mult) - a;
+			unsigned int e = d * d;
+			if(e < bestPixel)
+			{
+				bestPixel = e;
+				indices[i] = (unsigned char)m;
+			}
+		}
+		err += bestPixel;
+	}
+	return err;
+}
+
+void encodeEacAlphaBlock(const unsigned char block[16][4], TextureQuality quality, unsigned char out[8])
+{
+	int minA = 255, maxA = 0;
+	for(int i=0; i<16; i++)
+	{
+		if(block[i][3] < minA)
+			minA = block[i][3];
+		if(block[i][3] > maxA)
+			maxA = block[i][3];
+	}
+
+	int multRange = quality == TEXTURE_QUALITY_FAST ? 0 : (quality == TEXTURE_QUALITY_NORMAL ? 1 : 2);
+	int baseRange = quality == TEXTURE_QUALITY_FAST ? 0 : (quality == TEXTURE_QUALITY_NORMAL ? 1 : 4);
+
+	unsigned int bestErr = 0xffffffff;
+	int bestBase = minA, bestMult = 1, bestTable = 13;
+	unsigned char bestIndices[16];
+	unsigned char indices[16];
+
+	// Table 13 holds a zero modifier, exact for flat blocks.
+	if(minA == maxA)
+	{
+		bestErr = fitEac(block, minA, 1, 13, bestIndices, bestErr);
+	}
+
+	for(int t=0; t<16 && bestErr > 0; t++)
+	{
+		int lowMod = g_eacModifiers[t][3];
+		int highMod = g_eacModifiers[t][7];
+		int span = highMod - lowMod;
+		int mult0 = (maxA - minA + span / 2) / span;
+		if(mult0 < 1)
+			mult0 = 1;
+		if(mult0 > 15)
+			mult0 = 15;
+
+		for(int mult=mult0-multRange; mult<=mult0+multRange; mult++)
+		{
+			if(mult < 1 || mult > 15)
+				continue;
+
+			// Centre the modifier range on the alpha range.
+			int base0 = ((minA - lowMod * mult) + (maxA - highMod * mult) + 1) / 2;
+			for(int base=base0-baseRange; base<=base0+baseRange; base++)
+			{
+				if(base < 0 || base > 255)
+					continue;
+
+				unsigned int err = fitEac(block, base, mult, t, indices, bestErr);
+				if(err < bestErr)
+				{
+					bestErr = err;
+					bestBase = base;
+					bestMult = mult;
+					bestTable = t;
+					for(int i=0; i<16; i++)
+						bestIndices[i] = indices[i];
+				}
+			}
+		}
+	}
+
+	unsigned long long bits = ((unsigned long long)bestBase << 56) | ((unsigned long long)bestMult << 52) | ((unsigned long long)bestTable << 48);
+	for(int i=0; i<16; i++)
+		bits |= (unsigned long long)bestIndices[i] << (45 - i * 3);
+
+	for(int b=0; b<8; b++)
+		out[b] = (unsigned char)(bits >> (56 - b * 8));
+}
+
+void decodeEacAlphaBlock(const unsigned char in[8], unsigned char block[16][4])
+{
+	unsigned long long bits = 0;
+	for(int b=0; b<8; b++)
+		bits = (bits << 8) | in[b];
+
+	int base = (int)(bits >> 56) & 255;
+	int mult = (int)(bits >> 52) & 15;
+	int table = (int)(bits >> 48) & 15;
+
+	for(int i=0; i<16; i++)
+	{
+		int index = (int)(bits >> (45 - i * 3)) & 7;
+		block[i][3] = (unsigned char)clamp255(base + g_eacModifiers[table][index] * mult);
+	}
+}
+
+bool hasAlpha(const TextureImage &img)
+{
+	for(size_t i=3; i<img.pixels.size(); i+=4)
+	{
+		if(img.pixels[i] != 255)
+			return true;
+	}
+	return false;
+}
+
+void compressEtcImage(const TextureImage &img, bool bAlpha, TextureQuality quality, std::vector<unsigned char> &out)
+{
+	unsigned int blocksX = (img.width + 3) / 4;
+	unsigned int blocksY = (img.height + 3) / 4;
+	unsigned int blockBytes = bAlpha ? 16 : 8;
+
+	out.resize((size_t)blocksX * blocksY * blockBytes);
+	unsigned char *dst = &out[0];
+
+	for(unsigned int by=0; by<blocksY; by++)
+	{
+		for(unsigned int bx=0; bx<blocksX; bx++)
+		{
+			unsigned char block[16][4];
+			for(int i=0; i<16; i++)
+			{
+				unsigned int x = bx * 4 + i / 4;
+				unsigned int y = by * 4 + i % 4;
+				if(x >= img.width)
+					x = img.width - 1;
+				if(y >= img.height)
+					y = img.height - 1;
+
+				const unsigned char *src = &img.pixels[((size_t)y * img.width + x) * 4];
+				for(int c=0; c<4; c++)
+					block[i][c] = src[c];
+			}
+
+			// ETC2 RGBA8 puts the alpha block first.
+			if(bAlpha)
+			{
+				encodeEacAlphaBlock(block, quality, dst);
+				dst += 8;
+			}
+			encodeEtc1Block(block, quality, dst);
+			dst += 8;
+		}
+	}
+}
+
+void decompressEtcImage(const std::vector<unsigned char> &data, unsigned int width, unsigned int height, bool bAlpha, TextureImage &out)
+{
+	unsigned int blocksX = (width + 3) / 4;
+	unsigned int blocksY = (height + 3) / 4;
+
+	out.width = width;
+	out.height = height;
+	out.pixels.resize((size_t)width * height * 4);
+
+	const unsigned char *src = &data[0];
+	for(unsigned int by=0; by<blocksY; by++)
+	{
+		for(unsigned int bx=0; bx<blocksX; bx++)
+		{
+			unsigned char block[16][4];
+			if(bAlpha)
+			{
+				decodeEtc1Block(src + 8, block);
+				decodeEacAlphaBlock(src, block);
+				src += 16;
+			}
+			else
+			{
+				decodeEtc1Block(src, block);
+				src += 8;
+			}
+
+			for(int i=0; i<16; i++)
+			{
+				unsigned int x = bx * 4 + i / 4;
+				unsigned int y = by * 4 + i % 4;
+				if(x >= width || y >= height)
+					continue;
+
+				unsigned char *dst = &out.pixels[((size_t)y * width + x) * 4];
+				for(int c=0; c<4; c++)
+					dst[c] = block[i][c];
+			}
+		}
+	}
+}
+
+double computePSNR(const TextureImage &a, const TextureImage &b, bool bAlpha)
+{
+	if(a.width != b.width || a.height != b.height || a.pixels.empty())
+		return 0;
+
+	int channels = bAlpha ? 4 : 3;
+	double sum = 0;
+	for(size_t i=0; i<a.pixels.size(); i+=4)
+	{
+		for(int c=0; c<channels; c++)
+		{
+			double d = (double)a.pixels[i + c] - (double)b.pixels[i + c];
+			sum += d * d;
+		}
+	}
+
+	double mse = sum / ((double)a.width * a.height * channels);
+	if(mse <= 0)
+		return 99;
+
+	return 10 * log10(255.0 * 255.0 / mse);
+}
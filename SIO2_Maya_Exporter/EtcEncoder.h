@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef ETCENCODER_H
+#define ETCENCODER_H
+
+#include <string>
+#include <vector>
+#include "TextureProcessor.h"
+
+// OpenGL ES internal formats written in the KTX header.
+#define SIO2_GL_ETC1_RGB8_OES				0x8D64
+#define SIO2_GL_COMPRESSED_RGBA8_ETC2_EAC	0x9278
+
+// Encodes one 4x4 block. Pixels are RGBA, ordered the way
+// the block stores its indices: pixel i is at x = i / 4, y = i % 4.
+// ETC1 blocks are also valid ETC2 RGB blocks.
+void encodeEtc1Block(const unsigned char block[16][4], TextureQuality quality, unsigned char out[8]);
+void decodeEtc1Block(const unsigned char in[8], unsigned char block[16][4]);
+
+// EAC alpha half of an ETC2 RGBA8 block.
+void encodeEacAlphaBlock(const unsigned char block[16][4], TextureQuality quality, unsigned char out[8]);
+void decodeEacAlphaBlock(const unsigned char in[8], unsigned char block[16][4]);
+
+// True if any texel is not fully opaque.
+bool hasAlpha(const TextureImage &img);
+
+// Compresses a whole level. bAlpha selects ETC2 RGBA8 (16
+// bytes a block) over ETC1 (8 bytes a block). Sizes that are
+// not a multiple of 4 repeat their last row and column.
+void compressEtcImage(const TextureImage &img, bool bAlpha, TextureQuality quality, std::vector<unsigned char> &out);
+void decompressEtcImage(const std::vector<unsigned char> &data, unsigned int width, unsigned int height, bool bAlpha, TextureImage &out);
+
+// Peak signal to noise ratio in dB over RGB, and alpha if
+// bAlpha is set. Identical images give 99.
+double computePSNR(const TextureImage &a, const TextureImage &b, bool bAlpha);
+
+#endif
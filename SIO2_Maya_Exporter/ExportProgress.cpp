@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "ExportProgress.h"
+
+#include <stdio.h>
+#include "WorkerPool.h"
+
+ExportProgress::ExportProgress()
+{
+	m_callback = NULL;
+	m_pUser = NULL;
+	m_fInterval = 0.25;
+	reset();
+}
+
+void ExportProgress::reset()
+{
+	m_vStages.clear();
+	m_nCurrent = -1;
+	m_bCancelled = false;
+	m_fLastReport = 0;
+}
+
+void ExportProgress::setCallback(ProgressCallback callback, void *user, double fInterval)
+{
+	m_callback = callback;
+	m_pUser = user;
+	m_fInterval = fInterval;
+}
+
+int ExportProgress::addStage(const char *name, double work)
+{
+	Stage stage;
+	stage.name = name;
+	stage.work = work > 0 ? work : 0;
+	stage.done = 0;
+	m_vStages.push_back(stage);
+	return (int)m_vStages.size() - 1;
+}
+
+void ExportProgress::setStageWork(int stage, double work)
+{
+	if(stage >= 0 && stage < (int)m_vStages.size())
+		m_vStages[stage].work = work > 0 ? work : 0;
+}
+
+void ExportProgress::beginStage(int stage)
+{
+	m_nCurrent = stage;
+	report(true);
+}
+
+bool ExportProgress::advance(double work)
+{
+	if(m_nCurrent >= 0 && m_nCurrent < (int)m_vStages.size())
+	{
+		Stage &stage = m_vStages[m_nCurrent];
+		stage.done += work;
+		if(stage.done > stage.work)
+			stage.done = stage.work;
+	}
+	report(false);
+	return !m_bCancelled;
+}
+
+void ExportProgress::endStage()
+{
+	if(m_nCurrent >= 0 && m_nCurrent < (int)m_vStages.size())
+		m_vStages[m_nCurrent].done = m_vStages[m_nCurrent].work;
+	report(true);
+}
+
+float ExportProgress::fraction() const
+{
+	double total = 0, done = 0;
+	for(unsigned int i=0; i<m_vStages.size(); i++)
+	{
+		total += m_vStages[i].work;
+		done += m_vStages[i].done;
+	}
+	return total > 0 ? (float)(done / total) : 0.0f;
+}
+
+void ExportProgress::report(bool bForce)
+{
+	if(!m_callback || m_bCancelled)
+		return;
+
+	double fNow = getTimeSeconds();
+	if(!bForce && fNow - m_fLastReport < m_fInterval)
+		return;
+	m_fLastReport = fNow;
+
+	const char *name = m_nCurrent >= 0 && m_nCurrent < (int)m_vStages.size() ? m_vStages[m_nCurrent].name : "";
+	if(!m_callback(fraction(), name, m_pUser))
+		m_bCancelled = true;
+}
+
+ExportJournal::ExportJournal()
+{
+	m_nResumed = 0;
+}
+
+ExportJournal::~ExportJournal()
+{
+	close();
+}
+
+bool ExportJournal::open(const std::string &path, bool bResume)
+{
+	close();
+	m_sPath = path;
+	m_sDone.clear();
+	m_nResumed = 0;
+
+	bool bPartial = false;
+	if(bResume)
+	{
+		std::ifstream in(path.c_str());
+		std::string line;
+		while(std::getline(in, line))
+		{
+			// A line cut short by a crash has no newline and is
+			// dropped with the partial file it named.
+			if(in.eof())
+			{
+				bPartial = !line.empty();
+				break;
+			}
+			if(!line.empty() && m_sDone.insert(line).second)
+				m_nResumed++;
+		}
+	}
+
+	m_file.open(path.c_str(), bResume ? std::ios::out | std::ios::app : std::ios::out | std::ios::trunc);
+	if(!m_file.is_open())
+		return false;
+
+	// Ends the partial line so the next name starts its own.
+	if(bPartial)
+	{
+		m_file<<"\n";
+		m_file.flush();
+	}
+	return true;
+}
+
+void ExportJournal::close()
+{
+	if(m_file.is_open())
+		m_file.close();
+}
+
+bool ExportJournal::isDone(const std::string &name) const
+{
+	return m_sDone.find(name) != m_sDone.end();
+}
+
+void ExportJournal::markDone(const std::string &name)
+{
+	m_sDone.insert(name);
+	if(m_file.is_open())
+	{
+		m_file<<name<<"\n";
+		m_file.flush();
+	}
+}
+
+void ExportJournal::remove()
+{
+	close();
+	if(!m_sPath.empty())
+		::remove(m_sPath.c_str());
+	m_sDone.clear();
+}
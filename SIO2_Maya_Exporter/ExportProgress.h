@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef EXPORTPROGRESS_H
+#define EXPORTPROGRESS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "HashUtil.h"
+
+// Told how far the export is, between 0 and 1, and the stage
+// it is in. Returns false to cancel the export.
+typedef bool (*ProgressCallback)(float fraction, const char *stage, void *user);
+
+// Progress of the export as work units spread over stages,
+// for example nodes and vertices for the scene or frames for
+// the animation bake. A stage whose size is only known later
+// can have its work set when it begins. The callback is called
+// at most once per interval.
+class ExportProgress
+{
+	public:
+		ExportProgress();
+
+		void reset();
+		void setCallback(ProgressCallback callback, void *user, double fInterval);
+
+		// Returns the index of the stage.
+		int addStage(const char *name, double work);
+		void setStageWork(int stage, double work);
+
+		void beginStage(int stage);
+		// Adds work done in the current stage. Returns false once
+		// the export has been cancelled.
+		bool advance(double work = 1);
+		void endStage();
+
+		void cancel() { m_bCancelled = true; }
+		bool isCancelled() const { return m_bCancelled; }
+
+		float fraction() const;
+
+	protected:
+		struct Stage
+		{
+			const char *name;
+			double work;
+			double done;
+		};
+
+		void report(bool bForce);
+
+		std::vector<Stage> m_vStages;
+		int m_nCurrent;
+		bool m_bCancelled;
+
+		ProgressCallback m_callback;
+		void *m_pUser;
+		double m_fInterval;
+		double m_fLastReport;
+};
+
+// Names of what an export has finished writing, one per line,
+// flushed as they are added. An export that is cancelled or
+// dies leaves it behind, so the next one can skip what is done.
+class ExportJournal
+{
+	public:
+		ExportJournal();
+		~ExportJournal();
+
+		// Starts a journal at path. When resuming the names
+		// already in it are read back, otherwise it is emptied.
+		bool open(const std::string &path, bool bResume);
+		void close();
+
+		bool isDone(const std::string &name) const;
+		void markDone(const std::string &name);
+
+		// Names read back when it was opened.
+		unsigned int resumedCount() const { return m_nResumed; }
+
+		// The export finished, nothing to resume.
+		void remove();
+
+	protected:
+		std::string m_sPath;
+		std::ofstream m_file;
+		StringHashSet m_sDone;
+		unsigned int m_nResumed;
+};
+
+#endif
@@ -0,0 +1,265 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "ExportWorkList.h"
+
+#include <sstream>
+
+#include <maya/MFnDagNode.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnBlendShapeDeformer.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MItDag.h>
+#include <maya/MItDependencyGraph.h>
+#include <maya/MItDependencyNodes.h>
+#include <maya/MObjectArray.h>
+#include <maya/MIntArray.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+
+static const char *g_cWorkKindNames[ExportWorkList::WORK_KIND_COUNT] =
+{
+	"textures", "materials", "cameras", "lamps", "meshes", "skin clusters", "blend shapes"
+};
+
+ExportWorkList::ExportWorkList()
+{
+}
+
+void ExportWorkList::clear()
+{
+	for(int i=0; i<WORK_KIND_COUNT; i++)
+		m_vNodes[i].clear();
+	m_mAdded.clear();
+}
+
+const char *ExportWorkList::kindName(Kind kind)
+{
+	return kind >= 0 && kind < WORK_KIND_COUNT ? g_cWorkKindNames[kind] : "unknown";
+}
+
+std::string ExportWorkList::counts() const
+{
+	std::ostringstream s;
+	for(int k=0; k<WORK_KIND_COUNT; k++)
+	{
+		if(m_vNodes[k].empty())
+			continue;
+		if(s.tellp() > 0)
+			s<<" ";
+		s<<g_cWorkKindNames[k]<<": "<<m_vNodes[k].size();
+	}
+	return s.str();
+}
+
+bool ExportWorkList::isExportedLight(MObject node)
+{
+	switch(node.apiType())
+	{
+		case MFn::kLight:
+		case MFn::kAmbientLight:
+		case MFn::kSpotLight:
+		case MFn::kPointLight:
+		case MFn::kDirectionalLight:
+		case MFn::kAreaLight:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool ExportWorkList::isExportedMaterial(MObject node)
+{
+	MFn::Type type = node.apiType();
+	return type == MFn::kLambert || type == MFn::kPhong || type == MFn::kBlinn;
+}
+
+bool ExportWorkList::add(Kind kind, MObject node)
+{
+	MObjectHandle handle(node);
+	std::pair<std::multimap<unsigned int, MObjectHandle>::iterator, std::multimap<unsigned int, MObjectHandle>::iterator> range =
+		m_mAdded.equal_range(handle.hashCode());
+	for(std::multimap<unsigned int, MObjectHandle>::iterator it = range.first; it != range.second; ++it)
+	{
+		if(it->second == handle)
+			return false;
+	}
+
+	m_mAdded.insert(std::make_pair(handle.hashCode(), handle));
+	m_vNodes[kind].push_back(node);
+	return true;
+}
+
+void ExportWorkList::addSelected(MObject node, const MDagPath *path)
+{
+	if(path != NULL)
+	{
+		addShapesBelow(*path);
+		return;
+	}
+
+	// Nodes outside the DAG the exporter writes on their own.
+	if(node.hasFn(MFn::kShadingEngine))
+		addShadingEngine(node);
+	else if(isExportedMaterial(node))
+		add(WORK_MATERIAL, node);
+	else if(node.hasFn(MFn::kFileTexture))
+		add(WORK_TEXTURE, node);
+}
+
+void ExportWorkList::addShapesBelow(const MDagPath &path)
+{
+	// A selected transform means everything under it.
+	MItDag it;
+	it.reset(path, MItDag::kDepthFirst, MFn::kInvalid);
+	for(; !it.isDone(); it.next())
+		addShape(it.currentItem());
+}
+
+void ExportWorkList::addShape(MObject shape)
+{
+	if(shape.apiType() == MFn::kMesh)
+	{
+		MFnMesh mesh(shape);
+		if(!mesh.isIntermediateObject())
+			add(WORK_MESH, shape);
+	}
+	else if(shape.apiType() == MFn::kCamera)
+	{
+		add(WORK_CAMERA, shape);
+	}
+	else if(isExportedLight(shape))
+	{
+		add(WORK_LAMP, shape);
+	}
+}
+
+void ExportWorkList::addScene()
+{
+	// Only the shapes of the DAG, an instanced one is reached
+	// through each of its paths but added once.
+	MStatus stat;
+	MItDag dag(MItDag::kDepthFirst, MFn::kShape, &stat);
+	for(; stat == MS::kSuccess && !dag.isDone(); dag.next())
+		addShape(dag.currentItem());
+
+	MItDependencyNodes materials(MFn::kLambert, &stat);
+	for(; stat == MS::kSuccess && !materials.isDone(); materials.next())
+	{
+		if(isExportedMaterial(materials.item()))
+			add(WORK_MATERIAL, materials.item());
+	}
+
+	MItDependencyNodes textures(MFn::kFileTexture, &stat);
+	for(; stat == MS::kSuccess && !textures.isDone(); textures.next())
+		add(WORK_TEXTURE, textures.item());
+
+	MItDependencyNodes skins(MFn::kSkinClusterFilter, &stat);
+	for(; stat == MS::kSuccess && !skins.isDone(); skins.next())
+		add(WORK_SKIN, skins.item());
+
+	MItDependencyNodes shapes(MFn::kBlendShape, &stat);
+	for(; stat == MS::kSuccess && !shapes.isDone(); shapes.next())
+		add(WORK_BLEND_SHAPE, shapes.item());
+}
+
+void ExportWorkList::addShadingEngine(MObject engine)
+{
+	// Same plug getMeshMaterials follows.
+	MFnDependencyNode fnEngine(engine);
+	MPlug surfaceShader = fnEngine.findPlug("surfaceShader");
+	MPlugArray connected;
+	surfaceShader.connectedTo(connected, true, false);
+	for(unsigned int i=0; i<connected.length(); i++)
+	{
+		MObject material = connected[i].node();
+		if(material.hasFn(MFn::kLambert))
+			add(WORK_MATERIAL, material);
+	}
+}
+
+void ExportWorkList::addMeshDependencies(MObject mesh)
+{
+	MFnMesh fnMesh(mesh);
+	MObjectArray engines;
+	MIntArray faceEngines;
+	fnMesh.getConnectedShaders(0, engines, faceEngines);
+	for(unsigned int i=0; i<engines.length(); i++)
+		addShadingEngine(engines[i]);
+
+	MStatus stat;
+	MItDependencyGraph skins(mesh, MFn::kSkinClusterFilter, MItDependencyGraph::kUpstream,
+		MItDependencyGraph::kBreadthFirst, MItDependencyGraph::kNodeLevel, &stat);
+	for(; stat == MS::kSuccess && !skins.isDone(); skins.next())
+		add(WORK_SKIN, skins.currentItem());
+
+	// The targets are written as objects of their own, as
+	// exporting the whole scene does.
+	MItDependencyGraph shapes(mesh, MFn::kBlendShape, MItDependencyGraph::kUpstream,
+		MItDependencyGraph::kBreadthFirst, MItDependencyGraph::kNodeLevel, &stat);
+	for(; stat == MS::kSuccess && !shapes.isDone(); shapes.next())
+	{
+		MObject deformer = shapes.currentItem();
+		if(!add(WORK_BLEND_SHAPE, deformer))
+			continue;
+
+		MFnBlendShapeDeformer fnDeformer(deformer);
+		MObjectArray bases;
+		MIntArray weights;
+		fnDeformer.getBaseObjects(bases);
+		fnDeformer.weightIndexList(weights);
+		for(unsigned int b=0; b<bases.length(); b++)
+		{
+			for(unsigned int w=0; w<weights.length(); w++)
+			{
+				MObjectArray targets;
+				fnDeformer.getTargets(bases[b], weights[w], targets);
+				for(unsigned int t=0; t<targets.length(); t++)
+				{
+					if(targets[t].hasFn(MFn::kMesh) && !MFnMesh(targets[t]).isIntermediateObject())
+						add(WORK_MESH, targets[t]);
+				}
+			}
+		}
+	}
+}
+
+void ExportWorkList::close()
+{
+	// Blend shape targets are added while going through the
+	// meshes, so the list can grow under the loop.
+	for(unsigned int i=0; i<m_vNodes[WORK_MESH].size(); i++)
+		addMeshDependencies(m_vNodes[WORK_MESH][i]);
+
+	for(unsigned int i=0; i<m_vNodes[WORK_MATERIAL].size(); i++)
+	{
+		MStatus stat;
+		MItDependencyGraph textures(m_vNodes[WORK_MATERIAL][i], MFn::kFileTexture, MItDependencyGraph::kUpstream,
+			MItDependencyGraph::kBreadthFirst, MItDependencyGraph::kNodeLevel, &stat);
+		for(; stat == MS::kSuccess && !textures.isDone(); textures.next())
+			add(WORK_TEXTURE, textures.currentItem());
+	}
+}
+
+void ExportWorkList::getNodes(std::vector<MObject> &vNodes) const
+{
+	const Kind order[5] = { WORK_TEXTURE, WORK_MATERIAL, WORK_CAMERA, WORK_LAMP, WORK_MESH };
+	vNodes.clear();
+	for(int k=0; k<5; k++)
+		vNodes.insert(vNodes.end(), m_vNodes[order[k]].begin(), m_vNodes[order[k]].end());
+}
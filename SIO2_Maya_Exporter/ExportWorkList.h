@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef EXPORTWORKLIST_H
+#define EXPORTWORKLIST_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MDagPath.h>
+
+// The nodes an export writes, sorted by kind before anything is
+// written. addScene() walks the whole scene with iterators
+// filtered to the types the exporter writes. For a selection,
+// selected transforms bring
+// the meshes, cameras and lamps below them, and close() follows
+// the graph from those to what they need in the scene folder:
+// the materials of the shading engines, the file textures of the
+// materials and the targets of blend shapes. Skin clusters are
+// only counted, the object writer reads them from the mesh.
+class ExportWorkList
+{
+	public:
+		enum Kind
+		{
+			WORK_TEXTURE,
+			WORK_MATERIAL,
+			WORK_CAMERA,
+			WORK_LAMP,
+			WORK_MESH,
+			WORK_SKIN,
+			WORK_BLEND_SHAPE,
+			WORK_KIND_COUNT
+		};
+
+		ExportWorkList();
+
+		void clear();
+
+		// Every exported node of the scene, plus the skin
+		// clusters and blend shapes for the counts.
+		void addScene();
+
+		// A selected node, with its path when it is in the DAG.
+		void addSelected(MObject node, const MDagPath *path);
+
+		// Adds the dependencies of everything added so far.
+		void close();
+
+		// What to export, textures first so materials and objects
+		// find their images, then materials, cameras, lamps and
+		// meshes. Skin clusters and blend shapes are not in it.
+		void getNodes(std::vector<MObject> &vNodes) const;
+
+		unsigned int count(Kind kind) const { return (unsigned int)m_vNodes[kind].size(); }
+		static const char *kindName(Kind kind);
+		// "meshes: 12 materials: 3 ...", kinds with none left out.
+		std::string counts() const;
+
+		// The types exportNode writes, other lights and materials
+		// derived from lambert are skipped as before.
+		static bool isExportedLight(MObject node);
+		static bool isExportedMaterial(MObject node);
+
+	protected:
+		// False when the node was already in the list.
+		bool add(Kind kind, MObject node);
+		void addShape(MObject shape);
+		void addShapesBelow(const MDagPath &path);
+		void addShadingEngine(MObject engine);
+		void addMeshDependencies(MObject mesh);
+
+		std::vector<MObject> m_vNodes[WORK_KIND_COUNT];
+		// By MObjectHandle hash code.
+		std::multimap<unsigned int, MObjectHandle> m_mAdded;
+};
+
+#endif
@@ -0,0 +1,278 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "FrameNormals.h"
+
+#include <math.h>
+#include <fstream>
+#include "MeshData.h"
+#include "Trace.h"
+#include "SimdConfig.h"
+
+static const char *g_cDefAnimName = "DefAnimName";
+
+// Unnormalised face normal of a triangle, twice its area long.
+static inline void addFaceNormal(const float *positions, unsigned int a, unsigned int b, unsigned int c, float *accum)
+{
+	const float *pa = positions + a * 3;
+	const float *pb = positions + b * 3;
+	const float *pc = positions + c * 3;
+
+	float e1x = pb[0] - pa[0], e1y = pb[1] - pa[1], e1z = pb[2] - pa[2];
+	float e2x = pc[0] - pa[0], e2y = pc[1] - pa[1], e2z = pc[2] - pa[2];
+	float nx = e1y * e2z - e1z * e2y;
+	float ny = e1z * e2x - e1x * e2z;
+	float nz = e1x * e2y - e1y * e2x;
+
+	accum[a*3] += nx; accum[a*3+1] += ny; accum[a*3+2] += nz;
+	accum[b*3] += nx; accum[b*3+1] += ny; accum[b*3+2] += nz;
+	accum[c*3] += nx; accum[c*3+1] += ny; accum[c*3+2] += nz;
+}
+
+// Rounds half away from zero, as the SSE2 path does.
+static inline signed char quantizeUnit(float v)
+{
+	return (signed char)(int)(v * 127.0f + (v < 0 ? -0.5f : 0.5f));
+}
+
+static inline void quantizeNormal(const float *n, signed char *out)
+{
+	float fLength = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	if(fLength > 0)
+	{
+		out[0] = quantizeUnit(n[0] / fLength);
+		out[1] = quantizeUnit(n[1] / fLength);
+		out[2] = quantizeUnit(n[2] / fLength);
+	}
+	else
+	{
+		out[0] = out[1] = out[2] = 0;
+	}
+}
+
+#ifdef SIO2_USE_SSE2
+// Four triangles at a time, the corners are gathered into x, y
+// and z registers and the sums scattered back one by one.
+static void addFaceNormalsSSE2(const float *positions, const IndexBuffer &triangles, size_t nTriangles, float *accum)
+{
+	size_t t = 0;
+	for(; t+4<=nTriangles; t+=4)
+	{
+		unsigned int idx[3][4];
+		for(int k=0; k<4; k++)
+		{
+			idx[0][k] = triangles[(t+k)*3];
+			idx[1][k] = triangles[(t+k)*3+1];
+			idx[2][k] = triangles[(t+k)*3+2];
+		}
+
+		__m128 p[3][3];
+		for(int c=0; c<3; c++)
+		{
+			const float *q0 = positions + idx[c][0] * 3;
+			const float *q1 = positions + idx[c][1] * 3;
+			const float *q2 = positions + idx[c][2] * 3;
+			const float *q3 = positions + idx[c][3] * 3;
+			p[c][0] = _mm_set_ps(q3[0], q2[0], q1[0], q0[0]);
+			p[c][1] = _mm_set_ps(q3[1], q2[1], q1[1], q0[1]);
+			p[c][2] = _mm_set_ps(q3[2], q2[2], q1[2], q0[2]);
+		}
+
+		__m128 e1x = _mm_sub_ps(p[1][0], p[0][0]), e1y = _mm_sub_ps(p[1][1], p[0][1]), e1z = _mm_sub_ps(p[1][2], p[0][2]);
+		__m128 e2x = _mm_sub_ps(p[2][0], p[0][0]), e2y = _mm_sub_ps(p[2][1], p[0][1]), e2z = _mm_sub_ps(p[2][2], p[0][2]);
+
+		float nx[4], ny[4], nz[4];
+		_mm_storeu_ps(nx, _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)));
+		_mm_storeu_ps(ny, _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)));
+		_mm_storeu_ps(nz, _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)));
+
+		for(int k=0; k<4; k++)
+		{
+			for(int c=0; c<3; c++)
+			{
+				float *a = accum + idx[c][k] * 3;
+				a[0] += nx[k];
+				a[1] += ny[k];
+				a[2] += nz[k];
+			}
+		}
+	}
+
+	for(; t<nTriangles; t++)
+		addFaceNormal(positions, triangles[t*3], triangles[t*3+1], triangles[t*3+2], accum);
+}
+
+// Four vertices at a time.
+static void quantizeNormalsSSE2(const float *accum, unsigned int nVertices, signed char *out)
+{
+	const __m128 vScale = _mm_set1_ps(127.0f);
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+	const __m128 vSign = _mm_set1_ps(-0.0f);
+	const __m128 vZero = _mm_setzero_ps();
+
+	unsigned int v = 0;
+	for(; v+4<=nVertices; v+=4)
+	{
+		const float *a = accum + v * 3;
+		__m128 x = _mm_set_ps(a[9], a[6], a[3], a[0]);
+		__m128 y = _mm_set_ps(a[10], a[7], a[4], a[1]);
+		__m128 z = _mm_set_ps(a[11], a[8], a[5], a[2]);
+
+		__m128 fLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		__m128 mValid = _mm_cmpgt_ps(fLength, vZero);
+
+		__m128 c[3] = { x, y, z };
+		int q[3][4];
+		for(int i=0; i<3; i++)
+		{
+			__m128 n = _mm_and_ps(_mm_div_ps(c[i], fLength), mValid);
+			__m128 s = _mm_mul_ps(n, vScale);
+			s = _mm_add_ps(s, _mm_or_ps(_mm_and_ps(n, vSign), vHalf));
+			s = _mm_and_ps(s, mValid);
+			_mm_storeu_si128((__m128i *)q[i], _mm_cvttps_epi32(s));
+		}
+
+		for(int k=0; k<4; k++)
+		{
+			out[(v+k)*3] = (signed char)q[0][k];
+			out[(v+k)*3+1] = (signed char)q[1][k];
+			out[(v+k)*3+2] = (signed char)q[2][k];
+		}
+	}
+
+	for(; v<nVertices; v++)
+		quantizeNormal(accum + v * 3, out + v * 3);
+}
+#endif
+
+void computeFrameNormals(const float *positions, unsigned int nVertices, const IndexBuffer &triangles,
+						 std::vector<float> &accum, signed char *out)
+{
+	accum.assign((size_t)nVertices * 3, 0.0f);
+	if(nVertices == 0)
+		return;
+
+	size_t nTriangles = triangles.size() / 3;
+#ifdef SIO2_USE_SSE2
+	addFaceNormalsSSE2(positions, triangles, nTriangles, &accum[0]);
+	quantizeNormalsSSE2(&accum[0], nVertices, out);
+#else
+	for(size_t t=0; t<nTriangles; t++)
+		addFaceNormal(positions, triangles[t*3], triangles[t*3+1], triangles[t*3+2], &accum[0]);
+	for(unsigned int v=0; v<nVertices; v++)
+		quantizeNormal(&accum[v*3], out + v * 3);
+#endif
+}
+
+AnimMergeJob::AnimMergeJob(AnimFrameBuffer &buffer, int nBufferId, const std::string &fileName,
+	std::vector<unsigned int> &sources, IndexBuffer &triangles, std::vector<unsigned int> &normalGroups,
+	bool bNormals)
+: m_sFileName(fileName), m_nBufferId(nBufferId), m_bWritten(false), m_nFrames(0), m_fSeconds(0),
+  m_buffer(buffer), m_bNormals(bNormals)
+{
+	m_vSources.swap(sources);
+	m_triangles.swap(triangles);
+	m_vNormalGroups.swap(normalGroups);
+
+	// The fans of a group are summed on its first vertex, which
+	// has the same position as the rest.
+	if(!m_vNormalGroups.empty() && !m_triangles.empty())
+	{
+		IndexBuffer grouped;
+		grouped.reset((unsigned int)m_vNormalGroups.size(), m_triangles.size());
+		for(size_t i=0; i<m_triangles.size(); i++)
+		{
+			unsigned int v = m_triangles[i];
+			grouped.push_back(v < m_vNormalGroups.size() ? m_vNormalGroups[v] : v);
+		}
+		m_triangles.swap(grouped);
+	}
+}
+
+void AnimMergeJob::run()
+{
+	SIO2_TRACE_DETAIL("AnimMergeJob", m_sFileName.c_str());
+	double fStart = getTimeSeconds();
+
+	std::ofstream osf(m_sFileName.c_str(), std::ios::out | std::ios::app);
+
+	// Write number of Frames
+	osf<<"\tn_frame( " <<m_buffer.frameCount(m_nBufferId)<< " "<<")"<<std::endl;
+
+	unsigned int nBaked = m_buffer.vertexCount(m_nBufferId);
+	bool bExpand = !m_vSources.empty() && m_vSources.size() != nBaked;
+	unsigned int nVerts = bExpand ? (unsigned int)m_vSources.size() : nBaked;
+
+	std::vector<float> xyz, expanded, accum;
+	std::vector<signed char> normals(m_bNormals ? (size_t)nVerts * 3 : 0);
+	double frame;
+
+	m_buffer.beginRead(m_nBufferId);
+	while(m_buffer.nextFrame(m_nBufferId, frame, xyz))
+	{
+		const float *p = xyz.empty() ? NULL : &xyz[0];
+		if(bExpand)
+		{
+			expanded.resize((size_t)nVerts * 3);
+			for(unsigned int v=0; v<nVerts; v++)
+			{
+				const float *from = &xyz[m_vSources[v] * 3];
+				expanded[v*3] = from[0];
+				expanded[v*3+1] = from[1];
+				expanded[v*3+2] = from[2];
+			}
+			p = nVerts > 0 ? &expanded[0] : NULL;
+		}
+
+		osf<<"\tframe( " <<optimizeFloat((float)frame)<<" \""<< g_cDefAnimName<<"\" )"<<std::endl;
+		for(unsigned int v=0; v<nVerts; v++)
+		{
+			osf<<"\tfvert( " << optimizeFloat(p[v*3])<<" "
+				<<optimizeFloat(-1*p[v*3+2])<<" "
+				<<optimizeFloat(p[v*3+1])<<" )"<<std::endl;
+		}
+
+		if(m_bNormals && nVerts > 0)
+		{
+			computeFrameNormals(p, nVerts, m_triangles, accum, &normals[0]);
+			for(unsigned int v=0; v<nVerts && v<m_vNormalGroups.size(); v++)
+			{
+				unsigned int g = m_vNormalGroups[v];
+				if(g != v)
+				{
+					normals[v*3] = normals[g*3];
+					normals[v*3+1] = normals[g*3+1];
+					normals[v*3+2] = normals[g*3+2];
+				}
+			}
+			// Same axis swap as fvert, y up becomes z up.
+			for(unsigned int v=0; v<nVerts; v++)
+			{
+				osf<<"\tfnor( " <<(int)normals[v*3]<<" "
+					<<-(int)normals[v*3+2]<<" "
+					<<(int)normals[v*3+1]<<" )"<<std::endl;
+			}
+		}
+		m_nFrames++;
+	}
+	osf<<"}";
+
+	m_bWritten = !osf.fail();
+	osf.close();
+	m_fSeconds = getTimeSeconds() - fStart;
+}
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef FRAMENORMALS_H
+#define FRAMENORMALS_H
+
+#include <string>
+#include <vector>
+#include "AnimFrameBuffer.h"
+#include "IndexBuffer.h"
+#include "WorkerPool.h"
+
+// Area weighted vertex normals of a triangle list, for the baked
+// frames of animated meshes. positions holds 3 floats per vertex.
+// The normals are written to out as 3 signed bytes per vertex,
+// scaled by 127, vertices no triangle uses get 0 0 0. accum is
+// scratch room kept between frames. Uses SSE2 when the compiler
+// targets it, the results are the same as the scalar code.
+void computeFrameNormals(const float *positions, unsigned int nVertices, const IndexBuffer &triangles,
+						 std::vector<float> &accum, signed char *out);
+
+// Appends the baked frames of one animated mesh to its object
+// file: n_frame, then for each frame its fvert lines and, when
+// asked, its fnor lines. The meshes read their own frames from
+// the buffer, so one job per mesh can run on the worker pool.
+class AnimMergeJob : public WorkerTask
+{
+	public:
+		// sources maps each written vertex to the baked one it
+		// is a copy of, see VertexSplit, empty when they are the
+		// same. triangles uses the written vertices in Maya
+		// winding order and is only needed for the normals.
+		// normalGroups, see VertexSplit::normalGroups, makes the
+		// copies of a group share one normal, empty when each
+		// vertex is its own group. All are taken, the arrays
+		// passed are left empty.
+		AnimMergeJob(AnimFrameBuffer &buffer, int nBufferId, const std::string &fileName,
+			std::vector<unsigned int> &sources, IndexBuffer &triangles, std::vector<unsigned int> &normalGroups,
+			bool bNormals);
+
+		virtual void run();
+
+		std::string m_sFileName;
+		int m_nBufferId;
+
+		// Results
+		bool m_bWritten;
+		unsigned int m_nFrames;
+		double m_fSeconds;
+
+	protected:
+		AnimFrameBuffer &m_buffer;
+		std::vector<unsigned int> m_vSources;
+		IndexBuffer m_triangles;
+		std::vector<unsigned int> m_vNormalGroups;
+		bool m_bNormals;
+};
+
+#endif
@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef HASHUTIL_H
+#define HASHUTIL_H
+
+#include <math.h>
+#include <string>
+
+// Hash set of names. VS2005 only ships the stdext version.
+#if defined(_MSC_VER) && _MSC_VER < 1600
+#include <hash_set>
+typedef stdext::hash_set<std::string> StringHashSet;
+#else
+#include <unordered_set>
+typedef std::unordered_set<std::string> StringHashSet;
+#endif
+
+// 64 bit FNV-1a, used to fingerprint exported data.
+typedef unsigned long long HashValue;
+
+const HashValue g_nHashSeed = 14695981039346656037ULL;
+
+inline HashValue hashBytes(HashValue h, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for(size_t i=0; i<size; i++)
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+inline HashValue hashInt(HashValue h, long long val)
+{
+	return hashBytes(h, &val, sizeof(val));
+}
+
+inline HashValue hashString(HashValue h, const std::string &str)
+{
+	h = hashInt(h, (long long)str.size());
+	return hashBytes(h, str.c_str(), str.size());
+}
+
+// Floats are snapped to a grid of the given tolerance so
+// that values within it hash the same. Values sitting right
+// on a cell border can still land in different cells.
+inline HashValue hashFloat(HashValue h, float val, float tolerance)
+{
+	return hashInt(h, (long long)floor(val / tolerance + 0.5f));
+}
+
+#endif
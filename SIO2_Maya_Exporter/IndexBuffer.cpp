@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "IndexBuffer.h"
+
+#include <algorithm>
+
+void IndexBuffer::reset(unsigned int vertexCount, size_t reserveIndices)
+{
+	clear();
+	// The largest 16 bit value is left for the strip restart index.
+	m_b16 = vertexCount <= 0xFFFF;
+	if(m_b16)
+		std::vector<unsigned int>().swap(m_v32);
+	else
+		std::vector<unsigned short>().swap(m_v16);
+	reserve(reserveIndices);
+}
+
+void IndexBuffer::reserve(size_t nIndices)
+{
+	if(m_b16)
+		m_v16.reserve(nIndices);
+	else
+		m_v32.reserve(nIndices);
+}
+
+const void *IndexBuffer::data() const
+{
+	if(m_b16)
+		return m_v16.empty() ? NULL : &m_v16[0];
+	return m_v32.empty() ? NULL : &m_v32[0];
+}
+
+void IndexBuffer::widen()
+{
+	m_v32.reserve(m_v16.capacity() > m_v16.size() ? m_v16.capacity() : m_v16.size() + 1);
+	m_v32.assign(m_v16.begin(), m_v16.end());
+	std::vector<unsigned short>().swap(m_v16);
+	m_b16 = false;
+}
+
+void IndexBuffer::pushWide(unsigned int index)
+{
+	if(m_b16)
+		widen();
+	m_v32.push_back(index);
+}
+
+void IndexBuffer::append(const IndexBuffer &other, unsigned int base)
+{
+	size_t n = other.size();
+	if(n == 0)
+		return;
+
+	unsigned int nMax = 0;
+	for(size_t i=0; i<n; i++)
+		nMax = std::max(nMax, other[i]);
+	if(m_b16 && nMax + base > 0xFFFF)
+		widen();
+
+	reserve(size() + n);
+	if(m_b16)
+	{
+		for(size_t i=0; i<n; i++)
+			m_v16.push_back((unsigned short)(other[i] + base));
+	}
+	else
+	{
+		for(size_t i=0; i<n; i++)
+			m_v32.push_back(other[i] + base);
+	}
+}
+
+void IndexBuffer::assign(const std::vector<unsigned int> &indices)
+{
+	unsigned int nMax = 0;
+	for(size_t i=0; i<indices.size(); i++)
+		nMax = std::max(nMax, indices[i]);
+
+	// Here the restart index can be in the values, only the
+	// range matters.
+	clear();
+	m_b16 = nMax <= 0xFFFF;
+	if(m_b16)
+	{
+		std::vector<unsigned int>().swap(m_v32);
+		m_v16.assign(indices.begin(), indices.end());
+	}
+	else
+	{
+		std::vector<unsigned short>().swap(m_v16);
+		m_v32 = indices;
+	}
+}
+
+void IndexBuffer::copyTo(std::vector<unsigned int> &indices) const
+{
+	if(m_b16)
+		indices.assign(m_v16.begin(), m_v16.end());
+	else
+		indices.assign(m_v32.begin(), m_v32.end());
+}
+
+void IndexBuffer::swap(IndexBuffer &other)
+{
+	m_v16.swap(other.m_v16);
+	m_v32.swap(other.m_v32);
+	std::swap(m_b16, other.m_b16);
+}
+
+void IndexBuffer::flipTriangles()
+{
+	if(m_b16)
+	{
+		for(size_t i=0; i+2<m_v16.size(); i+=3)
+			std::swap(m_v16[i+1], m_v16[i+2]);
+	}
+	else
+	{
+		for(size_t i=0; i+2<m_v32.size(); i+=3)
+			std::swap(m_v32[i+1], m_v32[i+2]);
+	}
+}
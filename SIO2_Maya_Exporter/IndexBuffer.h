@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef INDEXBUFFER_H
+#define INDEXBUFFER_H
+
+#include <stddef.h>
+#include <vector>
+
+// Triangle or strip indices, stored as 16 bit values while every
+// vertex fits and as 32 bit ones otherwise. Most meshes stay
+// under 65535 vertices so they take half the memory of a plain
+// unsigned int array. A buffer reset() for a vertex count picks
+// its width up front, one filled without it starts at 16 bit and
+// widens on the first index that does not fit.
+class IndexBuffer
+{
+	public:
+		IndexBuffer() : m_b16(true) {}
+
+		// Empties the buffer for a mesh of vertexCount vertices,
+		// with room for reserveIndices. The memory is kept.
+		void reset(unsigned int vertexCount, size_t reserveIndices = 0);
+		// Empties the buffer and goes back to 16 bit, as a new one.
+		void clear() { m_v16.clear(); m_v32.clear(); m_b16 = true; }
+		void reserve(size_t nIndices);
+
+		void push_back(unsigned int index)
+		{
+			if(m_b16 && index <= 0xFFFF)
+				m_v16.push_back((unsigned short)index);
+			else
+				pushWide(index);
+		}
+
+		unsigned int operator[](size_t i) const { return m_b16 ? m_v16[i] : m_v32[i]; }
+		size_t size() const { return m_b16 ? m_v16.size() : m_v32.size(); }
+		bool empty() const { return size() == 0; }
+		bool is16Bit() const { return m_b16; }
+
+		// Raw values, bytes() long.
+		const void *data() const;
+		size_t bytes() const { return m_b16 ? m_v16.size() * 2 : m_v32.size() * 4; }
+		// Memory held, reserved room included.
+		size_t byteSize() const { return m_v16.capacity() * 2 + m_v32.capacity() * 4; }
+
+		// Adds the indices of other moved up by base.
+		void append(const IndexBuffer &other, unsigned int base);
+		void assign(const std::vector<unsigned int> &indices);
+		void copyTo(std::vector<unsigned int> &indices) const;
+		void swap(IndexBuffer &other);
+
+		// Reverses the winding of a triangle list by swapping the
+		// last two indices of each triangle.
+		void flipTriangles();
+
+	protected:
+		void pushWide(unsigned int index);
+		void widen();
+
+		std::vector<unsigned short> m_v16;
+		std::vector<unsigned int> m_v32;
+		bool m_b16;
+};
+
+#endif
@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "MaterialRegistry.h"
+
+MaterialRegistry::MaterialRegistry()
+{
+	m_bMerge = false;
+	m_nMerged = 0;
+}
+
+void MaterialRegistry::setMerge(bool bMerge)
+{
+	m_bMerge = bMerge;
+}
+
+std::string MaterialRegistry::add(const std::string &name, const std::string &params, bool &bIsNew)
+{
+	bIsNew = false;
+
+	std::map<std::string, std::string>::const_iterator found = m_mCanonicalOf.find(name);
+	if(found != m_mCanonicalOf.end())
+		return found->second;
+
+	HashValue h = hashString(g_nHashSeed, params);
+
+	if(m_bMerge)
+	{
+		// Compare the text as well, a hash match alone
+		// is not enough to merge two materials.
+		std::multimap<HashValue, Canonical>::const_iterator it = m_mByHash.lower_bound(h);
+		for(; it != m_mByHash.end() && it->first == h; ++it)
+		{
+			if(it->second.params == params)
+			{
+				m_mCanonicalOf[name] = it->second.name;
+				m_nMerged++;
+				return it->second.name;
+			}
+		}
+	}
+
+	Canonical canonical;
+	canonical.name = name;
+	canonical.params = params;
+	m_mByHash.insert(std::make_pair(h, canonical));
+	m_mCanonicalOf[name] = name;
+
+	bIsNew = true;
+	return name;
+}
+
+bool MaterialRegistry::isRegistered(const std::string &name) const
+{
+	return m_mCanonicalOf.find(name) != m_mCanonicalOf.end();
+}
+
+std::string MaterialRegistry::canonicalName(const std::string &name) const
+{
+	std::map<std::string, std::string>::const_iterator found = m_mCanonicalOf.find(name);
+	if(found != m_mCanonicalOf.end())
+		return found->second;
+
+	return name;
+}
+
+void MaterialRegistry::skip(const std::string &name)
+{
+	m_sSkipped.insert(name);
+}
+
+bool MaterialRegistry::isSkipped(const std::string &name) const
+{
+	return m_sSkipped.find(name) != m_sSkipped.end();
+}
+
+void MaterialRegistry::clear()
+{
+	m_nMerged = 0;
+	m_mCanonicalOf.clear();
+	m_mByHash.clear();
+	m_sSkipped.clear();
+}
@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MATERIALREGISTRY_H
+#define MATERIALREGISTRY_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "HashUtil.h"
+
+// Keeps track of the materials written during an export.
+// Materials are identified by the text of their parameters
+// (everything writeMatTextureInfo outputs), so two Maya
+// materials with the same colours and textures share one
+// canonical file. Also holds the materials that must not
+// be exported.
+class MaterialRegistry
+{
+	public:
+		MaterialRegistry();
+
+		// When merging is off every material is its own canonical.
+		void setMerge(bool bMerge);
+
+		// Adds a material and returns the name of the canonical
+		// material for it. bIsNew is true if the caller has to
+		// write the file.
+		std::string add(const std::string &name, const std::string &params, bool &bIsNew);
+
+		bool isRegistered(const std::string &name) const;
+
+		// Canonical name of a registered material, or the name
+		// itself if it was never registered.
+		std::string canonicalName(const std::string &name) const;
+
+		void skip(const std::string &name);
+		bool isSkipped(const std::string &name) const;
+
+		unsigned int mergedCount() const { return m_nMerged; }
+
+		void clear();
+
+	protected:
+		struct Canonical
+		{
+			std::string name;
+			std::string params;
+		};
+
+		bool m_bMerge;
+		unsigned int m_nMerged;
+		std::map<std::string, std::string> m_mCanonicalOf;
+		std::multimap<HashValue, Canonical> m_mByHash;
+		StringHashSet m_sSkipped;
+};
+
+#endif
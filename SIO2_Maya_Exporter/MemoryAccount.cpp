@@ -0,0 +1,211 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "MemoryAccount.h"
+#include "Trace.h"
+
+const char *memoryStageName(MemoryStage stage)
+{
+	switch(stage)
+	{
+		case MEMORY_EXTRACTION:
+			return "extraction";
+		case MEMORY_POINTS:
+			return "points";
+		case MEMORY_INDICES:
+			return "indices";
+		case MEMORY_UVS:
+			return "uvs";
+		case MEMORY_ANIMATION:
+			return "animation";
+		case MEMORY_TEXTURES:
+			return "textures";
+		case MEMORY_BATCHES:
+			return "batches";
+		case MEMORY_LODS:
+			return "lods";
+		case MEMORY_INSTANCES:
+			return "instances";
+		default:
+			return "unknown";
+	}
+}
+
+MemoryAccount::MemoryAccount()
+{
+	reset();
+}
+
+void MemoryAccount::reset()
+{
+	ScopedLock lock(m_mutex);
+	for(int i=0; i<MEMORY_STAGE_COUNT; i++)
+	{
+		m_vCurrent[i] = 0;
+		m_vPeak[i] = 0;
+	}
+	m_nTotal = 0;
+	m_nTotalPeak = 0;
+	m_bInMesh = false;
+	m_nMeshCurrent = 0;
+	m_vMeshes.clear();
+}
+
+bool MemoryAccount::isMeshStage(MemoryStage stage)
+{
+	return stage == MEMORY_EXTRACTION || stage == MEMORY_POINTS || stage == MEMORY_INDICES || stage == MEMORY_UVS;
+}
+
+// Called with the lock held.
+void MemoryAccount::update(MemoryStage stage, size_t bytes)
+{
+	size_t old = m_vCurrent[stage];
+	m_vCurrent[stage] = bytes;
+	m_nTotal = m_nTotal - old + bytes;
+
+	if(bytes > m_vPeak[stage])
+		m_vPeak[stage] = bytes;
+	if(m_nTotal > m_nTotalPeak)
+		m_nTotalPeak = m_nTotal;
+
+	if(m_bInMesh && isMeshStage(stage))
+	{
+		m_nMeshCurrent = m_nMeshCurrent - old + bytes;
+		if(m_nMeshCurrent > m_vMeshes.back().peakBytes)
+			m_vMeshes.back().peakBytes = m_nMeshCurrent;
+	}
+}
+
+void MemoryAccount::add(MemoryStage stage, size_t bytes)
+{
+	ScopedLock lock(m_mutex);
+	update(stage, m_vCurrent[stage] + bytes);
+}
+
+void MemoryAccount::remove(MemoryStage stage, size_t bytes)
+{
+	ScopedLock lock(m_mutex);
+	update(stage, bytes < m_vCurrent[stage] ? m_vCurrent[stage] - bytes : 0);
+}
+
+void MemoryAccount::set(MemoryStage stage, size_t bytes)
+{
+	ScopedLock lock(m_mutex);
+	update(stage, bytes);
+}
+
+size_t MemoryAccount::current(MemoryStage stage) const
+{
+	ScopedLock lock(m_mutex);
+	return m_vCurrent[stage];
+}
+
+size_t MemoryAccount::peak(MemoryStage stage) const
+{
+	ScopedLock lock(m_mutex);
+	return m_vPeak[stage];
+}
+
+size_t MemoryAccount::totalCurrent() const
+{
+	ScopedLock lock(m_mutex);
+	return m_nTotal;
+}
+
+size_t MemoryAccount::totalPeak() const
+{
+	ScopedLock lock(m_mutex);
+	return m_nTotalPeak;
+}
+
+void MemoryAccount::beginMesh(const std::string &name)
+{
+	ScopedLock lock(m_mutex);
+	MeshUsage usage;
+	usage.name = name;
+	usage.peakBytes = 0;
+	m_vMeshes.push_back(usage);
+
+	m_bInMesh = true;
+	m_nMeshCurrent = 0;
+}
+
+void MemoryAccount::endMesh()
+{
+	ScopedLock lock(m_mutex);
+	m_bInMesh = false;
+}
+
+void MemoryAccount::writeJson(std::ostream &osf) const
+{
+	ScopedLock lock(m_mutex);
+
+	osf<<"{\"peakBytes\":"<<m_nTotalPeak<<",\"currentBytes\":"<<m_nTotal<<",\"stages\":{";
+	for(int i=0; i<MEMORY_STAGE_COUNT; i++)
+	{
+		osf<<(i ? "," : "")<<"\""<<memoryStageName((MemoryStage)i)<<"\":{\"peakBytes\":"<<m_vPeak[i]
+			<<",\"currentBytes\":"<<m_vCurrent[i]<<"}";
+	}
+	osf<<"},\"meshes\":[";
+	for(size_t i=0; i<m_vMeshes.size(); i++)
+	{
+		osf<<(i ? "," : "")<<"{\"name\":";
+		writeJsonString(osf, m_vMeshes[i].name);
+		osf<<",\"peakBytes\":"<<m_vMeshes[i].peakBytes<<"}";
+	}
+	osf<<"]}";
+}
+
+MemoryAccount &memoryAccount()
+{
+	static MemoryAccount account;
+	return account;
+}
+
+MemoryMeshScope::MemoryMeshScope(const std::string &name)
+{
+	memoryAccount().beginMesh(name);
+}
+
+MemoryMeshScope::~MemoryMeshScope()
+{
+	memoryAccount().endMesh();
+}
+
+MemoryCharge::MemoryCharge(MemoryStage stage, size_t bytes)
+{
+	m_nStage = stage;
+	m_nBytes = bytes;
+	if(bytes > 0)
+		memoryAccount().add(stage, bytes);
+}
+
+MemoryCharge::~MemoryCharge()
+{
+	if(m_nBytes > 0)
+		memoryAccount().remove(m_nStage, m_nBytes);
+}
+
+void MemoryCharge::resize(size_t bytes)
+{
+	if(bytes > m_nBytes)
+		memoryAccount().add(m_nStage, bytes - m_nBytes);
+	else if(bytes < m_nBytes)
+		memoryAccount().remove(m_nStage, m_nBytes - bytes);
+	m_nBytes = bytes;
+}
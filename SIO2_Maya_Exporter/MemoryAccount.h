@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "WorkerPool.h"
+
+// What the bytes are held for.
+enum MemoryStage
+{
+	// MeshData pulled out of Maya.
+	MEMORY_EXTRACTION,
+	// Maya point arrays kept while an object is written.
+	MEMORY_POINTS,
+	// Index lists of the vertex groups.
+	MEMORY_INDICES,
+	// UV arrays of the meshes.
+	MEMORY_UVS,
+	// Baked animation frames held in RAM.
+	MEMORY_ANIMATION,
+	// Decoded textures and their mipmaps.
+	MEMORY_TEXTURES,
+	// Meshes waiting in the static batches.
+	MEMORY_BATCHES,
+	// Meshes waiting to be simplified.
+	MEMORY_LODS,
+	// Geometry of the meshes instances are compared against.
+	MEMORY_INSTANCES,
+	MEMORY_STAGE_COUNT
+};
+
+const char *memoryStageName(MemoryStage stage);
+
+// Counts the bytes the exporter holds, per stage and in total,
+// with their peaks. The Maya arrays and our own buffers are
+// charged by hand where they are made, so it shows where the
+// memory goes rather than every allocation. Safe to use from
+// the worker threads.
+class MemoryAccount
+{
+	public:
+		MemoryAccount();
+
+		void reset();
+
+		void add(MemoryStage stage, size_t bytes);
+		void remove(MemoryStage stage, size_t bytes);
+		// For stages that report their own size.
+		void set(MemoryStage stage, size_t bytes);
+
+		size_t current(MemoryStage stage) const;
+		size_t peak(MemoryStage stage) const;
+		size_t totalCurrent() const;
+		size_t totalPeak() const;
+
+		// Peak of the extraction, points, indices and UV stages
+		// while a mesh is being written, main thread only.
+		void beginMesh(const std::string &name);
+		void endMesh();
+
+		struct MeshUsage
+		{
+			std::string name;
+			size_t peakBytes;
+		};
+		const std::vector<MeshUsage> &meshes() const { return m_vMeshes; }
+
+		// {"peakBytes":..,"stages":{..},"meshes":[..]}
+		void writeJson(std::ostream &osf) const;
+
+	protected:
+		void update(MemoryStage stage, size_t bytes);
+		static bool isMeshStage(MemoryStage stage);
+
+		mutable Mutex m_mutex;
+		size_t m_vCurrent[MEMORY_STAGE_COUNT];
+		size_t m_vPeak[MEMORY_STAGE_COUNT];
+		size_t m_nTotal;
+		size_t m_nTotalPeak;
+
+		bool m_bInMesh;
+		size_t m_nMeshCurrent;
+		std::vector<MeshUsage> m_vMeshes;
+};
+
+// Counts the mesh stages towards name until it goes away.
+class MemoryMeshScope
+{
+	public:
+		MemoryMeshScope(const std::string &name);
+		~MemoryMeshScope();
+};
+
+// The account of the export.
+MemoryAccount &memoryAccount();
+
+// Holds a charge for the life of the object.
+class MemoryCharge
+{
+	public:
+		MemoryCharge(MemoryStage stage, size_t bytes = 0);
+		~MemoryCharge();
+
+		// Changes the bytes held.
+		void resize(size_t bytes);
+
+	protected:
+		MemoryStage m_nStage;
+		size_t m_nBytes;
+};
+
+#endif
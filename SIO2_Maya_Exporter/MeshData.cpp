@@ -0,0 +1,292 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "MeshData.h"
+
+#include <iomanip>
+#include <math.h>
+#include <sstream>
+
+static HashValue hashFloats(HashValue h, const std::vector<float> &vals, float tolerance)
+{
+	h = hashInt(h, (long long)vals.size());
+	for(size_t i=0; i<vals.size(); i++)
+		h = hashFloat(h, vals[i], tolerance);
+
+	return h;
+}
+
+HashValue MeshData::hash(float tolerance) const
+{
+	HashValue h = g_nHashSeed;
+
+	h = hashFloats(h, positions, tolerance);
+	h = hashFloats(h, normals, tolerance);
+	h = hashFloats(h, colors, tolerance);
+	h = hashFloats(h, tangents, tolerance);
+
+	h = hashInt(h, (long long)uvs.size());
+	for(size_t i=0; i<uvs.size(); i++)
+		h = hashFloats(h, uvs[i], tolerance);
+
+	h = hashInt(h, (long long)indices.size());
+	h = hashBytes(h, indices.data(), indices.bytes());
+
+	h = hashString(h, groupName);
+	for(size_t i=0; i<materials.size(); i++)
+		h = hashString(h, materials[i]);
+
+	return h;
+}
+
+static bool floatsEqual(const std::vector<float> &a, const std::vector<float> &b, float tolerance)
+{
+	if(a.size() != b.size())
+		return false;
+
+	for(size_t i=0; i<a.size(); i++)
+	{
+		if(fabs(a[i] - b[i]) > tolerance)
+			return false;
+	}
+	return true;
+}
+
+bool MeshData::equals(const MeshData &other, float tolerance) const
+{
+	if(groupName != other.groupName || materials != other.materials || uvs.size() != other.uvs.size()
+		|| indices.size() != other.indices.size())
+		return false;
+
+	if(!floatsEqual(positions, other.positions, tolerance) || !floatsEqual(normals, other.normals, tolerance)
+		|| !floatsEqual(colors, other.colors, tolerance) || !floatsEqual(tangents, other.tangents, tolerance))
+		return false;
+
+	for(size_t i=0; i<uvs.size(); i++)
+	{
+		if(!floatsEqual(uvs[i], other.uvs[i], tolerance))
+			return false;
+	}
+
+	for(size_t i=0; i<indices.size(); i++)
+	{
+		if(indices[i] != other.indices[i])
+			return false;
+	}
+	return true;
+}
+
+size_t MeshData::byteSize() const
+{
+	size_t nBytes = (positions.size() + normals.size() + colors.size() + tangents.size()) * sizeof(float);
+	for(size_t i=0; i<uvs.size(); i++)
+		nBytes += uvs[i].size() * sizeof(float);
+
+	nBytes += uvSeams.size();
+	nBytes += indices.byteSize();
+	return nBytes;
+}
+
+void MeshData::clear()
+{
+	positions.clear();
+	normals.clear();
+	colors.clear();
+	tangents.clear();
+	uvs.clear();
+	uvSeams.clear();
+	indices.clear();
+	groupName.clear();
+	materials.clear();
+}
+
+void MeshData::swap(MeshData &other)
+{
+	positions.swap(other.positions);
+	normals.swap(other.normals);
+	colors.swap(other.colors);
+	tangents.swap(other.tangents);
+	uvs.swap(other.uvs);
+	uvSeams.swap(other.uvSeams);
+	indices.swap(other.indices);
+	groupName.swap(other.groupName);
+	materials.swap(other.materials);
+}
+
+void MeshData::transform(const double matrix[4][4], const double normalMatrix[4][4])
+{
+	for(size_t i=0; i+2<positions.size(); i+=3)
+	{
+		double p[3] = { positions[i], positions[i+1], positions[i+2] };
+		for(int c=0; c<3; c++)
+			positions[i+c] = (float)(p[0] * matrix[0][c] + p[1] * matrix[1][c] + p[2] * matrix[2][c] + matrix[3][c]);
+	}
+
+	for(size_t i=0; i+2<normals.size(); i+=3)
+	{
+		double n[3];
+		for(int c=0; c<3; c++)
+			n[c] = normals[i] * normalMatrix[0][c] + normals[i+1] * normalMatrix[1][c] + normals[i+2] * normalMatrix[2][c];
+
+		double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(len > 0)
+		{
+			for(int c=0; c<3; c++)
+				normals[i+c] = (float)(n[c] / len);
+		}
+	}
+
+	double det = matrix[0][0] * (matrix[1][1] * matrix[2][2] - matrix[1][2] * matrix[2][1])
+		- matrix[0][1] * (matrix[1][0] * matrix[2][2] - matrix[1][2] * matrix[2][0])
+		+ matrix[0][2] * (matrix[1][0] * matrix[2][1] - matrix[1][1] * matrix[2][0]);
+	for(size_t i=0; i+3<tangents.size(); i+=4)
+	{
+		double t[3];
+		for(int c=0; c<3; c++)
+			t[c] = tangents[i] * matrix[0][c] + tangents[i+1] * matrix[1][c] + tangents[i+2] * matrix[2][c];
+
+		double len = sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+		if(len > 0)
+		{
+			for(int c=0; c<3; c++)
+				tangents[i+c] = (float)(t[c] / len);
+		}
+		if(det < 0)
+			tangents[i+3] = -tangents[i+3];
+	}
+
+	// A mirror turns the faces inside out.
+	if(det < 0)
+		indices.flipTriangles();
+}
+
+void MeshData::append(const MeshData &other)
+{
+	unsigned int nBase = vertexCount();
+
+	positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+	normals.insert(normals.end(), other.normals.begin(), other.normals.end());
+	colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+	tangents.insert(tangents.end(), other.tangents.begin(), other.tangents.end());
+	uvSeams.insert(uvSeams.end(), other.uvSeams.begin(), other.uvSeams.end());
+	if(uvs.size() < other.uvs.size())
+		uvs.resize(other.uvs.size());
+	for(size_t s=0; s<other.uvs.size(); s++)
+		uvs[s].insert(uvs[s].end(), other.uvs[s].begin(), other.uvs[s].end());
+
+	indices.append(other.indices, nBase);
+}
+
+float optimizeFloat(float num)
+{
+	int i = (int)num;
+
+	std::stringstream s;
+	float r;
+	s<<std::setprecision(3)<<std::setiosflags(std::ios_base::fixed)<<num;
+	s>>r;
+
+	if(i == r)
+		return (float)i;
+	return r;
+}
+
+size_t writeMeshData(std::ostream &osf, const MeshData &data, StripMode stripMode)
+{
+	unsigned int nVerts = data.vertexCount();
+
+	// vbo_offset( size color normal uv0 uv1 [tangent] ), the
+	// tangent offset is only written when there are tangents.
+	long long offsets[5] = {0, 0, 0, 0, 0};
+	long long size = (long long)nVerts * 3 * 4;
+	if(!data.colors.empty())
+	{
+		offsets[0] = size;
+		size += nVerts * 4;
+	}
+	if(!data.normals.empty())
+	{
+		offsets[1] = size;
+		size += nVerts * 12;
+	}
+	if(!data.uvs.empty())
+	{
+		offsets[2] = size;
+		size += nVerts * 8;
+		if(data.uvs.size() > 1)
+		{
+			offsets[3] = size;
+			size += nVerts * 8;
+		}
+	}
+	if(!data.tangents.empty())
+	{
+		offsets[4] = size;
+		size += nVerts * 16;
+	}
+	osf<<"\tvbo_offset( "<<size;
+	for(int i=0; i<(data.tangents.empty() ? 4 : 5); i++)
+		osf<<" "<<optimizeFloat((float)offsets[i]);
+	osf<<" )"<<std::endl;
+
+	// Maya space to SIO2, y up becomes z up.
+	for(unsigned int i=0; i<nVerts; i++)
+	{
+		osf<<"\tvert( "<<optimizeFloat(data.positions[i*3])
+			<<" "<<optimizeFloat(-1*data.positions[i*3+2])
+			<<" "<<optimizeFloat(data.positions[i*3+1])<<" )"<<std::endl;
+	}
+
+	for(size_t i=0; i+3<data.colors.size(); i+=4)
+	{
+		osf<<"\tvcol( "<<optimizeFloat(data.colors[i])
+			<<" "<<optimizeFloat(data.colors[i+1])
+			<<" "<<optimizeFloat(data.colors[i+2])
+			<<" "<<optimizeFloat(data.colors[i+3])<<" )"<<std::endl;
+	}
+
+	for(size_t i=0; i+2<data.normals.size(); i+=3)
+	{
+		osf<<"\tvnor( "<<optimizeFloat(data.normals[i])
+			<<" "<<optimizeFloat(-1*data.normals[i+2])
+			<<" "<<optimizeFloat(data.normals[i+1])<<" )"<<std::endl;
+	}
+
+	for(size_t s=0; s<data.uvs.size(); s++)
+	{
+		const std::vector<float> &uv = data.uvs[s];
+		for(size_t i=0; i+1<uv.size(); i+=2)
+			osf<<"\tuv"<<s<<"( "<<optimizeFloat(uv[i])<<" "<<optimizeFloat(uv[i+1])<<" )"<<std::endl;
+	}
+
+	// Same axis swap as the normals, the sign is unchanged.
+	for(size_t i=0; i+3<data.tangents.size(); i+=4)
+	{
+		osf<<"\tvtan( "<<optimizeFloat(data.tangents[i])
+			<<" "<<optimizeFloat(-1*data.tangents[i+2])
+			<<" "<<optimizeFloat(data.tangents[i+1])
+			<<" "<<optimizeFloat(data.tangents[i+3])<<" )"<<std::endl;
+	}
+
+	osf<<"\tn_vgroup( 1 )"<<std::endl;
+	osf<<"\tvgroup( \""<<data.groupName<<"\")"<<std::endl;
+	for(size_t i=0; i<data.materials.size(); i++)
+		osf<<"\tmname( \"material/"<<data.materials[i]<<"\" )"<<std::endl;
+
+	return writeIndexStream(osf, data.indices, stripMode);
+}
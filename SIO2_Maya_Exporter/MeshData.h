@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "HashUtil.h"
+#include "IndexBuffer.h"
+#include "TriangleStrip.h"
+
+// Geometry of a mesh as it is written to the object file,
+// pulled out of Maya so it can be worked on without the API.
+// Positions and normals are in Maya object space, the axis
+// swap to SIO2 happens when writing. UVs are already flipped.
+struct MeshData
+{
+	// 3 floats per vertex.
+	std::vector<float> positions;
+	// 3 floats per vertex, may be empty.
+	std::vector<float> normals;
+	// 4 floats per vertex, may be empty.
+	std::vector<float> colors;
+	// Tangent and bitangent sign, 4 floats per vertex, may be
+	// empty. See computeFaceTangents.
+	std::vector<float> tangents;
+	// One array per UV set, 2 floats per vertex.
+	std::vector< std::vector<float> > uvs;
+	// 1 for vertices whose corners use different UVs in Maya, a
+	// UV seam the vertices are not split on, may be empty. Kept in
+	// place by the simplifier, not written.
+	std::vector<unsigned char> uvSeams;
+	// 3 indices per triangle.
+	IndexBuffer indices;
+	// Names of the vertex group and its materials.
+	std::string groupName;
+	std::vector<std::string> materials;
+
+	unsigned int vertexCount() const { return (unsigned int)(positions.size() / 3); }
+	unsigned int triangleCount() const { return (unsigned int)(indices.size() / 3); }
+
+	// Content hash, floats compared with the given tolerance.
+	HashValue hash(float tolerance) const;
+
+	// True when both have the same arrays, indices, group and
+	// materials, with floats no more than tolerance apart. Used
+	// to rule out hash collisions.
+	bool equals(const MeshData &other, float tolerance) const;
+
+	// Memory held by the arrays.
+	size_t byteSize() const;
+
+	void clear();
+	void swap(MeshData &other);
+
+	// Moves the geometry by a Maya style matrix (points are row
+	// vectors). Normals use normalMatrix, the inverse transpose,
+	// and are renormalised. Tangents use matrix. When it mirrors
+	// the tangents change sign and the triangles are flipped to
+	// keep facing out.
+	void transform(const double matrix[4][4], const double normalMatrix[4][4]);
+
+	// Adds the vertices and triangles of other, which must have
+	// the same arrays (colours, normals, tangents, UV sets) as
+	// this one.
+	void append(const MeshData &other);
+};
+
+// Rounds to the precision of the object files, the same way as
+// SIO2_ExporterCmd::optimize_float.
+float optimizeFloat(float num);
+
+// Writes the geometry part of an object file, vbo_offset
+// down to the indices, the same way the Maya writers do for
+// a mesh with a single vertex group. Returns the number of
+// indices written.
+size_t writeMeshData(std::ostream &osf, const MeshData &data, StripMode stripMode = STRIP_NONE);
+
+#endif
@@ -0,0 +1,866 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "MeshSimplifier.h"
+#include "Trace.h"
+#include "MemoryAccount.h"
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+// Border edges are held in place by planes through them,
+// weighted well above the faces.
+const double g_fBorderWeight = 10.0;
+
+// An attribute difference of 1 (a whole UV range, or normals
+// a radian apart) costs as much as moving the surface by this
+// fraction of the mesh size.
+const double g_fAttributeWeight = 0.1;
+
+// Collapses may not turn a face normal by more than this (cosine).
+const double g_fMinNormalDot = 0.2;
+
+void Quadric::clear()
+{
+	a2 = ab = ac = ad = 0;
+	b2 = bc = bd = 0;
+	c2 = cd = 0;
+	d2 = 0;
+}
+
+void Quadric::addPlane(double a, double b, double c, double d, double weight)
+{
+	a2 += weight * a * a;
+	ab += weight * a * b;
+	ac += weight * a * c;
+	ad += weight * a * d;
+	b2 += weight * b * b;
+	bc += weight * b * c;
+	bd += weight * b * d;
+	c2 += weight * c * c;
+	cd += weight * c * d;
+	d2 += weight * d * d;
+}
+
+void Quadric::add(const Quadric &q)
+{
+	a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+	b2 += q.b2; bc += q.bc; bd += q.bd;
+	c2 += q.c2; cd += q.cd;
+	d2 += q.d2;
+}
+
+double Quadric::evaluate(double x, double y, double z) const
+{
+	double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+		+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+		+ c2 * z * z + 2 * cd * z
+		+ d2;
+	return e > 0 ? e : 0;
+}
+
+static void cross(const double a[3], const double b[3], double out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double length(const double v[3])
+{
+	return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static double dot(const double a[3], const double b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Distance from p to the closest point of triangle abc, found by
+// the region of the triangle p projects onto.
+static double pointTriangleDistance(const double p[3], const double a[3], const double b[3], const double c[3])
+{
+	double ab[3], ac[3], ap[3], closest[3];
+	for(int i=0; i<3; i++)
+	{
+		ab[i] = b[i] - a[i];
+		ac[i] = c[i] - a[i];
+		ap[i] = p[i] - a[i];
+	}
+
+	double d1 = dot(ab, ap), d2 = dot(ac, ap);
+	double bp[3], cp[3];
+	for(int i=0; i<3; i++)
+	{
+		bp[i] = p[i] - b[i];
+		cp[i] = p[i] - c[i];
+	}
+	double d3 = dot(ab, bp), d4 = dot(ac, bp);
+	double d5 = dot(ab, cp), d6 = dot(ac, cp);
+
+	double va = d3 * d6 - d5 * d4;
+	double vb = d5 * d2 - d1 * d6;
+	double vc = d1 * d4 - d3 * d2;
+
+	if(d1 <= 0 && d2 <= 0)
+	{
+		for(int i=0; i<3; i++) closest[i] = a[i];
+	}
+	else if(d3 >= 0 && d4 <= d3)
+	{
+		for(int i=0; i<3; i++) closest[i] = b[i];
+	}
+	else if(d6 >= 0 && d5 <= d6)
+	{
+		for(int i=0; i<3; i++) closest[i] = c[i];
+	}
+	else if(vc <= 0 && d1 >= 0 && d3 <= 0)
+	{
+		double v = d1 / (d1 - d3);
+		for(int i=0; i<3; i++) closest[i] = a[i] + ab[i] * v;
+	}
+	else if(vb <= 0 && d2 >= 0 && d6 <= 0)
+	{
+		double w = d2 / (d2 - d6);
+		for(int i=0; i<3; i++) closest[i] = a[i] + ac[i] * w;
+	}
+	else if(va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+	{
+		double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		for(int i=0; i<3; i++) closest[i] = b[i] + (c[i] - b[i]) * w;
+	}
+	else
+	{
+		double sum = va + vb + vc;
+		double v = sum != 0 ? vb / sum : 0;
+		double w = sum != 0 ? vc / sum : 0;
+		for(int i=0; i<3; i++) closest[i] = a[i] + ab[i] * v + ac[i] * w;
+	}
+
+	double d[3] = { p[0] - closest[0], p[1] - closest[1], p[2] - closest[2] };
+	return length(d);
+}
+
+MeshSimplifier::MeshSimplifier(const MeshData &mesh) : m_mesh(mesh)
+{
+	unsigned int nVerts = mesh.vertexCount();
+
+	mesh.indices.copyTo(m_vIndices);
+	m_nTriangles = mesh.triangleCount();
+	m_vTriangleAlive.assign(m_nTriangles, true);
+	m_vVertexTriangles.resize(nVerts);
+	m_vQuadrics.resize(nVerts);
+	m_vWeights.assign(nVerts, 0);
+	m_vVersions.assign(nVerts, 0);
+	m_vVertexAlive.assign(nVerts, true);
+	m_vLocked.assign(nVerts, false);
+	m_vBorder.assign(nVerts, false);
+	m_vCollapsedInto.resize(nVerts);
+	for(unsigned int v=0; v<nVerts; v++)
+		m_vCollapsedInto[v] = v;
+	m_fError = 0;
+
+	for(unsigned int t=0; t<m_nTriangles; t++)
+	{
+		for(int k=0; k<3; k++)
+			m_vVertexTriangles[m_vIndices[t*3 + k]].push_back(t);
+	}
+
+	// Bounding box diagonal sets the scale of the attribute cost.
+	double minP[3] = {0, 0, 0}, maxP[3] = {0, 0, 0};
+	for(unsigned int v=0; v<nVerts; v++)
+	{
+		for(int c=0; c<3; c++)
+		{
+			double p = mesh.positions[v*3 + c];
+			if(v == 0 || p < minP[c])
+				minP[c] = p;
+			if(v == 0 || p > maxP[c])
+				maxP[c] = p;
+		}
+	}
+	double diag[3] = { maxP[0] - minP[0], maxP[1] - minP[1], maxP[2] - minP[2] };
+	double size = length(diag) * g_fAttributeWeight;
+	m_fAttributeScale = size * size;
+
+	findSeams();
+	computeQuadrics();
+
+	for(unsigned int t=0; t<m_nTriangles; t++)
+	{
+		for(int k=0; k<3; k++)
+		{
+			unsigned int a = m_vIndices[t*3 + k];
+			unsigned int b = m_vIndices[t*3 + (k + 1) % 3];
+			pushEdge(a, b);
+		}
+	}
+}
+
+void MeshSimplifier::getPosition(unsigned int v, double p[3]) const
+{
+	p[0] = m_mesh.positions[v*3];
+	p[1] = m_mesh.positions[v*3 + 1];
+	p[2] = m_mesh.positions[v*3 + 2];
+}
+
+void MeshSimplifier::findSeams()
+{
+	// Vertices on a UV seam keep one of its UVs, moving them
+	// would drag the other side's texture along.
+	for(unsigned int v=0; v<m_mesh.uvSeams.size() && v<m_vLocked.size(); v++)
+	{
+		if(m_mesh.uvSeams[v])
+			m_vLocked[v] = true;
+	}
+
+	// Vertices split for a normal or tangent seam share their
+	// position.
+	std::map< std::vector<float>, unsigned int > positions;
+	std::vector<float> key(3);
+	for(unsigned int v=0; v<m_mesh.vertexCount(); v++)
+	{
+		key[0] = m_mesh.positions[v*3];
+		key[1] = m_mesh.positions[v*3 + 1];
+		key[2] = m_mesh.positions[v*3 + 2];
+
+		std::map< std::vector<float>, unsigned int >::iterator found = positions.find(key);
+		if(found == positions.end())
+		{
+			positions[key] = v;
+		}
+		else
+		{
+			m_vLocked[v] = true;
+			m_vLocked[found->second] = true;
+		}
+	}
+}
+
+bool MeshSimplifier::isBorderEdge(unsigned int a, unsigned int b) const
+{
+	int nShared = 0;
+	const std::vector<unsigned int> &tris = m_vVertexTriangles[a];
+	for(unsigned int i=0; i<tris.size(); i++)
+	{
+		unsigned int t = tris[i];
+		if(!m_vTriangleAlive[t])
+			continue;
+		if(m_vIndices[t*3] == b || m_vIndices[t*3 + 1] == b || m_vIndices[t*3 + 2] == b)
+			nShared++;
+	}
+	return nShared == 1;
+}
+
+void MeshSimplifier::computeQuadrics()
+{
+	for(unsigned int t=0; t<m_nTriangles; t++)
+	{
+		double p[3][3];
+		for(int k=0; k<3; k++)
+			getPosition(m_vIndices[t*3 + k], p[k]);
+
+		double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		double n[3];
+		cross(e1, e2, n);
+		double len = length(n);
+		if(len <= 0)
+			continue;
+
+		double area = len * 0.5;
+		n[0] /= len;
+		n[1] /= len;
+		n[2] /= len;
+		double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_vIndices[t*3 + k];
+			m_vQuadrics[v].addPlane(n[0], n[1], n[2], d, area);
+			m_vWeights[v] += area;
+		}
+
+		// Planes standing on the open edges keep the outline.
+		for(int k=0; k<3; k++)
+		{
+			unsigned int a = m_vIndices[t*3 + k];
+			unsigned int b = m_vIndices[t*3 + (k + 1) % 3];
+			if(!isBorderEdge(a, b))
+				continue;
+
+			m_vBorder[a] = true;
+			m_vBorder[b] = true;
+
+			double edge[3] = { p[(k + 1) % 3][0] - p[k][0], p[(k + 1) % 3][1] - p[k][1], p[(k + 1) % 3][2] - p[k][2] };
+			double bn[3];
+			cross(edge, n, bn);
+			double bLen = length(bn);
+			if(bLen <= 0)
+				continue;
+
+			bn[0] /= bLen;
+			bn[1] /= bLen;
+			bn[2] /= bLen;
+			double bd = -(bn[0] * p[k][0] + bn[1] * p[k][1] + bn[2] * p[k][2]);
+			double weight = g_fBorderWeight * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+
+			m_vQuadrics[a].addPlane(bn[0], bn[1], bn[2], bd, weight);
+			m_vQuadrics[b].addPlane(bn[0], bn[1], bn[2], bd, weight);
+		}
+	}
+}
+
+double MeshSimplifier::attributeDistance(unsigned int a, unsigned int b) const
+{
+	double dist = 0;
+
+	if(!m_mesh.normals.empty())
+	{
+		for(int c=0; c<3; c++)
+		{
+			double d = m_mesh.normals[a*3 + c] - m_mesh.normals[b*3 + c];
+			dist += d * d;
+		}
+	}
+	if(!m_mesh.colors.empty())
+	{
+		for(int c=0; c<4; c++)
+		{
+			double d = m_mesh.colors[a*4 + c] - m_mesh.colors[b*4 + c];
+			dist += d * d;
+		}
+	}
+	if(!m_mesh.tangents.empty())
+	{
+		for(int c=0; c<3; c++)
+		{
+			double d = m_mesh.tangents[a*4 + c] - m_mesh.tangents[b*4 + c];
+			dist += d * d;
+		}
+	}
+	for(unsigned int s=0; s<m_mesh.uvs.size(); s++)
+	{
+		for(int c=0; c<2; c++)
+		{
+			double d = m_mesh.uvs[s][a*2 + c] - m_mesh.uvs[s][b*2 + c];
+			dist += d * d;
+		}
+	}
+	return dist;
+}
+
+bool MeshSimplifier::collapseCost(unsigned int from, unsigned int to, double &cost, double &posError) const
+{
+	if(m_vLocked[from])
+		return false;
+
+	// Border vertices only slide along the border.
+	if(m_vBorder[from] && (!m_vBorder[to] || !isBorderEdge(from, to)))
+		return false;
+
+	double p[3];
+	getPosition(to, p);
+
+	Quadric q = m_vQuadrics[from];
+	q.add(m_vQuadrics[to]);
+	double weight = m_vWeights[from] + m_vWeights[to];
+
+	posError = q.evaluate(p[0], p[1], p[2]) / (weight > 0 ? weight : 1);
+	cost = posError + m_fAttributeScale * attributeDistance(from, to);
+	return true;
+}
+
+void MeshSimplifier::pushEdge(unsigned int a, unsigned int b)
+{
+	// Both directions, the cheaper one is popped first.
+	for(int dir=0; dir<2; dir++)
+	{
+		unsigned int from = dir ? b : a;
+		unsigned int to = dir ? a : b;
+
+		Collapse c;
+		double posError;
+		if(!collapseCost(from, to, c.cost, posError))
+			continue;
+
+		c.from = from;
+		c.to = to;
+		c.fromVersion = m_vVersions[from];
+		c.toVersion = m_vVersions[to];
+		m_qCollapses.push(c);
+	}
+}
+
+bool MeshSimplifier::isValidCollapse(unsigned int from, unsigned int to) const
+{
+	// Link condition, the two vertices may only share the
+	// neighbours across the faces being removed.
+	std::vector<unsigned int> fromNeighbours;
+	const std::vector<unsigned int> &fromTris = m_vVertexTriangles[from];
+	int nSharedFaces = 0;
+	for(unsigned int i=0; i<fromTris.size(); i++)
+	{
+		unsigned int t = fromTris[i];
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		bool bHasTo = false;
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_vIndices[t*3 + k];
+			if(v == to)
+				bHasTo = true;
+			else if(v != from)
+				fromNeighbours.push_back(v);
+		}
+		if(bHasTo)
+			nSharedFaces++;
+	}
+	if(nSharedFaces == 0)
+		return false;
+
+	int nShared = 0;
+	const std::vector<unsigned int> &toTris = m_vVertexTriangles[to];
+	std::vector<unsigned int> seen;
+	for(unsigned int i=0; i<toTris.size(); i++)
+	{
+		unsigned int t = toTris[i];
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_vIndices[t*3 + k];
+			if(v == to || v == from)
+				continue;
+			if(std::find(seen.begin(), seen.end(), v) != seen.end())
+				continue;
+
+			seen.push_back(v);
+			if(std::find(fromNeighbours.begin(), fromNeighbours.end(), v) != fromNeighbours.end())
+				nShared++;
+		}
+	}
+	if(nShared > nSharedFaces)
+		return false;
+
+	// Faces moving with the vertex must not flip or collapse.
+	double target[3];
+	getPosition(to, target);
+	for(unsigned int i=0; i<fromTris.size(); i++)
+	{
+		unsigned int t = fromTris[i];
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		const unsigned int *tri = &m_vIndices[t*3];
+		if(tri[0] == to || tri[1] == to || tri[2] == to)
+			continue;
+
+		double p[3][3], q[3][3];
+		for(int k=0; k<3; k++)
+		{
+			getPosition(tri[k], p[k]);
+			for(int c=0; c<3; c++)
+				q[k][c] = tri[k] == from ? target[c] : p[k][c];
+		}
+
+		double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		double f1[3] = { q[1][0] - q[0][0], q[1][1] - q[0][1], q[1][2] - q[0][2] };
+		double f2[3] = { q[2][0] - q[0][0], q[2][1] - q[0][1], q[2][2] - q[0][2] };
+		double nOld[3], nNew[3];
+		cross(e1, e2, nOld);
+		cross(f1, f2, nNew);
+
+		double lenOld = length(nOld);
+		double lenNew = length(nNew);
+		if(lenNew <= 0)
+			return false;
+		if(lenOld > 0)
+		{
+			double dot = (nOld[0] * nNew[0] + nOld[1] * nNew[1] + nOld[2] * nNew[2]) / (lenOld * lenNew);
+			if(dot < g_fMinNormalDot)
+				return false;
+		}
+	}
+	return true;
+}
+
+void MeshSimplifier::collapse(unsigned int from, unsigned int to)
+{
+	std::vector<unsigned int> &fromTris = m_vVertexTriangles[from];
+	std::vector<unsigned int> &toTris = m_vVertexTriangles[to];
+
+	for(unsigned int i=0; i<fromTris.size(); i++)
+	{
+		unsigned int t = fromTris[i];
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		unsigned int *tri = &m_vIndices[t*3];
+		if(tri[0] == to || tri[1] == to || tri[2] == to)
+		{
+			m_vTriangleAlive[t] = false;
+			m_nTriangles--;
+			continue;
+		}
+
+		for(int k=0; k<3; k++)
+		{
+			if(tri[k] == from)
+				tri[k] = to;
+		}
+		toTris.push_back(t);
+	}
+	std::vector<unsigned int>().swap(fromTris);
+
+	m_vQuadrics[to].add(m_vQuadrics[from]);
+	m_vWeights[to] += m_vWeights[from];
+	m_vVertexAlive[from] = false;
+	m_vCollapsedInto[from] = to;
+	m_vVersions[to]++;
+
+	// Drop the dead faces and refresh the edges around the vertex.
+	std::vector<unsigned int> alive;
+	for(unsigned int i=0; i<toTris.size(); i++)
+	{
+		if(m_vTriangleAlive[toTris[i]])
+			alive.push_back(toTris[i]);
+	}
+	toTris.swap(alive);
+
+	// Collapses around the neighbours that were rejected before
+	// may be valid now, so their edges go back in as well.
+	std::vector<unsigned int> ring;
+	for(unsigned int i=0; i<toTris.size(); i++)
+	{
+		unsigned int t = toTris[i];
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_vIndices[t*3 + k];
+			if(v != to && std::find(ring.begin(), ring.end(), v) == ring.end())
+			{
+				ring.push_back(v);
+				pushEdge(to, v);
+			}
+		}
+	}
+	for(unsigned int i=0; i<ring.size(); i++)
+	{
+		const std::vector<unsigned int> &tris = m_vVertexTriangles[ring[i]];
+		for(unsigned int j=0; j<tris.size(); j++)
+		{
+			unsigned int t = tris[j];
+			if(!m_vTriangleAlive[t])
+				continue;
+
+			for(int k=0; k<3; k++)
+			{
+				unsigned int v = m_vIndices[t*3 + k];
+				if(v != to && v != ring[i] && ring[i] < v)
+					pushEdge(ring[i], v);
+			}
+		}
+	}
+}
+
+void MeshSimplifier::simplify(unsigned int targetTriangles)
+{
+	while(m_nTriangles > targetTriangles && !m_qCollapses.empty())
+	{
+		Collapse c = m_qCollapses.top();
+		m_qCollapses.pop();
+
+		// Stale entries, something around them changed.
+		if(!m_vVertexAlive[c.from] || !m_vVertexAlive[c.to]
+			|| c.fromVersion != m_vVersions[c.from] || c.toVersion != m_vVersions[c.to])
+			continue;
+
+		if(!isValidCollapse(c.from, c.to))
+			continue;
+
+		double cost, posError;
+		if(!collapseCost(c.from, c.to, cost, posError))
+			continue;
+
+		collapse(c.from, c.to);
+	}
+
+	measureError();
+}
+
+void MeshSimplifier::measureError()
+{
+	unsigned int nVerts = m_mesh.vertexCount();
+
+	// Triangles left in a grid of about one per cell, so the
+	// closest one to a point is found among a few cells.
+	std::vector<unsigned int> alive;
+	double minP[3] = {0, 0, 0}, maxP[3] = {0, 0, 0};
+	for(unsigned int t=0; t<m_vTriangleAlive.size(); t++)
+	{
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		for(int k=0; k<3; k++)
+		{
+			double p[3];
+			getPosition(m_vIndices[t*3 + k], p);
+			for(int c=0; c<3; c++)
+			{
+				if(alive.empty() || p[c] < minP[c])
+					minP[c] = p[c];
+				if(alive.empty() || p[c] > maxP[c])
+					maxP[c] = p[c];
+			}
+		}
+		alive.push_back(t);
+	}
+	if(alive.empty())
+		return;
+
+	int nCells = (int)pow((double)alive.size(), 1.0 / 3.0) + 1;
+	double cellSize[3];
+	for(int c=0; c<3; c++)
+	{
+		cellSize[c] = (maxP[c] - minP[c]) / nCells;
+		if(cellSize[c] <= 0)
+			cellSize[c] = 1;
+	}
+
+	std::vector< std::vector<unsigned int> > cells(nCells * nCells * nCells);
+	for(unsigned int i=0; i<alive.size(); i++)
+	{
+		int lo[3], hi[3];
+		for(int c=0; c<3; c++)
+		{
+			lo[c] = nCells;
+			hi[c] = 0;
+		}
+		for(int k=0; k<3; k++)
+		{
+			double p[3];
+			getPosition(m_vIndices[alive[i]*3 + k], p);
+			for(int c=0; c<3; c++)
+			{
+				int n = (int)((p[c] - minP[c]) / cellSize[c]);
+				n = n < 0 ? 0 : (n >= nCells ? nCells - 1 : n);
+				lo[c] = n < lo[c] ? n : lo[c];
+				hi[c] = n > hi[c] ? n : hi[c];
+			}
+		}
+		for(int x=lo[0]; x<=hi[0]; x++)
+			for(int y=lo[1]; y<=hi[1]; y++)
+				for(int z=lo[2]; z<=hi[2]; z++)
+					cells[(x * nCells + y) * nCells + z].push_back(alive[i]);
+	}
+
+	for(unsigned int v=0; v<nVerts; v++)
+	{
+		// Vertex the original one ended up as, the ones still
+		// alive are on the surface.
+		unsigned int rep = v;
+		while(m_vCollapsedInto[rep] != rep)
+			rep = m_vCollapsedInto[rep];
+		m_vCollapsedInto[v] = rep;
+		if(rep == v)
+			continue;
+
+		double p[3];
+		getPosition(v, p);
+
+		// The triangles around where it went bound the search,
+		// anything closer must be in the cells within reach.
+		double fClosest = -1;
+		const std::vector<unsigned int> &tris = m_vVertexTriangles[rep];
+		for(unsigned int i=0; i<tris.size(); i++)
+		{
+			if(!m_vTriangleAlive[tris[i]])
+				continue;
+
+			double d = triangleDistance(p, tris[i]);
+			if(fClosest < 0 || d < fClosest)
+				fClosest = d;
+		}
+
+		int lo[3], hi[3];
+		for(int c=0; c<3; c++)
+		{
+			if(fClosest < 0)
+			{
+				lo[c] = 0;
+				hi[c] = nCells - 1;
+				continue;
+			}
+			lo[c] = (int)floor((p[c] - fClosest - minP[c]) / cellSize[c]);
+			hi[c] = (int)floor((p[c] + fClosest - minP[c]) / cellSize[c]);
+			lo[c] = lo[c] < 0 ? 0 : lo[c];
+			hi[c] = hi[c] >= nCells ? nCells - 1 : hi[c];
+		}
+		for(int x=lo[0]; x<=hi[0]; x++)
+		{
+			for(int y=lo[1]; y<=hi[1]; y++)
+			{
+				for(int z=lo[2]; z<=hi[2]; z++)
+				{
+					const std::vector<unsigned int> &cell = cells[(x * nCells + y) * nCells + z];
+					for(unsigned int i=0; i<cell.size(); i++)
+					{
+						double d = triangleDistance(p, cell[i]);
+						if(fClosest < 0 || d < fClosest)
+							fClosest = d;
+					}
+				}
+			}
+		}
+
+		if(fClosest > m_fError)
+			m_fError = (float)fClosest;
+	}
+}
+
+double MeshSimplifier::triangleDistance(const double p[3], unsigned int t) const
+{
+	double a[3], b[3], c[3];
+	getPosition(m_vIndices[t*3], a);
+	getPosition(m_vIndices[t*3 + 1], b);
+	getPosition(m_vIndices[t*3 + 2], c);
+	return pointTriangleDistance(p, a, b, c);
+}
+
+void MeshSimplifier::getMesh(MeshData &out) const
+{
+	unsigned int nVerts = m_mesh.vertexCount();
+	std::vector<int> remap(nVerts, -1);
+
+	out.clear();
+	out.groupName = m_mesh.groupName;
+	out.materials = m_mesh.materials;
+	out.uvs.resize(m_mesh.uvs.size());
+	out.indices.reset(m_mesh.vertexCount(), m_nTriangles * 3);
+
+	unsigned int nUsed = 0;
+	for(unsigned int t=0; t<m_vTriangleAlive.size(); t++)
+	{
+		if(!m_vTriangleAlive[t])
+			continue;
+
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_vIndices[t*3 + k];
+			if(remap[v] < 0)
+			{
+				remap[v] = nUsed++;
+				out.positions.insert(out.positions.end(), m_mesh.positions.begin() + v*3, m_mesh.positions.begin() + v*3 + 3);
+				if(!m_mesh.normals.empty())
+					out.normals.insert(out.normals.end(), m_mesh.normals.begin() + v*3, m_mesh.normals.begin() + v*3 + 3);
+				if(!m_mesh.colors.empty())
+					out.colors.insert(out.colors.end(), m_mesh.colors.begin() + v*4, m_mesh.colors.begin() + v*4 + 4);
+				if(!m_mesh.tangents.empty())
+					out.tangents.insert(out.tangents.end(), m_mesh.tangents.begin() + v*4, m_mesh.tangents.begin() + v*4 + 4);
+				if(!m_mesh.uvSeams.empty())
+					out.uvSeams.push_back(m_mesh.uvSeams[v]);
+				for(unsigned int s=0; s<m_mesh.uvs.size(); s++)
+					out.uvs[s].insert(out.uvs[s].end(), m_mesh.uvs[s].begin() + v*2, m_mesh.uvs[s].begin() + v*2 + 2);
+			}
+			out.indices.push_back(remap[v]);
+		}
+	}
+}
+
+LodJob::LodJob(const std::string &name, const std::string &objectDir, const std::string &relativeDir,
+			   const std::string &header, MeshData &mesh, unsigned int levels, float ratio,
+			   StripMode stripMode, unsigned int maxVertices)
+{
+	m_sName = name;
+	m_sObjectDir = objectDir;
+	m_sRelativeDir = relativeDir;
+	m_sHeader = header;
+	m_nLevels = levels;
+	m_fRatio = ratio;
+	m_nStripMode = stripMode;
+	m_nMaxVertices = maxVertices;
+
+	m_nSrcTriangles = mesh.triangleCount();
+	m_fSeconds = 0;
+
+	m_mesh.swap(mesh);
+	mesh.clear();
+	memoryAccount().add(MEMORY_LODS, m_mesh.byteSize());
+}
+
+void LodJob::run()
+{
+	SIO2_TRACE_DETAIL("LodJob", m_sName.c_str());
+	double fStart = getTimeSeconds();
+
+	// The switch distance puts the error of a level under a
+	// pixel on a 480 pixel high screen with a 45 degree field
+	// of view.
+	const float fPixelAngle = 2.0f * 0.41421356f / 480.0f;
+
+	MeshSimplifier simplifier(m_mesh);
+	float fTarget = (float)m_nSrcTriangles;
+	float fLastDistance = 0;
+
+	for(unsigned int i=1; i<=m_nLevels; i++)
+	{
+		fTarget *= m_fRatio;
+		simplifier.simplify((unsigned int)fTarget);
+
+		Level level;
+		std::stringstream s;
+		s<<m_sName<<"_lod"<<i;
+		level.name = s.str();
+		level.triangles = simplifier.triangleCount();
+		level.error = simplifier.error();
+		level.distance = level.error / fPixelAngle;
+		if(level.distance < fLastDistance)
+			level.distance = fLastDistance;
+		fLastDistance = level.distance;
+
+		std::vector<MeshData> parts(1);
+		simplifier.getMesh(parts[0]);
+		if(m_nMaxVertices > 0 && parts[0].vertexCount() > m_nMaxVertices)
+		{
+			MeshData mesh;
+			mesh.swap(parts[0]);
+			splitMesh(mesh, m_nMaxVertices, parts);
+		}
+		level.parts = (unsigned int)parts.size();
+
+		// Base object and the distance this level takes over at.
+		std::stringstream header;
+		header<<m_sHeader;
+		header<<"\tlod( \""<<m_sRelativeDir<<"/"<<m_sName<<"\" "<<i<<" "<<level.distance<<" )"<<std::endl;
+
+		level.listIndices = 0;
+		level.indices = 0;
+		level.bWritten = writeMeshParts(m_sObjectDir, m_sRelativeDir, level.name, header.str(), parts,
+			m_nStripMode, level.listIndices, level.indices);
+		m_vLevels.push_back(level);
+	}
+
+	memoryAccount().remove(MEMORY_LODS, m_mesh.byteSize());
+	MeshData().swap(m_mesh);
+	m_fSeconds = getTimeSeconds() - fStart;
+}
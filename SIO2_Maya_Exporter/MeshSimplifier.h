@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <queue>
+#include <string>
+#include <vector>
+#include "MeshData.h"
+#include "MeshSplitter.h"
+#include "WorkerPool.h"
+
+// Error quadric of a vertex, the sum of the squared distances
+// to a set of planes as a symmetric 4x4 matrix.
+struct Quadric
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+
+	Quadric() { clear(); }
+	void clear();
+
+	// Plane ax + by + cz + d = 0 with a unit normal.
+	void addPlane(double a, double b, double c, double d, double weight);
+	void add(const Quadric &q);
+	double evaluate(double x, double y, double z) const;
+};
+
+// Quadric error metric simplifier using half edge collapses,
+// so the vertices left keep their own normals, colours and UVs.
+// The cost of a collapse adds how far its attributes are from
+// the vertex removed. Vertices sharing a position with another
+// one (normal or tangent seams) or marked in uvSeams never move
+// and open borders only shrink along themselves, so seams and
+// holes stay closed.
+class MeshSimplifier
+{
+	public:
+		explicit MeshSimplifier(const MeshData &mesh);
+
+		// Collapses edges until the mesh has at most
+		// targetTriangles. Can be called again with a lower
+		// target to continue from where it stopped.
+		void simplify(unsigned int targetTriangles);
+
+		unsigned int triangleCount() const { return m_nTriangles; }
+
+		// Largest distance from a vertex of the original mesh
+		// to the simplified surface, in object units. Measured
+		// after each simplify().
+		float error() const { return m_fError; }
+
+		// The current mesh with unused vertices removed.
+		void getMesh(MeshData &out) const;
+
+	protected:
+		struct Collapse
+		{
+			double cost;
+			unsigned int from, to;
+			unsigned int fromVersion, toVersion;
+
+			bool operator<(const Collapse &other) const { return cost > other.cost; }
+		};
+
+		void computeQuadrics();
+		void findSeams();
+		void pushEdge(unsigned int a, unsigned int b);
+		bool collapseCost(unsigned int from, unsigned int to, double &cost, double &posError) const;
+		bool isValidCollapse(unsigned int from, unsigned int to) const;
+		bool isBorderEdge(unsigned int a, unsigned int b) const;
+		void collapse(unsigned int from, unsigned int to);
+		void getPosition(unsigned int v, double p[3]) const;
+		double attributeDistance(unsigned int a, unsigned int b) const;
+		void measureError();
+		double triangleDistance(const double p[3], unsigned int t) const;
+
+		const MeshData &m_mesh;
+		std::vector<unsigned int> m_vIndices;
+		std::vector<bool> m_vTriangleAlive;
+		std::vector< std::vector<unsigned int> > m_vVertexTriangles;
+		std::vector<Quadric> m_vQuadrics;
+		std::vector<double> m_vWeights;
+		std::vector<unsigned int> m_vVersions;
+		std::vector<bool> m_vVertexAlive;
+		std::vector<bool> m_vLocked;
+		std::vector<bool> m_vBorder;
+		// Vertex each one was collapsed into, itself while alive.
+		std::vector<unsigned int> m_vCollapsedInto;
+		std::priority_queue<Collapse> m_qCollapses;
+
+		unsigned int m_nTriangles;
+		float m_fError;
+		// Squared size at which attributes are weighed against
+		// geometric error.
+		double m_fAttributeScale;
+};
+
+// Builds the LOD chain of one mesh and writes each level as
+// its own object. Runs on the worker pool.
+class LodJob : public WorkerTask
+{
+	public:
+		// The geometry is taken from mesh, which is left empty.
+		// header holds the object lines written before the
+		// geometry (transforms and the like).
+		LodJob(const std::string &name, const std::string &objectDir, const std::string &relativeDir,
+			const std::string &header, MeshData &mesh, unsigned int levels, float ratio,
+			StripMode stripMode, unsigned int maxVertices);
+
+		virtual void run();
+
+		struct Level
+		{
+			std::string name;
+			unsigned int triangles;
+			// Indices as a list and as written.
+			size_t listIndices;
+			size_t indices;
+			// Objects the level was split into, see splitMesh.
+			unsigned int parts;
+			float error;
+			// Suggested switch distance, see run().
+			float distance;
+			bool bWritten;
+		};
+
+		std::string m_sName;
+		std::string m_sObjectDir;
+		// Directory as written in the object names.
+		std::string m_sRelativeDir;
+		std::string m_sHeader;
+		unsigned int m_nLevels;
+		float m_fRatio;
+		StripMode m_nStripMode;
+		// Levels above it are split, 0 never splits.
+		unsigned int m_nMaxVertices;
+
+		// Results
+		unsigned int m_nSrcTriangles;
+		std::vector<Level> m_vLevels;
+		double m_fSeconds;
+
+	protected:
+		MeshData m_mesh;
+};
+
+#endif
@@ -0,0 +1,224 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "MeshSplitter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// Orders triangles by their centroid along one axis.
+struct CentroidLess
+{
+	const std::vector<float> *centroids;
+	int axis;
+
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		return (*centroids)[a*3 + axis] < (*centroids)[b*3 + axis];
+	}
+};
+
+class MeshSplitter
+{
+	public:
+		MeshSplitter(const MeshData &data, unsigned int maxVertices);
+
+		void run(std::vector<MeshData> &parts);
+
+	protected:
+		unsigned int countVertices(unsigned int first, unsigned int last);
+		void split(unsigned int first, unsigned int last, std::vector<MeshData> &parts);
+		void makePart(unsigned int first, unsigned int last, MeshData &part);
+
+		const MeshData &m_data;
+		unsigned int m_nMaxVertices;
+		std::vector<float> m_vCentroids;
+		// Triangles, reordered so each part is a range.
+		std::vector<unsigned int> m_vOrder;
+		std::vector<unsigned int> m_vStamp;
+		unsigned int m_nStamp;
+};
+
+MeshSplitter::MeshSplitter(const MeshData &data, unsigned int maxVertices) : m_data(data)
+{
+	m_nMaxVertices = maxVertices < 3 ? 3 : maxVertices;
+	m_vStamp.assign(data.vertexCount(), 0);
+	m_nStamp = 0;
+
+	unsigned int nTris = data.triangleCount();
+	m_vCentroids.resize(nTris * 3);
+	m_vOrder.resize(nTris);
+	for(unsigned int t=0; t<nTris; t++)
+	{
+		m_vOrder[t] = t;
+		for(int c=0; c<3; c++)
+		{
+			m_vCentroids[t*3 + c] = (data.positions[data.indices[t*3]*3 + c]
+				+ data.positions[data.indices[t*3 + 1]*3 + c]
+				+ data.positions[data.indices[t*3 + 2]*3 + c]) / 3.0f;
+		}
+	}
+}
+
+unsigned int MeshSplitter::countVertices(unsigned int first, unsigned int last)
+{
+	m_nStamp++;
+	unsigned int nVerts = 0;
+	for(unsigned int i=first; i<last; i++)
+	{
+		size_t tri = m_vOrder[i]*3;
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_data.indices[tri + k];
+			if(m_vStamp[v] != m_nStamp)
+			{
+				m_vStamp[v] = m_nStamp;
+				nVerts++;
+			}
+		}
+	}
+	return nVerts;
+}
+
+void MeshSplitter::split(unsigned int first, unsigned int last, std::vector<MeshData> &parts)
+{
+	if(last - first <= 1 || countVertices(first, last) <= m_nMaxVertices)
+	{
+		parts.push_back(MeshData());
+		makePart(first, last, parts.back());
+		return;
+	}
+
+	float minC[3], maxC[3];
+	for(int c=0; c<3; c++)
+		minC[c] = maxC[c] = m_vCentroids[m_vOrder[first]*3 + c];
+	for(unsigned int i=first + 1; i<last; i++)
+	{
+		for(int c=0; c<3; c++)
+		{
+			float v = m_vCentroids[m_vOrder[i]*3 + c];
+			if(v < minC[c])
+				minC[c] = v;
+			if(v > maxC[c])
+				maxC[c] = v;
+		}
+	}
+
+	CentroidLess less;
+	less.centroids = &m_vCentroids;
+	less.axis = 0;
+	for(int c=1; c<3; c++)
+	{
+		if(maxC[c] - minC[c] > maxC[less.axis] - minC[less.axis])
+			less.axis = c;
+	}
+
+	unsigned int middle = first + (last - first) / 2;
+	std::nth_element(m_vOrder.begin() + first, m_vOrder.begin() + middle, m_vOrder.begin() + last, less);
+
+	split(first, middle, parts);
+	split(middle, last, parts);
+}
+
+void MeshSplitter::makePart(unsigned int first, unsigned int last, MeshData &part)
+{
+	// Keep the triangles in their original order, it is the
+	// one the vertex cache and strips were built around.
+	std::sort(m_vOrder.begin() + first, m_vOrder.begin() + last);
+
+	std::vector<int> remap(m_data.vertexCount(), -1);
+	part.indices.reset(std::min(m_data.vertexCount(), (last - first) * 3), (last - first) * 3);
+	part.groupName = m_data.groupName;
+	part.materials = m_data.materials;
+	part.uvs.resize(m_data.uvs.size());
+
+	unsigned int nUsed = 0;
+	for(unsigned int i=first; i<last; i++)
+	{
+		size_t tri = m_vOrder[i]*3;
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = m_data.indices[tri + k];
+			if(remap[v] < 0)
+			{
+				remap[v] = nUsed++;
+				part.positions.insert(part.positions.end(), m_data.positions.begin() + v*3, m_data.positions.begin() + v*3 + 3);
+				if(!m_data.normals.empty())
+					part.normals.insert(part.normals.end(), m_data.normals.begin() + v*3, m_data.normals.begin() + v*3 + 3);
+				if(!m_data.colors.empty())
+					part.colors.insert(part.colors.end(), m_data.colors.begin() + v*4, m_data.colors.begin() + v*4 + 4);
+				if(!m_data.tangents.empty())
+					part.tangents.insert(part.tangents.end(), m_data.tangents.begin() + v*4, m_data.tangents.begin() + v*4 + 4);
+				if(!m_data.uvSeams.empty())
+					part.uvSeams.push_back(m_data.uvSeams[v]);
+				for(unsigned int s=0; s<m_data.uvs.size(); s++)
+					part.uvs[s].insert(part.uvs[s].end(), m_data.uvs[s].begin() + v*2, m_data.uvs[s].begin() + v*2 + 2);
+			}
+			part.indices.push_back(remap[v]);
+		}
+	}
+}
+
+void MeshSplitter::run(std::vector<MeshData> &parts)
+{
+	parts.clear();
+	if(m_vOrder.empty())
+		return;
+
+	split(0, (unsigned int)m_vOrder.size(), parts);
+}
+
+void splitMesh(const MeshData &data, unsigned int maxVertices, std::vector<MeshData> &parts)
+{
+	MeshSplitter splitter(data, maxVertices);
+	splitter.run(parts);
+}
+
+bool writeMeshParts(const std::string &objectDir, const std::string &relativeDir, const std::string &name,
+					const std::string &header, const std::vector<MeshData> &parts, StripMode stripMode,
+					size_t &listIndices, size_t &indices)
+{
+	bool bWritten = true;
+	for(unsigned int i=0; i<parts.size(); i++)
+	{
+		std::stringstream s;
+		s<<name;
+		if(i > 0)
+			s<<"_part"<<i;
+		std::string partName = s.str();
+
+		std::string path = objectDir + "/" + partName;
+		std::ofstream osf(path.c_str());
+		osf<<"object( \""<<relativeDir<<"/"<<partName<<"\" )"<<std::endl
+			<<"{"<<std::endl;
+		osf<<header;
+		// Drawn and culled on their own, but they belong to the first part.
+		if(i > 0)
+			osf<<"\tlink( \""<<relativeDir<<"/"<<name<<"\" )"<<std::endl;
+
+		listIndices += parts[i].indices.size();
+		indices += writeMeshData(osf, parts[i], stripMode);
+		osf<<"}";
+
+		if(osf.fail())
+			bWritten = false;
+		osf.close();
+	}
+	return bWritten;
+}
@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MESHSPLITTER_H
+#define MESHSPLITTER_H
+
+#include <string>
+#include <vector>
+#include "MeshData.h"
+#include "TriangleStrip.h"
+
+// Most vertices a part can have so every index fits in 16 bits.
+const unsigned int g_nMaxVertices16 = 65536;
+
+// Cuts the triangles of data into parts of at most maxVertices
+// vertices each. The triangles are halved along the longest
+// side of their bounds until every half fits, so each part is a
+// compact piece of the surface that can be culled on its own.
+// Every part keeps the vertex group and materials of data.
+void splitMesh(const MeshData &data, unsigned int maxVertices, std::vector<MeshData> &parts);
+
+// Writes the first part as <objectDir>/<name> and the others as
+// <name>_part1, <name>_part2... header holds the lines written
+// after the opening brace of each object, the extra parts add a
+// link line naming the first. listIndices and indices add up
+// the indices of the parts as a list and as written.
+bool writeMeshParts(const std::string &objectDir, const std::string &relativeDir, const std::string &name,
+					const std::string &header, const std::vector<MeshData> &parts, StripMode stripMode,
+					size_t &listIndices, size_t &indices);
+
+#endif
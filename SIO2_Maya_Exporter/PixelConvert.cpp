@@ -0,0 +1,487 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "PixelConvert.h"
+
+#include <algorithm>
+#include "SimdConfig.h"
+
+static const unsigned char g_bayer4[4][4] =
+{
+	{0, 8, 2, 10},
+	{12, 4, 14, 6},
+	{3, 11, 1, 9},
+	{15, 7, 13, 5}
+};
+
+bool isPixelKernelAvailable(PixelKernel kernel)
+{
+	switch(kernel)
+	{
+		case PIXEL_KERNEL_SCALAR:
+			return true;
+#ifdef SIO2_USE_SSE2
+		case PIXEL_KERNEL_SSE2:
+			return true;
+#endif
+#ifdef SIO2_USE_AVX2
+		case PIXEL_KERNEL_AVX2:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+PixelKernel bestPixelKernel()
+{
+	if(isPixelKernelAvailable(PIXEL_KERNEL_AVX2))
+		return PIXEL_KERNEL_AVX2;
+	if(isPixelKernelAvailable(PIXEL_KERNEL_SSE2))
+		return PIXEL_KERNEL_SSE2;
+
+	return PIXEL_KERNEL_SCALAR;
+}
+
+const char *pixelKernelName(PixelKernel kernel)
+{
+	switch(kernel)
+	{
+		case PIXEL_KERNEL_SSE2:
+			return "sse2";
+		case PIXEL_KERNEL_AVX2:
+			return "avx2";
+		default:
+			return "scalar";
+	}
+}
+
+bool is16BitFormat(TextureFormat format)
+{
+	return format == TEXTURE_FORMAT_RGB565 || format == TEXTURE_FORMAT_RGBA4444 || format == TEXTURE_FORMAT_RGBA5551;
+}
+
+// Bits kept of R, G, B and A.
+static void getChannelBits(TextureFormat format, int bits[4])
+{
+	static const int bits565[4] = {5, 6, 5, 0};
+	static const int bits4444[4] = {4, 4, 4, 4};
+	static const int bits5551[4] = {5, 5, 5, 1};
+
+	const int *src = format == TEXTURE_FORMAT_RGB565 ? bits565 : (format == TEXTURE_FORMAT_RGBA4444 ? bits4444 : bits5551);
+	for(int c=0; c<4; c++)
+		bits[c] = src[c];
+}
+
+static unsigned int rowStride(unsigned int width)
+{
+	return (width * 2 + 3) & ~3u;
+}
+
+// Truncates each channel to its top bits.
+template <TextureFormat F>
+static inline unsigned int packTexel(const unsigned char *p)
+{
+	if(F == TEXTURE_FORMAT_RGB565)
+		return ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+	if(F == TEXTURE_FORMAT_RGBA4444)
+		return ((p[0] >> 4) << 12) | ((p[1] >> 4) << 8) | ((p[2] >> 4) << 4) | (p[3] >> 4);
+
+	return ((p[0] >> 3) << 11) | ((p[1] >> 3) << 6) | ((p[2] >> 3) << 1) | (p[3] >> 7);
+}
+
+// bias holds the dither offsets of 4 texels, repeated along the row.
+template <TextureFormat F>
+static void packRowScalar(const unsigned char *src, unsigned char *dst, unsigned int x, unsigned int width, const unsigned char bias[16])
+{
+	for(; x<width; x++)
+	{
+		const unsigned char *b = bias + (x & 3) * 4;
+		unsigned char p[4];
+		for(int c=0; c<4; c++)
+		{
+			int v = src[x*4 + c] + b[c];
+			p[c] = (unsigned char)(v > 255 ? 255 : v);
+		}
+
+		unsigned int v = packTexel<F>(p);
+		dst[x*2] = (unsigned char)v;
+		dst[x*2 + 1] = (unsigned char)(v >> 8);
+	}
+}
+
+#ifdef SIO2_USE_SSE2
+// Packs the 4 RGBA texels of p into the low 16 bits of each lane.
+template <TextureFormat F>
+static inline __m128i packTexelsSSE2(__m128i p)
+{
+	__m128i v;
+	if(F == TEXTURE_FORMAT_RGB565)
+	{
+		v = _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8),
+			_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xFC00)), 5)),
+			_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 19));
+	}
+	else if(F == TEXTURE_FORMAT_RGBA4444)
+	{
+		v = _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF0)), 8),
+			_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF000)), 4)),
+			_mm_or_si128(_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF00000)), 16),
+			_mm_srli_epi32(p, 28)));
+	}
+	else
+	{
+		v = _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8),
+			_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF800)), 5)),
+			_mm_or_si128(_mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 18),
+			_mm_srli_epi32(p, 31)));
+	}
+	// Sign extend so the saturating pack keeps all 16 bits.
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+template <TextureFormat F>
+static void packRowSSE2(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char bias[16])
+{
+	__m128i vBias = _mm_loadu_si128((const __m128i *)bias);
+	unsigned int x = 0;
+
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i p0 = _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(src + x * 4)), vBias);
+		__m128i p1 = _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(src + x * 4 + 16)), vBias);
+		_mm_storeu_si128((__m128i *)(dst + x * 2), _mm_packs_epi32(packTexelsSSE2<F>(p0), packTexelsSSE2<F>(p1)));
+	}
+	packRowScalar<F>(src, dst, x, width, bias);
+}
+#endif
+
+#ifdef SIO2_USE_AVX2
+template <TextureFormat F>
+static inline __m256i packTexelsAVX2(__m256i p)
+{
+	__m256i v;
+	if(F == TEXTURE_FORMAT_RGB565)
+	{
+		v = _mm256_or_si256(_mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF8)), 8),
+			_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xFC00)), 5)),
+			_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF80000)), 19));
+	}
+	else if(F == TEXTURE_FORMAT_RGBA4444)
+	{
+		v = _mm256_or_si256(_mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF0)), 8),
+			_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF000)), 4)),
+			_mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF00000)), 16),
+			_mm256_srli_epi32(p, 28)));
+	}
+	else
+	{
+		v = _mm256_or_si256(_mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF8)), 8),
+			_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF800)), 5)),
+			_mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(p, _mm256_set1_epi32(0xF80000)), 18),
+			_mm256_srli_epi32(p, 31)));
+	}
+	return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+template <TextureFormat F>
+static void packRowAVX2(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char bias[16])
+{
+	__m256i vBias = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)bias));
+	unsigned int x = 0;
+
+	for(; x + 16 <= width; x += 16)
+	{
+		__m256i p0 = _mm256_adds_epu8(_mm256_loadu_si256((const __m256i *)(src + x * 4)), vBias);
+		__m256i p1 = _mm256_adds_epu8(_mm256_loadu_si256((const __m256i *)(src + x * 4 + 32)), vBias);
+		// The pack works per 128 bit lane, put the texels back in order.
+		__m256i v = _mm256_packs_epi32(packTexelsAVX2<F>(p0), packTexelsAVX2<F>(p1));
+		_mm256_storeu_si256((__m256i *)(dst + x * 2), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	packRowScalar<F>(src, dst, x, width, bias);
+}
+#endif
+
+template <TextureFormat F>
+static void packOrdered(const TextureImage &img, TextureDither dither, std::vector<unsigned char> &out, PixelKernel kernel)
+{
+	int bits[4];
+	getChannelBits(F, bits);
+	unsigned int stride = rowStride(img.width);
+
+	for(unsigned int y=0; y<img.height; y++)
+	{
+		// Offsets below one step of each channel, a single
+		// bit of alpha is thresholded instead.
+		unsigned char bias[16];
+		for(int k=0; k<4; k++)
+		{
+			for(int c=0; c<4; c++)
+			{
+				int step = bits[c] > 1 ? 256 >> bits[c] : 0;
+				bias[k*4 + c] = (unsigned char)(dither == TEXTURE_DITHER_ORDERED ? g_bayer4[y & 3][k] * step / 16 : 0);
+			}
+		}
+
+		const unsigned char *src = &img.pixels[(size_t)y * img.width * 4];
+		unsigned char *dst = &out[(size_t)y * stride];
+
+		switch(kernel)
+		{
+#ifdef SIO2_USE_AVX2
+			case PIXEL_KERNEL_AVX2:
+				packRowAVX2<F>(src, dst, img.width, bias);
+				break;
+#endif
+#ifdef SIO2_USE_SSE2
+			case PIXEL_KERNEL_SSE2:
+				packRowSSE2<F>(src, dst, img.width, bias);
+				break;
+#endif
+			default:
+				packRowScalar<F>(src, dst, 0, img.width, bias);
+				break;
+		}
+	}
+}
+
+static unsigned int packQuantized(const int q[4], TextureFormat format)
+{
+	if(format == TEXTURE_FORMAT_RGB565)
+		return (q[0] << 11) | (q[1] << 5) | q[2];
+	if(format == TEXTURE_FORMAT_RGBA4444)
+		return (q[0] << 12) | (q[1] << 8) | (q[2] << 4) | q[3];
+
+	return (q[0] << 11) | (q[1] << 6) | (q[2] << 1) | q[3];
+}
+
+// Floyd-Steinberg, alternating the direction of the rows.
+static void packDiffusion(const TextureImage &img, TextureFormat format, std::vector<unsigned char> &out)
+{
+	int bits[4];
+	getChannelBits(format, bits);
+	unsigned int width = img.width;
+	unsigned int stride = rowStride(width);
+
+	// Error carried to this row and the next in 1/16ths, with
+	// a texel of margin on each side.
+	std::vector<int> errCur((width + 2) * 4, 0);
+	std::vector<int> errNext((width + 2) * 4, 0);
+
+	// Nearest level of each 8 bit value and the value the
+	// GPU expands each level back to.
+	unsigned char quant[4][256];
+	int recon[4][256];
+	for(int c=0; c<4; c++)
+	{
+		int maxQ = bits[c] > 0 ? (1 << bits[c]) - 1 : 1;
+		for(int v=0; v<256; v++)
+		{
+			quant[c][v] = (unsigned char)((v * maxQ + 127) / 255);
+			recon[c][v] = v <= maxQ ? (v * 255 + maxQ / 2) / maxQ : 255;
+		}
+	}
+
+	for(unsigned int y=0; y<img.height; y++)
+	{
+		int dir = (y & 1) ? -1 : 1;
+		std::fill(errNext.begin(), errNext.end(), 0);
+
+		const unsigned char *src = &img.pixels[(size_t)y * width * 4];
+		unsigned char *dst = &out[(size_t)y * stride];
+
+		for(unsigned int i=0; i<width; i++)
+		{
+			unsigned int x = dir > 0 ? i : width - 1 - i;
+			int q[4];
+
+			for(int c=0; c<4; c++)
+			{
+				if(bits[c] <= 1)
+				{
+					q[c] = bits[c] ? src[x*4 + c] >> 7 : 0;
+					continue;
+				}
+
+				int e = errCur[(x + 1) * 4 + c];
+				int v = src[x*4 + c] + (e >= 0 ? (e + 8) / 16 : -((8 - e) / 16));
+				v = v < 0 ? 0 : (v > 255 ? 255 : v);
+
+				q[c] = quant[c][v];
+				int err = v - recon[c][q[c]];
+
+				errCur[(x + 1 + dir) * 4 + c] += err * 7;
+				errNext[(x + 1 - dir) * 4 + c] += err * 3;
+				errNext[(x + 1) * 4 + c] += err * 5;
+				errNext[(x + 1 + dir) * 4 + c] += err;
+			}
+
+			unsigned int v = packQuantized(q, format);
+			dst[x*2] = (unsigned char)v;
+			dst[x*2 + 1] = (unsigned char)(v >> 8);
+		}
+		errCur.swap(errNext);
+	}
+}
+
+void convertPixels16(const TextureImage &img, TextureFormat format, TextureDither dither,
+					 std::vector<unsigned char> &out, PixelKernel kernel)
+{
+	out.assign((size_t)rowStride(img.width) * img.height, 0);
+	if(img.pixels.empty())
+		return;
+
+	if(!isPixelKernelAvailable(kernel))
+		kernel = PIXEL_KERNEL_SCALAR;
+
+	if(dither == TEXTURE_DITHER_DIFFUSION)
+	{
+		packDiffusion(img, format, out);
+		return;
+	}
+
+	switch(format)
+	{
+		case TEXTURE_FORMAT_RGB565:
+			packOrdered<TEXTURE_FORMAT_RGB565>(img, dither, out, kernel);
+			break;
+		case TEXTURE_FORMAT_RGBA4444:
+			packOrdered<TEXTURE_FORMAT_RGBA4444>(img, dither, out, kernel);
+			break;
+		default:
+			packOrdered<TEXTURE_FORMAT_RGBA5551>(img, dither, out, kernel);
+			break;
+	}
+}
+
+void expandPixels16(const std::vector<unsigned char> &data, unsigned int width, unsigned int height,
+					TextureFormat format, TextureImage &out)
+{
+	int bits[4];
+	getChannelBits(format, bits);
+	unsigned int stride = rowStride(width);
+
+	out.width = width;
+	out.height = height;
+	out.pixels.resize((size_t)width * height * 4);
+
+	for(unsigned int y=0; y<height; y++)
+	{
+		for(unsigned int x=0; x<width; x++)
+		{
+			const unsigned char *src = &data[(size_t)y * stride + x * 2];
+			unsigned int v = src[0] | (src[1] << 8);
+			unsigned char *dst = &out.pixels[((size_t)y * width + x) * 4];
+
+			// Channels from the top bits down.
+			int shift = 16;
+			for(int c=0; c<4; c++)
+			{
+				if(bits[c] == 0)
+				{
+					dst[c] = 255;
+					continue;
+				}
+
+				shift -= bits[c];
+				int maxQ = (1 << bits[c]) - 1;
+				int q = (v >> shift) & maxQ;
+				dst[c] = (unsigned char)((q * 255 + maxQ / 2) / maxQ);
+			}
+		}
+	}
+}
+
+void getPixels16GLFormat(TextureFormat format, unsigned int &internalFormat, unsigned int &baseFormat, unsigned int &type)
+{
+	switch(format)
+	{
+		case TEXTURE_FORMAT_RGB565:
+			// GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5
+			internalFormat = 0x8D62;
+			baseFormat = 0x1907;
+			type = 0x8363;
+			break;
+		case TEXTURE_FORMAT_RGBA4444:
+			// GL_RGBA4, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4
+			internalFormat = 0x8056;
+			baseFormat = 0x1908;
+			type = 0x8033;
+			break;
+		default:
+			// GL_RGB5_A1, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1
+			internalFormat = 0x8057;
+			baseFormat = 0x1908;
+			type = 0x8034;
+			break;
+	}
+}
+
+void benchmarkPixelKernels(unsigned int size, unsigned int repeats, std::vector<PixelBenchmarkResult> &results)
+{
+	// Gradients with some texel to texel noise, like a lightmap.
+	TextureImage img;
+	img.width = size;
+	img.height = size;
+	img.pixels.resize((size_t)size * size * 4);
+	unsigned int seed = 1;
+	for(size_t i=0; i<img.pixels.size(); i+=4)
+	{
+		unsigned int x = (unsigned int)(i / 4) % size;
+		unsigned int y = (unsigned int)(i / 4) / size;
+		seed = seed * 1103515245 + 12345;
+		img.pixels[i] = (unsigned char)(x * 255 / size);
+		img.pixels[i + 1] = (unsigned char)(y * 255 / size);
+		img.pixels[i + 2] = (unsigned char)((x + y) * 127 / size + ((seed >> 16) & 7));
+		img.pixels[i + 3] = (unsigned char)(255 - x * 255 / size);
+	}
+
+	const TextureFormat formats[3] = { TEXTURE_FORMAT_RGB565, TEXTURE_FORMAT_RGBA4444, TEXTURE_FORMAT_RGBA5551 };
+	const TextureDither dithers[3] = { TEXTURE_DITHER_NONE, TEXTURE_DITHER_ORDERED, TEXTURE_DITHER_DIFFUSION };
+	const char *ditherNames[3] = { "none", "ordered", "diffusion" };
+	const PixelKernel kernels[3] = { PIXEL_KERNEL_SCALAR, PIXEL_KERNEL_SSE2, PIXEL_KERNEL_AVX2 };
+
+	std::vector<unsigned char> out;
+	for(int f=0; f<3; f++)
+	{
+		for(int d=0; d<3; d++)
+		{
+			for(int k=0; k<3; k++)
+			{
+				if(!isPixelKernelAvailable(kernels[k]) || (dithers[d] == TEXTURE_DITHER_DIFFUSION && kernels[k] != PIXEL_KERNEL_SCALAR))
+					continue;
+
+				double fStart = getTimeSeconds();
+				for(unsigned int r=0; r<repeats; r++)
+					convertPixels16(img, formats[f], dithers[d], out, kernels[k]);
+				double fSeconds = getTimeSeconds() - fStart;
+
+				PixelBenchmarkResult result;
+				result.name = std::string(textureFormatName(formats[f])) + " " + ditherNames[d] + " " + pixelKernelName(kernels[k]);
+				result.megaPixelsPerSecond = fSeconds > 0 ? (double)size * size * repeats / fSeconds / 1000000.0 : 0;
+				results.push_back(result);
+			}
+		}
+	}
+}
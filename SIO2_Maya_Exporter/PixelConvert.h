@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef PIXELCONVERT_H
+#define PIXELCONVERT_H
+
+#include <string>
+#include <vector>
+#include "TextureProcessor.h"
+
+// Code paths of the 16 bit packers. Which ones exist depends
+// on what the compiler targets, they all give the same output.
+enum PixelKernel
+{
+	PIXEL_KERNEL_SCALAR,
+	PIXEL_KERNEL_SSE2,
+	PIXEL_KERNEL_AVX2
+};
+
+bool isPixelKernelAvailable(PixelKernel kernel);
+PixelKernel bestPixelKernel();
+const char *pixelKernelName(PixelKernel kernel);
+
+bool is16BitFormat(TextureFormat format);
+
+// Packs to RGB565, RGBA4444 or RGBA5551, 2 bytes a texel in
+// little endian order with rows padded to 4 bytes as KTX
+// expects. Error diffusion walks the rows in order and always
+// runs on the scalar path.
+void convertPixels16(const TextureImage &img, TextureFormat format, TextureDither dither,
+					 std::vector<unsigned char> &out, PixelKernel kernel);
+
+// Back to 8 bit RGBA, to measure the loss.
+void expandPixels16(const std::vector<unsigned char> &data, unsigned int width, unsigned int height,
+					TextureFormat format, TextureImage &out);
+
+// Sized internal format, base format and packed type for the KTX header.
+void getPixels16GLFormat(TextureFormat format, unsigned int &internalFormat, unsigned int &baseFormat, unsigned int &type);
+
+struct PixelBenchmarkResult
+{
+	std::string name;
+	double megaPixelsPerSecond;
+};
+
+// Times every format, dither and available kernel on a
+// size x size image converted repeats times.
+void benchmarkPixelKernels(unsigned int size, unsigned int repeats, std::vector<PixelBenchmarkResult> &results);
+
+#endif
@@ -64,6 +64,10 @@
 #include <maya/MArgDatabase.h>
 #include <maya/MFileIO.h>
 
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+
 #include "SIO2_ExporterCmd.h"
 
 
@@ -98,6 +102,87 @@ const char * g_cBlendShapeLongFlag = "-blendShape";
 const char * g_cBackFaceCullingFlag = "-bf"; 
 const char * g_cBackFaceCullingLongFlag = "-convert2BFC";
 
+const char * g_cAnimMemoryFlag = "-am";
+const char * g_cAnimMemoryLongFlag = "-animMemMB";
+
+const char * g_cInstanceFlag = "-i";
+const char * g_cInstanceLongFlag = "-instance";
+
+const char * g_cMergeMaterialsFlag = "-mm";
+const char * g_cMergeMaterialsLongFlag = "-mergeMaterials";
+
+const char * g_cTextureProcessFlag = "-tp";
+const char * g_cTextureProcessLongFlag = "-textureProcess";
+
+const char * g_cTextureMaxFlag = "-tm";
+const char * g_cTextureMaxLongFlag = "-textureMax";
+
+const char * g_cThreadsFlag = "-th";
+const char * g_cThreadsLongFlag = "-threads";
+
+const char * g_cAtlasFlag = "-at";
+const char * g_cAtlasLongFlag = "-atlasSize";
+
+const char * g_cTextureCompressFlag = "-tc";
+const char * g_cTextureCompressLongFlag = "-textureCompress";
+
+const char * g_cTextureRuleFlag = "-tcr";
+const char * g_cTextureRuleLongFlag = "-textureCompressRule";
+
+const char * g_cTextureQualityFlag = "-tq";
+const char * g_cTextureQualityLongFlag = "-textureQuality";
+
+const char * g_cTextureDitherFlag = "-td";
+const char * g_cTextureDitherLongFlag = "-textureDither";
+
+const char * g_cTextureBenchmarkFlag = "-tb";
+const char * g_cTextureBenchmarkLongFlag = "-textureBenchmark";
+
+const char * g_cLodLevelsFlag = "-lod";
+const char * g_cLodLevelsLongFlag = "-lodLevels";
+
+const char * g_cLodRatioFlag = "-lr";
+const char * g_cLodRatioLongFlag = "-lodRatio";
+
+const char * g_cStripFlag = "-ts";
+const char * g_cStripLongFlag = "-triangleStrips";
+
+const char * g_cSplitVerticesFlag = "-sv";
+const char * g_cSplitVerticesLongFlag = "-splitVertices";
+
+const char * g_cStaticBatchFlag = "-sb";
+const char * g_cStaticBatchLongFlag = "-staticBatch";
+
+const char * g_cTraceFlag = "-tr";
+const char * g_cTraceLongFlag = "-trace";
+
+const char * g_cSummaryFlag = "-sum";
+const char * g_cSummaryLongFlag = "-summary";
+
+const char * g_cResumeFlag = "-rs";
+const char * g_cResumeLongFlag = "-resume";
+
+const char * g_cWatchFlag = "-w";
+const char * g_cWatchLongFlag = "-watch";
+
+const char * g_cWatchDelayFlag = "-wd";
+const char * g_cWatchDelayLongFlag = "-watchDelay";
+
+const char * g_cStopWatchFlag = "-sw";
+const char * g_cStopWatchLongFlag = "-stopWatch";
+
+const char * g_cWatchUpdateFlag = "-wu";
+const char * g_cWatchUpdateLongFlag = "-watchUpdate";
+
+const char * g_cHierarchyFlag = "-hi";
+const char * g_cHierarchyLongFlag = "-hierarchy";
+
+const char * g_cFrameNormalsFlag = "-fn";
+const char * g_cFrameNormalsLongFlag = "-frameNormals";
+
+const char * g_cTangentsFlag = "-tan";
+const char * g_cTangentsLongFlag = "-tangents";
+
 
 const char * g_cHelpText = 
 "\nSIO SDK Version: 1.3.5 \
@@ -111,6 +196,95 @@ export the vertex position for each frame untill it reaches the end playback ran
 want to export blend shape nicely use the -bs flag.\
 Note: If you do not have keyframes when you export using -bs, nothing \
 will be exported. \
+\n\nNormals are taken from the faces around each vertex, a vertex on a \
+hard edge is written once for each side of it. Use -frameNormals to also \
+write the normals of each baked animation frame as fnor lines after its \
+fvert lines, three numbers from -127 to 127 per vertex. \
+\n\nUse -tangents to write a vtan( x y z w ) line per vertex of the meshes \
+with UVs, for normal maps. The tangent follows U of the first UV set and \
+w is the sign of the bitangent, the vbo_offset line gets a sixth value \
+with the offset of the tangents. A vertex is only written twice where \
+the tangents of its faces disagree, as on a mirrored UV seam. The \
+tangents are computed on the worker threads. \
+\n\nUse -animMemMB to set how many MB of baked animation frames are kept \
+in memory (default 256). Frames above it are spilled to temporary files \
+next to the scene folder and merged into the objects at the end. \
+\n\nUse -instance to write static meshes with the same geometry and \
+materials only once. The copies are exported with their own transforms \
+and an instname pointing to the first one. \
+\n\nUse -mergeMaterials to write materials with the same colours and \
+textures only once, objects reference the first one through mname. \
+\n\nUse -textureProcess to resize textures to a power of two no bigger \
+than -textureMax (default 1024) and write them with their mipmaps as .tga \
+files. This runs on -threads worker threads (default one per processor) \
+while the rest of the scene is exported. \
+\n\nUse -atlasSize to pack the colour textures of materials that can \
+share one into atlases of that size. The UVs of the meshes using them \
+and the material tname0 are rewritten to point into the atlas. \
+Each texture is surrounded by a copy of its border, 2 to 32 texels \
+growing with the smallest texture packed, which keeps the textures \
+apart in the mipmaps down to the level where that texture is about 16 \
+texels wide. Smaller levels may mix neighbouring textures. \
+\n\nUse -textureCompress etc1, etc2 or etc (etc1 for opaque textures, \
+etc2 for the rest) to write textures as compressed .ktx files with their \
+mipmaps. -textureCompressRule \"*_ui*=tga;*_n.*=etc1\" picks the format \
+by file name, and a string sio2Compress attribute on a material sets it \
+for its textures. -textureQuality fast, normal or high trades export \
+time for quality, the PSNR of each texture is shown with -verbose. \
+\n\nThe 16 bit formats rgb565, rgba4444 and rgba5551 are also written \
+as .ktx files. -textureDither none, ordered (default) or diffusion sets \
+how they are dithered, a rule or sio2Compress can add it to the format \
+as in rgba4444:diffusion. -textureBenchmark prints the speed of each \
+conversion kernel and exports nothing. \
+\n\nUse -lodLevels to write that many simplified copies of each static \
+mesh as <name>_lod1, <name>_lod2... Each keeps -lodRatio (default 0.5) of \
+the triangles of the one before, UV and normal seams are left in place. \
+A lod line names the full object and the distance the level can take \
+over at, the triangles and error of each level are shown with -verbose. \
+\n\nUse -triangleStrips degenerate or restart to write the indices of each \
+vertex group as triangle strips (n_sind and sind) instead of a list. \
+degenerate joins the strips with empty triangles, restart separates them \
+with a strip_restart index of 65535. A group that has a vertex 65535, \
+an unsplit mesh with -splitVertices 0, falls back to degenerate strips. \
+The index count of both is shown. \
+\n\nStatic meshes with more than -splitVertices vertices (default 65536, \
+the most 16 bit indices can reach, 0 disables it) are cut into compact \
+pieces written as <name>, <name>_part1... The extra parts have a link \
+line naming the first one. Animated and skinned meshes are not split. \
+\n\nUse -staticBatch <cell size> to merge static meshes with the same \
+materials into batchN_<material> objects in world space, one draw call \
+each. Meshes are only merged with the ones whose centre is in the same \
+cell of a grid that size, and a batch never goes over the vertex limit. \
+Batched meshes are not instanced and get no LODs. \
+\n\nObjects, cameras and lamps are written in world space, with the \
+transforms of every group above them applied. Use -hierarchy to keep \
+the hierarchy instead: an object below another one is written relative \
+to it with a parent line naming it. Groups without a mesh are still \
+folded into their children, and cameras and lamps stay in world space. \
+-staticBatch is ignored with -hierarchy. \
+\n\nUse -trace <file> to write how long each stage, mesh, write call and \
+animation frame took as a Chrome trace, open it in chrome://tracing. \
+\n\nUse -summary <file> to write what was exported as JSON: counts of \
+objects, instances, batches, splits, LODs, textures and indices, and the \
+peak memory of each stage (extraction, points, indices, uvs, animation, \
+textures, batches, lods, instances) and of each mesh. -verbose prints the memory. \
+\n\nThe export can be cancelled with Esc. Every object and processed \
+texture written is listed in <scene name>.journal next to the scene \
+folder, use -resume to export into the same folder again skipping them. \
+Materials, cameras and lamps are always written again. The journal is \
+deleted once an export finishes. \
+\n\nUse -selection to export only the selected transforms, meshes, \
+cameras, lamps, materials and textures into the scene folder, leaving \
+the files already there. Everything they need is added: the materials \
+of the meshes, the file textures of the materials and the targets of \
+their blend shapes. Its journal is <scene name>.selection.journal. \
+\n\nUse -watch to keep the export up to date while you work. After the \
+export, the cameras, lamps, meshes, materials and textures that change \
+are written again once the scene has been left alone for -watchDelay \
+seconds (default 0.3), and the files of deleted or renamed ones are \
+removed. A change that affects other objects, such as a mesh with \
+-instance or -staticBatch or a material with -mergeMaterials or \
+-atlasSize, exports the whole scene again. -stopWatch ends it. \
 \n\nMake sure the the version number \
 at the end of the exporter's name matches the version of the \
 SDK being used for maximun compatibility.\
@@ -140,6 +314,19 @@ const char * g_cScriptDir = "script";
 // Project Specific, Face UV mapping should not exceed this separation.
 const float g_fUVMaxSep = 0.15;
 
+// Face vertex normals closer than this (cosine of the angle
+// between them) share a vertex, anything further is a hard edge.
+const float g_fHardEdgeCos = 0.9999f;
+
+// Corner tangents closer than this (cosine, 45 degrees) share a
+// vertex. They vary with the UV layout across a smooth surface,
+// only turned or mirrored UV seams should split it.
+const float g_fTangentSplitCos = 0.7071f;
+
+// Meshes whose values differ by less than this are considered
+// the same geometry when instancing. Matches PRECISION.
+const float g_fInstanceTolerance = 0.001f;
+
 std::string g_sDestDir = "C:/temp/";
 std::string g_sSceneDir;	
 std::string g_sSceneDirName = "TempScene";	
@@ -170,6 +357,33 @@ MStatus SIO2_ExporterCmd::doIt( const MArgList& args )
 	bool bDestSet = false, bSceneSet= false, bAnimRateSet = false; 
 	m_bConvert2BackFaceCulling = false;
 	m_bCorrectUVs = false;
+	m_nAnimMemMB = 256;
+	m_bUseInstancing = false;
+	m_bMergeMaterials = false;
+	m_bProcessTextures = false;
+	m_nTextureMaxSize = 1024;
+	m_nThreads = 0;
+	m_nAtlasSize = 0;
+	m_textureEncoding = TextureEncoding();
+	m_nTextureQuality = TEXTURE_QUALITY_NORMAL;
+	m_vTextureRules.clear();
+	m_nLodLevels = 0;
+	m_fLodRatio = 0.5;
+	m_nStripMode = STRIP_NONE;
+	m_nSplitVertices = g_nMaxVertices16;
+	m_fBatchCellSize = 0;
+	m_bHierarchy = false;
+	m_bFrameNormals = false;
+	m_bTangents = false;
+	m_sTraceFile.clear();
+	m_sSummaryFile.clear();
+	m_bResume = false;
+	m_bWatch = false;
+	m_bWatchUpdate = false;
+	m_fWatchDelay = 0.3;
+	m_nSceneStage = -1;
+	m_nAnimStage = -1;
+	m_nFinishStage = -1;
 	MString msSecneName;
 
 	if(argData.isFlagSet(g_cHelpFlag))
@@ -182,6 +396,12 @@ MStatus SIO2_ExporterCmd::doIt( const MArgList& args )
 		setResult(g_cCreditText);
 		return MS::kSuccess;
 	}
+	if(argData.isFlagSet(g_cStopWatchFlag))
+	{
+		SceneWatcher::instance().stop();
+		MGlobal::displayInfo("Stopped watching the scene.");
+		return MS::kSuccess;
+	}
 
 	// Check if SELECTION ONLY flag has been
 	// set. Export only selected items.
@@ -237,6 +457,193 @@ MStatus SIO2_ExporterCmd::doIt( const MArgList& args )
 		m_bConvert2BackFaceCulling = true;
 		MGlobal::displayInfo("Flag Set");
 	}
+
+	if(argData.isFlagSet(g_cInstanceFlag))
+		m_bUseInstancing = true;
+
+	if(argData.isFlagSet(g_cMergeMaterialsFlag))
+		m_bMergeMaterials = true;
+
+	if(argData.isFlagSet(g_cTextureProcessFlag))
+		m_bProcessTextures = true;
+
+	if(argData.isFlagSet(g_cTextureMaxFlag))
+	{
+		argData.getFlagArgument(g_cTextureMaxFlag, 0, m_nTextureMaxSize);
+		if(m_nTextureMaxSize < 1)
+			m_nTextureMaxSize = 1;
+	}
+
+	if(argData.isFlagSet(g_cAtlasFlag))
+	{
+		argData.getFlagArgument(g_cAtlasFlag, 0, m_nAtlasSize);
+		if(m_nAtlasSize > 0 && !isPowerOfTwo(m_nAtlasSize))
+		{
+			m_nAtlasSize = nearestPowerOfTwo(m_nAtlasSize, m_nAtlasSize * 2);
+			MGlobal::displayWarning(MString("Atlas size is not a power of two, using: ") + m_nAtlasSize);
+		}
+	}
+
+	if(argData.isFlagSet(g_cTextureBenchmarkFlag))
+	{
+		std::vector<PixelBenchmarkResult> results;
+		benchmarkPixelKernels(1024, 10, results);
+		for(unsigned int i=0; i<results.size(); i++)
+		{
+			MGlobal::displayInfo(MString(results[i].name.c_str()) + MString(" (MP/s): ") + results[i].megaPixelsPerSecond);
+		}
+		return MS::kSuccess;
+	}
+
+	// Before the rules, which default to it.
+	if(argData.isFlagSet(g_cTextureDitherFlag))
+	{
+		MString dither;
+		argData.getFlagArgument(g_cTextureDitherFlag, 0, dither);
+		if(!parseTextureDither(dither.asChar(), m_textureEncoding.dither))
+		{
+			MGlobal::displayError(MString("Unknown texture dither: ") + dither);
+			return MS::kFailure;
+		}
+	}
+
+	if(argData.isFlagSet(g_cTextureCompressFlag))
+	{
+		MString format;
+		argData.getFlagArgument(g_cTextureCompressFlag, 0, format);
+		if(!parseTextureEncoding(format.asChar(), m_textureEncoding))
+		{
+			MGlobal::displayError(MString("Unknown texture format: ") + format);
+			return MS::kFailure;
+		}
+	}
+
+	if(argData.isFlagSet(g_cTextureRuleFlag))
+	{
+		MString rules;
+		argData.getFlagArgument(g_cTextureRuleFlag, 0, rules);
+		if(parseTextureRules(rules.asChar()) != MS::kSuccess)
+			return MS::kFailure;
+	}
+
+	if(argData.isFlagSet(g_cTextureQualityFlag))
+	{
+		MString quality;
+		argData.getFlagArgument(g_cTextureQualityFlag, 0, quality);
+		if(!parseTextureQuality(quality.asChar(), m_nTextureQuality))
+		{
+			MGlobal::displayError(MString("Unknown texture quality: ") + quality);
+			return MS::kFailure;
+		}
+	}
+
+	if(argData.isFlagSet(g_cThreadsFlag))
+	{
+		argData.getFlagArgument(g_cThreadsFlag, 0, m_nThreads);
+		if(m_nThreads < 0)
+			m_nThreads = 0;
+	}
+
+	if(argData.isFlagSet(g_cLodLevelsFlag))
+	{
+		argData.getFlagArgument(g_cLodLevelsFlag, 0, m_nLodLevels);
+		if(m_nLodLevels < 0)
+			m_nLodLevels = 0;
+	}
+
+	if(argData.isFlagSet(g_cLodRatioFlag))
+	{
+		argData.getFlagArgument(g_cLodRatioFlag, 0, m_fLodRatio);
+		if(m_fLodRatio <= 0 || m_fLodRatio >= 1)
+		{
+			MGlobal::displayError(MString("The LOD ratio must be between 0 and 1: ") + m_fLodRatio);
+			return MS::kFailure;
+		}
+	}
+
+	if(argData.isFlagSet(g_cStripFlag))
+	{
+		MString mode;
+		argData.getFlagArgument(g_cStripFlag, 0, mode);
+		if(!parseStripMode(mode.asChar(), m_nStripMode))
+		{
+			MGlobal::displayError(MString("Unknown triangle strip mode: ") + mode);
+			return MS::kFailure;
+		}
+	}
+
+	if(argData.isFlagSet(g_cSplitVerticesFlag))
+	{
+		argData.getFlagArgument(g_cSplitVerticesFlag, 0, m_nSplitVertices);
+		if(m_nSplitVertices < 0)
+			m_nSplitVertices = 0;
+		else if(m_nSplitVertices > 0 && m_nSplitVertices < 3)
+			m_nSplitVertices = 3;
+	}
+
+	// The restart index itself can not name a vertex.
+	if(m_nStripMode == STRIP_RESTART && m_nSplitVertices > (int)g_nStripRestartIndex)
+		m_nSplitVertices = g_nStripRestartIndex;
+
+	if(argData.isFlagSet(g_cStaticBatchFlag))
+	{
+		argData.getFlagArgument(g_cStaticBatchFlag, 0, m_fBatchCellSize);
+		if(m_fBatchCellSize < 0)
+			m_fBatchCellSize = 0;
+	}
+
+	if(argData.isFlagSet(g_cHierarchyFlag))
+		m_bHierarchy = true;
+
+	if(argData.isFlagSet(g_cFrameNormalsFlag))
+		m_bFrameNormals = true;
+
+	if(argData.isFlagSet(g_cTangentsFlag))
+		m_bTangents = true;
+
+	// Batches are in world space, nothing can be below them.
+	if(m_bHierarchy && m_fBatchCellSize > 0)
+	{
+		MGlobal::displayWarning("-staticBatch is ignored with -hierarchy.");
+		m_fBatchCellSize = 0;
+	}
+
+	if(argData.isFlagSet(g_cTraceFlag))
+	{
+		MString traceFile;
+		argData.getFlagArgument(g_cTraceFlag, 0, traceFile);
+		m_sTraceFile = traceFile.asChar();
+	}
+
+	if(argData.isFlagSet(g_cSummaryFlag))
+	{
+		MString summaryFile;
+		argData.getFlagArgument(g_cSummaryFlag, 0, summaryFile);
+		m_sSummaryFile = summaryFile.asChar();
+	}
+
+	if(argData.isFlagSet(g_cResumeFlag))
+		m_bResume = true;
+
+	if(argData.isFlagSet(g_cWatchFlag))
+		m_bWatch = true;
+
+	if(argData.isFlagSet(g_cWatchUpdateFlag))
+		m_bWatchUpdate = true;
+
+	if(argData.isFlagSet(g_cWatchDelayFlag))
+	{
+		argData.getFlagArgument(g_cWatchDelayFlag, 0, m_fWatchDelay);
+		if(m_fWatchDelay < 0)
+			m_fWatchDelay = 0;
+	}
+
+	if(argData.isFlagSet(g_cAnimMemoryFlag))
+	{
+		argData.getFlagArgument(g_cAnimMemoryFlag, 0, m_nAnimMemMB);
+		if(m_nAnimMemMB < 1)
+			m_nAnimMemMB = 1;
+	}
 	
 	//if(m_bVerbose)
 	{
@@ -263,10 +670,59 @@ MStatus SIO2_ExporterCmd::doIt( const MArgList& args )
 	if(stat == MStatus::kFailure)
 		return stat;
 
-	if(m_bExportSelection)
-		stat = exportSelection();
+	if(m_sTraceFile.length() > 0)
+		traceBegin();
+
+	memoryAccount().reset();
+	double fStart = getTimeSeconds();
+
+	// Batch mode has no progress window, the export then
+	// cannot be cancelled. Watch updates are too short for one.
+	m_progress.reset();
+	bool bProgressWindow = !m_bWatchUpdate && MProgressWindow::reserve();
+	if(bProgressWindow)
+	{
+		MProgressWindow::setTitle("SIO2 Export");
+		MProgressWindow::setInterruptable(true);
+		MProgressWindow::setProgressRange(0, 100);
+		MProgressWindow::setProgress(0);
+		MProgressWindow::startProgress();
+		m_progress.setCallback(progressCallback, NULL, 0.25);
+	}
 	else
-		stat = exportAll();
+	{
+		m_progress.setCallback(NULL, NULL, 0);
+	}
+
+	{
+		SIO2_TRACE("doIt");
+		if(m_bWatchUpdate)
+			stat = exportWatchChanges();
+		else if(m_bExportSelection)
+			stat = exportSelection();
+		else
+			stat = exportAll();
+	}
+
+	if(m_bWatch && stat == MS::kSuccess)
+		startWatching(args);
+
+	if(bProgressWindow)
+		MProgressWindow::endProgress();
+
+	reportMemory();
+	if(m_sSummaryFile.length() > 0)
+		writeExportSummary(m_sSummaryFile, getTimeSeconds() - fStart);
+	m_scratch.release();
+
+	if(m_sTraceFile.length() > 0)
+	{
+		int nEvents = traceEnd(m_sTraceFile);
+		if(nEvents < 0)
+			MGlobal::displayError(MString("Failed to write trace: ") + m_sTraceFile.c_str());
+		else
+			MGlobal::displayInfo(MString("Trace: ") + m_sTraceFile.c_str() + MString(" events: ") + nEvents);
+	}
 
 
 	MGlobal::displayInfo("SIO2_Exporter command executed!\n");
@@ -287,6 +743,33 @@ MSyntax SIO2_ExporterCmd::pluginSyntax()
 	syntax.addFlag(g_cSceneNameFlag, g_cSceneNameLongFlag, MSyntax::kString);
 	syntax.addFlag(g_cBlendShapeFlag, g_cBlendShapeLongFlag);
 	syntax.addFlag(g_cBackFaceCullingFlag, g_cBackFaceCullingLongFlag);
+	syntax.addFlag(g_cAnimMemoryFlag, g_cAnimMemoryLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cInstanceFlag, g_cInstanceLongFlag);
+	syntax.addFlag(g_cMergeMaterialsFlag, g_cMergeMaterialsLongFlag);
+	syntax.addFlag(g_cTextureProcessFlag, g_cTextureProcessLongFlag);
+	syntax.addFlag(g_cTextureMaxFlag, g_cTextureMaxLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cThreadsFlag, g_cThreadsLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cAtlasFlag, g_cAtlasLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cTextureCompressFlag, g_cTextureCompressLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cTextureRuleFlag, g_cTextureRuleLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cTextureQualityFlag, g_cTextureQualityLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cTextureDitherFlag, g_cTextureDitherLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cTextureBenchmarkFlag, g_cTextureBenchmarkLongFlag);
+	syntax.addFlag(g_cLodLevelsFlag, g_cLodLevelsLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cLodRatioFlag, g_cLodRatioLongFlag, MSyntax::kDouble);
+	syntax.addFlag(g_cStripFlag, g_cStripLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cSplitVerticesFlag, g_cSplitVerticesLongFlag, MSyntax::kLong);
+	syntax.addFlag(g_cStaticBatchFlag, g_cStaticBatchLongFlag, MSyntax::kDouble);
+	syntax.addFlag(g_cTraceFlag, g_cTraceLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cSummaryFlag, g_cSummaryLongFlag, MSyntax::kString);
+	syntax.addFlag(g_cResumeFlag, g_cResumeLongFlag);
+	syntax.addFlag(g_cWatchFlag, g_cWatchLongFlag);
+	syntax.addFlag(g_cWatchDelayFlag, g_cWatchDelayLongFlag, MSyntax::kDouble);
+	syntax.addFlag(g_cStopWatchFlag, g_cStopWatchLongFlag);
+	syntax.addFlag(g_cWatchUpdateFlag, g_cWatchUpdateLongFlag);
+	syntax.addFlag(g_cHierarchyFlag, g_cHierarchyLongFlag);
+	syntax.addFlag(g_cFrameNormalsFlag, g_cFrameNormalsLongFlag);
+	syntax.addFlag(g_cTangentsFlag, g_cTangentsLongFlag);
 	return syntax;
 }
 
@@ -325,6 +808,9 @@ MStatus uninitializePlugin(MObject obj)
 	MFnPlugin pluginFn(obj);
 	
 	MStatus stat;
+	// Its callbacks point into the plugin.
+	SceneWatcher::instance().stop();
+
 	stat = pluginFn.deregisterCommand(g_cRegisterName);
 
 	if(!stat)
@@ -332,9 +818,10 @@ MStatus uninitializePlugin(MObject obj)
 
 	return stat;
 }
-// Export only selected items in the scene.
+// Export only selected items in the scene, with what they need.
 MStatus SIO2_ExporterCmd::exportSelection()
 {
+	SIO2_TRACE("exportSelection");
 	MSelectionList selection;
 	MGlobal::getActiveSelectionList(selection);
 
@@ -344,235 +831,534 @@ MStatus SIO2_ExporterCmd::exportSelection()
 		return MS::kFailure;
 
 	}
-	//Iterate through selected objects.
-	MItSelectionList iter (selection);
 
-	for(; !iter.isDone(); iter.next())
+	ExportWorkList work;
+	for(MItSelectionList iter(selection); !iter.isDone(); iter.next())
 	{
-		//iter.
 		MObject item;
 		iter.getDependNode(item);
-		
-		//Add code to process nodes
-		//e.i Camera, light, polygon etc.
-		MGlobal::displayInfo(MString("API Type: ")+item.apiTypeStr());
-
-		// TODO: Modify selection to get the correct objects to export
-		//switch(item.apiType())
-		//{
-		//	case MFn::kCamera:
-		//		exportCamera(item);
-		//		
-		//		if(m_bVerbose)
-		//			MGlobal::displayInfo("Camera Exported");
-		//		break;
-
-		//	case MFn::kLight:
-		//	case MFn::kAmbientLight:
-		//	case MFn::kSpotLight:
-		//	case MFn::kPointLight:
-		//	case MFn::kDirectionalLight:
-		//	case MFn::kAreaLight:
-		//		exportLight(item);
-		//		
-		//		if(m_bVerbose)
-		//			MGlobal::displayInfo("Light Exported");
-		//		break;
-
-		//	case MFn::kFileTexture:
-		//		exportImages(item);
-		//		
-		//		if(m_bVerbose)
-		//			MGlobal::displayInfo("Texture File Exported");
-		//		break;
-
-		//	case MFn::kLambert:
-		//	case MFn::kPhong:
-		//	case MFn::kBlinn:
-		//		exportMaterial(item);
-		//		
-		//		if(m_bVerbose)
-		//			MGlobal::displayInfo("Material Exported");	
-		//		break;
-
-		//	case MFn::kAnimCurve:
-		//		MGlobal::displayInfo("Animation Curve Found:");
-		//		break;
-		//	
-		//	case MFn::kMesh:
-		//		MFnMesh mesh(item);
-		//		if(!mesh.isIntermediateObject())		
-		//			exportObject(item);
-		//		break;
-
-		//}
+
+		MDagPath path;
+		if(iter.getDagPath(path) == MS::kSuccess)
+			work.addSelected(item, &path);
+		else
+			work.addSelected(item, NULL);
 	}
+	work.close();
 
-	return MS::kSuccess;
+	MGlobal::displayInfo(MString("Exporting selection, ") + work.counts().c_str());
+
+	std::vector<MObject> vNodes;
+	work.getNodes(vNodes);
+	if(vNodes.empty())
+	{
+		MGlobal::displayError("Nothing to export in the selection.");
+		return MS::kFailure;
+	}
+
+	MStatus stat = exportNodes(vNodes, g_sDestDir + g_sSceneDirName + ".selection.journal");
+	if(stat == MS::kSuccess)
+		MGlobal::displayInfo("Done Exporting Selection");
+
+	return stat;
+}
+bool SIO2_ExporterCmd::progressCallback(float fraction, const char *stage, void *user)
+{
+	MProgressWindow::setProgressStatus(MString(stage));
+	MProgressWindow::setProgress((int)(fraction * 100));
+	return !MProgressWindow::isCancelled();
 }
 // Export all items in the scene
 MStatus SIO2_ExporterCmd::exportAll()
 {
+	SIO2_TRACE("exportAll");
 	MGlobal::displayInfo("Exporting ALL");
-	MStatus stat;
-	MDagPath dagPath;
-	
-	MObject obj;
-	disableBlendShapes(obj);
 
-	MItDependencyNodes it(MFn::kInvalid);
-	while(!it.isDone())
+	// Sorted by kind up front, so the work is known before
+	// anything is written.
+	ExportWorkList work;
+	{
+		SIO2_TRACE("collectScene");
+		work.addScene();
+	}
+	MGlobal::displayInfo(MString("Scene: ") + work.counts().c_str());
+
+	std::vector<MObject> vNodes;
+	work.getNodes(vNodes);
+
+	MStatus stat = exportNodes(vNodes, g_sDestDir + g_sSceneDirName + ".journal");
+	if(stat == MS::kSuccess)
+		MGlobal::displayInfo("Done Exporting ALL");
+
+	return stat;
+}
+// Exports the nodes in order, then writes what was held back
+// for the end: batches, baked animation, textures and LODs.
+MStatus SIO2_ExporterCmd::exportNodes(const std::vector<MObject> &vNodes, const std::string &journalPath)
+{
+	// Lists what has been written so a cancelled export
+	// can be picked up with -resume.
+	if(!m_journal.open(journalPath, m_bResume))
+		MGlobal::displayWarning(MString("Could not open the export journal: ") + journalPath.c_str());
+	else if(m_journal.resumedCount() > 0)
+		MGlobal::displayInfo(MString("Resuming, already written: ") + (int)m_journal.resumedCount());
+
+	// A node is worth about as much as a thousand vertices,
+	// the frames are counted once the animated meshes are known.
+	double fSceneWork = 0;
+	for(unsigned int i=0; i<vNodes.size(); i++)
+	{
+		fSceneWork += 1;
+		if(vNodes[i].apiType() == MFn::kMesh)
+		{
+			MFnMesh countMesh(vNodes[i]);
+			if(!countMesh.isIntermediateObject())
+				fSceneWork += countMesh.numVertices() / 1000.0;
+		}
+	}
+	m_nSceneStage = m_progress.addStage("Exporting scene", fSceneWork);
+	m_nAnimStage = m_progress.addStage("Baking animation", 0);
+	m_nFinishStage = m_progress.addStage("Writing textures and LODs", 1);
+
+	beginExport();
+
+	m_progress.beginStage(m_nSceneStage);
+
+	unsigned int nPrefetch = 0;
+	for(unsigned int i=0; i<vNodes.size(); i++)
 	{	
-		MObject item = it.item();
-		switch(item.apiType())
+		MObject item = vNodes[i];
+		double fWork = 1;
+		prefetchVertexSplits(vNodes, nPrefetch);
+		exportNode(item);
+		if(item.apiType() == MFn::kMesh)
 		{
-			case MFn::kCamera:
-				stat = exportCamera(item);
-				
-				//if(m_bVerbose)
-					//MGlobal::displayInfo(MStrin("Camera Found"));
-				break;
+			MFnMesh meshObj(item);
+			if(!meshObj.isIntermediateObject())
+				fWork += meshObj.numVertices() / 1000.0;
+		}
 
-			case MFn::kLight:
-			case MFn::kAmbientLight:
-			case MFn::kSpotLight:
-			case MFn::kPointLight:
-			case MFn::kDirectionalLight:
-			case MFn::kAreaLight:
-				exportLight(item);
-				
-				//if(m_bVerbose)
-					//MGlobal::displayInfo("Light Found");
-				break;
+		// Everything written so far is complete, stopping
+		// between nodes leaves nothing half done.
+		if(!m_progress.advance(fWork))
+			break;
+	}
+	discardVertexSplits();
+	m_progress.endStage();
 
-			case MFn::kFileTexture:
-				exportImages(item);
-				
-				//if(m_bVerbose)
-					//MGlobal::displayInfo("Texture File Found");
-				break;
+	if(!m_progress.isCancelled())
+	{
+		writeBatches();
 
-			case MFn::kLambert:
-			case MFn::kPhong:
-			case MFn::kBlinn:
-				exportMaterial(item);
-				
-				//if(m_bVerbose)
-					//MGlobal::displayInfo("Material Found");	
-				break;
+		// All the objects have been written, now sample
+		// the animated ones and close their files.
+		bakeAnimations();
+	}
+	else
+	{
+		discardAnimations();
+	}
 
-			case MFn::kAnimCurve:
-				//MGlobal::displayInfo("Animation Curve Found:");
-				break;
+	// Queued textures and LODs are finished even when
+	// cancelling, they are journaled as they complete.
+	m_progress.beginStage(m_nFinishStage);
+	finishTextures();
+	finishLods();
+	m_workers.stop();
+	m_progress.endStage();
 
-			case MFn::kMesh:
-				MFnMesh meshObj(item);
-				//meshObj.getPath(dagPath);
-
-				//if(!dagPath.hasFn(MFn::kBlendShape))
-				//{
-				//MFnMesh mesh(item);
-				//MGlobal::displayInfo("Exporting Mesh");
-					if(!meshObj.isIntermediateObject())		
-						exportObject(item);
-				//}
-				break;
+	if(m_bUseInstancing)
+	{
+		MGlobal::displayInfo(MString("Instanced objects: ") + m_nInstanceCount
+			+ MString(" Bytes saved: ") + (double)m_nInstanceBytesSaved);
+	}
 
-		}
-		it.next();
+	if(m_bMergeMaterials)
+	{
+		MGlobal::displayInfo(MString("Merged materials: ") + m_materials.mergedCount());
+	}
+
+	if(m_nSplitMeshes > 0)
+	{
+		MGlobal::displayInfo(MString("Split meshes: ") + m_nSplitMeshes + MString(" into ") + m_nSplitParts + MString(" objects"));
+	}
+
+	if(m_nStripMode != STRIP_NONE && m_nListIndices > 0)
+	{
+		MGlobal::displayInfo(MString("Indices as list: ") + (double)m_nListIndices
+			+ MString(" as strips (") + stripModeName(m_nStripMode) + MString("): ") + (double)m_nStripIndices
+			+ MString(" ") + (int)(100.0 * m_nStripIndices / m_nListIndices) + MString("%"));
 	}
 
-	m_vNameMeshNotExported.clear();
+	m_materials.clear();
 
-	MGlobal::displayInfo("Done Exporting ALL");
+	if(m_progress.isCancelled())
+	{
+		m_journal.close();
+		MGlobal::displayWarning("Export cancelled, run it again with -resume to finish it.");
+		return MS::kFailure;
+	}
+	m_journal.remove();
 	
 	return MS::kSuccess;
 }
-//const int PRECISION = 3;
-float SIO2_ExporterCmd::optimize_float(float num)
+void SIO2_ExporterCmd::beginExport()
 {
-	int i = (int) num;
-	float r = round(num, PRECISION);
+	MObject obj;
+	disableBlendShapes(obj);
 
-	if (i == r)	
-		return i;
+	m_animBuffer.setBudget((size_t)m_nAnimMemMB * 1024 * 1024);
+	m_animBuffer.setSpillPrefix(g_sDestDir + g_sSceneDirName + "_anim");
+
+	m_materials.clear();
+	m_materials.setMerge(m_bMergeMaterials);
+
+	m_workers.start(m_nThreads);
+
+	// UVs and materials written below depend on the atlases.
+	buildTextureAtlases();
+
+	// Transforms may have moved since the last export.
+	m_transforms.clear();
+
+	m_mInstances.clear();
+	memoryAccount().set(MEMORY_INSTANCES, 0);
+	m_nInstanceCount = 0;
+	m_nInstanceBytesSaved = 0;
+	m_nListIndices = 0;
+	m_nStripIndices = 0;
+	m_nSplitMeshes = 0;
+	m_nSplitParts = 0;
+	m_nBatchedMeshes = 0;
+	m_nBatchObjects = 0;
+	m_nTexturesWritten = 0;
+	m_nLodsWritten = 0;
+	m_nHardEdgeVertices = 0;
+	m_nTangentSplitVertices = 0;
+
+	// Batches never need splitting.
+	m_batcher.clear();
+	m_batcher.setCellSize((float)m_fBatchCellSize);
+	if(m_nSplitVertices > 0)
+		m_batcher.setMaxVertices((unsigned int)m_nSplitVertices);
 	else
-		return r;
-
+		m_batcher.setMaxVertices(m_nStripMode == STRIP_RESTART ? g_nStripRestartIndex : g_nMaxVertices16);
 }
-
-float SIO2_ExporterCmd::round(float val, int precision)
+MStatus SIO2_ExporterCmd::exportNode(MObject item)
 {
-	std::stringstream s;
-	s<<std::setprecision(precision)<<std::setiosflags(std::ios_base::fixed)<<val;
-	s>>val;
-	return val;
-}
+	MStatus stat;
+	switch(item.apiType())
+	{
+		case MFn::kCamera:
+			stat = exportCamera(item);
+			
+			//if(m_bVerbose)
+				//MGlobal::displayInfo(MStrin("Camera Found"));
+			break;
 
-MStatus SIO2_ExporterCmd::createSIO2Directories(std::string base, std::string sceneName)
-{
+		case MFn::kLight:
+		case MFn::kAmbientLight:
+		case MFn::kSpotLight:
+		case MFn::kPointLight:
+		case MFn::kDirectionalLight:
+		case MFn::kAreaLight:
+			exportLight(item);
+			
+			//if(m_bVerbose)
+				//MGlobal::displayInfo("Light Found");
+			break;
 
-	std::string fullDir(base);
-	
-	fullDir = fullDir+sceneName;
-	int status;
+		case MFn::kFileTexture:
+			exportImages(item);
+			
+			//if(m_bVerbose)
+				//MGlobal::displayInfo("Texture File Found");
+			break;
 
-	status = _mkdir(fullDir.c_str());
+		case MFn::kLambert:
+		case MFn::kPhong:
+		case MFn::kBlinn:
+			exportMaterial(item);
+			
+			//if(m_bVerbose)
+				//MGlobal::displayInfo("Material Found");	
+			break;
+
+		case MFn::kAnimCurve:
+			//MGlobal::displayInfo("Animation Curve Found:");
+			break;
+
+		case MFn::kMesh:
+			MFnMesh meshObj(item);
+			//meshObj.getPath(dagPath);
+
+			//if(!dagPath.hasFn(MFn::kBlendShape))
+			//{
+			//MFnMesh mesh(item);
+			//MGlobal::displayInfo("Exporting Mesh");
+				if(!meshObj.isIntermediateObject())		
+					exportObject(item);
+			//}
+			break;
 
-	if(status != 0 )
-	{
-		MGlobal::displayError("Failed to create g_sDestDir: "+ MString(fullDir.c_str()));
-		return MStatus::kFailure;
 	}
-	else
-	{
+	return stat;
+}
+MStatus SIO2_ExporterCmd::startWatching(const MArgList &args)
+{
+	// The same command and flags, exporting only what changed.
+	MString updateCommand = g_cRegisterName;
+	for(unsigned int i=0; i<args.length(); i++)
+	{
+		MString arg = args.asString(i);
+		if(arg == g_cWatchFlag || arg == g_cWatchLongFlag)
+			continue;
+
+		// Flags and numbers as they are, the rest as strings.
+		std::string text = arg.asChar();
+		if(arg.isDouble() || (text.length() > 0 && text[0] == '-'))
+		{
+			updateCommand += MString(" ") + arg;
+		}
+		else
+		{
+			std::string quoted = " \"";
+			for(unsigned int c=0; c<text.length(); c++)
+			{
+				if(text[c] == '"' || text[c] == '\\')
+					quoted += '\\';
+				quoted += text[c];
+			}
+			updateCommand += MString(quoted.c_str()) + MString("\"");
+		}
+	}
+	updateCommand += MString(" ") + g_cWatchUpdateFlag;
+
+	SceneWatcher &watcher = SceneWatcher::instance();
+	if(!watcher.start(updateCommand, m_fWatchDelay))
+	{
+		MGlobal::displayError("Failed to start watching the scene.");
+		return MS::kFailure;
+	}
+
+	unsigned int nNodes = 0;
+	for(MItDependencyNodes it(MFn::kInvalid); !it.isDone(); it.next())
+	{
+		MObject item = it.item();
+		if(SceneWatcher::isExportedType(item))
+		{
+			watcher.watchNode(item, exportedFileName(item));
+			nNodes++;
+		}
+	}
+
+	MGlobal::displayInfo(MString("Watching ") + nNodes + MString(" nodes, use -stopWatch to stop."));
+	return MS::kSuccess;
+}
+MStatus SIO2_ExporterCmd::exportWatchChanges()
+{
+	SIO2_TRACE("exportWatchChanges");
+	MStatus stat = MS::kSuccess;
+	double fStart = getTimeSeconds();
+
+	SceneWatcher &watcher = SceneWatcher::instance();
+	std::vector<MObject> vDirty;
+	std::vector<std::string> vStale;
+	watcher.takeChanges(vDirty, vStale);
+
+	// The materials using a texture write its name.
+	unsigned int nChanged = (unsigned int)vDirty.size();
+	for(unsigned int i=0; i<nChanged; i++)
+	{
+		if(!vDirty[i].hasFn(MFn::kFileTexture))
+			continue;
+
+		MItDependencyGraph it(vDirty[i], MFn::kLambert, MItDependencyGraph::kDownstream,
+			MItDependencyGraph::kBreadthFirst, MItDependencyGraph::kNodeLevel);
+		for(; !it.isDone(); it.next())
+		{
+			MObject material = it.currentItem();
+			if(std::find(vDirty.begin(), vDirty.end(), material) == vDirty.end())
+				vDirty.push_back(material);
+		}
+	}
+
+	// Instances, batches, merged materials and atlases depend
+	// on more than the node changed, so those are redone whole.
+	bool bFull = false;
+	for(unsigned int i=0; i<vDirty.size(); i++)
+	{
+		MObject item = vDirty[i];
+		if(item.hasFn(MFn::kMesh) && (m_bUseInstancing || m_fBatchCellSize > 0))
+			bFull = true;
+		if((item.hasFn(MFn::kLambert) || item.hasFn(MFn::kFileTexture)) && (m_bMergeMaterials || m_nAtlasSize > 0))
+			bFull = true;
+	}
+
+	watcher.setSuspended(true);
+
+	for(unsigned int i=0; i<vStale.size(); i++)
+	{
+		remove((g_sSceneDir + vStale[i]).c_str());
+		if(m_bVerbose)
+			MGlobal::displayInfo(MString("Watch removed: ") + vStale[i].c_str());
+	}
+
+	if(bFull)
+	{
+		stat = exportAll();
+		for(MItDependencyNodes it(MFn::kInvalid); !it.isDone(); it.next())
+		{
+			if(SceneWatcher::isExportedType(it.item()))
+				watcher.watchNode(it.item(), exportedFileName(it.item()));
+		}
+	}
+	else if(vDirty.size() > 0)
+	{
+		beginExport();
+
+		for(unsigned int i=0; i<vDirty.size(); i++)
+		{
+			exportNode(vDirty[i]);
+			watcher.watchNode(vDirty[i], exportedFileName(vDirty[i]));
+
+			if(m_bVerbose)
+				MGlobal::displayInfo(MString("Watch exported: ") + MFnDependencyNode(vDirty[i]).name());
+		}
+
+		bakeAnimations();
+		finishTextures();
+		finishLods();
+		m_workers.stop();
+		m_materials.clear();
+	}
+
+	watcher.setSuspended(false);
+
+	MGlobal::displayInfo(MString("Watch update: ") + (int)vDirty.size() + MString(" nodes ")
+		+ (bFull ? MString("(full export) ") : MString("")) + MString("in (ms): ") + (int)((getTimeSeconds() - fStart) * 1000));
+
+	return stat;
+}
+std::string SIO2_ExporterCmd::exportedFileName(MObject obj)
+{
+	const char *dir = NULL;
+	if(obj.hasFn(MFn::kCamera))
+		dir = g_cCamerasDir;
+	else if(obj.hasFn(MFn::kLight))
+		dir = g_cLightDir;
+	else if(obj.hasFn(MFn::kMesh))
+		dir = g_cObjectDir;
+	else if(obj.hasFn(MFn::kLambert))
+		return std::string(g_cMaterialDir) + "/" + removeUnwantedChar(MFnDependencyNode(obj).name().asChar());
+	else
+		return "";
+
+	// Named after the transform, see exportObject.
+	MFnDagNode dagFn(obj);
+	if(dagFn.parentCount() == 0)
+		return "";
+	MFnDependencyNode parentFn(dagFn.parent(0));
+	return std::string(dir) + "/" + removeUnwantedChar(parentFn.name().asChar());
+}
+//const int PRECISION = 3;
+float SIO2_ExporterCmd::optimize_float(float num)
+{
+	int i = (int) num;
+	float r = round(num, PRECISION);
+
+	if (i == r)	
+		return i;
+	else
+		return r;
+
+}
+
+float SIO2_ExporterCmd::round(float val, int precision)
+{
+	std::stringstream s;
+	s<<std::setprecision(precision)<<std::setiosflags(std::ios_base::fixed)<<val;
+	s>>val;
+	return val;
+}
+
+// _mkdir, where a directory already there is fine when
+// bReuse is set.
+static int makeDirectory(const std::string &path, bool bReuse)
+{
+	int status = _mkdir(path.c_str());
+	if(status != 0 && bReuse && errno == EEXIST)
+		return 0;
+	return status;
+}
+
+MStatus SIO2_ExporterCmd::createSIO2Directories(std::string base, std::string sceneName)
+{
+
+	std::string fullDir(base);
+	
+	fullDir = fullDir+sceneName;
+	int status;
+
+	// A resumed or watched export writes over the last one,
+	// a selection is added to the scene already there.
+	bool bReuse = m_bResume || m_bWatch || m_bWatchUpdate || m_bExportSelection;
+	status = makeDirectory(fullDir, bReuse);
+
+	if(status != 0 )
+	{
+		MGlobal::displayError("Failed to create g_sDestDir: "+ MString(fullDir.c_str()));
+		return MStatus::kFailure;
+	}
+	else
+	{
 		g_sSceneDir = fullDir+"/";
 		std::string localDir;
 		// Create /camera inside the .soi2 file
 		localDir = fullDir +"/"+g_cCamerasDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status != 0)
 			return MStatus::kFailure;
 
 		// Create /lamp inside the .soi2 file
 		localDir = fullDir +"/"+g_cLightDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /image inside the .soi2 file
 		localDir = fullDir +"/"+g_cImageDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /ipo inside the .soi2 file
 		localDir = fullDir +"/"+g_cIpoDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /material inside the .soi2 file
 		localDir = fullDir +"/"+g_cMaterialDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /object inside the .soi2 file
 		localDir = fullDir +"/"+g_cObjectDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /sound inside the .soi2 file
 		localDir = fullDir +"/"+g_cSoundDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
 		// Create /script inside the .soi2 file
 		localDir = fullDir +"/"+g_cScriptDir;
-		status = _mkdir(localDir.c_str());
+		status = makeDirectory(localDir, bReuse);
 		if(status !=0)
 			return MStatus::kFailure;
 
@@ -584,6 +1370,7 @@ MStatus SIO2_ExporterCmd::createSIO2Directories(std::string base, std::string sc
 }
 MStatus SIO2_ExporterCmd::exportCamera(MObject obj)
 {
+	SIO2_TRACE("exportCamera");
 	MStatus stat;
 	// Make sure that the object is not null
 	// and that it is a camera object.
@@ -591,26 +1378,15 @@ MStatus SIO2_ExporterCmd::exportCamera(MObject obj)
 	assert(obj.hasFn(MFn::kCamera));
 
 
-	MFnDagNode dagFn(obj);
-
 	MFnCamera cam = MFnCamera(obj);
-	MDagPath path;
-	cam.getPath(path);
-	
-	MMatrix worldSpace = path.inclusiveMatrix();
-
-	MFnTransform transformFn(path);
 
 	MFnDependencyNode camParent(cam.parent(0));
 	// The parent of the camera object is the one that holds
-	// the transformation information of the camera.
-	MFnTransform camTransforms(cam.parent(0));
+	// the transformation information of the camera. The groups
+	// above it are applied, cameras are always in world space.
+	MMatrix worldSpace = m_transforms.world(cam.parent(0));
 	// Get the camera translations. i.e Position
-	MVector camTranslation = camTransforms.translation(MSpace::kTransform);
-
-	// Get the camera rotations, to know the direction in which is looking.
-	MEulerRotation camRotation;
-	camTransforms.getRotation(camRotation);
+	MVector camTranslation(worldSpace[3][0], worldSpace[3][1], worldSpace[3][2]);
 	
 	// Use the name of the parent to save the camera.
 	// The camera object usually contain shape in it,
@@ -644,6 +1420,7 @@ MStatus SIO2_ExporterCmd::exportCamera(MObject obj)
 
 MStatus SIO2_ExporterCmd::exportLight(MObject obj)
 {
+	SIO2_TRACE("exportLight");
 	// Make sure that the object is not null
 	// and that it is a light object.
 	assert(!obj.isNull());
@@ -654,13 +1431,11 @@ MStatus SIO2_ExporterCmd::exportLight(MObject obj)
 	MFnLight light(obj);
 	MFnDependencyNode lightParent(light.parent(0));
 	// The parent of the light object is the one that holds
-	// the transformation information of the light.
-	MFnTransform lightTransforms(light.parent(0));
+	// the transformation information of the light, in world
+	// space like the direction.
+	MMatrix worldSpace = m_transforms.world(light.parent(0));
 	// Get the light translations. i.e Position
-	MVector lightTranslation = lightTransforms.translation(MSpace::kTransform);
-	// Get the light rotations, to know the direction in which is looking.
-	MQuaternion lightRotation (0,0,0,1);
-	lightTransforms.getRotation(lightRotation);
+	MVector lightTranslation(worldSpace[3][0], worldSpace[3][1], worldSpace[3][2]);
 	
 
 	// Use the name of the parent to save the light.
@@ -821,6 +1596,7 @@ float SIO2_ExporterCmd::convertRadsToDeg(float angle)
 
 MStatus SIO2_ExporterCmd::exportImages(MObject obj)
 {
+	SIO2_TRACE("exportImages");
 	MStatus stat = MStatus::kSuccess;
 
 	std::string dirFinalFile;
@@ -837,12 +1613,30 @@ MStatus SIO2_ExporterCmd::exportImages(MObject obj)
 	int found = fileName.find_last_of("/");
 	std::string file = fileName.substr(found+1);
 	
-	if(file.find(".OGG")>-1 || file.find(".ogg")>-1)
+	if(isSoundBuffer(file))
 	{
 		dirFinalFile = g_sSceneDir + g_cSoundDir + "/"+file ;	
 	}
 	else
+	{
+		// Already written as part of an atlas.
+		if(m_sAtlasOnlyTextures.find(removeUnwantedChar(file)) != m_sAtlasOnlyTextures.end())
+			return stat;
+
+		// Processed by an export that was cancelled.
+		if(m_journal.isDone(std::string(g_cImageDir) + "/" + removeUnwantedChar(file)))
+			return stat;
+
+		TextureEncoding encoding = textureEncoding(obj);
+		if(m_bProcessTextures || isKTXFormat(encoding.format))
+		{
+			// Falls back to the plain copy if Maya
+			// cannot read the image.
+			if(queueTexture(fileName, removeUnwantedChar(file), encoding) == MS::kSuccess)
+				return stat;
+		}
 		dirFinalFile = g_sSceneDir + g_cImageDir + "/"+file ;
+	}
 	
 	// Copy Files to /Image folder in the .sio2
 	// file.
@@ -851,127 +1645,798 @@ MStatus SIO2_ExporterCmd::exportImages(MObject obj)
 	return stat;
 
 }
-
-MStatus SIO2_ExporterCmd::exportMaterial(MObject obj)
+MStatus SIO2_ExporterCmd::queueTexture(const std::string &srcPath, const std::string &fileName, const TextureEncoding &encoding)
 {
-	MStatus stat = MStatus::kSuccess;
-	
-	switch(obj.apiType())
+	// Several file nodes may use the same image.
+	if(m_sTexturesQueued.find(fileName) != m_sTexturesQueued.end())
+		return MS::kSuccess;
+	if(m_sTexturesCopied.find(fileName) != m_sTexturesCopied.end())
+		return MS::kFailure;
+
+	double fStart = getTimeSeconds();
+
+	// Decoding goes through Maya so it stays on this thread.
+	MImage image;
+	if(image.readFromFile(srcPath.c_str()) != MS::kSuccess)
 	{
-		case MFn::kPhong:
-		
-			break;
+		MGlobal::displayWarning(MString("Could not read texture, copying it as is: ") + srcPath.c_str());
+		m_sTexturesCopied.insert(fileName);
+		return MS::kFailure;
 	}
-	MFnDependencyNode depNode(obj);
-
-	std::string name = removeUnwantedChar(depNode.name().asChar());
 
-	if(m_bUseBlendShapes)
+	TextureImage decoded;
+	image.getSize(decoded.width, decoded.height);
+	if(decoded.width == 0 || decoded.height == 0 || image.pixels() == NULL)
 	{
-		
-		if(!shouldExportMaterial(name))
-			return MS::kFailure;
+		m_sTexturesCopied.insert(fileName);
+		return MS::kFailure;
 	}
 
-	std::string dirFinal = g_sSceneDir + g_cMaterialDir + "/" + name;
-	
-	std::ofstream osf(dirFinal.c_str());	
+	const unsigned char *pixels = image.pixels();
+	decoded.pixels.assign(pixels, pixels + (size_t)decoded.width * decoded.height * 4);
+	image.release();
 
-	osf<<"material( \""<<g_cMaterialDir<<"/"<<name<<"\" )"<<endl
-	<<"{"<<endl;
+	std::string outDir = g_sSceneDir + g_cImageDir;
+	TextureJob *job = new TextureJob(fileName, outDir, decoded, m_nTextureMaxSize, true, encoding.format, m_nTextureQuality, encoding.dither);
+	job->m_fDecodeSeconds = getTimeSeconds() - fStart;
 
-	writeMatTextureInfo(osf, obj);
+	m_vTextureJobs.push_back(job);
+	m_sTexturesQueued.insert(fileName);
+	m_workers.enqueue(job);
 
-	osf<<"}";
+	return MS::kSuccess;
+}
+MStatus SIO2_ExporterCmd::queueMeshLods(const std::string &name, MeshData &meshData, const std::string &header)
+{
+	if(meshData.triangleCount() == 0)
+		return MS::kFailure;
 
-	osf.close();
-	return stat;
+	LodJob *job = new LodJob(name, g_sSceneDir + g_cObjectDir, g_cObjectDir, header,
+		meshData, (unsigned int)m_nLodLevels, (float)m_fLodRatio, m_nStripMode, (unsigned int)m_nSplitVertices);
+	m_vLodJobs.push_back(job);
+	m_workers.enqueue(job);
 
+	return MS::kSuccess;
 }
-bool SIO2_ExporterCmd::shouldExportMaterial(std::string matName)
+void SIO2_ExporterCmd::finishLods()
 {
-	for(int i=0; i<m_vNameMeshNotExported.size(); i++)
+	SIO2_TRACE("finishLods");
+	m_workers.wait();
+
+	double fTotal = 0;
+	int nLevels = 0;
+	for(unsigned int i=0; i<m_vLodJobs.size(); i++)
 	{
-		if(strcmp(m_vNameMeshNotExported[i].c_str(), matName.c_str()) == 0)
+		LodJob *job = m_vLodJobs[i];
+		fTotal += job->m_fSeconds;
+
+		bool bAllWritten = true;
+		for(unsigned int l=0; l<job->m_vLevels.size(); l++)
 		{
-			return false;
+			const LodJob::Level &level = job->m_vLevels[l];
+			if(!level.bWritten)
+			{
+				MGlobal::displayError(MString("Failed to write LOD: ") + level.name.c_str());
+				bAllWritten = false;
+				continue;
+			}
+
+			nLevels++;
+			m_nListIndices += level.listIndices;
+			m_nStripIndices += level.indices;
+			if(m_bVerbose)
+			{
+				MGlobal::displayInfo(MString("LOD: ") + level.name.c_str()
+					+ MString(" triangles: ") + level.triangles + MString(" of ") + job->m_nSrcTriangles
+					+ MString(" error: ") + level.error
+					+ MString(" distance: ") + level.distance
+					+ (level.parts > 1 ? MString(" parts: ") + level.parts : MString("")));
+			}
 		}
+
+		// A resumed export writes the object and its LODs again
+		// unless all of them made it.
+		if(bAllWritten)
+			m_journal.markDone(job->m_sRelativeDir + "/" + job->m_sName);
+		delete job;
 	}
-	return true;
+
+	if(m_vLodJobs.size() > 0)
+	{
+		MGlobal::displayInfo(MString("LOD levels: ") + nLevels + MString(" for ") + (int)m_vLodJobs.size()
+			+ MString(" meshes, total (ms): ") + (int)(fTotal * 1000));
+	}
+
+	m_nLodsWritten += nLevels;
+	m_vLodJobs.clear();
 }
-std::string SIO2_ExporterCmd::removeUnwantedChar(std::string name)
+void SIO2_ExporterCmd::reportMemory()
 {
-	int loc = name.find(":");
-	while(loc>-1)
+	MemoryAccount &account = memoryAccount();
+	if(m_bVerbose)
 	{
-		name.replace(loc, 1, "_");
-		loc = name.find(":");
+		for(int i=0; i<MEMORY_STAGE_COUNT; i++)
+		{
+			MemoryStage stage = (MemoryStage)i;
+			if(account.peak(stage) == 0)
+				continue;
+
+			MGlobal::displayInfo(MString("Memory ") + memoryStageName(stage) + MString(" peak (KB): ") + (int)(account.peak(stage) / 1024)
+				+ MString(" current (KB): ") + (int)(account.current(stage) / 1024));
+		}
+
+		const std::vector<MemoryAccount::MeshUsage> &meshes = account.meshes();
+		for(unsigned int i=0; i<meshes.size(); i++)
+		{
+			MGlobal::displayInfo(MString("Memory mesh: ") + meshes[i].name.c_str()
+				+ MString(" peak (KB): ") + (int)(meshes[i].peakBytes / 1024));
+		}
+	}
+	MGlobal::displayInfo(MString("Memory peak (KB): ") + (int)(account.totalPeak() / 1024));
+
+	// Each request was at least one allocation before the arena.
+	if(m_scratch.requests() > 0)
+	{
+		MGlobal::displayInfo(MString("Scratch buffers requested: ") + (int)m_scratch.requests()
+			+ MString(" allocated: ") + (int)m_scratch.allocations());
+	}
+
+	if(m_bVerbose && m_transforms.lookups() > 0)
+	{
+		MGlobal::displayInfo(MString("Transforms computed: ") + (int)m_transforms.computed()
+			+ MString(" lookups: ") + (int)m_transforms.lookups());
 	}
-	return name;
 }
-MStatus SIO2_ExporterCmd::writeMatTextureInfo(std::ofstream &osf, MObject obj)
+void SIO2_ExporterCmd::writeExportSummary(const std::string &path, double fSeconds)
 {
-	MStatus stat = MStatus::kSuccess;
-	
-	
-	MFnDependencyNode matFn(obj);
-	
-	MPlug matPlug;
-	MPlugArray plugs;
-	
-	// Texture Channel 0
-	matPlug = matFn.findPlug("color");
-	matPlug.connectedTo(plugs, true,false);
+	std::ofstream osf(path.c_str());
+
+	osf<<"{"<<endl;
+	osf<<"\t\"scene\": ";
+	writeJsonString(osf, g_sSceneDirName);
+	osf<<","<<endl;
+	osf<<"\t\"seconds\": "<<fSeconds<<","<<endl;
+	osf<<"\t\"instances\": "<<m_nInstanceCount<<","<<endl;
+	osf<<"\t\"instanceBytesSaved\": "<<m_nInstanceBytesSaved<<","<<endl;
+	osf<<"\t\"batchedMeshes\": "<<m_nBatchedMeshes<<","<<endl;
+	osf<<"\t\"batchObjects\": "<<m_nBatchObjects<<","<<endl;
+	osf<<"\t\"splitMeshes\": "<<m_nSplitMeshes<<","<<endl;
+	osf<<"\t\"splitParts\": "<<m_nSplitParts<<","<<endl;
+	osf<<"\t\"lodLevels\": "<<m_nLodsWritten<<","<<endl;
+	osf<<"\t\"textures\": "<<m_nTexturesWritten<<","<<endl;
+	osf<<"\t\"indexMode\": \""<<stripModeName(m_nStripMode)<<"\","<<endl;
+	osf<<"\t\"listIndices\": "<<m_nListIndices<<","<<endl;
+	osf<<"\t\"writtenIndices\": "<<m_nStripIndices<<","<<endl;
+	osf<<"\t\"hardEdgeVertices\": "<<m_nHardEdgeVertices<<","<<endl;
+	osf<<"\t\"tangentSplitVertices\": "<<m_nTangentSplitVertices<<","<<endl;
+	osf<<"\t\"animationBytesSpilled\": "<<m_animBuffer.bytesSpilled()<<","<<endl;
+	osf<<"\t\"scratchRequests\": "<<m_scratch.requests()<<","<<endl;
+	osf<<"\t\"scratchAllocations\": "<<m_scratch.allocations()<<","<<endl;
+	osf<<"\t\"memory\": ";
+	memoryAccount().writeJson(osf);
+	osf<<endl<<"}"<<endl;
+
+	if(osf.fail())
+		MGlobal::displayError(MString("Failed to write summary: ") + path.c_str());
+	osf.close();
+}
+void SIO2_ExporterCmd::finishTextures()
+{
+	SIO2_TRACE("finishTextures");
+	m_workers.wait();
 
-	std::string nameTex;
-	for(int i=0; i<plugs.length(); i++)
+	double fTotal = 0;
+	double fPSNR = 0;
+	int nCompressed = 0;
+	for(unsigned int i=0; i<m_vTextureJobs.size(); i++)
 	{
-		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		TextureJob *job = m_vTextureJobs[i];
+		fTotal += job->m_fDecodeSeconds + job->m_fProcessSeconds;
+		if(job->m_bSuccess && isKTXFormat(job->m_nFormatWritten))
 		{
-			MFnDependencyNode fnDep(plugs[i].node());
-			nameTex = retriveTextureFileName(fnDep);
-			osf<<"\ttfalgs0( " <<1<< " "<<")"<<endl;
-			osf<<"\ttname0( \"" <<g_cImageDir<< "/" +nameTex << "\" "<<")"<<endl;
-	
+			fPSNR += job->m_fPSNR;
+			nCompressed++;
 		}
-	}
 
-	// Texture Channel 1
-	matPlug = matFn.findPlug("ambientColor");
-	matPlug.connectedTo(plugs, true,false);
+		if(job->m_bSuccess)
+		{
+			m_nTexturesWritten++;
+			m_journal.markDone(std::string(g_cImageDir) + "/" + job->m_sBaseName);
+		}
 
-	for(int i=0; i<plugs.length(); i++)
-	{
-		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		if(!job->m_bSuccess)
 		{
-			MFnDependencyNode fnDep(plugs[i].node());
-			nameTex = retriveTextureFileName(fnDep);
-			osf<<"\ttfalgs1( " <<1<< " "<<")"<<endl;
-			osf<<"\ttname1( " <<g_cImageDir<< "/" +nameTex << " "<<")"<<endl;
+			MGlobal::displayError(MString("Failed to write texture: ") + job->m_sBaseName.c_str());
 		}
+		else if(m_bVerbose)
+		{
+			MGlobal::displayInfo(MString("Texture: ") + job->m_sBaseName.c_str()
+				+ MString(" ") + job->m_nSrcWidth + MString("x") + job->m_nSrcHeight
+				+ MString(" -> ") + job->m_nWidth + MString("x") + job->m_nHeight
+				+ MString(" mips: ") + job->m_nLevels
+				+ MString(" ") + textureFormatName(job->m_nFormatWritten)
+				+ (isKTXFormat(job->m_nFormatWritten) ? MString(" psnr (dB): ") + job->m_fPSNR : MString(""))
+				+ MString(" decode (ms): ") + (int)(job->m_fDecodeSeconds * 1000)
+				+ MString(" process (ms): ") + (int)(job->m_fProcessSeconds * 1000));
+		}
+		delete job;
 	}
 
-	// Texture Channel 2
-	matPlug = matFn.findPlug("incandescence");
-	matPlug.connectedTo(plugs, true,false);
+	if(m_vTextureJobs.size() > 0)
+	{
+		MGlobal::displayInfo(MString("Processed textures: ") + (int)m_vTextureJobs.size()
+			+ MString(" on ") + m_workers.threadCount() + MString(" threads, total (ms): ") + (int)(fTotal * 1000));
+	}
+	if(nCompressed > 0)
+	{
+		MGlobal::displayInfo(MString("KTX textures: ") + nCompressed + MString(" average psnr (dB): ") + fPSNR / nCompressed);
+	}
 
-	for(int i=0; i<plugs.length(); i++)
+	m_vTextureJobs.clear();
+	m_sTexturesQueued.clear();
+	m_sTexturesCopied.clear();
+}
+// Texture waiting to be packed, nKind keeps opaque and
+// transparent textures on different pages.
+struct AtlasItem
+{
+	std::string name;
+	int nKind;
+	TextureImage image;
+};
+struct AtlasPage
+{
+	int nKind;
+	SkylinePacker packer;
+	TextureImage image;
+	std::vector<std::string> textures;
+};
+
+MStatus SIO2_ExporterCmd::buildTextureAtlases()
+{
+	SIO2_TRACE("buildTextureAtlases");
+	MStatus stat = MS::kSuccess;
+
+	m_mAtlasByTexture.clear();
+	m_mAtlasTextureOfMaterial.clear();
+	m_sAtlasOnlyTextures.clear();
+
+	if(m_nAtlasSize <= 0)
+		return stat;
+
+	// Material name -> colour texture, for the materials
+	// that could use an atlas.
+	std::map<std::string, std::string> mMatTexture;
+	// Texture -> source path and kind (0 opaque, 1 transparent,
+	// -1 cannot be packed).
+	std::map<std::string, std::string> mTexturePath;
+	std::map<std::string, int> mTextureKind;
+	// How many material channels use each texture, all of them
+	// and the ones that will be atlased.
+	std::map<std::string, int> mRefsAll, mRefsAtlas;
+
+	const char *channels[] = { "color", "ambientColor", "incandescence" };
+
+	MItDependencyNodes itMat(MFn::kLambert);
+	for(; !itMat.isDone(); itMat.next())
 	{
-		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		MFnDependencyNode matFn(itMat.item());
+		std::string matName = removeUnwantedChar(matFn.name().asChar());
+
+		std::string colorTex, colorPath;
+		bool bOtherTextures = false;
+
+		for(int c=0; c<3; c++)
 		{
-			MFnDependencyNode fnDep(plugs[i].node());
-			nameTex = retriveTextureFileName(fnDep);
-			if(isSoundBuffer(nameTex))
+			MPlugArray plugs;
+			matFn.findPlug(channels[c]).connectedTo(plugs, true, false);
+			for(unsigned int i=0; i<plugs.length(); i++)
 			{
-				osf<<"\tsfalgs( " <<1<< " "<<")"<<endl;
-				osf<<"\tsbname( " <<g_cImageDir<< "/" +nameTex << " "<<")"<<endl;
-			
+				if(plugs[i].node().apiType() != MFn::kFileTexture)
+					continue;
 
-			}		
+				MFnDependencyNode fnDep(plugs[i].node());
+				std::string tex = retriveTextureFileName(fnDep);
+				mRefsAll[tex]++;
+
+				if(c == 0)
+				{
+					colorTex = tex;
+					colorPath = fnDep.findPlug("ftn").asString().asChar();
+				}
+				else
+					bOtherTextures = true;
+			}
 		}
+
+		// Materials with more than the colour texture keep their own.
+		if(colorTex.empty() || bOtherTextures || isSoundBuffer(colorTex))
+			continue;
+
+		float tr, tg, tb;
+		matFn.findPlug("transparencyR").getValue(tr);
+		matFn.findPlug("transparencyG").getValue(tg);
+		matFn.findPlug("transparencyB").getValue(tb);
+		int nKind = (tr > 0 || tg > 0 || tb > 0) ? 1 : 0;
+
+		std::map<std::string, int>::iterator kind = mTextureKind.find(colorTex);
+		if(kind == mTextureKind.end())
+			mTextureKind[colorTex] = nKind;
+		else if(kind->second != nKind)
+			kind->second = -1;
+
+		mMatTexture[matName] = colorTex;
+		mTexturePath[colorTex] = colorPath;
 	}
 
-	MColor color;
+	// The UVs of every mesh drawing with the texture get remapped,
+	// which only works if they stay inside the texture and the
+	// mesh has nothing else on UV set 0.
+	const float fEpsilon = 0.001f;
+	MItDag itDag(MItDag::kDepthFirst, MFn::kMesh);
+	for(; !itDag.isDone(); itDag.next())
+	{
+		MObject meshObj = itDag.item();
+		MFnMesh mesh(meshObj);
+		if(mesh.isIntermediateObject())
+			continue;
+
+		MObjectArray materials;
+		getMeshMaterials(meshObj, materials);
+
+		bool bInRange = true;
+		MStringArray uvsets;
+		mesh.getUVSetNames(uvsets);
+		if(uvsets.length() > 0)
+		{
+			MFloatArray u, v;
+			mesh.getUVs(u, v, &uvsets[0]);
+			for(unsigned int i=0; i<u.length() && bInRange; i++)
+			{
+				if(u[i] < -fEpsilon || u[i] > 1 + fEpsilon || v[i] < -fEpsilon || v[i] > 1 + fEpsilon)
+					bInRange = false;
+			}
+		}
+
+		for(unsigned int m=0; m<materials.length(); m++)
+		{
+			MFnDependencyNode fnMat(materials[m]);
+			std::map<std::string, std::string>::iterator found = mMatTexture.find(removeUnwantedChar(fnMat.name().asChar()));
+			if(found == mMatTexture.end())
+				continue;
+
+			if(materials.length() != 1 || !bInRange)
+				mTextureKind[found->second] = -1;
+		}
+	}
+
+	// Load what is left, textures bigger than half an
+	// atlas are not worth packing.
+	std::vector<AtlasItem> vItems;
+	unsigned int nMaxTexture = m_nAtlasSize / 2;
+
+	for(std::map<std::string, int>::iterator it = mTextureKind.begin(); it != mTextureKind.end(); ++it)
+	{
+		if(it->second < 0)
+			continue;
+
+		MImage image;
+		if(image.readFromFile(mTexturePath[it->first].c_str()) != MS::kSuccess)
+			continue;
+
+		AtlasItem item;
+		item.name = it->first;
+		item.nKind = it->second;
+		image.getSize(item.image.width, item.image.height);
+		if(item.image.width == 0 || item.image.height == 0 || item.image.width > nMaxTexture || item.image.height > nMaxTexture)
+			continue;
+
+		const unsigned char *pixels = image.pixels();
+		item.image.pixels.assign(pixels, pixels + (size_t)item.image.width * item.image.height * 4);
+		vItems.push_back(item);
+	}
+
+	// Tallest first packs tighter with the skyline.
+	for(unsigned int i=1; i<vItems.size(); i++)
+	{
+		for(unsigned int j=i; j>0 && vItems[j].image.height > vItems[j-1].image.height; j--)
+			std::swap(vItems[j], vItems[j-1]);
+	}
+
+	// The gutter is a power of two and every rectangle a
+	// multiple of it, so the textures start on a texel of the
+	// mip level where the gutter is one texel wide and no texel
+	// down to it mixes two textures. It grows with the smallest
+	// texture, which is about 16 texels wide at that level.
+	unsigned int nMinSide = nMaxTexture;
+	for(unsigned int i=0; i<vItems.size(); i++)
+		nMinSide = std::min(nMinSide, std::min(vItems[i].image.width, vItems[i].image.height));
+
+	unsigned int nPad = 2;
+	while(nPad < 32 && nPad * 32 <= nMinSide)
+		nPad *= 2;
+
+	std::vector<AtlasPage> vPages;
+	std::map<std::string, AtlasPlacement> mPlaced;
+
+	for(unsigned int i=0; i<vItems.size(); i++)
+	{
+		AtlasItem &item = vItems[i];
+		unsigned int w = (item.image.width + nPad * 3 - 1) / nPad * nPad;
+		unsigned int h = (item.image.height + nPad * 3 - 1) / nPad * nPad;
+		unsigned int x = 0, y = 0;
+		int nPage = -1;
+
+		for(unsigned int p=0; p<vPages.size() && nPage < 0; p++)
+		{
+			if(vPages[p].nKind == item.nKind && vPages[p].packer.insert(w, h, x, y))
+				nPage = p;
+		}
+		if(nPage < 0)
+		{
+			AtlasPage page;
+			page.nKind = item.nKind;
+			page.packer.init(m_nAtlasSize, m_nAtlasSize);
+			page.image.width = m_nAtlasSize;
+			page.image.height = m_nAtlasSize;
+			page.image.pixels.assign((size_t)m_nAtlasSize * m_nAtlasSize * 4, 0);
+			vPages.push_back(page);
+
+			nPage = (int)vPages.size() - 1;
+			if(!vPages[nPage].packer.insert(w, h, x, y))
+				continue;
+		}
+
+		AtlasPage &page = vPages[nPage];
+		blitWithGutter(page.image, item.image, x + nPad, y + nPad, nPad);
+		page.textures.push_back(item.name);
+
+		AtlasPlacement placement;
+		placement.offsetU = (float)(x + nPad) / m_nAtlasSize;
+		placement.offsetV = (float)(y + nPad) / m_nAtlasSize;
+		placement.scaleU = (float)item.image.width / m_nAtlasSize;
+		placement.scaleV = (float)item.image.height / m_nAtlasSize;
+		mPlaced[item.name] = placement;
+
+		std::vector<unsigned char>().swap(item.image.pixels);
+	}
+
+	// A page holding a single texture saves nothing.
+	unsigned int nAtlases = 0;
+	for(unsigned int p=0; p<vPages.size(); p++)
+	{
+		AtlasPage &page = vPages[p];
+		if(page.textures.size() < 2)
+			continue;
+
+		std::stringstream s;
+		s<<"sio2_atlas"<<nAtlases++;
+		TextureEncoding encoding = textureEncodingForName(s.str());
+		std::string atlasName = TextureJob::outputName(s.str(), encoding.format);
+
+		for(unsigned int t=0; t<page.textures.size(); t++)
+		{
+			AtlasPlacement placement = mPlaced[page.textures[t]];
+			placement.atlasName = atlasName;
+			m_mAtlasByTexture[page.textures[t]] = placement;
+		}
+
+		if(m_bVerbose)
+		{
+			MGlobal::displayInfo(MString("Atlas: ") + atlasName.c_str() + MString(" textures: ") + (int)page.textures.size()
+				+ MString(" used (%): ") + (int)(page.packer.occupancy() * 100));
+		}
+
+		// Written by the workers like the other textures.
+		TextureJob *job = new TextureJob(atlasName, g_sSceneDir + g_cImageDir, page.image, m_nAtlasSize,
+			m_bProcessTextures || isKTXFormat(encoding.format), encoding.format, m_nTextureQuality, encoding.dither);
+		m_vTextureJobs.push_back(job);
+		m_sTexturesQueued.insert(atlasName);
+		m_workers.enqueue(job);
+	}
+
+	for(std::map<std::string, std::string>::iterator it = mMatTexture.begin(); it != mMatTexture.end(); ++it)
+	{
+		if(m_mAtlasByTexture.find(it->second) != m_mAtlasByTexture.end())
+		{
+			m_mAtlasTextureOfMaterial[it->first] = it->second;
+			mRefsAtlas[it->second]++;
+		}
+	}
+
+	// Textures nothing else uses are not copied again.
+	for(std::map<std::string, AtlasPlacement>::iterator it = m_mAtlasByTexture.begin(); it != m_mAtlasByTexture.end(); ++it)
+	{
+		if(mRefsAtlas[it->first] == mRefsAll[it->first])
+			m_sAtlasOnlyTextures.insert(it->first);
+	}
+
+	MGlobal::displayInfo(MString("Texture atlases: ") + nAtlases + MString(" holding ") + (int)m_mAtlasByTexture.size() + MString(" textures"));
+
+	return stat;
+}
+bool SIO2_ExporterCmd::getMaterialAtlasPlacement(const std::string &matName, AtlasPlacement &placement)
+{
+	std::map<std::string, std::string>::iterator tex = m_mAtlasTextureOfMaterial.find(matName);
+	if(tex == m_mAtlasTextureOfMaterial.end())
+		return false;
+
+	std::map<std::string, AtlasPlacement>::iterator found = m_mAtlasByTexture.find(tex->second);
+	if(found == m_mAtlasByTexture.end())
+		return false;
+
+	placement = found->second;
+	return true;
+}
+bool SIO2_ExporterCmd::getMeshAtlasPlacement(MObject obj, AtlasPlacement &placement)
+{
+	if(m_mAtlasTextureOfMaterial.empty())
+		return false;
+
+	MObjectArray materials;
+	getMeshMaterials(obj, materials);
+	if(materials.length() != 1)
+		return false;
+
+	MFnDependencyNode fnMat(materials[0]);
+	return getMaterialAtlasPlacement(removeUnwantedChar(fnMat.name().asChar()), placement);
+}
+std::string SIO2_ExporterCmd::exportedTextureName(MObject fileNode)
+{
+	MFnDependencyNode fnDep(fileNode);
+	std::string fileName = retriveTextureFileName(fnDep);
+	if(isSoundBuffer(fileName))
+		return fileName;
+
+	TextureEncoding encoding = textureEncoding(fileNode);
+	if(m_bProcessTextures || isKTXFormat(encoding.format))
+	{
+		// Whether Maya can read the image is only known once it
+		// is queued, the file node may come after its material.
+		bool bQueued = m_sTexturesQueued.find(fileName) != m_sTexturesQueued.end();
+		if(!bQueued && m_sTexturesCopied.find(fileName) == m_sTexturesCopied.end()
+			&& !m_journal.isDone(std::string(g_cImageDir) + "/" + fileName))
+		{
+			exportImages(fileNode);
+		}
+
+		// Copied as it is under its own name.
+		if(m_sTexturesCopied.find(fileName) != m_sTexturesCopied.end())
+			return fileName;
+
+		return TextureJob::outputName(fileName, encoding.format);
+	}
+
+	return fileName;
+}
+// Case insensitive match with * and ? wildcards.
+static bool matchPattern(const char *pattern, const char *str)
+{
+	if(*pattern == '*')
+	{
+		for(; ; str++)
+		{
+			if(matchPattern(pattern + 1, str))
+				return true;
+			if(*str == 0)
+				return false;
+		}
+	}
+	if(*str == 0)
+		return *pattern == 0;
+	if(*pattern == '?' || tolower(*pattern) == tolower(*str))
+		return matchPattern(pattern + 1, str + 1);
+
+	return false;
+}
+TextureEncoding SIO2_ExporterCmd::textureEncoding(MObject fileNode)
+{
+	MFnDependencyNode fnDep(fileNode);
+
+	MPlugArray plugs;
+	fnDep.findPlug("outColor").connectedTo(plugs, false, true);
+	for(unsigned int i=0; i<plugs.length(); i++)
+	{
+		MFnDependencyNode fnMat(plugs[i].node());
+		if(!fnMat.hasAttribute("sio2Compress"))
+			continue;
+
+		TextureEncoding encoding = m_textureEncoding;
+		MString name = fnMat.findPlug("sio2Compress").asString();
+		if(parseTextureEncoding(name.asChar(), encoding))
+			return encoding;
+
+		MGlobal::displayWarning(MString("Unknown sio2Compress format on ") + fnMat.name() + MString(": ") + name);
+	}
+
+	return textureEncodingForName(retriveTextureFileName(fnDep));
+}
+TextureEncoding SIO2_ExporterCmd::textureEncodingForName(const std::string &fileName)
+{
+	for(unsigned int i=0; i<m_vTextureRules.size(); i++)
+	{
+		if(matchPattern(m_vTextureRules[i].first.c_str(), fileName.c_str()))
+			return m_vTextureRules[i].second;
+	}
+	return m_textureEncoding;
+}
+MStatus SIO2_ExporterCmd::parseTextureRules(const std::string &rules)
+{
+	size_t start = 0;
+	while(start < rules.size())
+	{
+		size_t end = rules.find(';', start);
+		if(end == std::string::npos)
+			end = rules.size();
+
+		std::string rule = rules.substr(start, end - start);
+		start = end + 1;
+		if(rule.empty())
+			continue;
+
+		size_t eq = rule.find('=');
+		TextureEncoding encoding = m_textureEncoding;
+		if(eq == std::string::npos || !parseTextureEncoding(rule.substr(eq + 1), encoding))
+		{
+			MGlobal::displayError(MString("Bad texture rule: ") + rule.c_str());
+			return MS::kFailure;
+		}
+		m_vTextureRules.push_back(std::make_pair(rule.substr(0, eq), encoding));
+	}
+	return MS::kSuccess;
+}
+
+MStatus SIO2_ExporterCmd::exportMaterial(MObject obj)
+{
+	SIO2_TRACE("exportMaterial");
+	MStatus stat = MStatus::kSuccess;
+	
+	switch(obj.apiType())
+	{
+		case MFn::kPhong:
+		
+			break;
+	}
+	MFnDependencyNode depNode(obj);
+
+	std::string name = removeUnwantedChar(depNode.name().asChar());
+
+	if(m_bUseBlendShapes)
+	{
+		
+		if(!shouldExportMaterial(name))
+			return MS::kFailure;
+	}
+
+	// Objects may have registered it already.
+	registerMaterial(obj);
+
+	return stat;
+
+}
+std::string SIO2_ExporterCmd::registerMaterial(MObject obj)
+{
+	MFnDependencyNode depNode(obj);
+
+	std::string name = removeUnwantedChar(depNode.name().asChar());
+
+	// Only the shaders exportAll handles have a material file.
+	if(!obj.hasFn(MFn::kLambert))
+		return name;
+
+	if(m_materials.isRegistered(name))
+		return m_materials.canonicalName(name);
+
+	// The parameters are formatted first so identical
+	// materials can be found by their text.
+	std::ostringstream params;
+	writeMatTextureInfo(params, obj);
+
+	bool bIsNew;
+	std::string canonical = m_materials.add(name, params.str(), bIsNew);
+
+	if(bIsNew)
+	{
+		std::string dirFinal = g_sSceneDir + g_cMaterialDir + "/" + name;
+		
+		std::ofstream osf(dirFinal.c_str());	
+
+		osf<<"material( \""<<g_cMaterialDir<<"/"<<name<<"\" )"<<endl
+		<<"{"<<endl;
+
+		osf<<params.str();
+
+		osf<<"}";
+
+		osf.close();
+	}
+	else if(m_bVerbose)
+	{
+		MGlobal::displayInfo(MString("Material: ") + name.c_str() + MString(" merged into ") + canonical.c_str());
+	}
+
+	return canonical;
+}
+bool SIO2_ExporterCmd::shouldExportMaterial(std::string matName)
+{
+	return !m_materials.isSkipped(matName);
+}
+std::string SIO2_ExporterCmd::removeUnwantedChar(std::string name)
+{
+	int loc = name.find(":");
+	while(loc>-1)
+	{
+		name.replace(loc, 1, "_");
+		loc = name.find(":");
+	}
+	return name;
+}
+MStatus SIO2_ExporterCmd::writeMatTextureInfo(std::ostream &osf, MObject obj)
+{
+	MStatus stat = MStatus::kSuccess;
+	
+	
+	MFnDependencyNode matFn(obj);
+	
+	MPlug matPlug;
+	MPlugArray plugs;
+	
+	// Texture Channel 0
+	matPlug = matFn.findPlug("color");
+	matPlug.connectedTo(plugs, true,false);
+
+	AtlasPlacement atlas;
+	bool bAtlas = getMaterialAtlasPlacement(removeUnwantedChar(matFn.name().asChar()), atlas);
+
+	std::string nameTex;
+	for(int i=0; i<plugs.length(); i++)
+	{
+		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		{
+			nameTex = exportedTextureName(plugs[i].node());
+			if(bAtlas)
+				nameTex = atlas.atlasName;
+			osf<<"\ttfalgs0( " <<1<< " "<<")"<<endl;
+			osf<<"\ttname0( \"" <<g_cImageDir<< "/" +nameTex << "\" "<<")"<<endl;
+	
+		}
+	}
+
+	// Texture Channel 1
+	matPlug = matFn.findPlug("ambientColor");
+	matPlug.connectedTo(plugs, true,false);
+
+	for(int i=0; i<plugs.length(); i++)
+	{
+		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		{
+			nameTex = exportedTextureName(plugs[i].node());
+			osf<<"\ttfalgs1( " <<1<< " "<<")"<<endl;
+			osf<<"\ttname1( " <<g_cImageDir<< "/" +nameTex << " "<<")"<<endl;
+		}
+	}
+
+	// Texture Channel 2
+	matPlug = matFn.findPlug("incandescence");
+	matPlug.connectedTo(plugs, true,false);
+
+	for(int i=0; i<plugs.length(); i++)
+	{
+		if(plugs[i].node().apiType() == MFn::kFileTexture)
+		{
+			MFnDependencyNode fnDep(plugs[i].node());
+			nameTex = retriveTextureFileName(fnDep);
+			if(isSoundBuffer(nameTex))
+			{
+				osf<<"\tsfalgs( " <<1<< " "<<")"<<endl;
+				osf<<"\tsbname( " <<g_cImageDir<< "/" +nameTex << " "<<")"<<endl;
+			
+
+			}		
+		}
+	}
+
+	MColor color;
 	matPlug = matFn.findPlug("ambientColorR");
 	matPlug.getValue(color.r);
 	matPlug = matFn.findPlug("ambientColorG");
@@ -1066,7 +2531,7 @@ std::string SIO2_ExporterCmd::retriveTextureFileName(MFnDependencyNode dpNode)
 }
 bool SIO2_ExporterCmd::isSoundBuffer(std::string filename)
 {
-	return filename.find(".ogg")>-1 || filename.find(".OGG")>-1;
+	return filename.find(".ogg") != std::string::npos || filename.find(".OGG") != std::string::npos;
 }
 
 MStatus SIO2_ExporterCmd::exportObject(MObject obj)
@@ -1078,7 +2543,7 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 
 	if(m_bUseBlendShapes)
 	{
-		if(!containsKeyFrameAnimation(obj))
+		if(!isMeshWritten(obj))
 		{
 			// If we are using blend shapes with key frames 
 			// then only the base shape being animated has 
@@ -1086,25 +2551,12 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 			// export all the other shapes as meshes as well.
 			// These are not needed in SIO2 so we do not export
 			// them. Check the -h help.
-			MObjectArray shaders;
-			MIntArray FaceIndices;
-			MFnMesh meshObj(obj);
-			meshObj.getConnectedShaders(0, shaders, FaceIndices);
-			//Get material file name
-			int size = shaders.length();
-			MString matName;
-			for(int kk=0; kk<shaders.length(); kk++)
+			MObjectArray materials;
+			getMeshMaterials(obj, materials);
+			for(unsigned int kk=0; kk<materials.length(); kk++)
 			{
-				MFnDependencyNode fnShader (shaders[kk]);
-				MPlug sshader = fnShader.findPlug("surfaceShader");
-				MPlugArray materials;
-				sshader.connectedTo(materials,true, true);
-				for(int ii=0; ii<materials.length(); ii++)
-				{
-					MFnDependencyNode fnMat(materials[ii].node());
-					m_vNameMeshNotExported.push_back(removeUnwantedChar( fnMat.name().asChar()).c_str());
-				}
-
+				MFnDependencyNode fnMat(materials[kk]);
+				m_materials.skip(removeUnwantedChar( fnMat.name().asChar()));
 			}
 			return MS::kFailure;
 
@@ -1112,46 +2564,84 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 	}
 	std::string name = removeUnwantedChar(meshParentNode.name().asChar());
 	std::string dirFinal = g_sSceneDir + g_cObjectDir + "/" + name;
+
+	// Written by an export that was cancelled.
+	if(m_journal.isDone(std::string(g_cObjectDir) + "/" + name))
+		return stat;
+
+	SIO2_TRACE_DETAIL("exportObject", name.c_str());
+	MemoryMeshScope memoryScope(name);
+	m_scratch.reset();
+
+	// Every writer below, and extractMeshData, works on the
+	// vertices split on the hard edges.
+	buildVertexSplit(obj);
+	MemoryCharge splitCharge(MEMORY_POINTS, m_vertexSplit.byteSize());
+
+	MDagPath meshDagPath;
+	meshObject.getPath(meshDagPath);
+
+	std::vector<double> vAnimFrames;
+	findMeshAnimFrames(meshDagPath, vAnimFrames);
+
+	// Static meshes with the same geometry and materials as one
+	// already exported are written as an instance of it.
+	HashValue nInstanceHash = 0;
+	bool bStatic = vAnimFrames.size() == 0 && !isMeshSkinned(obj);
+	bool bInstanceable = m_bUseInstancing && bStatic;
+	MeshData meshData;
+	MemoryCharge extractCharge(MEMORY_EXTRACTION);
+
+	// Limits count the vertices written, copies included.
+	unsigned int nWrittenVertices = m_vertexSplit.vertexCount();
+
+	if(m_fBatchCellSize > 0 && bStatic && m_batcher.accepts(nWrittenVertices))
+		return batchObject(name, obj);
+
+	if(bInstanceable)
+	{
+		extractMeshData(obj, meshData);
+		extractCharge.resize(meshData.byteSize());
+		nInstanceHash = meshData.hash(g_fInstanceTolerance);
+
+		std::multimap<HashValue, MeshInstance>::iterator found = m_mInstances.lower_bound(nInstanceHash);
+		for(; found != m_mInstances.end() && found->first == nInstanceHash; ++found)
+		{
+			if(found->second.mesh.equals(meshData, g_fInstanceTolerance))
+				return exportInstance(name, obj, found->second);
+		}
+	}
+
+	// More vertices than the indices can reach.
+	if(m_nSplitVertices > 0 && nWrittenVertices > (unsigned int)m_nSplitVertices)
+	{
+		if(bStatic)
+		{
+			if(!bInstanceable)
+			{
+				extractMeshData(obj, meshData);
+				extractCharge.resize(meshData.byteSize());
+			}
+			return exportSplitObject(name, obj, meshData);
+		}
+		MGlobal::displayWarning(MString("Animated or skinned mesh has too many vertices to split: ") + name.c_str());
+	}
 	
 	std::ofstream osf(dirFinal.c_str());	
 
 	osf<<"object( \""<<g_cObjectDir<<"/"<<name<<"\" )"<<endl
 	<<"{"<<endl;
 
+	// The lines down to dim are kept for the LOD objects.
+	std::ostringstream header;
+
 	// Write loc( %s %s %s )
 	// Write rot( %f %f %f )
 	// Write scl( %f %f %f )
-	writeMeshTransforms(osf, obj);	
+	writeMeshTransforms(header, obj);	
 	
-	// Write rad( %f )
-	// TODO
-	// Currently Magic Numbers:
-	osf<<"\trad( " <<optimize_float(1.732)<< " "<<")"<<endl;
-	
-	// Write flags( %d )
-	// TODO
-
-	// Write bounds( %c )
-	// TODO
-	// Currently Magic Numbers:
-	osf<<"\tbounds( " <<optimize_float(4)<< " "<<")"<<endl;
-	
-	// Write mass( %f )
-	// TODO
-
-	// Write damp( %f )
-	// TODO
-
-	// Write rotdamp( %f )
-	// TODO
-
-	// Write margin( %f )
-	// TODO
-
-	// Write dim( %f %f %f )
-	// TODO
-	// Currently Magic Numbers:
-	osf<<"\tdim( " <<optimize_float(1) << " " <<optimize_float(1) << " " <<optimize_float(1) << " "<<")"<<endl;
+	writeMeshPlaceholderBounds(header);
+	osf<<header.str();
 	
 	// Write instname( %s )
 	// TODO
@@ -1174,7 +2664,7 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 	// Write bendconst(%c)
 	// TODO
 
-	// Write vbo_offset( %d %d %d %d %d )
+	// Write vbo_offset( %d %d %d %d %d [%d] )
 	writeMeshBoffset(osf, obj);
 
 	// Write vert( %f %f %f )
@@ -1189,6 +2679,9 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 	// Write uv#
 	writeMeshTexCoords(osf, obj);
 
+	// Write vtan( %f %f %f %f )
+	writeMeshVertTangents(osf, obj);
+
 	// Write n_vgroup( %d )
 	// Write vgroup( %s )
 	// Write mname( %s )
@@ -1199,76 +2692,279 @@ MStatus SIO2_ExporterCmd::exportObject(MObject obj)
 	// Write n_frame( %d )
 	// Write frame( %f %s )
 	// Write fvert( %f %f %f )
-	writeMeshAnimData(osf,obj);
+	// Write fnor( %d %d %d )
+	// The frames are appended by mergeAnimations once the whole
+	// scene has been sampled, so the object is left open here.
+	if(vAnimFrames.size() > 0)
+	{
+		osf.close();
+		return queueMeshAnimData(dirFinal, meshDagPath, vAnimFrames);
+	}
 
 	osf<<"}";
 
+	if(bInstanceable)
+	{
+		MeshInstance instance;
+		instance.name = name;
+		instance.nBytes = (size_t)osf.tellp();
+		std::multimap<HashValue, MeshInstance>::iterator added =
+			m_mInstances.insert(std::make_pair(nInstanceHash, instance));
+		added->second.mesh = meshData;
+		memoryAccount().add(MEMORY_INSTANCES, meshData.byteSize());
+	}
+
 	osf.close();
+
+	// With LODs the object is marked done by finishLods, once
+	// its levels are written too.
+	bool bLods = false;
+	if(bStatic && m_nLodLevels > 0)
+	{
+		if(!bInstanceable)
+			extractMeshData(obj, meshData);
+		bLods = queueMeshLods(name, meshData, header.str()) == MS::kSuccess;
+	}
+	if(!bLods)
+		m_journal.markDone(std::string(g_cObjectDir) + "/" + name);
 	return stat;
 }
-MStatus SIO2_ExporterCmd::writeMeshLocation(std::ofstream &osf, MObject obj)
+MStatus SIO2_ExporterCmd::exportInstance(const std::string &name, MObject obj, MeshInstance &original)
 {
-	MStatus stat = MS::kSuccess;
+	SIO2_TRACE("exportInstance");
+	MStatus stat = MStatus::kSuccess;
 
-	MFnMesh meshObj(obj);
-	
-	MFnTransform fn;
+	std::string dirFinal = g_sSceneDir + g_cObjectDir + "/" + name;
+	std::ofstream osf(dirFinal.c_str());
 
-	for(int i=0; i<meshObj.parentCount(); i++)
+	osf<<"object( \""<<g_cObjectDir<<"/"<<name<<"\" )"<<endl
+	<<"{"<<endl;
+
+	writeMeshTransforms(osf, obj);
+
+	writeMeshPlaceholderBounds(osf);
+
+	// The geometry, materials and vbo layout come from the original.
+	osf<<"\tinstname( \""<<g_cObjectDir<<"/"<<original.name<<"\" )"<<endl;
+
+	osf<<"}";
+
+	size_t nBytes = (size_t)osf.tellp();
+	osf.close();
+
+	m_journal.markDone(std::string(g_cObjectDir) + "/" + name);
+
+	m_nInstanceCount++;
+	if(original.nBytes > nBytes)
+		m_nInstanceBytesSaved += original.nBytes - nBytes;
+
+	if(m_bVerbose)
+		MGlobal::displayInfo(MString("Instance: ") + name.c_str() + MString(" of ") + original.name.c_str());
+
+	return stat;
+}
+MStatus SIO2_ExporterCmd::batchObject(const std::string &name, MObject obj)
+{
+	SIO2_TRACE("batchObject");
+	MStatus stat = MStatus::kSuccess;
+
+	MeshData meshData;
+	stat = extractMeshData(obj, meshData);
+	if(stat != MS::kSuccess)
+		return stat;
+
+	MMatrix world = m_transforms.world(TransformCache::parentTransform(obj));
+	MMatrix normalMatrix = world.inverse().transpose();
+	meshData.transform(world.matrix, normalMatrix.matrix);
+
+	memoryAccount().add(MEMORY_BATCHES, meshData.byteSize());
+	m_batcher.add(name, meshData);
+	return stat;
+}
+void SIO2_ExporterCmd::writeBatches()
+{
+	SIO2_TRACE("writeBatches");
+	const std::vector<StaticBatcher::Batch *> &batches = m_batcher.batches();
+	if(batches.empty())
+		return;
+
+	// The vertices are in world space already.
+	std::ostringstream header;
+	header<<"\tloc( " <<optimize_float(0) << " " <<optimize_float(0) << " " <<optimize_float(0) << " "<<")"<<endl;
+	header<<"\trot( " <<optimize_float(0) << " " <<optimize_float(0) << " " <<optimize_float(0) << " "<<")"<<endl;
+	header<<"\tscl( " <<optimize_float(1) << " " <<optimize_float(1) << " " <<optimize_float(1) << " "<<")"<<endl;
+
+	writeMeshPlaceholderBounds(header);
+
+	for(unsigned int i=0; i<batches.size(); i++)
 	{
-		if(meshObj.parent(i).hasFn(MFn::kTransform))
+		StaticBatcher::Batch *batch = batches[i];
+
+		// A mesh left on its own keeps its name.
+		std::string name = batch->sources.size() == 1 ? batch->sources[0] : batch->name;
+
+		std::vector<MeshData> parts(1);
+		parts[0].swap(batch->mesh);
+		if(!writeMeshParts(g_sSceneDir + g_cObjectDir, g_cObjectDir, name, header.str(), parts,
+			m_nStripMode, m_nListIndices, m_nStripIndices))
 		{
-			fn.setObject(meshObj.parent(i));
+			MGlobal::displayError(MString("Failed to write batch: ") + name.c_str());
+			continue;
+		}
+
+		for(unsigned int j=0; j<batch->sources.size(); j++)
+			m_journal.markDone(std::string(g_cObjectDir) + "/" + batch->sources[j]);
+
+		if(m_bVerbose)
+		{
+			MGlobal::displayInfo(MString("Batch: ") + name.c_str() + MString(" meshes: ") + (int)batch->sources.size()
+				+ MString(" vertices: ") + parts[0].vertexCount() + MString(" triangles: ") + parts[0].triangleCount());
 		}
 	}
-	
-	MVector vec = fn.translation(MSpace::kTransform, &stat);
+
+	MGlobal::displayInfo(MString("Batched meshes: ") + m_batcher.meshCount() + MString(" into ") + (int)batches.size() + MString(" objects"));
+	m_nBatchedMeshes = m_batcher.meshCount();
+	m_nBatchObjects = (unsigned int)batches.size();
+	m_batcher.clear();
+	memoryAccount().set(MEMORY_BATCHES, 0);
+}
+MStatus SIO2_ExporterCmd::exportSplitObject(const std::string &name, MObject obj, MeshData &meshData)
+{
+	SIO2_TRACE("exportSplitObject");
+	MStatus stat = MStatus::kSuccess;
+
+	std::ostringstream header;
+	writeMeshTransforms(header, obj);
+
+	writeMeshPlaceholderBounds(header);
+
+	std::vector<MeshData> parts;
+	splitMesh(meshData, (unsigned int)m_nSplitVertices, parts);
+
+	MemoryCharge partsCharge(MEMORY_EXTRACTION);
+	size_t nPartBytes = 0;
+	for(unsigned int i=0; i<parts.size(); i++)
+		nPartBytes += parts[i].byteSize();
+	partsCharge.resize(nPartBytes);
+
+	if(!writeMeshParts(g_sSceneDir + g_cObjectDir, g_cObjectDir, name, header.str(), parts,
+		m_nStripMode, m_nListIndices, m_nStripIndices))
+	{
+		MGlobal::displayError(MString("Failed to write the parts of: ") + name.c_str());
+		stat = MS::kFailure;
+	}
+
+	m_nSplitMeshes++;
+	m_nSplitParts += (unsigned int)parts.size();
+
+	if(m_bVerbose)
+	{
+		MGlobal::displayInfo(MString("Split: ") + name.c_str() + MString(" vertices: ") + meshData.vertexCount()
+			+ MString(" into ") + (int)parts.size() + MString(" objects"));
+	}
+
+	// Same as exportObject, finishLods marks it done after the LODs.
+	bool bLods = m_nLodLevels > 0 && queueMeshLods(name, meshData, header.str()) == MS::kSuccess;
+	if(stat == MS::kSuccess && !bLods)
+		m_journal.markDone(std::string(g_cObjectDir) + "/" + name);
+
+	return stat;
+}
+MStatus SIO2_ExporterCmd::writeMeshLocation(std::ofstream &osf, MObject obj)
+{
+	MStatus stat = MS::kSuccess;
+
+	MMatrix world = m_transforms.world(TransformCache::parentTransform(obj));
+	MVector vec(world[3][0], world[3][1], world[3][2]);
 	
 	osf<<"\tloc( " <<optimize_float(vec.x) << " " <<optimize_float(-1*vec.z) << " " <<optimize_float(vec.y) << " "<<")"<<endl;
 	return stat;
 }
 
-MStatus SIO2_ExporterCmd::writeMeshTransforms(std::ofstream &osf, MObject obj)
+void SIO2_ExporterCmd::writeMeshPlaceholderBounds(std::ostream &osf)
+{
+	// Write rad( %f )
+	// TODO
+	// Currently Magic Numbers:
+	osf<<"\trad( " <<optimize_float(1.732)<< " "<<")"<<endl;
+	
+	// Write flags( %d )
+	// TODO
+
+	// Write bounds( %c )
+	// TODO
+	// Currently Magic Numbers:
+	osf<<"\tbounds( " <<optimize_float(4)<< " "<<")"<<endl;
+	
+	// Write mass( %f )
+	// TODO
+
+	// Write damp( %f )
+	// TODO
+
+	// Write rotdamp( %f )
+	// TODO
+
+	// Write margin( %f )
+	// TODO
+
+	// Write dim( %f %f %f )
+	// TODO
+	// Currently Magic Numbers:
+	osf<<"\tdim( " <<optimize_float(1) << " " <<optimize_float(1) << " " <<optimize_float(1) << " "<<")"<<endl;
+}
+MStatus SIO2_ExporterCmd::writeMeshTransforms(std::ostream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshTransforms");
 	MStatus stat = MS::kSuccess;
 
-	MFnMesh meshObj(obj);
+	// The object takes its name from the first parent.
+	writeTransforms(osf, TransformCache::parentTransform(obj));
 	
-	MFnTransform fn;//(obj);
+	return stat;
+}
+void SIO2_ExporterCmd::writeTransforms(std::ostream &osf, MObject transform)
+{
+	MObject parentObject;
+	if(m_bHierarchy)
+		parentObject = findParentObject(transform);
 
-	for(int i=0; i<meshObj.parentCount(); i++)
-	{
-		if(meshObj.parent(i).hasFn(MFn::kTransform))
-		{
-			fn.setObject(meshObj.parent(i));
-		}
-	}
-	double meshScale [] = {0.0, 0.0, 0.0};
+	MVector vec;
 	MEulerRotation meshRot;
-	fn.getScale(meshScale);
-	fn.getRotation(meshRot);
-	MVector vec = fn.translation(MSpace::kTransform, &stat);
+	double meshScale [] = {1.0, 1.0, 1.0};
+	TransformCache::decompose(m_transforms.relative(transform, parentObject), vec, meshRot, meshScale);
 
 	osf<<"\tloc( " <<optimize_float(vec.x) << " " <<optimize_float(-1*vec.z) << " " <<optimize_float(vec.y) << " "<<")"<<endl;
 	osf<<"\trot( " <<optimize_float(convertRadsToDeg( meshRot.x)) << " " <<optimize_float(convertRadsToDeg(-1* meshRot.z)) << " " <<optimize_float(convertRadsToDeg(meshRot.y)) << " "<<")"<<endl;
 	osf<<"\tscl( " <<optimize_float(meshScale[0]) << " " <<optimize_float(meshScale[1]) << " " <<optimize_float(meshScale[2]) << " "<<")"<<endl;
 
-	
-	return stat;
+	if(!parentObject.isNull())
+	{
+		std::string parentName = removeUnwantedChar(MFnDependencyNode(parentObject).name().asChar());
+		osf<<"\tparent( \""<<g_cObjectDir<<"/"<<parentName<<"\" )"<<endl;
+	}
+}
+MObject SIO2_ExporterCmd::findParentObject(MObject transform)
+{
+	for(MObject node = TransformCache::parentTransform(transform); !node.isNull(); node = TransformCache::parentTransform(node))
+	{
+		MFnDagNode dagFn(node);
+		for(unsigned int i=0; i<dagFn.childCount(); i++)
+		{
+			// Same test as exportObject, a skipped mesh leaves
+			// no object to link to.
+			MObject child = dagFn.child(i);
+			if(child.hasFn(MFn::kMesh) && isMeshWritten(child))
+				return node;
+		}
+	}
+	return MObject::kNullObj;
 }
 
 MVector SIO2_ExporterCmd::retriveTranslation(MObject obj)
 {
-	MFnTransform fn(obj);
-	MVector transl = fn.getTranslation(MSpace::kTransform);
-
-	MGlobal::displayInfo(MString("")+transl.x);
-
-	if(fn.parentCount()>0)
-		return retriveTranslation(fn.parent(0));
-
-	return transl;
-
+	MMatrix world = m_transforms.world(obj);
+	return MVector(world[3][0], world[3][1], world[3][2]);
 }
 MStatus SIO2_ExporterCmd::printParentTrace(MObject obj, std::string level)
 {
@@ -1293,6 +2989,7 @@ MStatus SIO2_ExporterCmd::printParentTrace(MObject obj, std::string level)
 }
 MStatus SIO2_ExporterCmd::writeMeshSkinClusters(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshSkinClusters");
 	MStatus stat = MStatus::kSuccess;
 
 	MFnMesh meshObj(obj);
@@ -1304,25 +3001,13 @@ MStatus SIO2_ExporterCmd::writeMeshSkinClusters(std::ofstream &osf, MObject obj)
 	bool m_bSkinFound = false;
 
 	//Nasty Hack Must Fix
-	MObjectArray shaders;
-	MIntArray FaceIndices;
+	std::vector<std::string> vMaterials;
+	getMeshMaterialNames(obj, vMaterials);
 
-	meshObj.getConnectedShaders(0, shaders, FaceIndices);
-	//Get material file name
-	int size = shaders.length();
 	MString matName;
-	for(int kk=0; kk<shaders.length(); kk++)
+	for(unsigned int kk=0; kk<vMaterials.size(); kk++)
 	{
-		MFnDependencyNode fnShader (shaders[kk]);
-		MPlug sshader = fnShader.findPlug("surfaceShader");
-		MPlugArray materials;
-		sshader.connectedTo(materials,true, true);
-		for(int ii=0; ii<materials.length(); ii++)
-		{
-			MFnDependencyNode fnMat(materials[ii].node());
-			matName = matName+MString("\tmname( \"material/")+ removeUnwantedChar( fnMat.name().asChar()).c_str()+ MString("\" )\n");
-		}
-
+		matName = matName+MString("\tmname( \"material/")+ vMaterials[kk].c_str()+ MString("\" )\n");
 	}
 
 	
@@ -1382,7 +3067,7 @@ MStatus SIO2_ExporterCmd::writeMeshSkinClusters(std::ofstream &osf, MObject obj)
 					
 					MFnSingleIndexedComponent vertices(vertComp);
 					vertices.getElements(intVerts);
-					writeVertexIndicesFromMesh(osf, affectedPath, meshVertices);
+					writeVertexIndicesFromMesh(osf, affectedPath);
 
 				}			
 			}
@@ -1405,152 +3090,42 @@ MStatus SIO2_ExporterCmd::writeMeshSkinClusters(std::ofstream &osf, MObject obj)
 		MDagPath meshDagPath;
 		meshObj.getPath(meshDagPath);			
 
-		writeVertexIndicesFromMesh(osf, meshDagPath,meshVertices);
-		meshVertices.clear();
+		writeVertexIndicesFromMesh(osf, meshDagPath);
 
 	}
 	return stat;
 }
-MStatus SIO2_ExporterCmd::writeVertexIndicesFromMesh(std::ofstream &osf, MDagPath meshDagPath, MPointArray &vertexList)
+MStatus SIO2_ExporterCmd::writeVertexIndicesFromMesh(std::ofstream &osf, MDagPath meshDagPath)
 {
-	MStatus stat = MS::kSuccess;
-	int numTriangles = 0;
-	MIntArray outVertIndices; 
-	MString indCmdWrite("");
-	MPointArray verIndTris;
-
-	// Keep track of the number of triangels
-	// matching the vertices passed.
-	int nCountTriangles = 0; 
-	
-	MItMeshPolygon itPoly(meshDagPath, MObject::kNullObj);
-	for(; !itPoly.isDone(); itPoly.next())
-	{
-		itPoly.numTriangles(numTriangles);
-		for(int i= 0; i<numTriangles; i++)
-		{
-			MPointArray nonTweaked;
-			MIntArray triangleVertices;
-			MIntArray localIndex;
-
-			stat = itPoly.getTriangle(i, nonTweaked, triangleVertices, MSpace::kObject);
-
-			if(stat == MS::kSuccess)
-			{
-				
-				stat = writeVertexIndices(outVertIndices, vertexList, triangleVertices, osf);
-				if(stat == MS::kSuccess)
-				{
-					nCountTriangles++;
-					verIndTris.append(MPoint(outVertIndices[0], outVertIndices[1], outVertIndices[2]));
-				}
-				
-			}
-			// Preapare the list for the next triangle.
-			outVertIndices.clear();
-					
-		}
-	}
-	if(nCountTriangles > 0)
-	{
-		// If we found triangles matching the vertices
-		// then write them to file.
-
-		// Write the number of indices needed to create 
-		// the triangles.
-		osf<<"\tn_ind( "<<nCountTriangles*3<<" )"<<endl;
-		for(int i=0; i<verIndTris.length(); i++)
-		{
-			osf<<"\tind( "<<verIndTris[i].x<< " " << verIndTris[i].y << " " << verIndTris[i].z<<" )"<<endl;
-
-		}
-		
-		// Write the indices.
-		osf<<indCmdWrite.asChar();
-		
-	}
-
-	return stat;
-}
-
-MStatus SIO2_ExporterCmd::writeVertexIndices(MIntArray & outVertexIndeces, MPointArray & vertexList, MIntArray & trisData, std::ofstream &osf)
-{
-	MStatus stat = MS::kSuccess;
-
-	if(trisData.length()!=3)
-	{
-		stat = MS::kFailure;
-		return stat;
-	}
-	for(unsigned int i = 0; i<trisData.length(); i++)
-	{
-		for(unsigned int j = 0; j<vertexList.length(); j++)
-		{
-			if(trisData[i] == j)
-			{
-				outVertexIndeces.append(j);
-				break;
-			}
-
-		}
-	}
-	if(outVertexIndeces.length() != trisData.length())
-	{
-		// Wrong triangle
-		stat = MS::kFailure;
-	}
-	else
-	{
-		if(m_bConvert2BackFaceCulling)
-		{
-			//Write indices in conter-clockwise order
-			int ind2 = outVertexIndeces[1];
-			int ind3 = outVertexIndeces[2];
-			outVertexIndeces[1] = ind3;
-			outVertexIndeces[2] = ind2;
-		}	
-	}
-
-
-	return stat;
-}
-MStatus SIO2_ExporterCmd::getVertexIndices(MIntArray & outVertexIndeces, MPointArray & vertexList, MIntArray & trisData)
-{
-	//MIntArray vertIndex;
-	MStatus stat = MS::kSuccess;
-
-	if(trisData.length()!=3)
-	{
-		stat = MS::kFailure;
-		return stat;
-	}
-	for(unsigned int i = 0; i<trisData.length(); i++)
-	{
-		for(unsigned int j = 0; j<vertexList.length(); j++)
-		{
-			if(trisData[i] == j)//vertexList[j])
-			{
-				outVertexIndeces.append(j);
-				break;
-			}
+	SIO2_TRACE("writeVertexIndicesFromMesh");
+	MStatus stat = MS::kSuccess;
+	ScratchScope scratchScope(m_scratch);
+	IndexBuffer &verIndTris = m_scratch.indexBuffer();
 
-		}
-				
-	}
-	if(outVertexIndeces.length() != trisData.length())
+	getSplitTriangles(meshDagPath, verIndTris);
+
+	//Write indices in conter-clockwise order
+	if(m_bConvert2BackFaceCulling)
+		verIndTris.flipTriangles();
+
+	if(verIndTris.size() > 0)
 	{
-		// Wrong triangle 
-		stat = MS::kFailure;
+		// If we found triangles matching the vertices
+		// then write them to file, as a list or strips.
+		MemoryCharge indexCharge(MEMORY_INDICES, verIndTris.byteSize());
+		size_t nWritten = writeIndexStream(osf, verIndTris, m_nStripMode);
+		m_nListIndices += verIndTris.size();
+		m_nStripIndices += nWritten;
 	}
 
 	return stat;
 }
-
-MIntArray SIO2_ExporterCmd::GetLocalIndex( MIntArray & getVertices, MIntArray & getTriangle)
+void SIO2_ExporterCmd::GetLocalIndex( MIntArray & getVertices, MIntArray & getTriangle, MIntArray & localIndex)
 {
-  MIntArray   localIndex;
   unsigned    gv, gt;
 
+  localIndex.clear();
+
   assert ( getTriangle.length() == 3 );    // Should always deal with a triangle
 
   for ( gt = 0; gt < getTriangle.length(); gt++ )
@@ -1568,8 +3143,6 @@ MIntArray SIO2_ExporterCmd::GetLocalIndex( MIntArray & getVertices, MIntArray &
     if ( localIndex.length() == gt )
       localIndex.append( -1 );
   }
-
-  return localIndex;
 }
 
 MStatus SIO2_ExporterCmd::printChildTrace(MObject obj, std::string level)
@@ -1595,25 +3168,19 @@ MStatus SIO2_ExporterCmd::printChildTrace(MObject obj, std::string level)
 }
 MStatus SIO2_ExporterCmd::writeMeshBoffset(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshBoffset");
 	MStatus stat = MS::kSuccess;
 	// Attach function set to the object.
 	MFnMesh meshObj(obj);
 	
-	// Vertex Array
-	MPointArray vts;
-	// Get the vertices.
-	meshObj.getPoints(vts);
+	// Written vertices, with the copies made on hard edges.
+	unsigned int nVerts = m_vertexSplit.vertexCount();
 
 	// Vertex Color Array
 	MColorArray vcols;
 	// Get the vertices colors.
 	meshObj.getVertexColors(vcols);
 
-	// Vertex Color Array
-	MFloatVectorArray vnor;
-	// Get the vertices colors.
-	meshObj.getVertexNormals(false,vnor);
-
 	// UV set Array
 	MStringArray uvsets;
 	// Get the name of the UV sets.
@@ -1623,39 +3190,50 @@ MStatus SIO2_ExporterCmd::writeMeshBoffset(std::ofstream &osf, MObject obj)
 	for(int i=0; i<vbo_offset.length(); i++)
 		vbo_offset[i]=0;
 
-	MInt64 vbo_size  = vts.length() * 3 * 4;
+	MInt64 vbo_size  = nVerts * 3 * 4;
 
 
 	if(vcols.length()>0)
 	{
 		vbo_offset[0] = vbo_size;
-		vbo_size = vbo_size + vts.length() * 4;
+		vbo_size = vbo_size + nVerts * 4;
 	}
-	if(vnor.length()>0)
+	if(m_vertexSplit.normals().size()>0)
 	{
 		vbo_offset[ 1 ] = vbo_size;
-		vbo_size = vbo_size + vts.length() * 12 ;
+		vbo_size = vbo_size + nVerts * 12 ;
 	}
 
 	if(uvsets.length()>0 && meshObj.numUVs(uvsets[0])>0)
 	{
 		vbo_offset[ 2 ] = vbo_size;
-		vbo_size = vbo_size + vts.length() * 8 ;
+		vbo_size = vbo_size + nVerts * 8 ;
 
 		if(uvsets.length()>1)
 		{
 			vbo_offset[ 3 ] = vbo_size;
-			vbo_size = vbo_size + vts.length() * 8 ;
+			vbo_size = vbo_size + nVerts * 8 ;
 		}
 	}
 
+	// The tangents go last, their offset is a sixth value
+	// only written when there are any.
+	MInt64 tangent_offset = 0;
+	if(m_vertexSplit.tangents().size()>0)
+	{
+		tangent_offset = vbo_size;
+		vbo_size = vbo_size + nVerts * 16 ;
+	}
+
 	
 	osf<<"\tvbo_offset( " <<vbo_size 
 		<< " " <<optimize_float(vbo_offset[0])
 		<< " " <<optimize_float(vbo_offset[1])
 		<< " " <<optimize_float(vbo_offset[2])
-		<< " " <<optimize_float(vbo_offset[3]) 
-		<< " "<<")"<<endl;
+		<< " " <<optimize_float(vbo_offset[3]);
+	if(m_vertexSplit.tangents().size()>0)
+		osf<< " " <<optimize_float(tangent_offset);
+	osf<< " "<<")"<<endl;
 
 	return stat;
 
@@ -1663,6 +3241,7 @@ MStatus SIO2_ExporterCmd::writeMeshBoffset(std::ofstream &osf, MObject obj)
 }
 MStatus SIO2_ExporterCmd::writeMeshVerteices(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshVerteices");
 	MStatus stat = MS::kSuccess;
 	// Attach function set to the object.
 	MFnMesh meshObj(obj);
@@ -1673,19 +3252,22 @@ MStatus SIO2_ExporterCmd::writeMeshVerteices(std::ofstream &osf, MObject obj)
 	// Get the vertices.
 	meshObj.getPoints(vts);
 
-	for(int i=0; i<vts.length(); i++)
+	// The copies made on hard edges repeat their Maya vertex.
+	const std::vector<unsigned int> &sources = m_vertexSplit.sources();
+	for(unsigned int i=0; i<sources.size(); i++)
 	{
+		const MPoint &p = vts[sources[i]];
 
-		osf<<"\tvert( " <<optimize_float(vts[i].x) 
-			<< " " <<optimize_float(-1*vts[i].z)
-			<< " " <<optimize_float(vts[i].y) 
+		osf<<"\tvert( " <<optimize_float(p.x) 
+			<< " " <<optimize_float(-1*p.z)
+			<< " " <<optimize_float(p.y) 
 			<< " "<<")"<<endl;
 	}
-	meshVertices = vts;
 	return stat;
 }
 MStatus SIO2_ExporterCmd::writeMeshVertColor(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshVertColor");
 	MStatus stat = MS::kSuccess;
 	// Attach function set to the object.
 	MFnMesh meshObj(obj);
@@ -1694,13 +3276,18 @@ MStatus SIO2_ExporterCmd::writeMeshVertColor(std::ofstream &osf, MObject obj)
 	MColorArray vcols;
 	// Get the vertices colors.
 	meshObj.getVertexColors(vcols);
+	if(vcols.length() == 0)
+		return stat;
 
-	for(int i=0; i<vcols.length(); i++)
+	const std::vector<unsigned int> &sources = m_vertexSplit.sources();
+	for(unsigned int i=0; i<sources.size(); i++)
 	{
-		osf<<"\tvcol( " <<optimize_float(vcols[i].r) 
-			<< " " <<optimize_float(vcols[i].g) 
-			<< " " <<optimize_float(vcols[i].b)
-			<< " " <<optimize_float(vcols[i].a) << " "<<")"<<endl;
+		const MColor &c = vcols[sources[i]];
+
+		osf<<"\tvcol( " <<optimize_float(c.r) 
+			<< " " <<optimize_float(c.g) 
+			<< " " <<optimize_float(c.b)
+			<< " " <<optimize_float(c.a) << " "<<")"<<endl;
 	}
 
 	return stat;
@@ -1709,27 +3296,24 @@ MStatus SIO2_ExporterCmd::writeMeshVertColor(std::ofstream &osf, MObject obj)
 
 MStatus SIO2_ExporterCmd::writeMeshVertNormals(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshVertNormals");
 	MStatus stat = MS::kSuccess;
-	// Attach function set to the object.
-	MFnMesh meshObj(obj);
-
-	// Vertex Normal Array
-	MFloatVectorArray vnor;
 
-	// Get the vertices normals.
-	meshObj.getVertexNormals(false,vnor);
+	// Face vertex normals, one per written vertex so hard
+	// edges stay hard.
+	const std::vector<float> &vnor = m_vertexSplit.normals();
 
-	for(int i=0; i<vnor.length(); i++)
+	for(unsigned int i=0; i+2<vnor.size(); i+=3)
 	{
 		//RHS
-//		osf<<"\tvnor( " <<optimize_float(vnor[i].x) 
-//			<< " " <<optimize_float(vnor[i].y) 
-//			<< " " <<optimize_float(vnor[i].z)
+//		osf<<"\tvnor( " <<optimize_float(vnor[i]) 
+//			<< " " <<optimize_float(vnor[i+1]) 
+//			<< " " <<optimize_float(vnor[i+2])
 //			<< " "<<")"<<endl;
 		//LHS
-		osf<<"\tvnor( " <<optimize_float(vnor[i].x) 
-			<< " " <<optimize_float(-1*vnor[i].z) 
-			<< " " <<optimize_float(vnor[i].y)
+		osf<<"\tvnor( " <<optimize_float(vnor[i]) 
+			<< " " <<optimize_float(-1*vnor[i+2]) 
+			<< " " <<optimize_float(vnor[i+1])
 			<< " "<<")"<<endl;
 	}
 
@@ -1739,6 +3323,7 @@ MStatus SIO2_ExporterCmd::writeMeshVertNormals(std::ofstream &osf, MObject obj)
 
 MStatus SIO2_ExporterCmd::writeMeshTexCoords(std::ofstream &osf, MObject obj)
 {
+	SIO2_TRACE("writeMeshTexCoords");
 
 	MStatus stat = MS::kSuccess;
 	
@@ -1748,8 +3333,6 @@ MStatus SIO2_ExporterCmd::writeMeshTexCoords(std::ofstream &osf, MObject obj)
 	MDagPath dagForMesh;
 	meshObj.getPath(dagForMesh);
 
-	MIntArray outVertIndices; 
-					
 	// UV set Array
 	MStringArray uvsets;
 
@@ -1760,112 +3343,423 @@ MStatus SIO2_ExporterCmd::writeMeshTexCoords(std::ofstream &osf, MObject obj)
 		stat= MS::kFailure;
 		return stat;
 	}
-	 int  vtxInPolygon;
 
+	// UV set 0 is remapped into the atlas holding the texture.
+	AtlasPlacement atlas;
+	bool bAtlas = getMeshAtlasPlacement(obj, atlas);
+
+	std::vector<float> uvs;
 	for(int i =0; i<uvsets.length() && i<MAX_TEXTURE_CHANNELS; i++)
 	{
-		MFloatArray u_coords;
-		MFloatArray v_coords;
+		getSplitUVs(dagForMesh, uvsets[i], bAtlas && i == 0 ? &atlas : NULL, uvs);
+		MemoryCharge uvCharge(MEMORY_UVS, uvs.size() * sizeof(float));
+
+		// Write UVS
+		for(unsigned int j=0; j+1<uvs.size(); j+=2)
+		{
+			osf<<"\tuv"<<i<<"( " <<optimize_float(uvs[j]) 
+				<< " " <<optimize_float(uvs[j+1])
+				<< " "<<")"<<endl;	
+		}
+	}
+
+	return stat;
+
+}
+MStatus SIO2_ExporterCmd::writeMeshVertTangents(std::ofstream &osf, MObject obj)
+{
+	SIO2_TRACE("writeMeshVertTangents");
+	MStatus stat = MS::kSuccess;
+
+	// Same axis swap as the normals, w is the bitangent sign.
+	const std::vector<float> &vtan = m_vertexSplit.tangents();
+
+	for(unsigned int i=0; i+3<vtan.size(); i+=4)
+	{
+		osf<<"\tvtan( " <<optimize_float(vtan[i]) 
+			<< " " <<optimize_float(-1*vtan[i+2]) 
+			<< " " <<optimize_float(vtan[i+1])
+			<< " " <<optimize_float(vtan[i+3])
+			<< " "<<")"<<endl;
+	}
+
+	return stat;
+}
+MStatus SIO2_ExporterCmd::buildVertexSplit(MObject obj)
+{
+	SIO2_TRACE("buildVertexSplit");
+	MStatus stat = MS::kSuccess;
+
+	// Splits queued for meshes that were not written, skipped
+	// or already in the journal, come first.
+	VertexSplitJob *job = NULL;
+	while(!m_qPendingSplits.empty() && job == NULL)
+	{
+		PendingSplit pending = m_qPendingSplits.front();
+		m_qPendingSplits.pop_front();
+
+		m_workers.wait(pending.job);
+		if(pending.node == obj)
+			job = pending.job;
+		else
+			delete pending.job;
+	}
+
+	// Not prefetched, as when the watcher exports a mesh.
+	if(job == NULL)
+	{
+		job = gatherVertexSplit(obj);
+		job->run();
+	}
+
+	m_vertexSplit.swap(job->m_split);
+	m_nHardEdgeVertices += m_vertexSplit.splitCount() - m_vertexSplit.tangentSplitCount();
+	m_nTangentSplitVertices += m_vertexSplit.tangentSplitCount();
+	delete job;
+
+	return stat;
+}
+VertexSplitJob *SIO2_ExporterCmd::gatherVertexSplit(MObject obj)
+{
+	SIO2_TRACE("gatherVertexSplit");
+	VertexSplitJob *job = new VertexSplitJob();
+
+	MFnMesh meshObj(obj);
+
+	MIntArray polygonCounts, polygonVertices;
+	MIntArray normalCounts, normalIds;
+	MFloatVectorArray normals;
+	meshObj.getVertices(polygonCounts, polygonVertices);
+	meshObj.getNormalIds(normalCounts, normalIds);
+	meshObj.getNormals(normals);
+
+	job->m_nVertices = meshObj.numVertices();
+	job->m_fNormalCos = g_fHardEdgeCos;
+	job->m_fTangentCos = g_fTangentSplitCos;
+
+	job->m_vPolygonCounts.resize(polygonCounts.length());
+	for(unsigned int p=0; p<polygonCounts.length(); p++)
+		job->m_vPolygonCounts[p] = polygonCounts[p];
+
+	// Both lists walk the face vertices in the same order.
+	unsigned int nFaceVertices = polygonVertices.length();
+	job->m_vFaceVertices.resize(nFaceVertices);
+	job->m_vFaceNormals.assign(nFaceVertices * 3, 0.0f);
+	for(unsigned int f=0; f<nFaceVertices; f++)
+	{
+		job->m_vFaceVertices[f] = polygonVertices[f];
+		if(f < normalIds.length() && normalIds[f] >= 0 && normalIds[f] < (int)normals.length())
+		{
+			const MFloatVector &n = normals[normalIds[f]];
+			job->m_vFaceNormals[f*3] = n.x;
+			job->m_vFaceNormals[f*3+1] = n.y;
+			job->m_vFaceNormals[f*3+2] = n.z;
+		}
+	}
+
+	// Tangents follow UV set 0 as written, V flipped. The atlas
+	// only moves and scales it, which leaves them as they are.
+	MStringArray uvsets;
+	meshObj.getUVSetNames(uvsets);
+	if(!m_bTangents || uvsets.length() == 0 || meshObj.numUVs(uvsets[0]) == 0)
+		return job;
+
+	MFloatArray u_coords, v_coords;
+	MIntArray uvCounts, uvIds;
+	meshObj.getUVs(u_coords, v_coords, &uvsets[0]);
+	meshObj.getAssignedUVs(uvCounts, uvIds, &uvsets[0]);
 
-		MFloatArray u_coordsOut(meshVertices.length());
-		MFloatArray v_coordsOut(meshVertices.length());
+	job->m_vUVs.resize(u_coords.length() * 2);
+	for(unsigned int i=0; i<u_coords.length(); i++)
+	{
+		job->m_vUVs[i*2] = u_coords[i];
+		job->m_vUVs[i*2+1] = 1 - v_coords[i];
+	}
 
-		for(int i =0 ; i<u_coordsOut.length(); i++)
+	// Faces without UVs have no ids, so the counts are walked
+	// to line the ids up with the face vertices.
+	job->m_vUVIds.assign(nFaceVertices, -1);
+	unsigned int nFaceVertex = 0, nUV = 0;
+	for(unsigned int p=0; p<polygonCounts.length() && p<uvCounts.length(); p++)
+	{
+		if(uvCounts[p] == polygonCounts[p])
+		{
+			for(int c=0; c<polygonCounts[p] && nUV<uvIds.length(); c++)
+				job->m_vUVIds[nFaceVertex + c] = uvIds[nUV++];
+		}
+		else
 		{
-			u_coordsOut[i] = -1;
-			v_coordsOut[i] = -1;
+			nUV += uvCounts[p];
 		}
+		nFaceVertex += polygonCounts[p];
+	}
+
+	MPointArray points;
+	meshObj.getPoints(points);
+	job->m_vPositions.resize(points.length() * 3);
+	for(unsigned int i=0; i<points.length(); i++)
+	{
+		job->m_vPositions[i*3] = (float)points[i].x;
+		job->m_vPositions[i*3+1] = (float)points[i].y;
+		job->m_vPositions[i*3+2] = (float)points[i].z;
+	}
+
+	// The same triangles as getSplitTriangles writes.
+	MIntArray triangleCounts, triangleVertices;
+	meshObj.getTriangles(triangleCounts, triangleVertices);
+	job->m_vTriangleCounts.resize(triangleCounts.length());
+	for(unsigned int p=0; p<triangleCounts.length(); p++)
+		job->m_vTriangleCounts[p] = triangleCounts[p];
+	job->m_vTriangleVertices.resize(triangleVertices.length());
+	for(unsigned int i=0; i<triangleVertices.length(); i++)
+		job->m_vTriangleVertices[i] = triangleVertices[i];
+
+	return job;
+}
+void SIO2_ExporterCmd::prefetchVertexSplits(const std::vector<MObject> &vNodes, unsigned int &nNext)
+{
+	// Without threads buildVertexSplit does the work itself.
+	if(!m_workers.isRunning())
+		return;
+
+	// The mesh about to be written and one per thread after it.
+	while(nNext < vNodes.size() && m_qPendingSplits.size() <= m_workers.threadCount())
+	{
+		MObject node = vNodes[nNext++];
+		if(node.apiType() != MFn::kMesh)
+			continue;
+
+		MFnMesh meshObj(node);
+		if(meshObj.isIntermediateObject())
+			continue;
+
+		PendingSplit pending;
+		pending.node = node;
+		pending.job = gatherVertexSplit(node);
+		m_qPendingSplits.push_back(pending);
+		m_workers.enqueue(pending.job);
+	}
+}
+void SIO2_ExporterCmd::discardVertexSplits()
+{
+	while(!m_qPendingSplits.empty())
+	{
+		m_workers.wait(m_qPendingSplits.front().job);
+		delete m_qPendingSplits.front().job;
+		m_qPendingSplits.pop_front();
+	}
+}
+void SIO2_ExporterCmd::getSplitTriangles(const MDagPath &dagPath, IndexBuffer &triangles)
+{
+	// A polygon of n vertices makes n - 2 triangles.
+	MFnMesh fnMesh(dagPath);
+	int nTriangleEstimate = fnMesh.numFaceVertices() - 2 * fnMesh.numPolygons();
+	triangles.reset(m_vertexSplit.vertexCount(), nTriangleEstimate > 0 ? nTriangleEstimate * 3 : 0);
 
-		meshObj.getUVs(u_coords, v_coords, &uvsets[i]);
+	MItMeshPolygon itPoly(dagPath, MObject::kNullObj);
+	for(; !itPoly.isDone(); itPoly.next())
+	{
+		ScratchScope polygonScope(m_scratch);
+		MIntArray &polygonVertices = m_scratch.intArray();
+		itPoly.getVertices(polygonVertices);
+		unsigned int nPolygon = itPoly.index();
 
-		MStatus status;
-		MItMeshPolygon  itPolygon( dagForMesh, MObject::kNullObj );
-		for ( /* nothing */; !itPolygon.isDone(); itPolygon.next() )
+		int numTriangles = 0;
+		itPoly.numTriangles(numTriangles);
+		for(int i= 0; i<numTriangles; i++)
 		{
-			
-			MIntArray  polygonVertices;
-			itPolygon.getVertices( polygonVertices );
+			ScratchScope triangleScope(m_scratch);
+			MPointArray &nonTweaked = m_scratch.pointArray();
+			// object-relative vertex indices for each triangle
+			MIntArray &triangleVertices = m_scratch.intArray();
+			// face-relative vertex indices for each triangle
+			MIntArray &localIndex = m_scratch.intArray();
+
+			if(itPoly.getTriangle(i, nonTweaked, triangleVertices, MSpace::kObject) != MS::kSuccess
+				|| triangleVertices.length() != 3)
+				continue;
+
+			GetLocalIndex(polygonVertices, triangleVertices, localIndex);
+
+			int v[3];
+			for(int k=0; k<3; k++)
+				v[k] = localIndex[k] < 0 ? -1 : m_vertexSplit.vertex(nPolygon, localIndex[k]);
+			if(v[0] < 0 || v[1] < 0 || v[2] < 0)
+				continue;
+
+			triangles.push_back(v[0]);
+			triangles.push_back(v[1]);
+			triangles.push_back(v[2]);
+		}
+	}
+}
+void SIO2_ExporterCmd::getSplitUVs(const MDagPath &dagPath, const MString &uvSet, const AtlasPlacement *atlas, std::vector<float> &uvs,
+	std::vector<unsigned char> *seams)
+{
+	ScratchScope setScope(m_scratch);
+	MFloatArray &u_coords = m_scratch.floatArray();
+	MFloatArray &v_coords = m_scratch.floatArray();
 
+	MFnMesh fnMesh(dagPath);
+	fnMesh.getUVs(u_coords, v_coords, &uvSet);
 
+	uvs.assign(m_vertexSplit.vertexCount() * 2, -1.0f);
 
-			// Get triangulation of this poly.
-			int numTriangles;
-			itPolygon.numTriangles(numTriangles);
-			while ( numTriangles-- )
-			{
-					MPointArray                     nonTweaked;
-					// object-relative vertex indices for each triangle
-					MIntArray                       triangleVertices;
-					// face-relative vertex indices for each triangle
-					MIntArray                       localIndex;
-
-		       status = itPolygon.getTriangle( numTriangles,
-			                                nonTweaked,
-				                            triangleVertices,
-					                        MSpace::kObject );
-
-				if ( status == MS::kSuccess )
-				{
+	// UV id of the first corner of each vertex.
+	std::vector<int> vFirstId;
+	if(seams != NULL)
+	{
+		seams->resize(m_vertexSplit.vertexCount(), 0);
+		vFirstId.assign(m_vertexSplit.vertexCount(), -1);
+	}
+
+	MItMeshPolygon itPolygon(dagPath, MObject::kNullObj);
+	for(; !itPolygon.isDone(); itPolygon.next())
+	{
+		unsigned int nPolygon = itPolygon.index();
+		unsigned int nCorners = itPolygon.polygonVertexCount();
+		for(unsigned int c=0; c<nCorners; c++)
+		{
+			int uvID;
+			int nVertex = m_vertexSplit.vertex(nPolygon, c);
+			if(nVertex < 0 || itPolygon.getUVIndex(c, uvID, &uvSet) != MS::kSuccess)
+				continue;
 
-					// Get face-relative vertex indices for this triangle
-					localIndex = GetLocalIndex( polygonVertices,
-						                      triangleVertices );
-
-					status = getVertexIndices(outVertIndices, meshVertices, triangleVertices);
-					if(status == MS::kSuccess)
-					{
-						// Preapare the list for the next triangle.
-						//outVertIndices.clear();
-						int uvID[3];
-
-						// Get UV values for each vertex within this polygon
-						  
-						for ( vtxInPolygon = 0; vtxInPolygon < 3; vtxInPolygon++ )
-						{
-							itPolygon.getUVIndex( localIndex[vtxInPolygon],
-												  uvID[vtxInPolygon],
-												  &uvsets[i] );
-						}
-
-						if(m_bCorrectUVs)
-						{
-						
-						}
-						else
-						{
-							for(int i = 0; i<3; i++)
-							{
-								int vertInd = outVertIndices[i];
-								u_coordsOut[vertInd] = u_coords[uvID[i]];
-								v_coordsOut[vertInd] = 1 - v_coords[uvID[i]];
-
-							}
-						}
-
-					}
+			if(seams != NULL)
+			{
+				if(vFirstId[nVertex] < 0)
+					vFirstId[nVertex] = uvID;
+				else if(vFirstId[nVertex] != uvID)
+					(*seams)[nVertex] = 1;
+			}
 
-			
-				}
-				outVertIndices.clear();
-		
+			float u = u_coords[uvID];
+			float v = v_coords[uvID];
+			if(atlas != NULL)
+			{
+				u = atlas->offsetU + u * atlas->scaleU;
+				v = atlas->offsetV + v * atlas->scaleV;
 			}
+			uvs[nVertex*2] = u;
+			uvs[nVertex*2+1] = 1 - v;
 		}
-		// Write UVS
-		for(int j=0; j<u_coordsOut.length(); j++)
+	}
+}
+void SIO2_ExporterCmd::getMeshMaterials(MObject obj, MObjectArray &materials)
+{
+	MObjectArray shaders;
+	MIntArray FaceIndices;
+	MFnMesh meshObj(obj);
+
+	meshObj.getConnectedShaders(0, shaders, FaceIndices);
+	for(unsigned int kk=0; kk<shaders.length(); kk++)
+	{
+		MFnDependencyNode fnShader (shaders[kk]);
+		MPlug sshader = fnShader.findPlug("surfaceShader");
+		MPlugArray connected;
+		sshader.connectedTo(connected,true, true);
+		for(unsigned int ii=0; ii<connected.length(); ii++)
 		{
-			osf<<"\tuv"<<i<<"( " <<optimize_float(u_coordsOut[j]) 
-				<< " " <<optimize_float(v_coordsOut[j])
-				<< " "<<")"<<endl;	
+			materials.append(connected[ii].node());
 		}
-		u_coordsOut.clear();
-		v_coordsOut.clear();
+	}
+}
+void SIO2_ExporterCmd::getMeshMaterialNames(MObject obj, std::vector<std::string> &vNames)
+{
+	MObjectArray materials;
+	getMeshMaterials(obj, materials);
 
+	for(unsigned int kk=0; kk<materials.length(); kk++)
+	{
+		// Registering writes the material if it was not
+		// reached yet, so the name is final from here on.
+		vNames.push_back(registerMaterial(materials[kk]));
 	}
+}
+bool SIO2_ExporterCmd::isMeshSkinned(MObject obj)
+{
+	MStatus stat;
+	MItDependencyGraph dgIter(obj, 
+							MFn::kSkinClusterFilter, 
+							MItDependencyGraph::kUpstream,
+							MItDependencyGraph::kBreadthFirst,
+							MItDependencyGraph::kNodeLevel,
+							&stat);
 
-	return stat;
+	return stat == MS::kSuccess && !dgIter.isDone();
+}
+MStatus SIO2_ExporterCmd::extractMeshData(MObject obj, MeshData &data)
+{
+	SIO2_TRACE("extractMeshData");
+	MStatus stat = MS::kSuccess;
+
+	MFnMesh meshObj(obj);
+	MDagPath dagForMesh;
+	meshObj.getPath(dagForMesh);
+
+	data.clear();
+
+	// Written vertices, see buildVertexSplit.
+	MPointArray vts;
+	meshObj.getPoints(vts);
+	const std::vector<unsigned int> &sources = m_vertexSplit.sources();
+	unsigned int nVerts = (unsigned int)sources.size();
+
+	data.positions.resize(nVerts * 3);
+	for(unsigned int i=0; i<nVerts; i++)
+	{
+		const MPoint &p = vts[sources[i]];
+		data.positions[i*3] = (float)p.x;
+		data.positions[i*3+1] = (float)p.y;
+		data.positions[i*3+2] = (float)p.z;
+	}
+
+	MColorArray vcols;
+	meshObj.getVertexColors(vcols);
+	data.colors.resize(vcols.length() > 0 ? nVerts * 4 : 0);
+	for(unsigned int i=0; i<nVerts && vcols.length() > 0; i++)
+	{
+		const MColor &c = vcols[sources[i]];
+		data.colors[i*4] = c.r;
+		data.colors[i*4+1] = c.g;
+		data.colors[i*4+2] = c.b;
+		data.colors[i*4+3] = c.a;
+	}
+
+	data.normals = m_vertexSplit.normals();
+	data.tangents = m_vertexSplit.tangents();
+
+	// Triangle indices, same order as writeVertexIndicesFromMesh.
+	getSplitTriangles(dagForMesh, data.indices);
+	if(m_bConvert2BackFaceCulling)
+		data.indices.flipTriangles();
+
+	// UVs per vertex, same as writeMeshTexCoords.
+	MStringArray uvsets;
+	meshObj.getUVSetNames(uvsets);
+	AtlasPlacement atlas;
+	bool bAtlas = getMeshAtlasPlacement(obj, atlas);
+	if(uvsets.length() > 0 && meshObj.numUVs(uvsets[0]) > 0)
+	{
+		for(unsigned int s=0; s<uvsets.length() && s<MAX_TEXTURE_CHANNELS; s++)
+		{
+			data.uvs.push_back(std::vector<float>());
+			getSplitUVs(dagForMesh, uvsets[s], bAtlas && s == 0 ? &atlas : NULL, data.uvs.back(), &data.uvSeams);
+		}
+	}
 
+	if(isMeshSkinned(obj))
+		data.groupName = "skin";
+	else if(m_bUseBlendShapes)
+		data.groupName = "blendShape";
+	else
+		data.groupName = "null";
+
+	getMeshMaterialNames(obj, data.materials);
+
+	return stat;
 }
-bool SIO2_ExporterCmd::containsUV(MFloatArray u_coords, MFloatArray v_coords, double u, double v)
+bool SIO2_ExporterCmd::containsUV(const MFloatArray &u_coords, const MFloatArray &v_coords, double u, double v)
 {
 	for(int i=0; i<u_coords.length(); i++)
 	{
@@ -1948,19 +3842,11 @@ MStatus SIO2_ExporterCmd::GetPointsAtTimeContext(const MDagPath &dagPath, const
 //
 //      Output: (MStatus): MS::kSuccess if it worked; else MS::kFailure.
 // ************************************************************************************************
-MStatus SIO2_ExporterCmd::writeMeshAnimData(std::ofstream &osf, MObject obj)
+MStatus SIO2_ExporterCmd::findMeshAnimFrames(const MDagPath &dagPath, std::vector<double> &vKeyFrames)
 {
+	SIO2_TRACE("findMeshAnimFrames");
 	MStatus stat = MS::kSuccess;
 
-	MPointArray points;
-	MTime currentFrame, maxFrame;
-	std::vector<double> vKeyFrames;
-	std::string defAnimName = "DefAnimName";
-
-	MFnMesh mesh(obj);
-
-	MDagPath dagPath;
-	mesh.getPath(dagPath);
 	// Find key frames.
 	stat = findAnimKeyFrames(dagPath, vKeyFrames);
 
@@ -1968,67 +3854,207 @@ MStatus SIO2_ExporterCmd::writeMeshAnimData(std::ofstream &osf, MObject obj)
 	// either set thorugh the flag or the default of 1;
 	if(stat == MS::kFailure)
 	{
+		vKeyFrames.clear();
+
 		// Only export animation if no anim curve was found
 		// but a frame rate was specified.
 		if(g_nFrameRate > 0)
 		{
-			// Get Start Frame
-			currentFrame = MAnimControl::minTime();
-			// Write number of Frames
-			osf<<"\tn_frame( " <<optimize_float(ceil( maxFrame.value()/g_nFrameRate))<< " "<<")"<<endl;
-			
+			double currentFrame = MAnimControl::minTime().value();
+			double maxFrame = MAnimControl::maxTime().value();
+
 			while(currentFrame <= maxFrame)
 			{
-			
-				stat = GetPointsAtTimeContext( dagPath, currentFrame, points );
-				if(stat == MS::kSuccess)
-				{
-					// Get Frame data if any
-					osf<<"\tframe( " <<optimize_float( currentFrame.value())<<" \""<< defAnimName<<"\" )"<<endl;
-					for(int i=0; i<points.length(); i++)
-					{
-						writeFVert(osf, points[i]);
-					}
-				}
+				vKeyFrames.push_back(currentFrame);
 				currentFrame+= g_nFrameRate;
 			}
 		}
 	}
-	else
+
+	// Frames are baked in time order.
+	std::sort(vKeyFrames.begin(), vKeyFrames.end());
+
+	return vKeyFrames.size() > 0 ? MS::kSuccess : MS::kFailure;
+}
+MStatus SIO2_ExporterCmd::queueMeshAnimData(const std::string &fileName, const MDagPath &dagPath, const std::vector<double> &vFrames)
+{
+	MFnMesh mesh(dagPath);
+
+	AnimBakeMesh bake;
+	bake.dagPath = dagPath;
+	bake.fileName = fileName;
+	bake.vFrames = vFrames;
+	bake.nBufferId = m_animBuffer.addMesh(mesh.numVertices());
+
+	// Frames are baked per Maya vertex and copied to the hard
+	// edge vertices when written.
+	m_vAnimBake.push_back(bake);
+	if(m_vertexSplit.splitCount() > 0)
+		m_vAnimBake.back().vSources = m_vertexSplit.sources();
+	if(m_bFrameNormals)
+		getSplitTriangles(dagPath, m_vAnimBake.back().triangles);
+	if(m_bFrameNormals && m_vertexSplit.tangentSplitCount() > 0)
+		m_vAnimBake.back().vNormalGroups = m_vertexSplit.normalGroups();
+
+	return MS::kSuccess;
+}
+MStatus SIO2_ExporterCmd::bakeAnimations()
+{
+	SIO2_TRACE("bakeAnimations");
+	MStatus stat = MS::kSuccess;
+
+	if(m_vAnimBake.size() == 0)
+		return stat;
+
+	// Every frame needed by any of the meshes.
+	std::vector<double> vAllFrames;
+	for(unsigned int i=0; i<m_vAnimBake.size(); i++)
+	{
+		vAllFrames.insert(vAllFrames.end(), m_vAnimBake[i].vFrames.begin(), m_vAnimBake[i].vFrames.end());
+	}
+	std::sort(vAllFrames.begin(), vAllFrames.end());
+	vAllFrames.erase(std::unique(vAllFrames.begin(), vAllFrames.end()), vAllFrames.end());
+
+	// One unit per mesh and frame sampled.
+	double fAnimWork = 0;
+	for(unsigned int i=0; i<m_vAnimBake.size(); i++)
+		fAnimWork += (double)m_vAnimBake[i].vFrames.size();
+	m_progress.setStageWork(m_nAnimStage, fAnimWork);
+	m_progress.beginStage(m_nAnimStage);
+
+	MTime originalTime = MAnimControl::currentTime();
+
+	// Next frame to bake for each mesh, both lists are sorted.
+	std::vector<unsigned int> vCursor(m_vAnimBake.size(), 0);
+	std::vector<float> xyz;
+	MPointArray points;
+	bool bSpillFailed = false;
+
+	for(unsigned int f=0; f<vAllFrames.size() && !bSpillFailed && !m_progress.isCancelled(); f++)
 	{
-		// Write number of Frames
-		osf<<"\tn_frame( " <<optimize_float( vKeyFrames.size())<< " "<<")"<<endl;
-		for(int i =0 ; i<vKeyFrames.size(); i++)
+		SIO2_TRACE_DETAIL("frame", vAllFrames[f]);
+		bool bTimeSet = false;
+
+		for(unsigned int i=0; i<m_vAnimBake.size(); i++)
 		{
-			currentFrame = vKeyFrames[i];
-			stat = GetPointsAtTimeContext( dagPath, currentFrame, points );
-			if(stat == MS::kSuccess)
+			AnimBakeMesh &bake = m_vAnimBake[i];
+			if(vCursor[i] >= bake.vFrames.size() || bake.vFrames[vCursor[i]] != vAllFrames[f])
+				continue;
+
+			// Skip repeated key frames of the same mesh.
+			while(vCursor[i] < bake.vFrames.size() && bake.vFrames[vCursor[i]] == vAllFrames[f])
+				vCursor[i]++;
+
+			// Move Maya to the frame only once for all the meshes.
+			if(!bTimeSet)
 			{
-				// Get Frame data if any
-				osf<<"\tframe( " <<optimize_float( currentFrame.value())<<" \""<< defAnimName<<"\" )"<<endl;
-				for(int i=0; i<points.length(); i++)
-				{
+				SIO2_TRACE("viewFrame");
+				MGlobal::viewFrame(MTime(vAllFrames[f], MTime::uiUnit()));
+				bTimeSet = true;
+			}
 
-					writeFVert(osf, points[i]);
-				}
-		
+			// You MUST reinitialize the function set after changing time!
+			MFnMesh fnMesh(bake.dagPath);
+			unsigned int nVerts = m_animBuffer.vertexCount(bake.nBufferId);
+			if(fnMesh.getPoints(points) != MS::kSuccess || points.length() != nVerts || nVerts == 0)
+				continue;
+
+			xyz.resize(nVerts * 3);
+			for(unsigned int v=0; v<nVerts; v++)
+			{
+				xyz[v*3] = (float)points[v].x;
+				xyz[v*3+1] = (float)points[v].y;
+				xyz[v*3+2] = (float)points[v].z;
+			}
+
+			if(!m_animBuffer.appendFrame(bake.nBufferId, vAllFrames[f], &xyz[0]))
+			{
+				MGlobal::displayError("Failed to spill animation frames to disk.");
+				bSpillFailed = true;
+				break;
 			}
+
+			if(!m_progress.advance())
+				break;
 		}
+		memoryAccount().set(MEMORY_ANIMATION, m_animBuffer.bytesInMemory());
 	}
 
+	MGlobal::viewFrame(originalTime);
+	m_progress.endStage();
 
-	return stat;
+	// The objects have no frames yet, so none of them is kept
+	// and -resume exports them again.
+	if(m_progress.isCancelled())
+	{
+		discardAnimations();
+		return MS::kFailure;
+	}
+
+	if(m_bVerbose)
+	{
+		MGlobal::displayInfo(MString("Animation frames peak memory (KB): ") + (int)(m_animBuffer.peakBytesInMemory() / 1024)
+			+ MString(" spilled (KB): ") + (int)(m_animBuffer.bytesSpilled() / 1024));
+	}
+
+	return mergeAnimations();
 }
-MStatus SIO2_ExporterCmd::writeFVert(std::ofstream &osf, MPoint vert)
+MStatus SIO2_ExporterCmd::mergeAnimations()
 {
-	MStatus stat = MStatus::kSuccess;
+	SIO2_TRACE("mergeAnimations");
+	MStatus stat = MS::kSuccess;
+
+	// Each mesh reads its own frames, so they are written at the
+	// same time.
+	std::vector<AnimMergeJob *> vJobs;
+	for(unsigned int i=0; i<m_vAnimBake.size(); i++)
+	{
+		AnimBakeMesh &bake = m_vAnimBake[i];
+		AnimMergeJob *job = new AnimMergeJob(m_animBuffer, bake.nBufferId, bake.fileName,
+			bake.vSources, bake.triangles, bake.vNormalGroups, m_bFrameNormals);
+		vJobs.push_back(job);
+		m_workers.enqueue(job);
+	}
+	m_workers.wait();
+
+	double fTotal = 0;
+	for(unsigned int i=0; i<vJobs.size(); i++)
+	{
+		AnimMergeJob *job = vJobs[i];
+		fTotal += job->m_fSeconds;
+		if(job->m_bWritten)
+			m_journal.markDone(job->m_sFileName.substr(g_sSceneDir.length()));
+		else
+		{
+			MGlobal::displayError(MString("Failed to write animation: ") + job->m_sFileName.c_str());
+			stat = MS::kFailure;
+		}
+
+		m_animBuffer.release(job->m_nBufferId);
+		delete job;
+	}
 
-	osf<<"\tfvert( " << optimize_float(vert.x)<<" "
-		<<optimize_float(-1*vert.z)<<" "
-		<<optimize_float(vert.y)<<" )"<<endl;
+	if(m_bVerbose && vJobs.size() > 0)
+	{
+		MGlobal::displayInfo(MString("Animation frames written for ") + (int)vJobs.size()
+			+ MString(" meshes, total (ms): ") + (int)(fTotal * 1000));
+	}
+
+	m_vAnimBake.clear();
+	m_animBuffer.clear();
+	memoryAccount().set(MEMORY_ANIMATION, 0);
 
 	return stat;
 }
+void SIO2_ExporterCmd::discardAnimations()
+{
+	for(unsigned int i=0; i<m_vAnimBake.size(); i++)
+		remove(m_vAnimBake[i].fileName.c_str());
+
+	m_vAnimBake.clear();
+	m_animBuffer.clear();
+	memoryAccount().set(MEMORY_ANIMATION, 0);
+}
 MStatus SIO2_ExporterCmd::findAnimKeyFrames(const MDagPath &dagPath, std::vector<double> &vKeyFrames)
 {
 	MStatus stat = MS::kSuccess;
@@ -2081,6 +4107,18 @@ bool SIO2_ExporterCmd::containsAnimationFrame(MTime frame, const std::vector<dou
 	return false;
 }
 
+bool SIO2_ExporterCmd::isMeshWritten(MObject obj)
+{
+	if(MFnDagNode(obj).isIntermediateObject())
+		return false;
+
+	// Blend shape targets have no key frames of their own.
+	if(m_bUseBlendShapes && !containsKeyFrameAnimation(obj))
+		return false;
+
+	return true;
+}
+
 bool SIO2_ExporterCmd::containsKeyFrameAnimation(MObject obj)
 {
 
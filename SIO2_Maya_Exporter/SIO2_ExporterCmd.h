@@ -117,7 +117,9 @@
 #include <maya/MFnBlinnShader.h>
 
 #include <maya/MAnimControl.h>
+#include <maya/MImage.h>
 #include <maya/MFnBlendShapeDeformer.h>
+#include <maya/MProgressWindow.h>
 
 #include <math.h>
 #include <iostream>
@@ -128,7 +130,28 @@
 #include <cassert>
 #include <direct.h>
 #include <vector>
+#include <deque>
+#include <map>
 #include "FileDialog.h"
+#include "AnimFrameBuffer.h"
+#include "MeshData.h"
+#include "MaterialRegistry.h"
+#include "WorkerPool.h"
+#include "TextureProcessor.h"
+#include "PixelConvert.h"
+#include "AtlasPacker.h"
+#include "MeshSimplifier.h"
+#include "TriangleStrip.h"
+#include "StaticBatcher.h"
+#include "Trace.h"
+#include "MemoryAccount.h"
+#include "ExportProgress.h"
+#include "SceneWatcher.h"
+#include "ScratchArena.h"
+#include "ExportWorkList.h"
+#include "TransformCache.h"
+#include "VertexSplit.h"
+#include "FrameNormals.h"
 
 #ifdef WIN32
 #include "FileDialog_WIN.h"
@@ -148,17 +171,159 @@ class SIO2_ExporterCmd : public MPxCommand
 		
 		std::vector<std::vector<int>> m_vBoneVertexInfluence;
 		
-		// Used while exporting blend shapes and it contains
-		// the names of the meshes not exported. 
-		std::vector<std::string> m_vNameMeshNotExported;
+		// Materials written so far. Used while exporting blend 
+		// shapes, it also contains the names of the materials of 
+		// the meshes not exported.
+		MaterialRegistry m_materials;
 		
 		bool m_bExportSelection;
 		bool m_bVerbose;
 		bool m_bUseBlendShapes;
 		bool m_bConvert2BackFaceCulling;
 		bool m_bCorrectUVs;
+		bool m_bUseInstancing;
+		bool m_bMergeMaterials;
+		bool m_bProcessTextures;
+		// Largest texture side when processing textures.
+		int m_nTextureMaxSize;
+		// Worker threads, 0 is one per processor.
+		int m_nThreads;
+		// Side of the texture atlases, 0 disables them.
+		int m_nAtlasSize;
+		// Format and dithering of the textures not picked by a
+		// naming rule or the sio2Compress attribute of their material.
+		TextureEncoding m_textureEncoding;
+		TextureQuality m_nTextureQuality;
+		// Levels of detail made for static meshes, 0 disables them.
+		int m_nLodLevels;
+		// Fraction of the triangles kept by each level.
+		double m_fLodRatio;
+		// How the index streams are written.
+		StripMode m_nStripMode;
+		// Indices a list would take and indices written, for
+		// the strip report.
+		size_t m_nListIndices;
+		size_t m_nStripIndices;
+		// Meshes with more vertices are split, 0 never splits.
+		int m_nSplitVertices;
+		unsigned int m_nSplitMeshes;
+		unsigned int m_nSplitParts;
+		// Grid cell of the static batches, 0 disables batching.
+		double m_fBatchCellSize;
+		// Objects are written relative to the object above them
+		// with a parent line instead of in world space.
+		bool m_bHierarchy;
+		// World matrices of the transforms exported so far.
+		TransformCache m_transforms;
+		// Chrome trace written when set.
+		std::string m_sTraceFile;
+		// JSON summary written when set.
+		std::string m_sSummaryFile;
+		unsigned int m_nBatchedMeshes;
+		unsigned int m_nBatchObjects;
+		unsigned int m_nTexturesWritten;
+		unsigned int m_nLodsWritten;
+		StaticBatcher m_batcher;
+		// Skip what the journal of a cancelled export says is
+		// already written.
+		bool m_bResume;
+		ExportProgress m_progress;
+		int m_nSceneStage;
+		int m_nAnimStage;
+		int m_nFinishStage;
+		ExportJournal m_journal;
+		// Keep exporting the changed nodes after this export,
+		// see SceneWatcher.
+		bool m_bWatch;
+		// Run by the watcher to export what changed.
+		bool m_bWatchUpdate;
+		// Seconds the scene must be left alone before an update.
+		double m_fWatchDelay;
+		// File name pattern and encoding, the first match wins.
+		std::vector< std::pair<std::string, TextureEncoding> > m_vTextureRules;
 		MString m_sDesitnationDir;
-		MPointArray meshVertices;
+		// Vertices of the mesh being written, split on its hard
+		// edges. Built by exportObject before any writer runs.
+		VertexSplit m_vertexSplit;
+		// Copies made for hard edges in the whole export.
+		unsigned int m_nHardEdgeVertices;
+		// Write the normals of each baked frame.
+		bool m_bFrameNormals;
+		// Write the tangents of meshes with UVs, for normal maps.
+		bool m_bTangents;
+		// Copies made only because the tangents disagreed.
+		unsigned int m_nTangentSplitVertices;
+		// Splits of the meshes coming next, built on the worker
+		// pool while the meshes before them are written.
+		struct PendingSplit
+		{
+			MObject node;
+			VertexSplitJob *job;
+		};
+		std::deque<PendingSplit> m_qPendingSplits;
+
+		// RAM budget in MB for the baked animation frames.
+		// Anything above it is spilled to temporary files.
+		int m_nAnimMemMB;
+
+		// Animated meshes waiting to be baked. Their object
+		// files are left open (no closing brace) until the
+		// frames are appended by mergeAnimations.
+		struct AnimBakeMesh
+		{
+			MDagPath dagPath;
+			std::string fileName;
+			std::vector<double> vFrames;
+			int nBufferId;
+			// Baked vertex of each written one, empty when the
+			// mesh has no hard edges.
+			std::vector<unsigned int> vSources;
+			// Only kept for the frame normals.
+			IndexBuffer triangles;
+			// Empty when there are no tangent copies.
+			std::vector<unsigned int> vNormalGroups;
+		};
+		std::vector<AnimBakeMesh> m_vAnimBake;
+		AnimFrameBuffer m_animBuffer;
+		// Temporary arrays of the mesh being written.
+		ScratchArena m_scratch;
+
+		// Objects exported by geometry hash, used to write
+		// duplicates as instances of them. The geometry is kept
+		// to check a match is not a hash collision.
+		struct MeshInstance
+		{
+			std::string name;
+			size_t nBytes;
+			MeshData mesh;
+		};
+		std::multimap<HashValue, MeshInstance> m_mInstances;
+		unsigned int m_nInstanceCount;
+		size_t m_nInstanceBytesSaved;
+
+		// Runs the work that does not need Maya, like texture
+		// processing, while the scene keeps being exported.
+		WorkerPool m_workers;
+		std::vector<TextureJob *> m_vTextureJobs;
+		StringHashSet m_sTexturesQueued;
+		// Textures Maya could not read, copied as they are.
+		StringHashSet m_sTexturesCopied;
+		std::vector<LodJob *> m_vLodJobs;
+
+		// Where a texture ended up inside an atlas. Offsets and
+		// scales are in Maya UV space (before the V flip).
+		struct AtlasPlacement
+		{
+			std::string atlasName;
+			float offsetU, offsetV;
+			float scaleU, scaleV;
+		};
+		// Keyed by texture file name.
+		std::map<std::string, AtlasPlacement> m_mAtlasByTexture;
+		// Texture file name of each material drawn from an atlas.
+		std::map<std::string, std::string> m_mAtlasTextureOfMaterial;
+		// Textures only used through atlases, not copied on their own.
+		StringHashSet m_sAtlasOnlyTextures;
 	
 		FileDialog *fileDialog;
 
@@ -182,8 +347,27 @@ class SIO2_ExporterCmd : public MPxCommand
 		virtual MStatus doIt( const MArgList& args );
 
 		MStatus exportSelection();
+		MStatus exportNodes(const std::vector<MObject> &vNodes, const std::string &journalPath);
 
 		MStatus exportAll();
+
+		// Resets what an export keeps between nodes and starts
+		// the workers.
+		void beginExport();
+
+		// Writes a single node the way exportAll does.
+		MStatus exportNode(MObject item);
+
+		// Exports the nodes the watcher saw change and deletes
+		// the files of the ones removed or renamed.
+		MStatus exportWatchChanges();
+
+		// Starts the watcher on every node exported.
+		MStatus startWatching(const MArgList &args);
+
+		// File a node is written to, relative to the scene
+		// folder. Empty for nodes without one.
+		std::string exportedFileName(MObject obj);
 		
 		// This function exports a single camera object
 		// into the SIO2 v1.5.3 format.
@@ -205,6 +389,54 @@ class SIO2_ExporterCmd : public MPxCommand
 		// -Check for file extenssion other thant .ogg
 		MStatus exportImages(MObject obj);
 
+		// Decodes the texture and hands it to the worker pool 
+		// to be resized and mipmapped into the /image folder.
+		MStatus queueTexture(const std::string &srcPath, const std::string &fileName, const TextureEncoding &encoding);
+
+		// Waits for the texture jobs and prints their timings.
+		void finishTextures();
+
+		// Hands the mesh to the worker pool to build and write
+		// its levels of detail. header holds the transform and
+		// size lines of the object.
+		MStatus queueMeshLods(const std::string &name, MeshData &meshData, const std::string &header);
+
+		// Waits for the LOD jobs and prints their levels.
+		void finishLods();
+
+		// Peak memory of the export, per stage and mesh with -verbose.
+		void reportMemory();
+
+		// Counts and memory of the export as JSON.
+		void writeExportSummary(const std::string &path, double fSeconds);
+
+		// Name of the texture of a file node as written in /image,
+		// the original name when it could not be converted. Queues
+		// the texture if its file node was not reached yet.
+		std::string exportedTextureName(MObject fileNode);
+
+		// Format and dithering of the texture of a file node. A
+		// string sio2Compress attribute on a material using it wins
+		// over the naming rules, which win over -textureCompress.
+		TextureEncoding textureEncoding(MObject fileNode);
+		TextureEncoding textureEncodingForName(const std::string &fileName);
+
+		// Reads "pattern=format[:dither];..." into m_vTextureRules.
+		MStatus parseTextureRules(const std::string &rules);
+
+		// Packs the colour textures of materials that can share
+		// one into atlases before any object is written. A texture
+		// is packed when every mesh using it has a single material
+		// and UVs inside 0-1, and it is used by materials of the
+		// same kind (opaque or transparent).
+		MStatus buildTextureAtlases();
+
+		bool getMaterialAtlasPlacement(const std::string &matName, AtlasPlacement &placement);
+
+		// Placement for the UV set 0 of the mesh, if its material
+		// was moved into an atlas.
+		bool getMeshAtlasPlacement(MObject obj, AtlasPlacement &placement);
+
 		// This function exprots a given material
 		// to the SIO2 format.
 		// Refer to writeMatTextureInfo bellow for more details.
@@ -215,10 +447,29 @@ class SIO2_ExporterCmd : public MPxCommand
 		// -BLEND MODE
 		MStatus exportMaterial(MObject obj);
 
+		// Writes the material file unless an identical material
+		// was already written. Returns the name to reference it by.
+		std::string registerMaterial(MObject obj);
+
 		// This function exports a given object
 		// to the SIO2 format.
 		MStatus exportObject(MObject obj);
 
+		// Writes an object that reuses the geometry of an
+		// already exported one through instname.
+		MStatus exportInstance(const std::string &name, MObject obj, MeshInstance &original);
+
+		// Moves a static mesh to world space and hands it to the
+		// batcher instead of writing it.
+		MStatus batchObject(const std::string &name, MObject obj);
+
+		// Writes the static batches as objects at the origin.
+		void writeBatches();
+
+		// Writes a static mesh with too many vertices for 16 bit
+		// indices as linked objects small enough, see splitMesh.
+		MStatus exportSplitObject(const std::string &name, MObject obj, MeshData &meshData);
+
 		static MSyntax pluginSyntax();
 
 		static void * creator();
@@ -264,10 +515,23 @@ class SIO2_ExporterCmd : public MPxCommand
 		// used. In SIO2 0 means fully transparent while in
 		// Maya it is 1.
 		// Translucense - Used to represent the Shininess.
-		MStatus writeMatTextureInfo(std::ofstream &osf, MObject obj);
+		MStatus writeMatTextureInfo(std::ostream &osf, MObject obj);
 
 		// Wrtie the mesh transforms.
-		MStatus writeMeshTransforms(std::ofstream &osf, MObject obj);
+		MStatus writeMeshTransforms(std::ostream &osf, MObject obj);
+
+		// Writes the rad, bounds and dim lines of an object, the
+		// same for every object until the real bounds are known.
+		void writeMeshPlaceholderBounds(std::ostream &osf);
+
+		// Writes loc, rot and scl of a transform in world space,
+		// or with -hierarchy relative to the object above it
+		// followed by a parent line naming that object.
+		void writeTransforms(std::ostream &osf, MObject transform);
+
+		// Closest transform above this one that is written as an
+		// object, null when there is none.
+		MObject findParentObject(MObject transform);
 
 		// Write the location of the mesh.
 		MStatus writeMeshLocation(std::ofstream &osf, MObject obj);
@@ -288,17 +552,63 @@ class SIO2_ExporterCmd : public MPxCommand
 		// This function writes the UV for each channel.
 		MStatus writeMeshTexCoords(std::ofstream &osf, MObject obj);
 
+		// Writes the tangents of m_vertexSplit, if it has them.
+		MStatus writeMeshVertTangents(std::ofstream &osf, MObject obj);
+
 		// Used to write bone data for each deformer.
 		MStatus writeMeshSkinClusters(std::ofstream &osf, MObject obj);
 
-		// Used to write the vertex index.
-		MStatus writeVertexIndices(MIntArray & outVertexIndeces, MPointArray & vertexList, MIntArray & trisData, std::ofstream &osf);
-		
-		MStatus writeVertexIndicesFromMesh(std::ofstream &osf, MDagPath meshDagPath, MPointArray & vertexList);
+		MStatus writeVertexIndicesFromMesh(std::ofstream &osf, MDagPath meshDagPath);
+
+		// Splits the vertices of the mesh on its hard edges into
+		// m_vertexSplit, from the face vertex normals, and with
+		// -tangents where the tangents of UV set 0 disagree. Takes
+		// the split queued by prefetchVertexSplits if there is one.
+		MStatus buildVertexSplit(MObject obj);
+
+		// Pulls what buildVertexSplit needs out of Maya.
+		VertexSplitJob *gatherVertexSplit(MObject obj);
+
+		// Queues the splits of the meshes from vNodes[nNext] on,
+		// keeping one per worker thread ahead of the export.
+		void prefetchVertexSplits(const std::vector<MObject> &vNodes, unsigned int &nNext);
+
+		// Waits for and deletes the queued splits left.
+		void discardVertexSplits();
+
+		// Triangles of the mesh in m_vertexSplit vertices, in the
+		// Maya winding order.
+		void getSplitTriangles(const MDagPath &dagPath, IndexBuffer &triangles);
 
-		MStatus writeMeshAnimData(std::ofstream &osf, MObject obj);
+		// UVs of a set for each m_vertexSplit vertex, flipped and
+		// moved into the atlas when atlas is given. The last
+		// corner of a vertex sets its UV. When seams is given, the
+		// vertices whose corners use different UVs are set to 1.
+		void getSplitUVs(const MDagPath &dagPath, const MString &uvSet, const AtlasPlacement *atlas, std::vector<float> &uvs,
+			std::vector<unsigned char> *seams = NULL);
 
-		MStatus writeFVert(std::ofstream &osf, MPoint vert);
+		// Finds the frames that will be baked for the mesh.
+		MStatus findMeshAnimFrames(const MDagPath &dagPath, std::vector<double> &vFrames);
+
+		// Queues the mesh for bakeAnimations.
+		MStatus queueMeshAnimData(const std::string &fileName, const MDagPath &dagPath, const std::vector<double> &vFrames);
+
+		// Steps through every queued frame once, sampling all the
+		// meshes animated at that frame, instead of re-evaluating
+		// the scene for each mesh.
+		MStatus bakeAnimations();
+
+		// Appends the baked frames to each object file and closes
+		// it, one AnimMergeJob per mesh on the workers.
+		MStatus mergeAnimations();
+
+		// Deletes the object files still waiting for their frames,
+		// for a cancelled export.
+		void discardAnimations();
+
+		// Moves the Maya progress window, returns false once the
+		// user pressed Esc.
+		static bool progressCallback(float fraction, const char *stage, void *user);
 
 		// Function taken from : http://ewertb.soundlinker.com/api/api.009.htm
 		// ************************************************************************************************
@@ -344,6 +654,7 @@ class SIO2_ExporterCmd : public MPxCommand
 		
 		MStatus printChildTrace(MObject obj, std::string level);
 
+		// World translation of a transform.
 		MVector retriveTranslation(MObject obj);
 
 		// Use to detect if a file is an audio file.
@@ -361,18 +672,35 @@ class SIO2_ExporterCmd : public MPxCommand
 
 		bool containsKeyFrameAnimation(MObject obj);
 
+		// False for meshes exportObject skips, intermediate ones
+		// and blend shape targets with -bs.
+		bool isMeshWritten(MObject obj);
+
 		bool shouldExportMaterial(std::string matMeshName);
 
+		// Materials assigned to the mesh.
+		void getMeshMaterials(MObject obj, MObjectArray &materials);
+
+		// Names the mesh materials are referenced by, after merging.
+		void getMeshMaterialNames(MObject obj, std::vector<std::string> &vNames);
+
+		bool isMeshSkinned(MObject obj);
+
+		// Pulls the geometry written by writeMeshVerteices, 
+		// writeMeshVertColor, writeMeshVertNormals, writeMeshTexCoords,
+		// writeMeshVertTangents and writeVertexIndicesFromMesh into
+		// a MeshData.
+		MStatus extractMeshData(MObject obj, MeshData &data);
+
 		void disableBlendShapes(MObject obj);
 
 		double findMax(double a, double b);
 
-		MIntArray GetLocalIndex( MIntArray & getVertices, MIntArray & getTriangle);
+		void GetLocalIndex( MIntArray & getVertices, MIntArray & getTriangle, MIntArray & localIndex);
 
-		MStatus getVertexIndices(MIntArray & outVertexIndeces, MPointArray & vertexList, MIntArray & trisData);
 		
 
-		bool containsUV(MFloatArray u_coords, MFloatArray v_coords , double u, double v);
+		bool containsUV(const MFloatArray &u_coords, const MFloatArray &v_coords, double u, double v);
 
 		void createMesh();
 		
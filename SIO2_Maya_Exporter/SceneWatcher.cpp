@@ -0,0 +1,272 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "SceneWatcher.h"
+
+#include <maya/MGlobal.h>
+#include <maya/MAnimControl.h>
+#include <maya/MDGMessage.h>
+#include <maya/MTimerMessage.h>
+#include <maya/MFnDagNode.h>
+#include "WorkerPool.h"
+
+// How often the timer looks for changes to export.
+const float g_fWatchTimerPeriod = 0.1f;
+
+SceneWatcher &SceneWatcher::instance()
+{
+	static SceneWatcher watcher;
+	return watcher;
+}
+
+SceneWatcher::SceneWatcher()
+{
+	m_bWatching = false;
+	m_bSuspended = false;
+	m_bChanged = false;
+	m_bUpdateQueued = false;
+	m_fDelay = 0.3;
+	m_fLastChange = 0;
+}
+
+bool SceneWatcher::start(const MString &updateCommand, double fDelay)
+{
+	stop();
+
+	MStatus stat;
+	m_globalCallbacks.append(MDGMessage::addNodeAddedCallback(nodeAdded, "dependNode", this, &stat));
+	if(stat == MS::kSuccess)
+		m_globalCallbacks.append(MDGMessage::addNodeRemovedCallback(nodeRemoved, "dependNode", this, &stat));
+	if(stat == MS::kSuccess)
+		m_globalCallbacks.append(MTimerMessage::addTimerCallback(g_fWatchTimerPeriod, timerTick, this, &stat));
+
+	if(stat != MS::kSuccess)
+	{
+		stop();
+		return false;
+	}
+
+	m_sUpdateCommand = updateCommand;
+	m_fDelay = fDelay;
+	m_bWatching = true;
+	return true;
+}
+
+void SceneWatcher::stop()
+{
+	for(NodeMap::iterator it = m_mNodes.begin(); it != m_mNodes.end(); ++it)
+		MMessage::removeCallbacks(it->second.callbacks);
+	m_mNodes.clear();
+
+	if(m_globalCallbacks.length() > 0)
+		MMessage::removeCallbacks(m_globalCallbacks);
+	m_globalCallbacks.clear();
+
+	m_vStale.clear();
+	m_bWatching = false;
+	m_bSuspended = false;
+	m_bChanged = false;
+	m_bUpdateQueued = false;
+}
+
+bool SceneWatcher::isExportedType(MObject node)
+{
+	return node.hasFn(MFn::kCamera) || node.hasFn(MFn::kLight) || node.hasFn(MFn::kMesh)
+		|| node.hasFn(MFn::kLambert) || node.hasFn(MFn::kFileTexture);
+}
+
+SceneWatcher::NodeMap::iterator SceneWatcher::find(MObject node)
+{
+	MObjectHandle handle(node);
+	std::pair<NodeMap::iterator, NodeMap::iterator> range = m_mNodes.equal_range(handle.hashCode());
+	for(NodeMap::iterator it = range.first; it != range.second; ++it)
+	{
+		if(it->second.handle == handle)
+			return it;
+	}
+	return m_mNodes.end();
+}
+
+void SceneWatcher::watchNode(MObject node, const std::string &file)
+{
+	NodeMap::iterator found = find(node);
+	if(found != m_mNodes.end())
+	{
+		found->second.file = file;
+		return;
+	}
+
+	WatchedNode watched;
+	watched.handle = MObjectHandle(node);
+	watched.file = file;
+	watched.bDirty = false;
+
+	MStatus stat;
+	watched.callbacks.append(MNodeMessage::addAttributeChangedCallback(node, attributeChanged, this, &stat));
+	watched.callbacks.append(MNodeMessage::addNameChangedCallback(node, nameChanged, this, &stat));
+
+	// Edits through the construction history only dirty the mesh.
+	if(node.hasFn(MFn::kMesh))
+		watched.callbacks.append(MNodeMessage::addNodeDirtyCallback(node, nodeDirty, this, &stat));
+
+	m_mNodes.insert(NodeMap::value_type(watched.handle.hashCode(), watched));
+
+	// Cameras, lamps and meshes take their place from the
+	// transforms above them, up to the top of the hierarchy.
+	if(node.hasFn(MFn::kDagNode))
+	{
+		MFnDagNode dagFn(node);
+		for(unsigned int i=0; i<dagFn.parentCount(); i++)
+		{
+			MObject parent = dagFn.parent(i);
+			if(parent.hasFn(MFn::kTransform) && find(parent) == m_mNodes.end())
+				watchNode(parent, "");
+		}
+	}
+}
+
+void SceneWatcher::unwatchNode(MObject node)
+{
+	NodeMap::iterator found = find(node);
+	if(found == m_mNodes.end())
+		return;
+
+	MMessage::removeCallbacks(found->second.callbacks);
+	m_mNodes.erase(found);
+}
+
+void SceneWatcher::markDirty(MObject node)
+{
+	if(m_bSuspended)
+		return;
+
+	// A transform stands for the shapes under it.
+	if(node.hasFn(MFn::kTransform))
+	{
+		MFnDagNode dagFn(node);
+		for(unsigned int i=0; i<dagFn.childCount(); i++)
+			markDirty(dagFn.child(i));
+		return;
+	}
+
+	NodeMap::iterator found = find(node);
+	if(found == m_mNodes.end())
+		return;
+
+	found->second.bDirty = true;
+	m_bChanged = true;
+	m_fLastChange = getTimeSeconds();
+}
+
+void SceneWatcher::markStale(MObject node)
+{
+	if(node.hasFn(MFn::kTransform))
+	{
+		MFnDagNode dagFn(node);
+		for(unsigned int i=0; i<dagFn.childCount(); i++)
+			markStale(dagFn.child(i));
+		return;
+	}
+
+	NodeMap::iterator found = find(node);
+	if(found == m_mNodes.end() || found->second.file.empty())
+		return;
+
+	m_vStale.push_back(found->second.file);
+	found->second.file.clear();
+	m_bChanged = true;
+	m_fLastChange = getTimeSeconds();
+}
+
+void SceneWatcher::takeChanges(std::vector<MObject> &vDirty, std::vector<std::string> &vStale)
+{
+	for(NodeMap::iterator it = m_mNodes.begin(); it != m_mNodes.end(); ++it)
+	{
+		WatchedNode &watched = it->second;
+		if(watched.bDirty && watched.handle.isValid())
+			vDirty.push_back(watched.handle.object());
+		watched.bDirty = false;
+	}
+
+	vStale.insert(vStale.end(), m_vStale.begin(), m_vStale.end());
+	m_vStale.clear();
+
+	m_bChanged = false;
+	m_bUpdateQueued = false;
+}
+
+void SceneWatcher::attributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void *clientData)
+{
+	if(!(msg & (MNodeMessage::kAttributeSet | MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken)))
+		return;
+
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	watcher->markDirty(plug.node());
+}
+
+void SceneWatcher::nodeDirty(MObject &node, void *clientData)
+{
+	// Every animated mesh gets dirty on each frame.
+	if(MAnimControl::isPlaying())
+		return;
+
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	watcher->markDirty(node);
+}
+
+void SceneWatcher::nameChanged(MObject &node, const MString &prevName, void *clientData)
+{
+	// The files are named after the node, the old one goes.
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	watcher->markStale(node);
+	watcher->markDirty(node);
+}
+
+void SceneWatcher::nodeAdded(MObject &node, void *clientData)
+{
+	if(!isExportedType(node))
+		return;
+
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	watcher->watchNode(node, "");
+	watcher->markDirty(node);
+}
+
+void SceneWatcher::nodeRemoved(MObject &node, void *clientData)
+{
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	if(watcher->find(node) == watcher->m_mNodes.end())
+		return;
+
+	if(!node.hasFn(MFn::kTransform))
+		watcher->markStale(node);
+	watcher->unwatchNode(node);
+}
+
+void SceneWatcher::timerTick(float elapsedTime, float lastTime, void *clientData)
+{
+	SceneWatcher *watcher = (SceneWatcher *)clientData;
+	if(!watcher->m_bChanged || watcher->m_bUpdateQueued || watcher->m_bSuspended)
+		return;
+
+	if(getTimeSeconds() - watcher->m_fLastChange < watcher->m_fDelay || MAnimControl::isPlaying())
+		return;
+
+	watcher->m_bUpdateQueued = true;
+	MGlobal::executeCommandOnIdle(watcher->m_sUpdateCommand);
+}
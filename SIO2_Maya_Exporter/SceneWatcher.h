@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SCENEWATCHER_H
+#define SCENEWATCHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MString.h>
+#include <maya/MPlug.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MNodeMessage.h>
+
+// Tracks the nodes the exporter writes (cameras, lamps, meshes,
+// materials and file textures, plus the transforms above them)
+// and which of them changed. Once the scene has been left alone
+// for the delay, the update command is run on idle to export
+// only the changed nodes. It outlives the command that started
+// it, so there is a single one for the plugin.
+class SceneWatcher
+{
+	public:
+		static SceneWatcher &instance();
+
+		bool start(const MString &updateCommand, double fDelay);
+		void stop();
+		bool isWatching() const { return m_bWatching; }
+
+		// Starts tracking a node, or updates the file it was
+		// written to, relative to the scene folder. The file is
+		// deleted when the node is deleted or renamed.
+		void watchNode(MObject node, const std::string &file);
+
+		// The nodes changed and the files left behind by deleted
+		// or renamed nodes since the last call.
+		void takeChanges(std::vector<MObject> &vDirty, std::vector<std::string> &vStale);
+
+		// Changes made by the export itself, like the frames
+		// stepped through while baking, are ignored.
+		void setSuspended(bool bSuspended) { m_bSuspended = bSuspended; }
+
+		// Nodes exportAll writes a file for.
+		static bool isExportedType(MObject node);
+
+	protected:
+		SceneWatcher();
+
+		struct WatchedNode
+		{
+			MObjectHandle handle;
+			MCallbackIdArray callbacks;
+			std::string file;
+			bool bDirty;
+		};
+		typedef std::multimap<unsigned int, WatchedNode> NodeMap;
+
+		NodeMap::iterator find(MObject node);
+		void markDirty(MObject node);
+		void markStale(MObject node);
+		void unwatchNode(MObject node);
+
+		static void attributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void *clientData);
+		static void nodeDirty(MObject &node, void *clientData);
+		static void nameChanged(MObject &node, const MString &prevName, void *clientData);
+		static void nodeAdded(MObject &node, void *clientData);
+		static void nodeRemoved(MObject &node, void *clientData);
+		static void timerTick(float elapsedTime, float lastTime, void *clientData);
+
+		bool m_bWatching;
+		bool m_bSuspended;
+		bool m_bChanged;
+		bool m_bUpdateQueued;
+		MString m_sUpdateCommand;
+		double m_fDelay;
+		double m_fLastChange;
+
+		// By MObjectHandle hash code.
+		NodeMap m_mNodes;
+		std::vector<std::string> m_vStale;
+		MCallbackIdArray m_globalCallbacks;
+};
+
+#endif
@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "ScratchArena.h"
+
+ScratchArena::ScratchArena()
+	: m_nRequests(0), m_nAllocations(0)
+{
+}
+
+ScratchArena::~ScratchArena()
+{
+	release();
+}
+
+void ScratchArena::reset()
+{
+	m_ints.nUsed = 0;
+	m_floats.nUsed = 0;
+	m_points.nUsed = 0;
+	m_indices.nUsed = 0;
+}
+
+void ScratchArena::release()
+{
+	m_ints.release();
+	m_floats.release();
+	m_points.release();
+	m_indices.release();
+	m_nRequests = 0;
+	m_nAllocations = 0;
+}
+
+// clear() keeps the memory of the Maya arrays, the functions
+// filling them only grow it when a mesh needs more.
+MIntArray &ScratchArena::intArray()
+{
+	m_nRequests++;
+	MIntArray &a = m_ints.take(m_nAllocations);
+	a.clear();
+	return a;
+}
+
+MFloatArray &ScratchArena::floatArray()
+{
+	m_nRequests++;
+	MFloatArray &a = m_floats.take(m_nAllocations);
+	a.clear();
+	return a;
+}
+
+MPointArray &ScratchArena::pointArray()
+{
+	m_nRequests++;
+	MPointArray &a = m_points.take(m_nAllocations);
+	a.clear();
+	return a;
+}
+
+IndexBuffer &ScratchArena::indexBuffer()
+{
+	m_nRequests++;
+	IndexBuffer &b = m_indices.take(m_nAllocations);
+	b.clear();
+	return b;
+}
+
+ScratchScope::ScratchScope(ScratchArena &arena)
+	: m_arena(arena)
+{
+	m_nInts = arena.m_ints.nUsed;
+	m_nFloats = arena.m_floats.nUsed;
+	m_nPoints = arena.m_points.nUsed;
+	m_nIndices = arena.m_indices.nUsed;
+}
+
+ScratchScope::~ScratchScope()
+{
+	m_arena.m_ints.nUsed = m_nInts;
+	m_arena.m_floats.nUsed = m_nFloats;
+	m_arena.m_points.nUsed = m_nPoints;
+	m_arena.m_indices.nUsed = m_nIndices;
+}
@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <stddef.h>
+#include <vector>
+#include "IndexBuffer.h"
+#include <maya/MIntArray.h>
+#include <maya/MFloatArray.h>
+#include <maya/MPointArray.h>
+
+// Temporary arrays for writing a mesh. The loops over triangles
+// used to make and free a few Maya arrays per triangle, now they
+// borrow them from here and the arrays keep their storage from
+// one mesh to the next, so once the biggest mesh has been seen
+// the export stops allocating in those loops. Main thread only.
+class ScratchArena
+{
+	public:
+		ScratchArena();
+		~ScratchArena();
+
+		// Takes every buffer back, keeping their storage.
+		void reset();
+		// Frees the buffers, at the end of the export.
+		void release();
+
+		// An empty buffer, valid until reset() or until the
+		// ScratchScope it was taken in ends.
+		MIntArray &intArray();
+		MFloatArray &floatArray();
+		MPointArray &pointArray();
+		IndexBuffer &indexBuffer();
+
+		// Buffers handed out and buffers that had to be made,
+		// the heap allocations it saved are the difference.
+		size_t requests() const { return m_nRequests; }
+		size_t allocations() const { return m_nAllocations; }
+
+	protected:
+		friend class ScratchScope;
+
+		template<class T> struct Pool
+		{
+			std::vector<T *> vItems;
+			size_t nUsed;
+
+			Pool() : nUsed(0) {}
+			T &take(size_t &nAllocations)
+			{
+				if(nUsed == vItems.size())
+				{
+					vItems.push_back(new T);
+					nAllocations++;
+				}
+				return *vItems[nUsed++];
+			}
+			void release()
+			{
+				for(size_t i=0; i<vItems.size(); i++)
+					delete vItems[i];
+				vItems.clear();
+				nUsed = 0;
+			}
+		};
+
+		Pool<MIntArray> m_ints;
+		Pool<MFloatArray> m_floats;
+		Pool<MPointArray> m_points;
+		Pool<IndexBuffer> m_indices;
+		size_t m_nRequests;
+		size_t m_nAllocations;
+
+	private:
+		ScratchArena(const ScratchArena &);
+		ScratchArena &operator=(const ScratchArena &);
+};
+
+// Gives back the buffers taken from the arena while it lives, so
+// a function called many times for one mesh reuses the same ones.
+class ScratchScope
+{
+	public:
+		ScratchScope(ScratchArena &arena);
+		~ScratchScope();
+
+	protected:
+		ScratchArena &m_arena;
+		size_t m_nInts, m_nFloats, m_nPoints, m_nIndices;
+};
+
+#endif
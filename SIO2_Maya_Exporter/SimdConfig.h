@@ -0,0 +1,36 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SIMDCONFIG_H
+#define SIMDCONFIG_H
+
+// SIO2_USE_SSE2 is defined when the compiler targets SSE2: x64,
+// 32 bit MSVC built with /arch:SSE2 or above, and gcc or clang
+// with -msse2 (the x86_64 default).
+#if (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(_M_X64) || defined(__SSE2__)
+#define SIO2_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// SIO2_USE_AVX2 is defined when the compiler targets AVX2.
+#if defined(__AVX2__)
+#define SIO2_USE_AVX2
+#include <immintrin.h>
+#endif
+
+#endif
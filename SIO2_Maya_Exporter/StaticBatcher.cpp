@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "StaticBatcher.h"
+
+#include <math.h>
+#include <sstream>
+
+StaticBatcher::StaticBatcher()
+{
+	m_fCellSize = 0;
+	m_nMaxVertices = 65536;
+	m_nMeshes = 0;
+}
+
+StaticBatcher::~StaticBatcher()
+{
+	clear();
+}
+
+void StaticBatcher::clear()
+{
+	for(unsigned int i=0; i<m_vBatches.size(); i++)
+		delete m_vBatches[i];
+
+	m_vBatches.clear();
+	m_mOpen.clear();
+	m_nMeshes = 0;
+}
+
+std::string StaticBatcher::batchKey(const MeshData &mesh) const
+{
+	std::stringstream key;
+
+	key<<mesh.groupName;
+	for(unsigned int i=0; i<mesh.materials.size(); i++)
+		key<<"|"<<mesh.materials[i];
+
+	key<<"|"<<(mesh.colors.empty() ? 0 : 1)<<(mesh.normals.empty() ? 0 : 1)<<(mesh.tangents.empty() ? 0 : 1)<<mesh.uvs.size();
+
+	// Cell of the centre of the bounds.
+	if(m_fCellSize > 0 && mesh.vertexCount() > 0)
+	{
+		for(int c=0; c<3; c++)
+		{
+			float minP = mesh.positions[c];
+			float maxP = mesh.positions[c];
+			for(size_t i=c; i<mesh.positions.size(); i+=3)
+			{
+				if(mesh.positions[i] < minP)
+					minP = mesh.positions[i];
+				if(mesh.positions[i] > maxP)
+					maxP = mesh.positions[i];
+			}
+			key<<"|"<<(int)floor((minP + maxP) * 0.5f / m_fCellSize);
+		}
+	}
+	return key.str();
+}
+
+void StaticBatcher::add(const std::string &name, MeshData &mesh)
+{
+	std::string key = batchKey(mesh);
+	m_nMeshes++;
+
+	std::map<std::string, Batch *>::iterator found = m_mOpen.find(key);
+	Batch *batch = found != m_mOpen.end() ? found->second : NULL;
+	if(batch && batch->mesh.vertexCount() + mesh.vertexCount() > m_nMaxVertices)
+		batch = NULL;
+
+	if(!batch)
+	{
+		batch = new Batch;
+		std::stringstream s;
+		s<<"batch"<<m_vBatches.size();
+		if(!mesh.materials.empty())
+			s<<"_"<<mesh.materials[0];
+		batch->name = s.str();
+		batch->mesh.groupName = mesh.groupName;
+		batch->mesh.materials = mesh.materials;
+
+		m_vBatches.push_back(batch);
+		m_mOpen[key] = batch;
+	}
+
+	if(batch->sources.empty())
+		batch->mesh.swap(mesh);
+	else
+		batch->mesh.append(mesh);
+
+	batch->sources.push_back(name);
+	mesh.clear();
+}
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef STATICBATCHER_H
+#define STATICBATCHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "MeshData.h"
+
+// Merges static meshes drawn the same way into few objects.
+// Meshes are grouped by their materials and vertex layout, and
+// by the cell of a grid their centre falls in so a batch stays a
+// compact piece of the level that can still be culled. A batch
+// is closed once the next mesh would take it over the vertex
+// limit.
+class StaticBatcher
+{
+	public:
+		struct Batch
+		{
+			std::string name;
+			MeshData mesh;
+			// Meshes merged into it.
+			std::vector<std::string> sources;
+		};
+
+		StaticBatcher();
+		~StaticBatcher();
+
+		void setCellSize(float fCellSize) { m_fCellSize = fCellSize; }
+		void setMaxVertices(unsigned int nMaxVertices) { m_nMaxVertices = nMaxVertices; }
+
+		// Meshes with more vertices than the limit are not taken.
+		bool accepts(unsigned int nVertices) const { return nVertices <= m_nMaxVertices; }
+
+		// Takes the world space geometry of a mesh, which is
+		// left empty.
+		void add(const std::string &name, MeshData &mesh);
+
+		// Batches in the order they were started.
+		const std::vector<Batch *> &batches() const { return m_vBatches; }
+		unsigned int meshCount() const { return m_nMeshes; }
+
+		void clear();
+
+	protected:
+		std::string batchKey(const MeshData &mesh) const;
+
+		float m_fCellSize;
+		unsigned int m_nMaxVertices;
+		unsigned int m_nMeshes;
+		std::vector<Batch *> m_vBatches;
+		// Batch still taking meshes for each key.
+		std::map<std::string, Batch *> m_mOpen;
+};
+
+#endif
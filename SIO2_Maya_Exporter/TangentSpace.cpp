@@ -0,0 +1,210 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "TangentSpace.h"
+
+#include <math.h>
+
+// UV areas below this give no usable direction.
+static const float g_fMinUVArea = 1e-12f;
+
+void getTriangleFaceVertices(const std::vector<unsigned int> &polygonCounts, const std::vector<unsigned int> &faceVertices,
+							 const std::vector<unsigned int> &triangleCounts, const std::vector<unsigned int> &triangleVertices,
+							 std::vector<unsigned int> &triangles)
+{
+	triangles.clear();
+	triangles.reserve(triangleVertices.size());
+
+	unsigned int nStart = 0;
+	size_t nTriangle = 0;
+	for(size_t p=0; p<polygonCounts.size() && p<triangleCounts.size(); p++)
+	{
+		unsigned int nCorners = polygonCounts[p];
+		for(unsigned int t=0; t<triangleCounts[p] && nTriangle*3+2<triangleVertices.size(); t++, nTriangle++)
+		{
+			unsigned int corner[3];
+			bool bFound = true;
+			for(int k=0; k<3 && bFound; k++)
+			{
+				unsigned int v = triangleVertices[nTriangle*3 + k];
+				bFound = false;
+				for(unsigned int c=0; c<nCorners && nStart+c<faceVertices.size(); c++)
+				{
+					if(faceVertices[nStart + c] == v)
+					{
+						corner[k] = nStart + c;
+						bFound = true;
+						break;
+					}
+				}
+			}
+
+			if(bFound)
+			{
+				triangles.push_back(corner[0]);
+				triangles.push_back(corner[1]);
+				triangles.push_back(corner[2]);
+			}
+		}
+		nStart += nCorners;
+	}
+}
+
+static float dot3(const float a[3], const float b[3])
+{
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+void orthogonalizeTangent(const float n[3], float t[3])
+{
+	float d = dot3(n, t);
+	for(int c=0; c<3; c++)
+		t[c] -= n[c] * d;
+
+	float fLength = sqrtf(dot3(t, t));
+	if(fLength > 1e-6f)
+	{
+		for(int c=0; c<3; c++)
+			t[c] /= fLength;
+		return;
+	}
+
+	// Cross the normal with the axis furthest from it.
+	float axis[3] = { 0, 0, 0 };
+	int nSmallest = 0;
+	for(int c=1; c<3; c++)
+	{
+		if(fabsf(n[c]) < fabsf(n[nSmallest]))
+			nSmallest = c;
+	}
+	axis[nSmallest] = 1;
+
+	t[0] = n[1]*axis[2] - n[2]*axis[1];
+	t[1] = n[2]*axis[0] - n[0]*axis[2];
+	t[2] = n[0]*axis[1] - n[1]*axis[0];
+	fLength = sqrtf(dot3(t, t));
+	if(fLength > 0)
+	{
+		for(int c=0; c<3; c++)
+			t[c] /= fLength;
+	}
+	else
+	{
+		// No normal either.
+		t[0] = 1;
+		t[1] = t[2] = 0;
+	}
+}
+
+void computeFaceTangents(const std::vector<float> &positions, const std::vector<unsigned int> &faceVertices,
+						 const std::vector<float> &faceNormals, const std::vector<int> &uvIds, const std::vector<float> &uvs,
+						 const std::vector<unsigned int> &triangles, std::vector<float> &faceTangents)
+{
+	size_t nFaceVertices = faceVertices.size();
+	unsigned int nPositions = (unsigned int)(positions.size() / 3);
+	unsigned int nUVs = (unsigned int)(uvs.size() / 2);
+
+	// xyz weighed by angle, then the signed weight of the
+	// bitangent sign.
+	faceTangents.assign(nFaceVertices * 4, 0.0f);
+
+	for(size_t t=0; t+2<triangles.size(); t+=3)
+	{
+		const float *p[3];
+		const float *uv[3];
+		bool bValid = true;
+		for(int k=0; k<3 && bValid; k++)
+		{
+			unsigned int f = triangles[t + k];
+			bValid = f < nFaceVertices && faceVertices[f] < nPositions && f < uvIds.size()
+				&& uvIds[f] >= 0 && (unsigned int)uvIds[f] < nUVs;
+			if(bValid)
+			{
+				p[k] = &positions[faceVertices[f] * 3];
+				uv[k] = &uvs[uvIds[f] * 2];
+			}
+		}
+		if(!bValid)
+			continue;
+
+		float e1[3], e2[3];
+		for(int c=0; c<3; c++)
+		{
+			e1[c] = p[1][c] - p[0][c];
+			e2[c] = p[2][c] - p[0][c];
+		}
+		float s1 = uv[1][0] - uv[0][0], t1 = uv[1][1] - uv[0][1];
+		float s2 = uv[2][0] - uv[0][0], t2 = uv[2][1] - uv[0][1];
+		float r = s1*t2 - s2*t1;
+		if(fabsf(r) < g_fMinUVArea)
+			continue;
+
+		// Directions of increasing U and V on the triangle.
+		float sdir[3], tdir[3];
+		for(int c=0; c<3; c++)
+		{
+			sdir[c] = (e1[c]*t2 - e2[c]*t1) / r;
+			tdir[c] = (e2[c]*s1 - e1[c]*s2) / r;
+		}
+
+		for(int k=0; k<3; k++)
+		{
+			unsigned int f = triangles[t + k];
+			const float *n = &faceNormals[f*3];
+
+			// Angle between the two edges leaving the corner.
+			const float *a = p[(k+1) % 3];
+			const float *b = p[(k+2) % 3];
+			float ea[3], eb[3];
+			for(int c=0; c<3; c++)
+			{
+				ea[c] = a[c] - p[k][c];
+				eb[c] = b[c] - p[k][c];
+			}
+			float fLengths = sqrtf(dot3(ea, ea) * dot3(eb, eb));
+			if(fLengths <= 0)
+				continue;
+			float fCos = dot3(ea, eb) / fLengths;
+			float fAngle = acosf(fCos < -1 ? -1 : (fCos > 1 ? 1 : fCos));
+
+			float tan[3] = { sdir[0], sdir[1], sdir[2] };
+			float d = dot3(n, tan);
+			for(int c=0; c<3; c++)
+				tan[c] -= n[c] * d;
+			float fLength = sqrtf(dot3(tan, tan));
+			if(fLength <= 0)
+				continue;
+
+			float cross[3] = { n[1]*tan[2] - n[2]*tan[1], n[2]*tan[0] - n[0]*tan[2], n[0]*tan[1] - n[1]*tan[0] };
+			float fSign = dot3(cross, tdir) < 0 ? -1.0f : 1.0f;
+
+			float *out = &faceTangents[f*4];
+			for(int c=0; c<3; c++)
+				out[c] += tan[c] / fLength * fAngle;
+			out[3] += fSign * fAngle;
+		}
+	}
+
+	for(size_t f=0; f<nFaceVertices; f++)
+	{
+		float *out = &faceTangents[f*4];
+		if(dot3(out, out) > 0)
+			orthogonalizeTangent(&faceNormals[f*3], out);
+		out[3] = out[3] < 0 ? -1.0f : 1.0f;
+	}
+}
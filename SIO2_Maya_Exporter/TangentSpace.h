@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TANGENTSPACE_H
+#define TANGENTSPACE_H
+
+#include <vector>
+
+// Face vertices of the triangles of each polygon. triangleCounts
+// and triangleVertices are as given by MFnMesh::getTriangles, Maya
+// vertices, and are matched against the corners of their polygon.
+// triangles gets 3 face vertices per triangle, the ones whose
+// vertices are not all corners of the polygon are left out.
+void getTriangleFaceVertices(const std::vector<unsigned int> &polygonCounts, const std::vector<unsigned int> &faceVertices,
+							 const std::vector<unsigned int> &triangleCounts, const std::vector<unsigned int> &triangleVertices,
+							 std::vector<unsigned int> &triangles);
+
+// Tangent of each face vertex for normal mapping, following
+// MikkTSpace: the direction of increasing U of each triangle is
+// made perpendicular to the normal of the corner and the triangles
+// around the corner are weighed by their angle at it. The fourth
+// value is the sign of the bitangent, 1 when normal x tangent
+// points along increasing V.
+//
+// positions holds 3 floats per Maya vertex, faceVertices the Maya
+// vertex and faceNormals 3 floats per face vertex. uvIds gives the
+// UV of each face vertex, -1 for none, in uvs (2 floats per UV, V
+// up as written). triangles holds 3 face vertices per triangle.
+// faceTangents gets 4 floats per face vertex, 0 0 0 1 for corners
+// of triangles without UVs or with degenerate ones.
+void computeFaceTangents(const std::vector<float> &positions, const std::vector<unsigned int> &faceVertices,
+						 const std::vector<float> &faceNormals, const std::vector<int> &uvIds, const std::vector<float> &uvs,
+						 const std::vector<unsigned int> &triangles, std::vector<float> &faceTangents);
+
+// Makes t (xyz of a tangent) unit length and perpendicular to the
+// unit normal n. A tangent along the normal or of no length is
+// replaced by any direction perpendicular to it.
+void orthogonalizeTangent(const float n[3], float t[3]);
+
+#endif
@@ -0,0 +1,545 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "TextureProcessor.h"
+#include "EtcEncoder.h"
+#include "PixelConvert.h"
+#include "Trace.h"
+#include "MemoryAccount.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <sstream>
+#include "SimdConfig.h"
+
+bool isKTXFormat(TextureFormat format)
+{
+	return format != TEXTURE_FORMAT_TGA;
+}
+
+bool isEtcFormat(TextureFormat format)
+{
+	return format == TEXTURE_FORMAT_ETC || format == TEXTURE_FORMAT_ETC1 || format == TEXTURE_FORMAT_ETC2;
+}
+
+bool parseTextureFormat(const std::string &name, TextureFormat &format)
+{
+	if(name == "tga" || name == "none")
+		format = TEXTURE_FORMAT_TGA;
+	else if(name == "etc")
+		format = TEXTURE_FORMAT_ETC;
+	else if(name == "etc1")
+		format = TEXTURE_FORMAT_ETC1;
+	else if(name == "etc2")
+		format = TEXTURE_FORMAT_ETC2;
+	else if(name == "rgb565")
+		format = TEXTURE_FORMAT_RGB565;
+	else if(name == "rgba4444")
+		format = TEXTURE_FORMAT_RGBA4444;
+	else if(name == "rgba5551")
+		format = TEXTURE_FORMAT_RGBA5551;
+	else
+		return false;
+
+	return true;
+}
+
+const char *textureFormatName(TextureFormat format)
+{
+	switch(format)
+	{
+		case TEXTURE_FORMAT_ETC:
+			return "etc";
+		case TEXTURE_FORMAT_ETC1:
+			return "etc1";
+		case TEXTURE_FORMAT_ETC2:
+			return "etc2";
+		case TEXTURE_FORMAT_RGB565:
+			return "rgb565";
+		case TEXTURE_FORMAT_RGBA4444:
+			return "rgba4444";
+		case TEXTURE_FORMAT_RGBA5551:
+			return "rgba5551";
+		default:
+			return "tga";
+	}
+}
+
+bool parseTextureDither(const std::string &name, TextureDither &dither)
+{
+	if(name == "none")
+		dither = TEXTURE_DITHER_NONE;
+	else if(name == "ordered")
+		dither = TEXTURE_DITHER_ORDERED;
+	else if(name == "diffusion")
+		dither = TEXTURE_DITHER_DIFFUSION;
+	else
+		return false;
+
+	return true;
+}
+
+bool parseTextureEncoding(const std::string &name, TextureEncoding &encoding)
+{
+	size_t colon = name.find(':');
+	if(colon == std::string::npos)
+		return parseTextureFormat(name, encoding.format);
+
+	return parseTextureFormat(name.substr(0, colon), encoding.format) && parseTextureDither(name.substr(colon + 1), encoding.dither);
+}
+
+bool parseTextureQuality(const std::string &name, TextureQuality &quality)
+{
+	if(name == "fast")
+		quality = TEXTURE_QUALITY_FAST;
+	else if(name == "normal")
+		quality = TEXTURE_QUALITY_NORMAL;
+	else if(name == "high")
+		quality = TEXTURE_QUALITY_HIGH;
+	else
+		return false;
+
+	return true;
+}
+
+bool isPowerOfTwo(unsigned int n)
+{
+	return n > 0 && (n & (n - 1)) == 0;
+}
+
+unsigned int nearestPowerOfTwo(unsigned int n, unsigned int maxSize)
+{
+	unsigned int lower = 1;
+	while(lower * 2 <= n)
+		lower *= 2;
+
+	unsigned int pot = lower;
+	if(lower < n && (n - lower) > (lower * 2 - n))
+		pot = lower * 2;
+
+	while(pot > maxSize && pot > 1)
+		pot /= 2;
+
+	return pot;
+}
+
+// Source texels and weights contributing to each output texel.
+struct FilterTap
+{
+	unsigned int first;
+	std::vector<float> weights;
+};
+
+static void computeTaps(unsigned int srcSize, unsigned int dstSize, std::vector<FilterTap> &taps)
+{
+	float scale = (float)srcSize / (float)dstSize;
+	float support = scale > 1.0f ? scale : 1.0f;
+
+	taps.resize(dstSize);
+	for(unsigned int i=0; i<dstSize; i++)
+	{
+		float center = (i + 0.5f) * scale - 0.5f;
+		int first = (int)ceil(center - support);
+		int last = (int)floor(center + support);
+
+		if(first < 0)
+			first = 0;
+		if(last > (int)srcSize - 1)
+			last = srcSize - 1;
+
+		FilterTap &tap = taps[i];
+		tap.first = first;
+		tap.weights.clear();
+
+		float total = 0;
+		for(int s=first; s<=last; s++)
+		{
+			float w = 1.0f - fabs(s - center) / support;
+			if(w < 0)
+				w = 0;
+			tap.weights.push_back(w);
+			total += w;
+		}
+
+		// Nearest texel when the tent misses every sample.
+		if(total <= 0)
+		{
+			int nearest = (int)floor(center + 0.5f);
+			if(nearest < 0)
+				nearest = 0;
+			if(nearest > (int)srcSize - 1)
+				nearest = srcSize - 1;
+			tap.first = nearest;
+			tap.weights.assign(1, 1.0f);
+			total = 1.0f;
+		}
+
+		for(unsigned int w=0; w<tap.weights.size(); w++)
+			tap.weights[w] /= total;
+	}
+}
+
+void resampleImage(const TextureImage &src, unsigned int width, unsigned int height, TextureImage &dst)
+{
+	dst.width = width;
+	dst.height = height;
+	dst.pixels.resize((size_t)width * height * 4);
+
+	if(src.width == width && src.height == height)
+	{
+		dst.pixels = src.pixels;
+		return;
+	}
+
+	std::vector<FilterTap> tapsX, tapsY;
+	computeTaps(src.width, width, tapsX);
+	computeTaps(src.height, height, tapsY);
+
+	// Horizontal pass into floats, then vertical.
+	std::vector<float> temp((size_t)width * src.height * 4);
+	for(unsigned int y=0; y<src.height; y++)
+	{
+		const unsigned char *row = &src.pixels[(size_t)y * src.width * 4];
+		float *out = &temp[(size_t)y * width * 4];
+
+		for(unsigned int x=0; x<width; x++)
+		{
+			const FilterTap &tap = tapsX[x];
+			float acc[4] = {0, 0, 0, 0};
+			for(unsigned int w=0; w<tap.weights.size(); w++)
+			{
+				const unsigned char *p = row + (tap.first + w) * 4;
+				for(int c=0; c<4; c++)
+					acc[c] += p[c] * tap.weights[w];
+			}
+			for(int c=0; c<4; c++)
+				out[x*4 + c] = acc[c];
+		}
+	}
+
+	for(unsigned int y=0; y<height; y++)
+	{
+		const FilterTap &tap = tapsY[y];
+		unsigned char *out = &dst.pixels[(size_t)y * width * 4];
+
+		for(unsigned int x=0; x<width*4; x++)
+		{
+			float acc = 0;
+			for(unsigned int w=0; w<tap.weights.size(); w++)
+				acc += temp[(size_t)(tap.first + w) * width * 4 + x] * tap.weights[w];
+
+			int val = (int)(acc + 0.5f);
+			out[x] = (unsigned char)(val < 0 ? 0 : (val > 255 ? 255 : val));
+		}
+	}
+}
+
+void downsampleBox(const TextureImage &src, TextureImage &dst)
+{
+	unsigned int width = src.width > 1 ? src.width / 2 : 1;
+	unsigned int height = src.height > 1 ? src.height / 2 : 1;
+
+	dst.width = width;
+	dst.height = height;
+	dst.pixels.resize((size_t)width * height * 4);
+
+	// Rows and columns are clamped so 1 texel wide
+	// levels average with themselves.
+	unsigned int stepX = src.width > 1 ? 4 : 0;
+
+	for(unsigned int y=0; y<height; y++)
+	{
+		const unsigned char *row0 = &src.pixels[(size_t)(y * 2) * src.width * 4];
+		const unsigned char *row1 = src.height > 1 ? row0 + src.width * 4 : row0;
+		unsigned char *out = &dst.pixels[(size_t)y * width * 4];
+		unsigned int x = 0;
+
+#ifdef SIO2_USE_SSE2
+		// 8 source texels of both rows give 4 output texels,
+		// summed in 16 bits so they round like the loop below.
+		if(stepX != 0)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+			for(; x + 4 <= width; x += 4)
+			{
+				__m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+				__m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + x * 8 + 16));
+				__m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+				__m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + x * 8 + 16));
+
+				// Vertical sums, two texels a register.
+				__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+				// Even plus odd texels.
+				__m128i r0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+				__m128i r1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+				r0 = _mm_srli_epi16(_mm_add_epi16(r0, round), 2);
+				r1 = _mm_srli_epi16(_mm_add_epi16(r1, round), 2);
+
+				_mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(r0, r1));
+			}
+		}
+#endif
+		for(; x<width; x++)
+		{
+			const unsigned char *p0 = row0 + x * 2 * 4;
+			const unsigned char *p1 = row1 + x * 2 * 4;
+			for(int c=0; c<4; c++)
+			{
+				out[x*4 + c] = (unsigned char)((p0[c] + p0[c + stepX] + p1[c] + p1[c + stepX] + 2) >> 2);
+			}
+		}
+	}
+}
+
+void buildMipChain(const TextureImage &base, std::vector<TextureImage> &mips)
+{
+	mips.clear();
+	mips.push_back(base);
+
+	while(mips.back().width > 1 || mips.back().height > 1)
+	{
+		TextureImage level;
+		downsampleBox(mips.back(), level);
+		mips.push_back(level);
+	}
+}
+
+bool writeTGA(const std::string &path, const TextureImage &img)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(file == NULL)
+		return false;
+
+	unsigned char header[18] = {0};
+	// Uncompressed true color, bottom left origin, 8 bits of alpha.
+	header[2] = 2;
+	header[12] = (unsigned char)(img.width & 0xff);
+	header[13] = (unsigned char)(img.width >> 8);
+	header[14] = (unsigned char)(img.height & 0xff);
+	header[15] = (unsigned char)(img.height >> 8);
+	header[16] = 32;
+	header[17] = 8;
+	fwrite(header, 1, sizeof(header), file);
+
+	// TGA stores BGRA.
+	std::vector<unsigned char> row(img.width * 4);
+	for(unsigned int y=0; y<img.height; y++)
+	{
+		const unsigned char *src = &img.pixels[(size_t)y * img.width * 4];
+		for(unsigned int x=0; x<img.width; x++)
+		{
+			row[x*4] = src[x*4 + 2];
+			row[x*4 + 1] = src[x*4 + 1];
+			row[x*4 + 2] = src[x*4];
+			row[x*4 + 3] = src[x*4 + 3];
+		}
+		fwrite(&row[0], 1, row.size(), file);
+	}
+
+	bool bOk = ferror(file) == 0;
+	fclose(file);
+	return bOk;
+}
+
+static void writeUInt32(FILE *file, unsigned int v)
+{
+	// KTX is written little endian, the endianness field tells
+	// readers how to swap.
+	unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+	fwrite(b, 1, 4, file);
+}
+
+bool writeKTX(const std::string &path, unsigned int glInternalFormat, unsigned int glBaseFormat,
+			  unsigned int width, unsigned int height, const std::vector< std::vector<unsigned char> > &levels,
+			  unsigned int glType, unsigned int glTypeSize)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if(file == NULL)
+		return false;
+
+	static const unsigned char identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+	fwrite(identifier, 1, sizeof(identifier), file);
+
+	writeUInt32(file, 0x04030201);
+	// glFormat is 0 for compressed data.
+	writeUInt32(file, glType);
+	writeUInt32(file, glTypeSize);
+	writeUInt32(file, glType != 0 ? glBaseFormat : 0);
+	writeUInt32(file, glInternalFormat);
+	writeUInt32(file, glBaseFormat);
+	writeUInt32(file, width);
+	writeUInt32(file, height);
+	writeUInt32(file, 0);
+	writeUInt32(file, 0);
+	writeUInt32(file, 1);
+	writeUInt32(file, (unsigned int)levels.size());
+	writeUInt32(file, 0);
+
+	// Levels come 4 byte aligned, block sizes and the row
+	// padding of the 16 bit formats take care of it.
+	for(unsigned int i=0; i<levels.size(); i++)
+	{
+		writeUInt32(file, (unsigned int)levels[i].size());
+		if(!levels[i].empty())
+			fwrite(&levels[i][0], 1, levels[i].size(), file);
+	}
+
+	bool bOk = ferror(file) == 0;
+	fclose(file);
+	return bOk;
+}
+
+static std::string stripExtension(const std::string &name)
+{
+	size_t dot = name.find_last_of(".");
+	if(dot == std::string::npos)
+		return name;
+
+	return name.substr(0, dot);
+}
+
+TextureJob::TextureJob(const std::string &baseName, const std::string &outDir, TextureImage &image, unsigned int maxSize, bool bMips,
+					   TextureFormat format, TextureQuality quality, TextureDither dither)
+{
+	m_sBaseName = baseName;
+	m_sOutDir = outDir;
+	m_nMaxSize = maxSize;
+	m_bMips = bMips;
+	m_nFormat = format;
+	m_nQuality = quality;
+	m_nDither = dither;
+
+	m_bSuccess = false;
+	m_nSrcWidth = image.width;
+	m_nSrcHeight = image.height;
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nLevels = 0;
+	m_fDecodeSeconds = 0;
+	m_fProcessSeconds = 0;
+	m_fPSNR = 0;
+	m_nFormatWritten = format;
+
+	m_image.width = image.width;
+	m_image.height = image.height;
+	m_image.pixels.swap(image.pixels);
+	memoryAccount().add(MEMORY_TEXTURES, m_image.pixels.size());
+	image.width = 0;
+	image.height = 0;
+}
+
+std::string TextureJob::outputName(const std::string &baseName, TextureFormat format)
+{
+	return stripExtension(baseName) + (isKTXFormat(format) ? ".ktx" : ".tga");
+}
+
+void TextureJob::run()
+{
+	SIO2_TRACE_DETAIL("TextureJob", m_sBaseName.c_str());
+	double fStart = getTimeSeconds();
+
+	TextureImage base;
+	resampleImage(m_image, nearestPowerOfTwo(m_image.width, m_nMaxSize), nearestPowerOfTwo(m_image.height, m_nMaxSize), base);
+
+	// The source is no longer needed.
+	memoryAccount().remove(MEMORY_TEXTURES, m_image.pixels.size());
+	std::vector<unsigned char>().swap(m_image.pixels);
+
+	std::vector<TextureImage> mips;
+	if(m_bMips)
+		buildMipChain(base, mips);
+	else
+		mips.push_back(base);
+
+	size_t nMipBytes = base.pixels.size();
+	for(unsigned int i=0; i<mips.size(); i++)
+		nMipBytes += mips[i].pixels.size();
+	MemoryCharge mipCharge(MEMORY_TEXTURES, nMipBytes);
+
+	m_nWidth = base.width;
+	m_nHeight = base.height;
+	m_nLevels = (unsigned int)mips.size();
+
+	if(isEtcFormat(m_nFormat))
+	{
+		m_bSuccess = writeCompressed(mips);
+	}
+	else if(is16BitFormat(m_nFormat))
+	{
+		m_bSuccess = write16Bit(mips);
+	}
+	else
+	{
+		m_bSuccess = writeTGA(m_sOutDir + "/" + outputName(m_sBaseName), mips[0]);
+		for(unsigned int i=1; i<mips.size() && m_bSuccess; i++)
+		{
+			std::stringstream s;
+			s<<m_sOutDir<<"/"<<stripExtension(m_sBaseName)<<"_mip"<<i<<".tga";
+			m_bSuccess = writeTGA(s.str(), mips[i]);
+		}
+	}
+
+	m_fProcessSeconds = getTimeSeconds() - fStart;
+}
+
+bool TextureJob::writeCompressed(const std::vector<TextureImage> &mips)
+{
+	bool bAlpha;
+	if(m_nFormat == TEXTURE_FORMAT_ETC)
+		bAlpha = hasAlpha(mips[0]);
+	else
+		bAlpha = m_nFormat == TEXTURE_FORMAT_ETC2;
+	m_nFormatWritten = bAlpha ? TEXTURE_FORMAT_ETC2 : TEXTURE_FORMAT_ETC1;
+
+	std::vector< std::vector<unsigned char> > levels(mips.size());
+	for(unsigned int i=0; i<mips.size(); i++)
+		compressEtcImage(mips[i], bAlpha, m_nQuality, levels[i]);
+
+	// Quality is reported for the base level only.
+	TextureImage decoded;
+	decompressEtcImage(levels[0], mips[0].width, mips[0].height, bAlpha, decoded);
+	m_fPSNR = computePSNR(mips[0], decoded, bAlpha);
+
+	return writeKTX(m_sOutDir + "/" + outputName(m_sBaseName, m_nFormat),
+		bAlpha ? SIO2_GL_COMPRESSED_RGBA8_ETC2_EAC : SIO2_GL_ETC1_RGB8_OES,
+		bAlpha ? 0x1908 : 0x1907, mips[0].width, mips[0].height, levels);
+}
+
+bool TextureJob::write16Bit(const std::vector<TextureImage> &mips)
+{
+	PixelKernel kernel = bestPixelKernel();
+
+	std::vector< std::vector<unsigned char> > levels(mips.size());
+	for(unsigned int i=0; i<mips.size(); i++)
+		convertPixels16(mips[i], m_nFormat, m_nDither, levels[i], kernel);
+
+	TextureImage decoded;
+	expandPixels16(levels[0], mips[0].width, mips[0].height, m_nFormat, decoded);
+	m_fPSNR = computePSNR(mips[0], decoded, m_nFormat != TEXTURE_FORMAT_RGB565);
+
+	unsigned int internalFormat, baseFormat, type;
+	getPixels16GLFormat(m_nFormat, internalFormat, baseFormat, type);
+
+	return writeKTX(m_sOutDir + "/" + outputName(m_sBaseName, m_nFormat),
+		internalFormat, baseFormat, mips[0].width, mips[0].height, levels, type, 2);
+}
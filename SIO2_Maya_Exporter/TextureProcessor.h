@@ -0,0 +1,161 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TEXTUREPROCESSOR_H
+#define TEXTUREPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include "WorkerPool.h"
+
+// 8 bit RGBA image, rows stored bottom up the same way
+// MImage hands them out.
+struct TextureImage
+{
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> pixels;
+
+	TextureImage() : width(0), height(0) {}
+};
+
+// How a texture is written to /image.
+enum TextureFormat
+{
+	TEXTURE_FORMAT_TGA,
+	// ETC1 if the texture is opaque, ETC2 RGBA8 otherwise.
+	TEXTURE_FORMAT_ETC,
+	TEXTURE_FORMAT_ETC1,
+	TEXTURE_FORMAT_ETC2,
+	// 16 bit uncompressed.
+	TEXTURE_FORMAT_RGB565,
+	TEXTURE_FORMAT_RGBA4444,
+	TEXTURE_FORMAT_RGBA5551
+};
+
+// Dithering used when reducing to a 16 bit format.
+enum TextureDither
+{
+	TEXTURE_DITHER_NONE,
+	TEXTURE_DITHER_ORDERED,
+	TEXTURE_DITHER_DIFFUSION
+};
+
+// Encoder presets, trading export time for quality.
+enum TextureQuality
+{
+	TEXTURE_QUALITY_FAST,
+	TEXTURE_QUALITY_NORMAL,
+	TEXTURE_QUALITY_HIGH
+};
+
+// Format and dithering picked for one texture.
+struct TextureEncoding
+{
+	TextureFormat format;
+	TextureDither dither;
+
+	TextureEncoding() : format(TEXTURE_FORMAT_TGA), dither(TEXTURE_DITHER_ORDERED) {}
+};
+
+// Formats written as a .ktx file instead of .tga files.
+bool isKTXFormat(TextureFormat format);
+bool isEtcFormat(TextureFormat format);
+
+// Names used by the exporter flags: tga (or none), etc, etc1,
+// etc2, rgb565, rgba4444, rgba5551, then none, ordered,
+// diffusion and fast, normal, high.
+bool parseTextureFormat(const std::string &name, TextureFormat &format);
+const char *textureFormatName(TextureFormat format);
+bool parseTextureDither(const std::string &name, TextureDither &dither);
+bool parseTextureQuality(const std::string &name, TextureQuality &quality);
+
+// "format" or "format:dither", the dither is left as it
+// is when not given.
+bool parseTextureEncoding(const std::string &name, TextureEncoding &encoding);
+
+bool isPowerOfTwo(unsigned int n);
+
+// Closest power of two to n, never above maxSize.
+unsigned int nearestPowerOfTwo(unsigned int n, unsigned int maxSize);
+
+// Resamples with a tent filter widened to the scale factor,
+// so shrinking averages every source texel.
+void resampleImage(const TextureImage &src, unsigned int width, unsigned int height, TextureImage &dst);
+
+// Halves the image with a 2x2 box filter. Uses SSE2 when
+// the compiler targets it.
+void downsampleBox(const TextureImage &src, TextureImage &dst);
+
+// Fills mips with the base level followed by every
+// level down to 1x1.
+void buildMipChain(const TextureImage &base, std::vector<TextureImage> &mips);
+
+// Uncompressed 32 bit TGA.
+bool writeTGA(const std::string &path, const TextureImage &img);
+
+// KTX 1.1 container holding every mip level. glType is 0
+// for compressed formats.
+bool writeKTX(const std::string &path, unsigned int glInternalFormat, unsigned int glBaseFormat,
+			  unsigned int width, unsigned int height, const std::vector< std::vector<unsigned char> > &levels,
+			  unsigned int glType = 0, unsigned int glTypeSize = 1);
+
+// Resizes a decoded texture to a power of two, builds the
+// mip chain and writes the levels, either as TGA files or
+// packed into one KTX file. Runs on the worker pool.
+class TextureJob : public WorkerTask
+{
+	public:
+		// The pixels are taken from image, which is left empty.
+		TextureJob(const std::string &baseName, const std::string &outDir, TextureImage &image, unsigned int maxSize, bool bMips,
+			TextureFormat format = TEXTURE_FORMAT_TGA, TextureQuality quality = TEXTURE_QUALITY_NORMAL,
+			TextureDither dither = TEXTURE_DITHER_NONE);
+
+		virtual void run();
+
+		// Name of the file of the base level, relative to outDir.
+		static std::string outputName(const std::string &baseName, TextureFormat format = TEXTURE_FORMAT_TGA);
+
+		std::string m_sBaseName;
+		std::string m_sOutDir;
+		unsigned int m_nMaxSize;
+		bool m_bMips;
+		TextureFormat m_nFormat;
+		TextureQuality m_nQuality;
+		TextureDither m_nDither;
+
+		// Results
+		bool m_bSuccess;
+		unsigned int m_nSrcWidth, m_nSrcHeight;
+		unsigned int m_nWidth, m_nHeight;
+		unsigned int m_nLevels;
+		double m_fDecodeSeconds;
+		double m_fProcessSeconds;
+		// Of the base level, 0 when written as TGA.
+		double m_fPSNR;
+		// Format written, ETC is resolved to ETC1 or ETC2.
+		TextureFormat m_nFormatWritten;
+
+	protected:
+		bool writeCompressed(const std::vector<TextureImage> &mips);
+		bool write16Bit(const std::vector<TextureImage> &mips);
+
+		TextureImage m_image;
+};
+
+#endif
@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "Trace.h"
+
+#include <fstream>
+#include <sstream>
+#include "WorkerPool.h"
+
+#if defined(_MSC_VER)
+#define SIO2_THREAD_LOCAL __declspec(thread)
+#else
+#define SIO2_THREAD_LOCAL __thread
+#endif
+
+struct TraceEvent
+{
+	const char *name;
+	std::string detail;
+	double start;
+	double duration;
+};
+
+struct TraceBuffer
+{
+	unsigned int nThreadId;
+	std::vector<TraceEvent> vEvents;
+};
+
+static Mutex g_traceMutex;
+// Buffers of every thread that recorded in this trace, freed by
+// traceEnd. A thread whose buffer generation is not the current
+// one drops its pointer and takes a new buffer.
+static std::vector<TraceBuffer *> g_vTraceBuffers;
+static volatile unsigned int g_nTraceGeneration = 0;
+static volatile bool g_bTraceEnabled = false;
+static double g_fTraceStart = 0;
+static SIO2_THREAD_LOCAL TraceBuffer *t_pTraceBuffer = NULL;
+static SIO2_THREAD_LOCAL unsigned int t_nTraceGeneration = 0;
+
+static TraceBuffer *threadTraceBuffer()
+{
+	if(!t_pTraceBuffer || t_nTraceGeneration != g_nTraceGeneration)
+	{
+		TraceBuffer *buffer = new TraceBuffer;
+		ScopedLock lock(g_traceMutex);
+		buffer->nThreadId = (unsigned int)g_vTraceBuffers.size();
+		g_vTraceBuffers.push_back(buffer);
+		t_pTraceBuffer = buffer;
+		t_nTraceGeneration = g_nTraceGeneration;
+	}
+	return t_pTraceBuffer;
+}
+
+void writeJsonString(std::ostream &osf, const std::string &text)
+{
+	static const char *hex = "0123456789abcdef";
+	osf<<"\"";
+	for(size_t i=0; i<text.size(); i++)
+	{
+		unsigned char c = (unsigned char)text[i];
+		if(c == '"' || c == '\\')
+			osf<<"\\"<<c;
+		else if(c == '\n')
+			osf<<"\\n";
+		else if(c == '\t')
+			osf<<"\\t";
+		else if(c < 0x20)
+			osf<<"\\u00"<<hex[c >> 4]<<hex[c & 15];
+		else
+			osf<<c;
+	}
+	osf<<"\"";
+}
+
+void traceBegin()
+{
+	{
+		ScopedLock lock(g_traceMutex);
+		for(unsigned int i=0; i<g_vTraceBuffers.size(); i++)
+			g_vTraceBuffers[i]->vEvents.clear();
+	}
+
+	// The caller is the main thread, make sure it is the first.
+	threadTraceBuffer();
+	g_fTraceStart = getTimeSeconds();
+	g_bTraceEnabled = true;
+}
+
+bool isTraceEnabled()
+{
+	return g_bTraceEnabled;
+}
+
+// Called with the trace mutex held.
+static int writeTraceFile(const std::string &path)
+{
+	std::ofstream osf(path.c_str());
+	if(!osf)
+		return -1;
+
+	unsigned int mainId = t_pTraceBuffer && t_nTraceGeneration == g_nTraceGeneration ? t_pTraceBuffer->nThreadId : 0;
+	int nEvents = 0;
+
+	osf<<"{\"traceEvents\":["<<std::endl;
+	bool bFirst = true;
+	for(unsigned int b=0; b<g_vTraceBuffers.size(); b++)
+	{
+		TraceBuffer *buffer = g_vTraceBuffers[b];
+		if(buffer->vEvents.empty())
+			continue;
+
+		std::stringstream threadName;
+		if(buffer->nThreadId == mainId)
+			threadName<<"main";
+		else
+			threadName<<"worker "<<buffer->nThreadId;
+
+		osf<<(bFirst ? "" : ",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<buffer->nThreadId
+			<<",\"args\":{\"name\":";
+		writeJsonString(osf, threadName.str());
+		osf<<"}}";
+		bFirst = false;
+
+		for(unsigned int i=0; i<buffer->vEvents.size(); i++)
+		{
+			const TraceEvent &e = buffer->vEvents[i];
+			osf<<",\n{\"name\":";
+			writeJsonString(osf, e.name);
+			osf<<",\"cat\":\"export\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<buffer->nThreadId
+				<<",\"ts\":"<<(long long)(e.start * 1e6)
+				<<",\"dur\":"<<(long long)(e.duration * 1e6);
+			if(!e.detail.empty())
+			{
+				osf<<",\"args\":{\"detail\":";
+				writeJsonString(osf, e.detail);
+				osf<<"}";
+			}
+			osf<<"}";
+			nEvents++;
+		}
+	}
+	osf<<std::endl<<"]}"<<std::endl;
+
+	return osf.fail() ? -1 : nEvents;
+}
+
+int traceEnd(const std::string &path)
+{
+	g_bTraceEnabled = false;
+
+	ScopedLock lock(g_traceMutex);
+	int nEvents = writeTraceFile(path);
+
+	// Written or not, the buffers are freed. The workers are
+	// idle, their stale pointers are dropped on the next trace.
+	for(unsigned int b=0; b<g_vTraceBuffers.size(); b++)
+		delete g_vTraceBuffers[b];
+	g_vTraceBuffers.clear();
+	g_nTraceGeneration++;
+
+	return nEvents;
+}
+
+TraceScope::TraceScope(const char *name)
+{
+	m_bActive = g_bTraceEnabled;
+	if(m_bActive)
+	{
+		m_cName = name;
+		m_fStart = getTimeSeconds();
+	}
+}
+
+TraceScope::TraceScope(const char *name, const char *detail)
+{
+	m_bActive = g_bTraceEnabled;
+	if(m_bActive)
+	{
+		m_cName = name;
+		m_sDetail = detail;
+		m_fStart = getTimeSeconds();
+	}
+}
+
+TraceScope::TraceScope(const char *name, double value)
+{
+	m_bActive = g_bTraceEnabled;
+	if(m_bActive)
+	{
+		m_cName = name;
+		std::stringstream s;
+		s<<value;
+		m_sDetail = s.str();
+		m_fStart = getTimeSeconds();
+	}
+}
+
+TraceScope::~TraceScope()
+{
+	if(!m_bActive || !g_bTraceEnabled)
+		return;
+
+	double fEnd = getTimeSeconds();
+	TraceBuffer *buffer = threadTraceBuffer();
+	buffer->vEvents.push_back(TraceEvent());
+
+	TraceEvent &e = buffer->vEvents.back();
+	e.name = m_cName;
+	e.detail.swap(m_sDetail);
+	e.start = m_fStart - g_fTraceStart;
+	e.duration = fEnd - m_fStart;
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Timing of the export stages written as a Chrome trace
+// (chrome://tracing or Perfetto). Each thread records into its
+// own buffer, so markers cost one check when tracing is off and
+// take no lock when it is on.
+
+// Starts a new trace, dropping the events recorded so far. The
+// calling thread is named main.
+void traceBegin();
+
+// Stops recording and writes every event as trace event JSON.
+// No other thread may be recording while it runs. Returns the
+// number of events written, or -1 if the file could not be
+// written.
+int traceEnd(const std::string &path);
+
+bool isTraceEnabled();
+
+// Writes text as a quoted JSON string, escaping quotes,
+// backslashes and control characters. Shared by the other JSON
+// reports.
+void writeJsonString(std::ostream &osf, const std::string &text);
+
+// Records the time from construction to destruction. name must
+// outlive the trace (a literal), detail is copied.
+class TraceScope
+{
+	public:
+		explicit TraceScope(const char *name);
+		TraceScope(const char *name, const char *detail);
+		TraceScope(const char *name, double value);
+		~TraceScope();
+
+	protected:
+		const char *m_cName;
+		std::string m_sDetail;
+		double m_fStart;
+		bool m_bActive;
+};
+
+#define SIO2_TRACE_CONCAT2(a, b) a##b
+#define SIO2_TRACE_CONCAT(a, b) SIO2_TRACE_CONCAT2(a, b)
+
+// Traces the rest of the enclosing block.
+#define SIO2_TRACE(name) TraceScope SIO2_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define SIO2_TRACE_DETAIL(name, detail) TraceScope SIO2_TRACE_CONCAT(traceScope, __LINE__)(name, detail)
+
+#endif
@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "TransformCache.h"
+
+#include <maya/MFnDagNode.h>
+#include <maya/MFnTransform.h>
+#include <maya/MTransformationMatrix.h>
+
+TransformCache::TransformCache()
+: m_nLookups(0)
+{
+}
+
+void TransformCache::clear()
+{
+	m_vEntries.clear();
+	m_mIndex.clear();
+	m_nLookups = 0;
+}
+
+int TransformCache::find(MObject node) const
+{
+	MObjectHandle handle(node);
+	typedef std::multimap<unsigned int, unsigned int>::const_iterator Iter;
+	std::pair<Iter, Iter> range = m_mIndex.equal_range(handle.hashCode());
+	for(Iter it = range.first; it != range.second; ++it)
+	{
+		if(m_vEntries[it->second].handle.isValid() && m_vEntries[it->second].handle.object() == node)
+			return (int)it->second;
+	}
+	return -1;
+}
+
+MObject TransformCache::parentTransform(MObject node)
+{
+	if(node.isNull() || !node.hasFn(MFn::kDagNode))
+		return MObject::kNullObj;
+
+	MFnDagNode dagFn(node);
+	for(unsigned int i=0; i<dagFn.parentCount(); i++)
+	{
+		MObject parent = dagFn.parent(i);
+		if(parent.hasFn(MFn::kTransform))
+			return parent;
+	}
+	return MObject::kNullObj;
+}
+
+MMatrix TransformCache::world(MObject transform)
+{
+	m_nLookups++;
+	if(transform.isNull() || !transform.hasFn(MFn::kTransform))
+		return MMatrix::identity;
+
+	int nFound = find(transform);
+	if(nFound >= 0)
+		return m_vEntries[nFound].world;
+
+	// Climb to the first cached transform, or the top, then
+	// compute the ones missing on the way back down.
+	std::vector<MObject> vChain;
+	MMatrix parentWorld = MMatrix::identity;
+	for(MObject node = transform; !node.isNull(); node = parentTransform(node))
+	{
+		nFound = find(node);
+		if(nFound >= 0)
+		{
+			parentWorld = m_vEntries[nFound].world;
+			break;
+		}
+		vChain.push_back(node);
+	}
+
+	for(int i=(int)vChain.size()-1; i>=0; i--)
+	{
+		MFnTransform fn(vChain[i]);
+		Entry entry;
+		entry.handle = MObjectHandle(vChain[i]);
+		// Maya matrices act on row vectors, the parent goes last.
+		entry.world = fn.transformation().asMatrix() * parentWorld;
+		parentWorld = entry.world;
+
+		m_mIndex.insert(std::make_pair(entry.handle.hashCode(), (unsigned int)m_vEntries.size()));
+		m_vEntries.push_back(entry);
+	}
+	return parentWorld;
+}
+
+MMatrix TransformCache::relative(MObject transform, MObject ancestor)
+{
+	if(ancestor.isNull())
+		return world(transform);
+	return world(transform) * world(ancestor).inverse();
+}
+
+void TransformCache::decompose(const MMatrix &matrix, MVector &translation, MEulerRotation &rotation, double scale[3])
+{
+	MTransformationMatrix tm(matrix);
+	translation = tm.getTranslation(MSpace::kTransform);
+	rotation = tm.eulerRotation();
+	tm.getScale(scale, MSpace::kTransform);
+}
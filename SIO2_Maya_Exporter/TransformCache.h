@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TRANSFORMCACHE_H
+#define TRANSFORMCACHE_H
+
+#include <map>
+#include <vector>
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MMatrix.h>
+#include <maya/MVector.h>
+#include <maya/MEulerRotation.h>
+
+// World matrices of the transform nodes of an export. Each node
+// is computed once, from its own matrix and the cached one of the
+// transform above it, so a hierarchy is walked down a single time
+// however many objects, cameras and lamps sit in it. Instanced
+// nodes follow their first parent like the rest of the exporter.
+// Must be cleared when the scene may have changed.
+class TransformCache
+{
+	public:
+		TransformCache();
+
+		void clear();
+
+		// World matrix of a transform node.
+		MMatrix world(MObject transform);
+
+		// Matrix of a transform relative to one above it, the
+		// world matrix when ancestor is null.
+		MMatrix relative(MObject transform, MObject ancestor);
+
+		// First transform above a node, null at the top.
+		static MObject parentTransform(MObject node);
+
+		// Translation, XYZ rotation and scale of a matrix.
+		static void decompose(const MMatrix &matrix, MVector &translation, MEulerRotation &rotation, double scale[3]);
+
+		unsigned int lookups() const { return m_nLookups; }
+		unsigned int computed() const { return (unsigned int)m_vEntries.size(); }
+
+	protected:
+		struct Entry
+		{
+			MObjectHandle handle;
+			MMatrix world;
+		};
+
+		// Index of the node in m_vEntries, -1 when not cached.
+		int find(MObject node) const;
+
+		std::vector<Entry> m_vEntries;
+		// By MObjectHandle hash code.
+		std::multimap<unsigned int, unsigned int> m_mIndex;
+		unsigned int m_nLookups;
+};
+
+#endif
@@ -0,0 +1,388 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "TriangleStrip.h"
+
+#include <algorithm>
+#include <string.h>
+
+bool parseStripMode(const std::string &name, StripMode &mode)
+{
+	if(name == "none" || name == "list")
+		mode = STRIP_NONE;
+	else if(name == "degenerate")
+		mode = STRIP_DEGENERATE;
+	else if(name == "restart")
+		mode = STRIP_RESTART;
+	else
+		return false;
+
+	return true;
+}
+
+const char *stripModeName(StripMode mode)
+{
+	switch(mode)
+	{
+		case STRIP_DEGENERATE:
+			return "degenerate";
+		case STRIP_RESTART:
+			return "restart";
+		default:
+			return "none";
+	}
+}
+
+// Triangles around each edge, sorted by edge for lookups.
+struct StripEdge
+{
+	unsigned long long key;
+	unsigned int triangle;
+
+	bool operator<(const StripEdge &other) const { return key < other.key; }
+};
+
+static unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+	if(a > b)
+		std::swap(a, b);
+	return ((unsigned long long)a << 32) | b;
+}
+
+class Stripifier
+{
+	public:
+		Stripifier(const std::vector<unsigned int> &triangles);
+
+		void run(StripMode mode, std::vector<unsigned int> &out);
+
+	protected:
+		unsigned int unvisitedNeighbours(unsigned int t) const;
+		bool isRotation(unsigned int t, unsigned int a, unsigned int b, unsigned int c) const;
+		// Grows a strip from t starting with its corner first,
+		// marking the triangles used with stamp.
+		void grow(unsigned int t, int first, unsigned int stamp, std::vector<unsigned int> &strip,
+			std::vector<unsigned int> &tris);
+		unsigned int nextStart();
+
+		const std::vector<unsigned int> &m_vTriangles;
+		std::vector<StripEdge> m_vEdges;
+		// 0 unvisited, 1 in a strip, above 1 used by a trial.
+		std::vector<unsigned int> m_vStamp;
+		unsigned int m_nCursor;
+		unsigned int m_nLast;
+};
+
+Stripifier::Stripifier(const std::vector<unsigned int> &triangles) : m_vTriangles(triangles)
+{
+	unsigned int nTris = (unsigned int)(triangles.size() / 3);
+	m_vStamp.assign(nTris, 0);
+	m_nCursor = 0;
+	m_nLast = nTris;
+
+	for(unsigned int t=0; t<nTris; t++)
+	{
+		const unsigned int *tri = &triangles[t*3];
+		if(tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+		{
+			m_vStamp[t] = 1;
+			continue;
+		}
+
+		for(int k=0; k<3; k++)
+		{
+			StripEdge e;
+			e.key = edgeKey(tri[k], tri[(k + 1) % 3]);
+			e.triangle = t;
+			m_vEdges.push_back(e);
+		}
+	}
+	std::sort(m_vEdges.begin(), m_vEdges.end());
+}
+
+unsigned int Stripifier::unvisitedNeighbours(unsigned int t) const
+{
+	unsigned int n = 0;
+	const unsigned int *tri = &m_vTriangles[t*3];
+	for(int k=0; k<3; k++)
+	{
+		StripEdge e;
+		e.key = edgeKey(tri[k], tri[(k + 1) % 3]);
+		std::vector<StripEdge>::const_iterator it = std::lower_bound(m_vEdges.begin(), m_vEdges.end(), e);
+		for(; it != m_vEdges.end() && it->key == e.key; ++it)
+		{
+			if(it->triangle != t && m_vStamp[it->triangle] == 0)
+				n++;
+		}
+	}
+	return n;
+}
+
+bool Stripifier::isRotation(unsigned int t, unsigned int a, unsigned int b, unsigned int c) const
+{
+	const unsigned int *tri = &m_vTriangles[t*3];
+	for(int k=0; k<3; k++)
+	{
+		if(tri[k] == a && tri[(k + 1) % 3] == b && tri[(k + 2) % 3] == c)
+			return true;
+	}
+	return false;
+}
+
+void Stripifier::grow(unsigned int t, int first, unsigned int stamp, std::vector<unsigned int> &strip,
+					  std::vector<unsigned int> &tris)
+{
+	const unsigned int *tri = &m_vTriangles[t*3];
+	strip.clear();
+	tris.clear();
+	strip.push_back(tri[first]);
+	strip.push_back(tri[(first + 1) % 3]);
+	strip.push_back(tri[(first + 2) % 3]);
+	tris.push_back(t);
+	m_vStamp[t] = stamp;
+
+	for(;;)
+	{
+		size_t n = strip.size();
+		unsigned int a = strip[n - 2];
+		unsigned int b = strip[n - 1];
+		// Odd triangles of a strip are drawn the other way round.
+		bool bOdd = ((n - 2) & 1) != 0;
+
+		StripEdge e;
+		e.key = edgeKey(a, b);
+		std::vector<StripEdge>::const_iterator it = std::lower_bound(m_vEdges.begin(), m_vEdges.end(), e);
+
+		bool bFound = false;
+		for(; it != m_vEdges.end() && it->key == e.key; ++it)
+		{
+			unsigned int next = it->triangle;
+			if(m_vStamp[next] != 0)
+				continue;
+
+			const unsigned int *nt = &m_vTriangles[next*3];
+			unsigned int c = nt[0];
+			if(c == a || c == b)
+				c = nt[1];
+			if(c == a || c == b)
+				c = nt[2];
+
+			if(bOdd ? isRotation(next, b, a, c) : isRotation(next, a, b, c))
+			{
+				strip.push_back(c);
+				tris.push_back(next);
+				m_vStamp[next] = stamp;
+				bFound = true;
+				break;
+			}
+		}
+		if(!bFound)
+			break;
+	}
+}
+
+unsigned int Stripifier::nextStart()
+{
+	// Carry on next to the last strip, from the triangle with
+	// the fewest free neighbours so it is not left stranded.
+	unsigned int nTris = (unsigned int)m_vStamp.size();
+	unsigned int best = nTris;
+	unsigned int bestCount = 4;
+	if(m_nLast < nTris)
+	{
+		const unsigned int *tri = &m_vTriangles[m_nLast*3];
+		for(int k=0; k<3; k++)
+		{
+			StripEdge e;
+			e.key = edgeKey(tri[k], tri[(k + 1) % 3]);
+			std::vector<StripEdge>::const_iterator it = std::lower_bound(m_vEdges.begin(), m_vEdges.end(), e);
+			for(; it != m_vEdges.end() && it->key == e.key; ++it)
+			{
+				if(m_vStamp[it->triangle] != 0)
+					continue;
+
+				unsigned int count = unvisitedNeighbours(it->triangle);
+				if(count < bestCount)
+				{
+					best = it->triangle;
+					bestCount = count;
+				}
+			}
+		}
+	}
+	if(best < nTris)
+		return best;
+
+	while(m_nCursor < nTris && m_vStamp[m_nCursor] != 0)
+		m_nCursor++;
+	return m_nCursor;
+}
+
+void Stripifier::run(StripMode mode, std::vector<unsigned int> &out)
+{
+	unsigned int nTris = (unsigned int)m_vStamp.size();
+	std::vector<unsigned int> strip, tris, bestStrip, bestTris;
+	unsigned int stamp = 2;
+
+	out.clear();
+	for(;;)
+	{
+		unsigned int start = nextStart();
+		if(start >= nTris)
+			break;
+
+		// Try each corner first and keep the longest strip.
+		bestStrip.clear();
+		bestTris.clear();
+		for(int first=0; first<3; first++)
+		{
+			grow(start, first, stamp, strip, tris);
+			for(unsigned int i=0; i<tris.size(); i++)
+				m_vStamp[tris[i]] = 0;
+			stamp++;
+
+			if(strip.size() > bestStrip.size())
+			{
+				bestStrip.swap(strip);
+				bestTris.swap(tris);
+			}
+		}
+		for(unsigned int i=0; i<bestTris.size(); i++)
+			m_vStamp[bestTris[i]] = 1;
+		m_nLast = bestTris.back();
+
+		if(!out.empty())
+		{
+			if(mode == STRIP_RESTART)
+			{
+				out.push_back(g_nStripRestartIndex);
+			}
+			else
+			{
+				// Repeat the ends so the triangles between the
+				// strips have no area, and one more when needed
+				// so the next strip starts on an even triangle.
+				bool bOdd = (out.size() & 1) != 0;
+				out.push_back(out.back());
+				out.push_back(bestStrip[0]);
+				if(bOdd)
+					out.push_back(bestStrip[0]);
+			}
+		}
+		out.insert(out.end(), bestStrip.begin(), bestStrip.end());
+	}
+}
+
+void stripifyTriangles(const std::vector<unsigned int> &triangles, StripMode mode,
+					   std::vector<unsigned int> &strip)
+{
+	Stripifier stripifier(triangles);
+	stripifier.run(mode, strip);
+}
+
+// Digits of value ending at end, returns where they start.
+static char *formatIndex(char *end, unsigned int value)
+{
+	do
+	{
+		*--end = (char)('0' + value % 10);
+		value /= 10;
+	}
+	while(value != 0);
+	return end;
+}
+
+// Writes key( a b c ) lines, 3 indices to a line and the last one
+// shorter when needed. The lines are built in a block and
+// written together rather than going through the stream for
+// every number.
+template<class Indices> static void writeIndexLines(std::ostream &osf, const char *key, const Indices &indices)
+{
+	char block[16384];
+	char digits[16];
+	char *p = block;
+	size_t nKey = strlen(key);
+
+	size_t n = indices.size();
+	for(size_t i=0; i<n; i+=3)
+	{
+		// Tab, key, "(", 3 numbers of up to 10 digits with their
+		// spaces, " )" and the newline.
+		if(p + nKey + 40 > block + sizeof(block))
+		{
+			osf.write(block, p - block);
+			p = block;
+		}
+		*p++ = '\t';
+		memcpy(p, key, nKey);
+		p += nKey;
+		*p++ = '(';
+		for(size_t j=i; j<i+3 && j<n; j++)
+		{
+			*p++ = ' ';
+			char *end = digits + sizeof(digits);
+			char *start = formatIndex(end, indices[j]);
+			memcpy(p, start, end - start);
+			p += end - start;
+		}
+		*p++ = ' ';
+		*p++ = ')';
+		*p++ = '\n';
+	}
+	osf.write(block, p - block);
+}
+
+size_t writeIndexStream(std::ostream &osf, const IndexBuffer &triangles, StripMode mode)
+{
+	if(triangles.empty())
+		return 0;
+
+	if(mode == STRIP_NONE)
+	{
+		osf<<"\tn_ind( "<<triangles.size()<<" )"<<std::endl;
+		writeIndexLines(osf, "ind", triangles);
+		return triangles.size();
+	}
+
+	// The strip search works on a 32 bit copy.
+	std::vector<unsigned int> list, strip;
+	triangles.copyTo(list);
+
+	// A group with a vertex at the restart index, which only an
+	// unsplit mesh can have, joins its strips with degenerate
+	// triangles instead.
+	if(mode == STRIP_RESTART)
+	{
+		for(size_t i=0; i<list.size(); i++)
+		{
+			if(list[i] >= g_nStripRestartIndex)
+			{
+				mode = STRIP_DEGENERATE;
+				break;
+			}
+		}
+	}
+	stripifyTriangles(list, mode, strip);
+
+	if(mode == STRIP_RESTART)
+		osf<<"\tstrip_restart( "<<g_nStripRestartIndex<<" )"<<std::endl;
+
+	osf<<"\tn_sind( "<<strip.size()<<" )"<<std::endl;
+	writeIndexLines(osf, "sind", strip);
+	return strip.size();
+}
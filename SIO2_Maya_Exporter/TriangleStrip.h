@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TRIANGLESTRIP_H
+#define TRIANGLESTRIP_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "IndexBuffer.h"
+
+// How the index stream of a vertex group is written.
+enum StripMode
+{
+	// Independent triangles, ind( a b c ).
+	STRIP_NONE,
+	// One strip, the pieces joined by degenerate triangles.
+	STRIP_DEGENERATE,
+	// Pieces separated by the primitive restart index.
+	STRIP_RESTART
+};
+
+// Index marking the end of a strip in STRIP_RESTART mode, the
+// largest 16 bit index.
+const unsigned int g_nStripRestartIndex = 0xFFFF;
+
+bool parseStripMode(const std::string &name, StripMode &mode);
+const char *stripModeName(StripMode mode);
+
+// Turns a triangle list (3 indices a triangle) into strips
+// keeping the winding of every triangle. Triangles with a
+// repeated vertex are dropped.
+void stripifyTriangles(const std::vector<unsigned int> &triangles, StripMode mode,
+					   std::vector<unsigned int> &strip);
+
+// Writes the indices of a vertex group, n_ind and ind lines for
+// a list, or n_sind and sind lines (3 to a line, the last one
+// may be shorter) for strips, preceded by strip_restart when the
+// restart index is used. STRIP_RESTART falls back to degenerate
+// strips when an index reaches the restart index. Returns the
+// number of indices written.
+size_t writeIndexStream(std::ostream &osf, const IndexBuffer &triangles, StripMode mode);
+
+#endif
@@ -0,0 +1,284 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "VertexSplit.h"
+
+#include <algorithm>
+#include <math.h>
+#include "TangentSpace.h"
+
+// Face vertex of a Maya vertex that does not exist.
+static const unsigned int g_nNoVertex = 0xFFFFFFFF;
+
+VertexSplit::VertexSplit()
+: m_nOriginal(0)
+, m_nTangentSplits(0)
+{
+}
+
+void VertexSplit::clear()
+{
+	m_nOriginal = 0;
+	m_nTangentSplits = 0;
+	m_vSource.clear();
+	m_vPolygonStart.clear();
+	m_vPolygonCount.clear();
+	m_vFaceVertex.clear();
+	m_vNormals.clear();
+	m_vNormalGroup.clear();
+	m_vTangents.clear();
+}
+
+void VertexSplit::swap(VertexSplit &other)
+{
+	std::swap(m_nOriginal, other.m_nOriginal);
+	std::swap(m_nTangentSplits, other.m_nTangentSplits);
+	m_vSource.swap(other.m_vSource);
+	m_vPolygonStart.swap(other.m_vPolygonStart);
+	m_vPolygonCount.swap(other.m_vPolygonCount);
+	m_vFaceVertex.swap(other.m_vFaceVertex);
+	m_vNormals.swap(other.m_vNormals);
+	m_vNormalGroup.swap(other.m_vNormalGroup);
+	m_vTangents.swap(other.m_vTangents);
+}
+
+void VertexSplit::build(unsigned int nVertices, const std::vector<unsigned int> &polygonCounts,
+	const std::vector<unsigned int> &faceVertices, const std::vector<float> &faceNormals, float fMinCos,
+	const std::vector<float> &faceTangents, float fTangentMinCos)
+{
+	clear();
+	m_nOriginal = nVertices;
+
+	m_vSource.resize(nVertices);
+	m_vNormalGroup.resize(nVertices);
+	for(unsigned int v=0; v<nVertices; v++)
+	{
+		m_vSource[v] = v;
+		m_vNormalGroup[v] = v;
+	}
+
+	m_vPolygonStart.resize(polygonCounts.size());
+	m_vPolygonCount = polygonCounts;
+	unsigned int nStart = 0;
+	for(size_t p=0; p<polygonCounts.size(); p++)
+	{
+		m_vPolygonStart[p] = nStart;
+		nStart += polygonCounts[p];
+	}
+
+	unsigned int nFaceVertices = (unsigned int)faceVertices.size();
+	bool bTangents = faceTangents.size() >= (size_t)nFaceVertices * 4;
+
+	// The normal and tangent of the first corner are the ones
+	// the others are compared to, the sums become the written
+	// ones. A first tangent of no length is taken from the next
+	// corner that has one.
+	std::vector<float> vFirst(nVertices * 3, 0.0f);
+	std::vector<float> vFirstTangent(bTangents ? nVertices * 4 : 0, 0.0f);
+	std::vector<bool> vUsed(nVertices, false);
+	// Next copy of the same Maya vertex, 0 ends the chain
+	// since copies never have index 0.
+	std::vector<unsigned int> vNext(nVertices, 0);
+	m_vNormals.assign(nVertices * 3, 0.0f);
+	if(bTangents)
+		m_vTangents.assign(nVertices * 4, 0.0f);
+
+	m_vFaceVertex.resize(nFaceVertices);
+	for(unsigned int f=0; f<nFaceVertices; f++)
+	{
+		unsigned int v = faceVertices[f];
+		const float *n = &faceNormals[f*3];
+		const float *t = bTangents ? &faceTangents[f*4] : NULL;
+		if(v >= nVertices)
+		{
+			m_vFaceVertex[f] = g_nNoVertex;
+			continue;
+		}
+
+		unsigned int nFound = v;
+		if(vUsed[v])
+		{
+			// First vertex of the chain the normal agreed with.
+			unsigned int nNormalMatch = g_nNoVertex;
+			for(;;)
+			{
+				const float *first = &vFirst[nFound*3];
+				bool bNormalSame = first[0]*n[0] + first[1]*n[1] + first[2]*n[2] >= fMinCos;
+				bool bTangentSame = true;
+				if(bTangents)
+				{
+					const float *ft = &vFirstTangent[nFound*4];
+					bool bNone = (ft[0] == 0 && ft[1] == 0 && ft[2] == 0) || (t[0] == 0 && t[1] == 0 && t[2] == 0);
+					bTangentSame = bNone || (ft[3] == t[3] && ft[0]*t[0] + ft[1]*t[1] + ft[2]*t[2] >= fTangentMinCos);
+				}
+				if(bNormalSame && bTangentSame)
+					break;
+				if(bNormalSame && nNormalMatch == g_nNoVertex)
+					nNormalMatch = nFound;
+
+				if(vNext[nFound] == 0)
+				{
+					unsigned int nCopy = (unsigned int)m_vSource.size();
+					vNext[nFound] = nCopy;
+					nFound = nCopy;
+
+					// A copy the normals alone would not have made.
+					if(nNormalMatch != g_nNoVertex)
+						m_nTangentSplits++;
+
+					m_vSource.push_back(v);
+					m_vNormalGroup.push_back(nNormalMatch != g_nNoVertex ? m_vNormalGroup[nNormalMatch] : nCopy);
+					vNext.push_back(0);
+					vUsed.push_back(false);
+					vFirst.resize(vFirst.size() + 3, 0.0f);
+					m_vNormals.resize(m_vNormals.size() + 3, 0.0f);
+					if(bTangents)
+					{
+						vFirstTangent.resize(vFirstTangent.size() + 4, 0.0f);
+						m_vTangents.resize(m_vTangents.size() + 4, 0.0f);
+					}
+					break;
+				}
+				nFound = vNext[nFound];
+			}
+		}
+
+		if(!vUsed[nFound])
+		{
+			vUsed[nFound] = true;
+			vFirst[nFound*3] = n[0];
+			vFirst[nFound*3+1] = n[1];
+			vFirst[nFound*3+2] = n[2];
+		}
+		m_vNormals[nFound*3] += n[0];
+		m_vNormals[nFound*3+1] += n[1];
+		m_vNormals[nFound*3+2] += n[2];
+
+		if(bTangents)
+		{
+			float *ft = &vFirstTangent[nFound*4];
+			if(ft[0] == 0 && ft[1] == 0 && ft[2] == 0)
+			{
+				for(int c=0; c<4; c++)
+					ft[c] = t[c];
+			}
+			for(int c=0; c<3; c++)
+				m_vTangents[nFound*4 + c] += t[c];
+		}
+		m_vFaceVertex[f] = nFound;
+	}
+
+	// Tangent copies are the same surface, each gets the normal
+	// of all the corners of its group.
+	for(size_t v=nVertices; v<m_vSource.size(); v++)
+	{
+		unsigned int g = m_vNormalGroup[v];
+		if(g == v)
+			continue;
+		for(int c=0; c<3; c++)
+			m_vNormals[g*3 + c] += m_vNormals[v*3 + c];
+	}
+	for(size_t v=nVertices; v<m_vSource.size(); v++)
+	{
+		unsigned int g = m_vNormalGroup[v];
+		for(int c=0; c<3 && g != v; c++)
+			m_vNormals[v*3 + c] = m_vNormals[g*3 + c];
+	}
+
+	for(size_t i=0; i+2<m_vNormals.size(); i+=3)
+	{
+		float fLength = sqrtf(m_vNormals[i]*m_vNormals[i] + m_vNormals[i+1]*m_vNormals[i+1] + m_vNormals[i+2]*m_vNormals[i+2]);
+		if(fLength > 0)
+		{
+			m_vNormals[i] /= fLength;
+			m_vNormals[i+1] /= fLength;
+			m_vNormals[i+2] /= fLength;
+		}
+	}
+
+	// The averaged normal moved, so the tangent is made
+	// perpendicular to it again.
+	for(size_t v=0; bTangents && v<m_vSource.size(); v++)
+	{
+		orthogonalizeTangent(&m_vNormals[v*3], &m_vTangents[v*4]);
+		m_vTangents[v*4 + 3] = vFirstTangent[v*4 + 3] < 0 ? -1.0f : 1.0f;
+	}
+}
+
+int VertexSplit::vertex(unsigned int polygon, unsigned int local) const
+{
+	if(polygon >= m_vPolygonStart.size() || local >= m_vPolygonCount[polygon])
+		return -1;
+
+	unsigned int nVertex = m_vFaceVertex[m_vPolygonStart[polygon] + local];
+	return nVertex == g_nNoVertex ? -1 : (int)nVertex;
+}
+
+size_t VertexSplit::byteSize() const
+{
+	return m_vSource.capacity() * sizeof(unsigned int) + m_vPolygonStart.capacity() * sizeof(unsigned int)
+		+ m_vPolygonCount.capacity() * sizeof(unsigned int) + m_vFaceVertex.capacity() * sizeof(unsigned int)
+		+ m_vNormalGroup.capacity() * sizeof(unsigned int) + (m_vNormals.capacity() + m_vTangents.capacity()) * sizeof(float);
+}
+
+void VertexSplit::expand(const std::vector<float> &in, unsigned int stride, std::vector<float> &out) const
+{
+	out.resize(m_vSource.size() * stride);
+	for(size_t v=0; v<m_vSource.size(); v++)
+	{
+		size_t nFrom = (size_t)m_vSource[v] * stride;
+		for(unsigned int c=0; c<stride; c++)
+			out[v*stride + c] = nFrom + c < in.size() ? in[nFrom + c] : 0.0f;
+	}
+}
+
+VertexSplitJob::VertexSplitJob()
+: m_nVertices(0)
+, m_fNormalCos(1)
+, m_fTangentCos(1)
+, m_fSeconds(0)
+{
+}
+
+void VertexSplitJob::run()
+{
+	double fStart = getTimeSeconds();
+
+	std::vector<float> vFaceTangents;
+	if(!m_vUVs.empty())
+	{
+		std::vector<unsigned int> vTriangles;
+		getTriangleFaceVertices(m_vPolygonCounts, m_vFaceVertices, m_vTriangleCounts, m_vTriangleVertices, vTriangles);
+		computeFaceTangents(m_vPositions, m_vFaceVertices, m_vFaceNormals, m_vUVIds, m_vUVs, vTriangles, vFaceTangents);
+	}
+
+	m_split.build(m_nVertices, m_vPolygonCounts, m_vFaceVertices, m_vFaceNormals, m_fNormalCos,
+		vFaceTangents, m_fTangentCos);
+
+	// Only the split is needed from here on.
+	std::vector<unsigned int>().swap(m_vPolygonCounts);
+	std::vector<unsigned int>().swap(m_vFaceVertices);
+	std::vector<float>().swap(m_vFaceNormals);
+	std::vector<float>().swap(m_vPositions);
+	std::vector<int>().swap(m_vUVIds);
+	std::vector<float>().swap(m_vUVs);
+	std::vector<unsigned int>().swap(m_vTriangleCounts);
+	std::vector<unsigned int>().swap(m_vTriangleVertices);
+
+	m_fSeconds = getTimeSeconds() - fStart;
+}
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef VERTEXSPLIT_H
+#define VERTEXSPLIT_H
+
+#include <stddef.h>
+#include <vector>
+#include "WorkerPool.h"
+
+// Gives each face vertex (corner of a polygon) of a mesh the
+// vertex it is written as. Corners of a Maya vertex share one
+// while their normals agree and get their own copy across hard
+// edges. With tangents, corners whose tangent frames disagree
+// (UV seams turned or mirrored) are split as well. The first
+// vertices keep the Maya numbering, the copies come after them.
+class VertexSplit
+{
+	public:
+		VertexSplit();
+
+		void clear();
+		void swap(VertexSplit &other);
+
+		// polygonCounts holds the number of vertices of each
+		// polygon, faceVertices the Maya vertex of each face
+		// vertex and faceNormals 3 floats per face vertex.
+		// Normals whose dot product is at least fMinCos are
+		// taken as the same. faceTangents, 4 floats per face
+		// vertex (see computeFaceTangents) or empty, must also
+		// have the same sign and a dot product of at least
+		// fTangentMinCos. Tangents of no length match any.
+		void build(unsigned int nVertices, const std::vector<unsigned int> &polygonCounts,
+			const std::vector<unsigned int> &faceVertices, const std::vector<float> &faceNormals, float fMinCos,
+			const std::vector<float> &faceTangents, float fTangentMinCos);
+
+		unsigned int vertexCount() const { return (unsigned int)m_vSource.size(); }
+		unsigned int originalCount() const { return m_nOriginal; }
+		unsigned int splitCount() const { return vertexCount() - m_nOriginal; }
+		// Copies made only because the tangents disagreed.
+		unsigned int tangentSplitCount() const { return m_nTangentSplits; }
+
+		// Vertex written for the local'th corner of a polygon,
+		// -1 when there is no such corner.
+		int vertex(unsigned int polygon, unsigned int local) const;
+
+		// Maya vertex each written vertex was copied from.
+		const std::vector<unsigned int> &sources() const { return m_vSource; }
+
+		// Average of the corner normals of each vertex, 3
+		// floats per vertex, normalised. Copies made only for
+		// the tangents share the normal of their group.
+		const std::vector<float> &normals() const { return m_vNormals; }
+
+		// First vertex of the group each vertex shares its normal
+		// with, the vertex itself unless it is a tangent copy.
+		const std::vector<unsigned int> &normalGroups() const { return m_vNormalGroup; }
+
+		// Average of the corner tangents of each vertex made
+		// perpendicular to its normal, then the bitangent sign,
+		// 4 floats per vertex. Empty when built without them.
+		const std::vector<float> &tangents() const { return m_vTangents; }
+
+		// Memory held by the arrays.
+		size_t byteSize() const;
+
+		// Copies an array with stride floats per Maya vertex to
+		// one per written vertex.
+		void expand(const std::vector<float> &in, unsigned int stride, std::vector<float> &out) const;
+
+	protected:
+		unsigned int m_nOriginal;
+		unsigned int m_nTangentSplits;
+		std::vector<unsigned int> m_vSource;
+		std::vector<unsigned int> m_vPolygonStart;
+		std::vector<unsigned int> m_vPolygonCount;
+		// Written vertex of each face vertex.
+		std::vector<unsigned int> m_vFaceVertex;
+		std::vector<float> m_vNormals;
+		std::vector<unsigned int> m_vNormalGroup;
+		std::vector<float> m_vTangents;
+};
+
+// Builds the split of one mesh, and its tangents when it has
+// UVs, on the worker pool. The inputs are pulled out of Maya
+// beforehand and freed once it has run.
+class VertexSplitJob : public WorkerTask
+{
+	public:
+		VertexSplitJob();
+
+		virtual void run();
+
+		// See VertexSplit::build.
+		unsigned int m_nVertices;
+		std::vector<unsigned int> m_vPolygonCounts;
+		std::vector<unsigned int> m_vFaceVertices;
+		std::vector<float> m_vFaceNormals;
+		float m_fNormalCos;
+
+		// See computeFaceTangents, no tangents when m_vUVs is
+		// empty. The triangles are as given by MFnMesh::getTriangles.
+		std::vector<float> m_vPositions;
+		std::vector<int> m_vUVIds;
+		std::vector<float> m_vUVs;
+		std::vector<unsigned int> m_vTriangleCounts;
+		std::vector<unsigned int> m_vTriangleVertices;
+		float m_fTangentCos;
+
+		// Results
+		VertexSplit m_split;
+		double m_fSeconds;
+};
+
+#endif
@@ -0,0 +1,327 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "WorkerPool.h"
+
+#ifndef WIN32
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+double getTimeSeconds()
+{
+#ifdef WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+unsigned int getProcessorCount()
+{
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long nCount = sysconf(_SC_NPROCESSORS_ONLN);
+	return nCount > 0 ? (unsigned int)nCount : 1;
+#endif
+}
+
+Mutex::Mutex()
+{
+#ifdef WIN32
+	InitializeCriticalSection(&m_section);
+#else
+	pthread_mutex_init(&m_mutex, NULL);
+#endif
+}
+
+Mutex::~Mutex()
+{
+#ifdef WIN32
+	DeleteCriticalSection(&m_section);
+#else
+	pthread_mutex_destroy(&m_mutex);
+#endif
+}
+
+void Mutex::lock()
+{
+#ifdef WIN32
+	EnterCriticalSection(&m_section);
+#else
+	pthread_mutex_lock(&m_mutex);
+#endif
+}
+
+void Mutex::unlock()
+{
+#ifdef WIN32
+	LeaveCriticalSection(&m_section);
+#else
+	pthread_mutex_unlock(&m_mutex);
+#endif
+}
+
+WorkerPool::WorkerPool()
+{
+	m_nPending = 0;
+	m_bQuit = false;
+#ifdef WIN32
+	// One count per queued task, the idle event is set
+	// while nothing is pending.
+	m_hWork = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+	m_hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	m_hTaskDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+#else
+	pthread_cond_init(&m_workCond, NULL);
+	pthread_cond_init(&m_idleCond, NULL);
+#endif
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+#ifdef WIN32
+	CloseHandle(m_hWork);
+	CloseHandle(m_hIdle);
+	CloseHandle(m_hTaskDone);
+#else
+	pthread_cond_destroy(&m_workCond);
+	pthread_cond_destroy(&m_idleCond);
+#endif
+}
+
+bool WorkerPool::start(unsigned int numThreads)
+{
+	if(isRunning())
+		return true;
+
+	if(numThreads == 0)
+		numThreads = getProcessorCount();
+
+	m_bQuit = false;
+	for(unsigned int i=0; i<numThreads; i++)
+	{
+#ifdef WIN32
+		HANDLE hThread = CreateThread(NULL, 0, threadMain, this, 0, NULL);
+		if(hThread == NULL)
+			break;
+		m_vThreads.push_back(hThread);
+#else
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, threadMain, this) != 0)
+			break;
+		m_vThreads.push_back(thread);
+#endif
+	}
+	return isRunning();
+}
+
+void WorkerPool::stop()
+{
+	if(!isRunning())
+		return;
+
+	wait();
+
+	m_mutex.lock();
+	m_bQuit = true;
+	m_mutex.unlock();
+
+#ifdef WIN32
+	ReleaseSemaphore(m_hWork, (LONG)m_vThreads.size(), NULL);
+	for(unsigned int i=0; i<m_vThreads.size(); i++)
+	{
+		WaitForSingleObject(m_vThreads[i], INFINITE);
+		CloseHandle(m_vThreads[i]);
+	}
+#else
+	m_mutex.lock();
+	pthread_cond_broadcast(&m_workCond);
+	m_mutex.unlock();
+	for(unsigned int i=0; i<m_vThreads.size(); i++)
+		pthread_join(m_vThreads[i], NULL);
+#endif
+	m_vThreads.clear();
+}
+
+void WorkerPool::enqueue(WorkerTask *task)
+{
+	if(!isRunning())
+	{
+		task->run();
+		return;
+	}
+
+	m_mutex.lock();
+	m_qTasks.push_back(task);
+	m_nPending++;
+#ifdef WIN32
+	ResetEvent(m_hIdle);
+	m_mutex.unlock();
+	ReleaseSemaphore(m_hWork, 1, NULL);
+#else
+	pthread_cond_signal(&m_workCond);
+	m_mutex.unlock();
+#endif
+}
+
+void WorkerPool::wait()
+{
+	if(!isRunning())
+		return;
+
+#ifdef WIN32
+	WaitForSingleObject(m_hIdle, INFINITE);
+#else
+	m_mutex.lock();
+	while(m_nPending > 0)
+		pthread_cond_wait(&m_idleCond, m_mutex.native());
+	m_mutex.unlock();
+#endif
+}
+
+void WorkerPool::wait(WorkerTask *task)
+{
+	if(!isRunning())
+		return;
+
+	m_mutex.lock();
+	for(std::deque<WorkerTask *>::iterator it = m_qTasks.begin(); it != m_qTasks.end(); ++it)
+	{
+		if(*it == task)
+		{
+			// Its semaphore count is left behind, the thread
+			// taking it finds the queue empty and waits again.
+			m_qTasks.erase(it);
+			m_mutex.unlock();
+
+			task->run();
+			taskDone(NULL);
+			return;
+		}
+	}
+
+#ifdef WIN32
+	while(isRunning(task))
+	{
+		// Reset while holding the lock, so a task finishing
+		// after this is not missed.
+		ResetEvent(m_hTaskDone);
+		m_mutex.unlock();
+		WaitForSingleObject(m_hTaskDone, INFINITE);
+		m_mutex.lock();
+	}
+#else
+	while(isRunning(task))
+		pthread_cond_wait(&m_idleCond, m_mutex.native());
+#endif
+	m_mutex.unlock();
+}
+
+bool WorkerPool::isRunning(WorkerTask *task) const
+{
+	for(size_t i=0; i<m_vRunning.size(); i++)
+	{
+		if(m_vRunning[i] == task)
+			return true;
+	}
+	return false;
+}
+
+WorkerTask *WorkerPool::dequeue()
+{
+	WorkerTask *task = NULL;
+
+#ifdef WIN32
+	for(;;)
+	{
+		WaitForSingleObject(m_hWork, INFINITE);
+		m_mutex.lock();
+		if(!m_qTasks.empty() || m_bQuit)
+			break;
+		// The task was run by wait(task).
+		m_mutex.unlock();
+	}
+#else
+	m_mutex.lock();
+	while(m_qTasks.empty() && !m_bQuit)
+		pthread_cond_wait(&m_workCond, m_mutex.native());
+#endif
+	if(!m_qTasks.empty())
+	{
+		task = m_qTasks.front();
+		m_qTasks.pop_front();
+		m_vRunning.push_back(task);
+	}
+	m_mutex.unlock();
+
+	return task;
+}
+
+void WorkerPool::taskDone(WorkerTask *task)
+{
+	ScopedLock lock(m_mutex);
+
+	for(size_t i=0; i<m_vRunning.size(); i++)
+	{
+		if(m_vRunning[i] == task)
+		{
+			m_vRunning.erase(m_vRunning.begin() + i);
+			break;
+		}
+	}
+
+	m_nPending--;
+#ifdef WIN32
+	SetEvent(m_hTaskDone);
+	if(m_nPending == 0)
+		SetEvent(m_hIdle);
+#else
+	// wait(task) waits on the same condition.
+	pthread_cond_broadcast(&m_idleCond);
+#endif
+}
+
+#ifdef WIN32
+DWORD WINAPI WorkerPool::threadMain(LPVOID param)
+#else
+void *WorkerPool::threadMain(void *param)
+#endif
+{
+	WorkerPool *pool = (WorkerPool *)param;
+
+	for(;;)
+	{
+		WorkerTask *task = pool->dequeue();
+		if(task == NULL)
+			break;
+
+		task->run();
+		pool->taskDone(task);
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <deque>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Seconds from an arbitrary start, high resolution.
+double getTimeSeconds();
+
+// Number of processors available to the exporter.
+unsigned int getProcessorCount();
+
+class Mutex
+{
+	public:
+		Mutex();
+		~Mutex();
+
+		void lock();
+		void unlock();
+
+#ifndef WIN32
+		pthread_mutex_t *native() { return &m_mutex; }
+#endif
+
+	protected:
+#ifdef WIN32
+		CRITICAL_SECTION m_section;
+#else
+		pthread_mutex_t m_mutex;
+#endif
+};
+
+// Locks the mutex for the life of the object.
+class ScopedLock
+{
+	public:
+		ScopedLock(Mutex &mutex) : m_mutex(mutex) { m_mutex.lock(); }
+		~ScopedLock() { m_mutex.unlock(); }
+
+	protected:
+		Mutex &m_mutex;
+};
+
+// Work item run by the pool. The tasks must not call into
+// the Maya API, only work on data already pulled out of it.
+class WorkerTask
+{
+	public:
+		virtual ~WorkerTask() {}
+		virtual void run() = 0;
+};
+
+// Fixed set of threads pulling tasks from a queue. Tasks are
+// not owned by the pool, the caller keeps them alive until
+// wait() returns.
+class WorkerPool
+{
+	public:
+		WorkerPool();
+		~WorkerPool();
+
+		// Starts the threads, 0 uses one per processor.
+		bool start(unsigned int numThreads = 0);
+
+		// Waits for the queued work and joins the threads.
+		void stop();
+
+		bool isRunning() const { return m_vThreads.size() > 0; }
+		unsigned int threadCount() const { return (unsigned int)m_vThreads.size(); }
+
+		// Queues a task. If the pool is not running the
+		// task is run right away on the calling thread.
+		void enqueue(WorkerTask *task);
+
+		// Blocks until every queued task has finished.
+		void wait();
+
+		// Blocks until one task has finished. A task no thread
+		// has taken yet is run on the calling thread instead.
+		void wait(WorkerTask *task);
+
+	protected:
+		WorkerTask *dequeue();
+		void taskDone(WorkerTask *task);
+		bool isRunning(WorkerTask *task) const;
+
+#ifdef WIN32
+		static DWORD WINAPI threadMain(LPVOID param);
+
+		std::vector<HANDLE> m_vThreads;
+		HANDLE m_hWork;
+		HANDLE m_hIdle;
+		// Set each time a task finishes.
+		HANDLE m_hTaskDone;
+#else
+		static void *threadMain(void *param);
+
+		std::vector<pthread_t> m_vThreads;
+		pthread_cond_t m_workCond;
+		pthread_cond_t m_idleCond;
+#endif
+		Mutex m_mutex;
+		std::deque<WorkerTask *> m_qTasks;
+		// Tasks taken by the threads and not finished.
+		std::vector<WorkerTask *> m_vRunning;
+		unsigned int m_nPending;
+		bool m_bQuit;
+};
+
+#endif
@@ -0,0 +1,372 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "SceneDiff.h"
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+
+static void addKey(RecordDiff &diff, const std::string &key)
+{
+	if(std::find(diff.changedKeys.begin(), diff.changedKeys.end(), key) == diff.changedKeys.end())
+		diff.changedKeys.push_back(key);
+}
+
+void DiffDeviation::max(const DiffDeviation &other)
+{
+	fPosition = fPosition > other.fPosition ? fPosition : other.fPosition;
+	fNormal = fNormal > other.fNormal ? fNormal : other.fNormal;
+	fUv = fUv > other.fUv ? fUv : other.fUv;
+	fColor = fColor > other.fColor ? fColor : other.fColor;
+	fValue = fValue > other.fValue ? fValue : other.fValue;
+	fFrame = fFrame > other.fFrame ? fFrame : other.fFrame;
+}
+
+// Largest difference of one component between element a of
+// one array and element b of the other.
+static float elementDeviation(const std::vector<float> &va, unsigned int a, const std::vector<float> &vb,
+	unsigned int b, unsigned int nComponents)
+{
+	float fMax = 0;
+	for(unsigned int i=0; i<nComponents; i++)
+	{
+		float d = (float)fabs(va[a * nComponents + i] - vb[b * nComponents + i]);
+		if(d > fMax)
+			fMax = d;
+	}
+	return fMax;
+}
+
+static void updateMax(float &fMax, float value)
+{
+	if(value > fMax)
+		fMax = value;
+}
+
+static void diffProperties(const SioRecord &a, const SioRecord &b, const DiffOptions &options, RecordDiff &diff)
+{
+	// A key can be given more than once, the nth lines are compared.
+	typedef std::map< std::string, std::vector<const SioProperty *> > PropertyMap;
+	PropertyMap mapA, mapB;
+	for(unsigned int i=0; i<a.properties.size(); i++)
+		mapA[a.properties[i].key].push_back(&a.properties[i]);
+	for(unsigned int i=0; i<b.properties.size(); i++)
+		mapB[b.properties[i].key].push_back(&b.properties[i]);
+
+	for(PropertyMap::const_iterator it = mapA.begin(); it != mapA.end(); ++it)
+	{
+		PropertyMap::const_iterator other = mapB.find(it->first);
+		if(other == mapB.end() || other->second.size() != it->second.size())
+		{
+			addKey(diff, it->first);
+			continue;
+		}
+		for(unsigned int n=0; n<it->second.size(); n++)
+		{
+			const SioProperty &pa = *it->second[n];
+			const SioProperty &pb = *other->second[n];
+			if(pa.text != pb.text || pa.values.size() != pb.values.size())
+			{
+				addKey(diff, it->first);
+				continue;
+			}
+			float fMax = 0;
+			for(unsigned int v=0; v<pa.values.size(); v++)
+				updateMax(fMax, (float)fabs(pa.values[v] - pb.values[v]));
+			updateMax(diff.deviation.fValue, fMax);
+			if(fMax > options.fAttributeTolerance)
+				addKey(diff, it->first);
+		}
+	}
+	for(PropertyMap::const_iterator it = mapB.begin(); it != mapB.end(); ++it)
+	{
+		if(mapA.find(it->first) == mapA.end())
+			addKey(diff, it->first);
+	}
+}
+
+namespace
+{
+
+// Triangle of the second object filed by the grid cell of its centre.
+struct CellEntry
+{
+	int x, y, z;
+	unsigned int triangle;
+
+	bool operator<(const CellEntry &other) const
+	{
+		if(x != other.x)
+			return x < other.x;
+		if(y != other.y)
+			return y < other.y;
+		return z < other.z;
+	}
+};
+
+struct TriangleMatcher
+{
+	const SioRecord &a;
+	const SioRecord &b;
+	const std::vector<unsigned int> &trianglesA;
+	const std::vector<unsigned int> &trianglesB;
+	float fTolerance;
+	float fCellSize;
+
+	void cellOf(const SioRecord &r, const unsigned int *t, CellEntry &cell) const
+	{
+		float c[3];
+		for(int k=0; k<3; k++)
+			c[k] = (r.vertices[t[0] * 3 + k] + r.vertices[t[1] * 3 + k] + r.vertices[t[2] * 3 + k]) / 3;
+		cell.x = (int)floor(c[0] / fCellSize);
+		cell.y = (int)floor(c[1] / fCellSize);
+		cell.z = (int)floor(c[2] / fCellSize);
+	}
+
+	// Pairs each triangle of a with the closest unused triangle of
+	// b whose corners are all within the tolerance, trying the
+	// three rotations that keep the winding. vertexMap gets the
+	// vertex of b for each matched vertex of a.
+	void match(std::vector<int> &vertexMap, unsigned int &nOnlyInA, unsigned int &nOnlyInB, float &fPosition)
+	{
+		unsigned int nB = (unsigned int)(trianglesB.size() / 3);
+		std::vector<CellEntry> cells(nB);
+		for(unsigned int i=0; i<nB; i++)
+		{
+			cellOf(b, &trianglesB[i * 3], cells[i]);
+			cells[i].triangle = i;
+		}
+		std::sort(cells.begin(), cells.end());
+
+		std::vector<bool> used(nB, false);
+		unsigned int nMatched = 0;
+		nOnlyInA = 0;
+		for(size_t t=0; t+2<trianglesA.size(); t+=3)
+		{
+			const unsigned int *ta = &trianglesA[t];
+			CellEntry centre;
+			cellOf(a, ta, centre);
+
+			float fBest = fTolerance;
+			int nBest = -1, nBestRotation = 0;
+			for(int dx=-1; dx<=1; dx++)
+			for(int dy=-1; dy<=1; dy++)
+			for(int dz=-1; dz<=1; dz++)
+			{
+				CellEntry key = centre;
+				key.x += dx;
+				key.y += dy;
+				key.z += dz;
+				std::pair<std::vector<CellEntry>::const_iterator, std::vector<CellEntry>::const_iterator> range =
+					std::equal_range(cells.begin(), cells.end(), key);
+				for(std::vector<CellEntry>::const_iterator it = range.first; it != range.second; ++it)
+				{
+					if(used[it->triangle])
+						continue;
+					const unsigned int *tb = &trianglesB[it->triangle * 3];
+					for(int r=0; r<3; r++)
+					{
+						float d = 0;
+						for(int k=0; k<3; k++)
+							updateMax(d, elementDeviation(a.vertices, ta[k], b.vertices, tb[(k + r) % 3], 3));
+						if(d <= fBest)
+						{
+							fBest = d;
+							nBest = it->triangle;
+							nBestRotation = r;
+						}
+					}
+				}
+			}
+
+			if(nBest < 0)
+			{
+				nOnlyInA++;
+				continue;
+			}
+			used[nBest] = true;
+			nMatched++;
+			updateMax(fPosition, fBest);
+			const unsigned int *tb = &trianglesB[nBest * 3];
+			for(int k=0; k<3; k++)
+				vertexMap[ta[k]] = tb[(k + nBestRotation) % 3];
+		}
+		nOnlyInB = nB - nMatched;
+	}
+};
+
+}
+
+static void diffGeometry(const SioRecord &a, const SioRecord &b, const DiffOptions &options, RecordDiff &diff)
+{
+	// Which attributes are written is a change of its own.
+	if(a.colors.empty() != b.colors.empty())
+		addKey(diff, "vcol");
+	if(a.normals.empty() != b.normals.empty())
+		addKey(diff, "vnor");
+	if(a.uv0.empty() != b.uv0.empty())
+		addKey(diff, "uv0");
+	if(a.uv1.empty() != b.uv1.empty())
+		addKey(diff, "uv1");
+	if(a.tangents.empty() != b.tangents.empty())
+		addKey(diff, "vtan");
+
+	std::vector<unsigned int> trianglesA, trianglesB, triangles;
+	bool bSameGroups = a.groups.size() == b.groups.size();
+	for(unsigned int g=0; g<a.groups.size(); g++)
+	{
+		diff.nIndicesA += a.groups[g].indices.size();
+		a.getTriangles(g, triangles);
+		trianglesA.insert(trianglesA.end(), triangles.begin(), triangles.end());
+		if(bSameGroups && (a.groups[g].name != b.groups[g].name || a.groups[g].materials != b.groups[g].materials))
+			bSameGroups = false;
+	}
+	for(unsigned int g=0; g<b.groups.size(); g++)
+	{
+		diff.nIndicesB += b.groups[g].indices.size();
+		b.getTriangles(g, triangles);
+		trianglesB.insert(trianglesB.end(), triangles.begin(), triangles.end());
+	}
+	if(!bSameGroups)
+		addKey(diff, "vgroup");
+	if(diff.nIndicesA != diff.nIndicesB)
+		addKey(diff, "ind");
+
+	// Same vertices in the same order is the common case, every
+	// vertex is compared with its own. Otherwise the triangles
+	// are paired by position and the vertices through them.
+	std::vector<int> vertexMap(diff.nVerticesA, -1);
+	if(diff.nVerticesA == diff.nVerticesB && trianglesA == trianglesB)
+	{
+		for(unsigned int v=0; v<diff.nVerticesA; v++)
+		{
+			vertexMap[v] = v;
+			updateMax(diff.deviation.fPosition, elementDeviation(a.vertices, v, b.vertices, v, 3));
+		}
+	}
+	else
+	{
+		// The cells are at least a 1e5th of the largest coordinate,
+		// so the cell numbers fit an int and float rounding of the
+		// centres stays within the neighbouring cells.
+		float fExtent = 0;
+		for(size_t i=0; i<a.vertices.size(); i++)
+			updateMax(fExtent, (float)fabs(a.vertices[i]));
+		for(size_t i=0; i<b.vertices.size(); i++)
+			updateMax(fExtent, (float)fabs(b.vertices[i]));
+		float fCellSize = fExtent * 1e-5f > 1e-6f ? fExtent * 1e-5f : 1e-6f;
+		if(options.fPositionTolerance > fCellSize)
+			fCellSize = options.fPositionTolerance;
+
+		TriangleMatcher matcher = { a, b, trianglesA, trianglesB, options.fPositionTolerance, fCellSize };
+		matcher.match(vertexMap, diff.nOnlyInA, diff.nOnlyInB, diff.deviation.fPosition);
+		diff.bMatchedByPosition = true;
+		if(diff.nOnlyInA > 0 || diff.nOnlyInB > 0)
+			addKey(diff, "vert");
+	}
+
+	for(unsigned int v=0; v<diff.nVerticesA; v++)
+	{
+		if(vertexMap[v] < 0)
+			continue;
+		unsigned int w = vertexMap[v];
+		if(!a.normals.empty() && !b.normals.empty())
+			updateMax(diff.deviation.fNormal, elementDeviation(a.normals, v, b.normals, w, 3));
+		if(!a.colors.empty() && !b.colors.empty())
+			updateMax(diff.deviation.fColor, elementDeviation(a.colors, v, b.colors, w, 4));
+		if(!a.uv0.empty() && !b.uv0.empty())
+			updateMax(diff.deviation.fUv, elementDeviation(a.uv0, v, b.uv0, w, 2));
+		if(!a.uv1.empty() && !b.uv1.empty())
+			updateMax(diff.deviation.fUv, elementDeviation(a.uv1, v, b.uv1, w, 2));
+		// Tangents are directions too, they count with the normals.
+		if(!a.tangents.empty() && !b.tangents.empty())
+			updateMax(diff.deviation.fNormal, elementDeviation(a.tangents, v, b.tangents, w, 4));
+	}
+
+	if(a.frames.size() != b.frames.size())
+	{
+		addKey(diff, "frame");
+		return;
+	}
+	for(unsigned int f=0; f<a.frames.size(); f++)
+	{
+		const SioFrame &fa = a.frames[f];
+		const SioFrame &fb = b.frames[f];
+		if(fa.name != fb.name || fabs(fa.time - fb.time) > options.fAttributeTolerance)
+			addKey(diff, "frame");
+		for(unsigned int v=0; v<diff.nVerticesA && v * 3 + 2 < fa.vertices.size(); v++)
+		{
+			if(vertexMap[v] >= 0 && vertexMap[v] * 3 + 2 < (int)fb.vertices.size())
+				updateMax(diff.deviation.fFrame, elementDeviation(fa.vertices, v, fb.vertices, vertexMap[v], 3));
+		}
+	}
+}
+
+void diffRecord(const SioRecord *a, const SioRecord *b, const DiffOptions &options, RecordDiff &diff)
+{
+	const SioRecord *r = a != NULL ? a : b;
+	diff.name = r->name;
+	diff.type = r->type;
+	diff.changedKeys.clear();
+	diff.deviation = DiffDeviation();
+	diff.nVerticesA = a != NULL ? a->vertexCount() : 0;
+	diff.nVerticesB = b != NULL ? b->vertexCount() : 0;
+	diff.nIndicesA = 0;
+	diff.nIndicesB = 0;
+	diff.nOnlyInA = 0;
+	diff.nOnlyInB = 0;
+	diff.bMatchedByPosition = false;
+
+	if(a == NULL || b == NULL)
+	{
+		diff.state = a == NULL ? DIFF_ADDED : DIFF_REMOVED;
+		return;
+	}
+
+	if(a->type != b->type)
+		addKey(diff, "type");
+	diffProperties(*a, *b, options, diff);
+	diffGeometry(*a, *b, options, diff);
+
+	const DiffDeviation &d = diff.deviation;
+	bool bOver = d.fPosition > options.fPositionTolerance || d.fFrame > options.fPositionTolerance
+		|| d.fNormal > options.fAttributeTolerance || d.fUv > options.fAttributeTolerance
+		|| d.fColor > options.fAttributeTolerance;
+	diff.state = bOver || !diff.changedKeys.empty() ? DIFF_CHANGED : DIFF_SAME;
+}
+
+DiffTask::DiffTask(const std::vector<const SioRecord *> &a, const std::vector<const SioRecord *> &b,
+	size_t begin, size_t end, const DiffOptions &options, std::vector<RecordDiff> &diffs)
+	: m_vA(a), m_vB(b), m_nBegin(begin), m_nEnd(end), m_options(options), m_vDiffs(diffs)
+{
+}
+
+void DiffTask::run()
+{
+	// Each task writes its own slots, no locking needed.
+	for(size_t i=m_nBegin; i<m_nEnd; i++)
+		diffRecord(m_vA[i], m_vB[i], m_options, m_vDiffs[i]);
+}
+
+void SceneLoadTask::run()
+{
+	double fStart = getTimeSeconds();
+	m_bLoaded = m_scene.load(m_sPath, m_sError);
+	m_fSeconds = getTimeSeconds() - fStart;
+}
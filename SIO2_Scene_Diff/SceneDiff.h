@@ -0,0 +1,115 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SCENEDIFF_H
+#define SCENEDIFF_H
+
+#include <string>
+#include <vector>
+#include "SioScene.h"
+#include "WorkerPool.h"
+
+// Compares two exports of a scene record by record, so the effect
+// of an exporter option shows as which objects changed and by how
+// much rather than as a text diff of every vert( ) line.
+
+struct DiffOptions
+{
+	// Largest difference still counted as equal, for positions
+	// and for the other vertex attributes and values.
+	float fPositionTolerance;
+	float fAttributeTolerance;
+};
+
+enum DiffState
+{
+	DIFF_SAME,
+	DIFF_CHANGED,
+	DIFF_ADDED,
+	DIFF_REMOVED
+};
+
+// Largest deviations, also kept when under the tolerance.
+struct DiffDeviation
+{
+	float fPosition;
+	float fNormal;
+	float fUv;
+	float fColor;
+	float fValue;
+	float fFrame;
+
+	DiffDeviation() : fPosition(0), fNormal(0), fUv(0), fColor(0), fValue(0), fFrame(0) {}
+	void max(const DiffDeviation &other);
+};
+
+struct RecordDiff
+{
+	std::string name;
+	SioRecordType type;
+	DiffState state;
+
+	// Keys whose values differ or that only one side has.
+	std::vector<std::string> changedKeys;
+	DiffDeviation deviation;
+
+	unsigned int nVerticesA, nVerticesB;
+	size_t nIndicesA, nIndicesB;
+	// Triangles with no counterpart within the tolerance.
+	unsigned int nOnlyInA, nOnlyInB;
+	// Vertices were reordered, so triangles were matched by
+	// position rather than by index.
+	bool bMatchedByPosition;
+};
+
+// Either record may be NULL when it is only in one scene.
+void diffRecord(const SioRecord *a, const SioRecord *b, const DiffOptions &options, RecordDiff &diff);
+
+// Diffs a range of record pairs on the worker pool.
+class DiffTask : public WorkerTask
+{
+	public:
+		DiffTask(const std::vector<const SioRecord *> &a, const std::vector<const SioRecord *> &b,
+			size_t begin, size_t end, const DiffOptions &options, std::vector<RecordDiff> &diffs);
+
+		virtual void run();
+
+	protected:
+		const std::vector<const SioRecord *> &m_vA;
+		const std::vector<const SioRecord *> &m_vB;
+		size_t m_nBegin, m_nEnd;
+		const DiffOptions &m_options;
+		std::vector<RecordDiff> &m_vDiffs;
+};
+
+// Loads one of the scenes on the worker pool.
+class SceneLoadTask : public WorkerTask
+{
+	public:
+		explicit SceneLoadTask(const std::string &path) : m_sPath(path), m_bLoaded(false) {}
+
+		virtual void run();
+
+		std::string m_sPath;
+		SioScene m_scene;
+		std::string m_sError;
+		bool m_bLoaded;
+		double m_fSeconds;
+};
+
+#endif
@@ -0,0 +1,317 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "SceneDiff.h"
+
+static const char *g_cUsage =
+"Usage: SIO2_SceneDiff <scene A> <scene B> [options]\n"
+"\n"
+"Scenes are export folders or .sio2 files.\n"
+"\n"
+"  -tol f        Position tolerance (default 0.002)\n"
+"  -atol f       Tolerance of normals, UVs, colours and values (default 0.002)\n"
+"  -p n          Threads, 0 for one per processor (default 0)\n"
+"  -max n        Changed records listed, 0 lists all (default 50)\n"
+"  -json file    Also write every changed record as JSON\n"
+"\n"
+"Exits with 0 when the scenes match, 1 when they differ and 2 on errors.\n";
+
+static const char *g_cStateNames[] = { "same", "changed", "added", "removed" };
+
+// Deviations reported in the summary, with the record they
+// were largest in.
+struct DeviationSummary
+{
+	const char *name;
+	float DiffDeviation::*member;
+	float fMax;
+	std::string record;
+};
+
+static void writeJsonString(std::ostream &out, const std::string &text)
+{
+	out<<'"';
+	for(unsigned int i=0; i<text.length(); i++)
+	{
+		if(text[i] == '\\' || text[i] == '"')
+			out<<'\\';
+		out<<text[i];
+	}
+	out<<'"';
+}
+
+static void printRecord(const RecordDiff &diff)
+{
+	printf("  %-8s %s", g_cStateNames[diff.state], diff.name.c_str());
+	if(diff.state != DIFF_CHANGED)
+	{
+		printf("\n");
+		return;
+	}
+
+	const DiffDeviation &d = diff.deviation;
+	if(d.fPosition > 0)
+		printf(", pos %g", d.fPosition);
+	if(d.fNormal > 0)
+		printf(", nor %g", d.fNormal);
+	if(d.fUv > 0)
+		printf(", uv %g", d.fUv);
+	if(d.fColor > 0)
+		printf(", col %g", d.fColor);
+	if(d.fFrame > 0)
+		printf(", frame %g", d.fFrame);
+	if(diff.nVerticesA != diff.nVerticesB)
+		printf(", verts %u -> %u", diff.nVerticesA, diff.nVerticesB);
+	if(diff.nIndicesA != diff.nIndicesB)
+		printf(", indices %u -> %u", (unsigned int)diff.nIndicesA, (unsigned int)diff.nIndicesB);
+	if(diff.nOnlyInA > 0 || diff.nOnlyInB > 0)
+		printf(", triangles -%u +%u", diff.nOnlyInA, diff.nOnlyInB);
+	if(!diff.changedKeys.empty())
+	{
+		printf(", keys");
+		for(unsigned int k=0; k<diff.changedKeys.size(); k++)
+			printf(" %s", diff.changedKeys[k].c_str());
+	}
+	printf("\n");
+}
+
+static void writeJson(const std::string &fileName, const std::string &pathA, const std::string &pathB,
+	const std::vector<RecordDiff> &diffs, const unsigned int nStates[4], const std::vector<DeviationSummary> &summary)
+{
+	std::ofstream out(fileName.c_str());
+	if(!out)
+	{
+		fprintf(stderr, "Could not write %s\n", fileName.c_str());
+		return;
+	}
+
+	out<<"{\n\t\"a\": ";
+	writeJsonString(out, pathA);
+	out<<",\n\t\"b\": ";
+	writeJsonString(out, pathB);
+	out<<",\n";
+	for(int s=0; s<4; s++)
+		out<<"\t\""<<g_cStateNames[s]<<"\": "<<nStates[s]<<",\n";
+	out<<"\t\"maxDeviation\": {";
+	for(unsigned int i=0; i<summary.size(); i++)
+		out<<(i ? ", " : " ")<<"\""<<summary[i].name<<"\": "<<summary[i].fMax;
+	out<<" },\n\t\"records\": [";
+
+	bool bFirst = true;
+	for(unsigned int i=0; i<diffs.size(); i++)
+	{
+		const RecordDiff &diff = diffs[i];
+		if(diff.state == DIFF_SAME)
+			continue;
+		out<<(bFirst ? "\n" : ",\n")<<"\t\t{ \"name\": ";
+		bFirst = false;
+		writeJsonString(out, diff.name);
+		out<<", \"state\": \""<<g_cStateNames[diff.state]<<"\"";
+		if(diff.state == DIFF_CHANGED)
+		{
+			for(unsigned int s=0; s<summary.size(); s++)
+				out<<", \""<<summary[s].name<<"\": "<<diff.deviation.*summary[s].member;
+			out<<", \"verticesA\": "<<diff.nVerticesA<<", \"verticesB\": "<<diff.nVerticesB
+				<<", \"indicesA\": "<<diff.nIndicesA<<", \"indicesB\": "<<diff.nIndicesB
+				<<", \"trianglesOnlyInA\": "<<diff.nOnlyInA<<", \"trianglesOnlyInB\": "<<diff.nOnlyInB
+				<<", \"keys\": [";
+			for(unsigned int k=0; k<diff.changedKeys.size(); k++)
+			{
+				out<<(k ? ", " : "");
+				writeJsonString(out, diff.changedKeys[k]);
+			}
+			out<<"]";
+		}
+		out<<" }";
+	}
+	out<<"\n\t]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 3)
+	{
+		fputs(g_cUsage, stderr);
+		return 2;
+	}
+
+	DiffOptions options;
+	options.fPositionTolerance = 0.002f;
+	options.fAttributeTolerance = 0.002f;
+	unsigned int nThreads = 0;
+	unsigned int nMaxListed = 50;
+	std::string jsonFile;
+	for(int i=3; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-tol") == 0 && i + 1 < argc)
+			options.fPositionTolerance = (float)atof(argv[++i]);
+		else if(strcmp(argv[i], "-atol") == 0 && i + 1 < argc)
+			options.fAttributeTolerance = (float)atof(argv[++i]);
+		else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			nThreads = (unsigned int)atoi(argv[++i]);
+		else if(strcmp(argv[i], "-max") == 0 && i + 1 < argc)
+			nMaxListed = (unsigned int)atoi(argv[++i]);
+		else if(strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			jsonFile = argv[++i];
+		else
+		{
+			fputs(g_cUsage, stderr);
+			return 2;
+		}
+	}
+
+	double fStart = getTimeSeconds();
+	WorkerPool pool;
+	pool.start(nThreads);
+
+	SceneLoadTask loadA(argv[1]);
+	SceneLoadTask loadB(argv[2]);
+	pool.enqueue(&loadA);
+	pool.enqueue(&loadB);
+	pool.wait();
+	if(!loadA.m_bLoaded || !loadB.m_bLoaded)
+	{
+		fprintf(stderr, "%s\n", (!loadA.m_bLoaded ? loadA.m_sError : loadB.m_sError).c_str());
+		return 2;
+	}
+	const SioScene &sceneA = loadA.m_scene;
+	const SioScene &sceneB = loadB.m_scene;
+
+	// Records are matched by name, in the order of scene A with
+	// the ones only in B at the end.
+	std::map<std::string, const SioRecord *> byName;
+	for(unsigned int i=0; i<sceneB.m_vRecords.size(); i++)
+		byName[sceneB.m_vRecords[i].name] = &sceneB.m_vRecords[i];
+
+	std::vector<const SioRecord *> pairA, pairB;
+	for(unsigned int i=0; i<sceneA.m_vRecords.size(); i++)
+	{
+		std::map<std::string, const SioRecord *>::iterator it = byName.find(sceneA.m_vRecords[i].name);
+		pairA.push_back(&sceneA.m_vRecords[i]);
+		pairB.push_back(it != byName.end() ? it->second : NULL);
+		if(it != byName.end())
+			byName.erase(it);
+	}
+	for(unsigned int i=0; i<sceneB.m_vRecords.size(); i++)
+	{
+		if(byName.count(sceneB.m_vRecords[i].name))
+		{
+			pairA.push_back(NULL);
+			pairB.push_back(&sceneB.m_vRecords[i]);
+		}
+	}
+
+	// Several tasks per thread so one big object does not hold
+	// up a whole share of the records.
+	std::vector<RecordDiff> diffs(pairA.size());
+	size_t nTasks = pool.threadCount() * 8;
+	if(nTasks < 1)
+		nTasks = 1;
+	size_t nPerTask = (pairA.size() + nTasks - 1) / nTasks;
+	std::vector<DiffTask *> tasks;
+	for(size_t begin=0; begin<pairA.size(); begin+=nPerTask)
+	{
+		size_t end = begin + nPerTask < pairA.size() ? begin + nPerTask : pairA.size();
+		tasks.push_back(new DiffTask(pairA, pairB, begin, end, options, diffs));
+		pool.enqueue(tasks.back());
+	}
+	pool.wait();
+	pool.stop();
+	for(unsigned int i=0; i<tasks.size(); i++)
+		delete tasks[i];
+
+	std::vector<DeviationSummary> summary;
+	const char *names[6] = { "position", "normal", "uv", "color", "value", "frame" };
+	float DiffDeviation::*members[6] = { &DiffDeviation::fPosition, &DiffDeviation::fNormal, &DiffDeviation::fUv,
+		&DiffDeviation::fColor, &DiffDeviation::fValue, &DiffDeviation::fFrame };
+	for(int i=0; i<6; i++)
+	{
+		DeviationSummary s;
+		s.name = names[i];
+		s.member = members[i];
+		s.fMax = 0;
+		summary.push_back(s);
+	}
+
+	unsigned int nStates[4] = { 0, 0, 0, 0 };
+	unsigned int nListed = 0;
+	printf("A %s, %u records\nB %s, %u records\n\n", argv[1], (unsigned int)sceneA.m_vRecords.size(),
+		argv[2], (unsigned int)sceneB.m_vRecords.size());
+	for(unsigned int i=0; i<diffs.size(); i++)
+	{
+		const RecordDiff &diff = diffs[i];
+		nStates[diff.state]++;
+		for(unsigned int s=0; s<summary.size(); s++)
+		{
+			if(diff.deviation.*summary[s].member > summary[s].fMax)
+			{
+				summary[s].fMax = diff.deviation.*summary[s].member;
+				summary[s].record = diff.name;
+			}
+		}
+
+		if(diff.state == DIFF_SAME)
+			continue;
+		if(nMaxListed == 0 || nListed < nMaxListed)
+			printRecord(diff);
+		else if(nListed == nMaxListed)
+			printf("  ...\n");
+		nListed++;
+	}
+
+	printf("%s%u same, %u changed, %u added, %u removed\n", nListed ? "\n" : "", nStates[DIFF_SAME],
+		nStates[DIFF_CHANGED], nStates[DIFF_ADDED], nStates[DIFF_REMOVED]);
+	for(unsigned int s=0; s<summary.size(); s++)
+	{
+		if(summary[s].fMax > 0)
+			printf("Max %s deviation %g in %s\n", summary[s].name, summary[s].fMax, summary[s].record.c_str());
+	}
+
+	// Images and the like are only compared by name.
+	unsigned int nOtherFiles = 0;
+	for(unsigned int i=0; i<sceneA.m_vOtherFiles.size(); i++)
+	{
+		if(!sceneB.hasFile(sceneA.m_vOtherFiles[i]))
+		{
+			printf("Only in A: %s\n", sceneA.m_vOtherFiles[i].c_str());
+			nOtherFiles++;
+		}
+	}
+	for(unsigned int i=0; i<sceneB.m_vOtherFiles.size(); i++)
+	{
+		if(!sceneA.hasFile(sceneB.m_vOtherFiles[i]))
+		{
+			printf("Only in B: %s\n", sceneB.m_vOtherFiles[i].c_str());
+			nOtherFiles++;
+		}
+	}
+	printf("Compared in %.3f s\n", getTimeSeconds() - fStart);
+
+	if(!jsonFile.empty())
+		writeJson(jsonFile, argv[1], argv[2], diffs, nStates, summary);
+
+	return nListed > 0 || nOtherFiles > 0 ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "Inflate.h"
+
+#include <string.h>
+
+namespace
+{
+
+// Canonical Huffman code, symbols sorted by code length.
+struct HuffmanTable
+{
+	unsigned short counts[16];
+	unsigned short symbols[288];
+};
+
+struct BitReader
+{
+	const unsigned char *src;
+	const unsigned char *end;
+	unsigned int bits;
+	int nBits;
+	bool bOverrun;
+
+	// Reads n bits, least significant first. Past the end of
+	// the input it reads zeros and flags the overrun.
+	unsigned int read(int n)
+	{
+		while(nBits < n)
+		{
+			unsigned int byte = 0;
+			if(src < end)
+				byte = *src++;
+			else
+				bOverrun = true;
+			bits |= byte << nBits;
+			nBits += 8;
+		}
+		unsigned int value = bits & ((1u << n) - 1);
+		bits >>= n;
+		nBits -= n;
+		return value;
+	}
+};
+
+bool buildTable(HuffmanTable &table, const unsigned char *lengths, int n)
+{
+	memset(table.counts, 0, sizeof(table.counts));
+	for(int i=0; i<n; i++)
+		table.counts[lengths[i]]++;
+	table.counts[0] = 0;
+
+	// An over-subscribed code is invalid, an incomplete one
+	// is allowed (a single distance code for example).
+	int left = 1;
+	for(int len=1; len<16; len++)
+	{
+		left <<= 1;
+		left -= table.counts[len];
+		if(left < 0)
+			return false;
+	}
+
+	unsigned short offsets[16];
+	offsets[1] = 0;
+	for(int len=1; len<15; len++)
+		offsets[len + 1] = offsets[len] + table.counts[len];
+
+	for(int i=0; i<n; i++)
+	{
+		if(lengths[i] != 0)
+			table.symbols[offsets[lengths[i]]++] = (unsigned short)i;
+	}
+	return true;
+}
+
+// Huffman codes are stored most significant bit first, so
+// they are read a bit at a time.
+int decodeSymbol(BitReader &in, const HuffmanTable &table)
+{
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for(int len=1; len<16; len++)
+	{
+		code |= (int)in.read(1);
+		int count = table.counts[len];
+		if(code - first < count)
+			return table.symbols[index + code - first];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+const unsigned short g_nLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const unsigned char g_nLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const unsigned short g_nDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const unsigned char g_nDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+bool inflateBlock(BitReader &in, const HuffmanTable &lengths, const HuffmanTable &distances,
+	unsigned char *dst, size_t dstSize, size_t &pos)
+{
+	for(;;)
+	{
+		int symbol = decodeSymbol(in, lengths);
+		if(symbol < 0 || in.bOverrun)
+			return false;
+
+		if(symbol < 256)
+		{
+			if(pos >= dstSize)
+				return false;
+			dst[pos++] = (unsigned char)symbol;
+		}
+		else if(symbol == 256)
+		{
+			return true;
+		}
+		else
+		{
+			symbol -= 257;
+			if(symbol >= 29)
+				return false;
+			size_t length = g_nLengthBase[symbol] + in.read(g_nLengthExtra[symbol]);
+
+			int distSymbol = decodeSymbol(in, distances);
+			if(distSymbol < 0 || distSymbol >= 30)
+				return false;
+			size_t distance = g_nDistBase[distSymbol] + in.read(g_nDistExtra[distSymbol]);
+
+			if(distance > pos || length > dstSize - pos)
+				return false;
+
+			// The copy may overlap what it writes.
+			for(size_t i=0; i<length; i++, pos++)
+				dst[pos] = dst[pos - distance];
+		}
+	}
+}
+
+bool readDynamicTables(BitReader &in, HuffmanTable &lengths, HuffmanTable &distances)
+{
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	int nLengths = (int)in.read(5) + 257;
+	int nDistances = (int)in.read(5) + 1;
+	int nCodes = (int)in.read(4) + 4;
+	if(nLengths > 286 || nDistances > 30)
+		return false;
+
+	unsigned char codeLengths[19];
+	memset(codeLengths, 0, sizeof(codeLengths));
+	for(int i=0; i<nCodes; i++)
+		codeLengths[order[i]] = (unsigned char)in.read(3);
+
+	HuffmanTable codes;
+	if(!buildTable(codes, codeLengths, 19))
+		return false;
+
+	unsigned char all[286 + 30];
+	int n = 0;
+	while(n < nLengths + nDistances)
+	{
+		int symbol = decodeSymbol(in, codes);
+		if(symbol < 0 || in.bOverrun)
+			return false;
+
+		if(symbol < 16)
+		{
+			all[n++] = (unsigned char)symbol;
+			continue;
+		}
+
+		unsigned char value = 0;
+		int repeat;
+		if(symbol == 16)
+		{
+			if(n == 0)
+				return false;
+			value = all[n - 1];
+			repeat = 3 + (int)in.read(2);
+		}
+		else if(symbol == 17)
+		{
+			repeat = 3 + (int)in.read(3);
+		}
+		else
+		{
+			repeat = 11 + (int)in.read(7);
+		}
+
+		if(n + repeat > nLengths + nDistances)
+			return false;
+		while(repeat--)
+			all[n++] = value;
+	}
+
+	// Without an end of block code nothing can be decoded.
+	if(all[256] == 0)
+		return false;
+
+	return buildTable(lengths, all, nLengths) && buildTable(distances, all + nLengths, nDistances);
+}
+
+void buildFixedTables(HuffmanTable &lengths, HuffmanTable &distances)
+{
+	unsigned char all[288];
+	int i = 0;
+	for(; i<144; i++)
+		all[i] = 8;
+	for(; i<256; i++)
+		all[i] = 9;
+	for(; i<280; i++)
+		all[i] = 7;
+	for(; i<288; i++)
+		all[i] = 8;
+	buildTable(lengths, all, 288);
+
+	for(i=0; i<30; i++)
+		all[i] = 5;
+	buildTable(distances, all, 30);
+}
+
+}
+
+bool inflateRaw(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize)
+{
+	BitReader in;
+	in.src = src;
+	in.end = src + srcSize;
+	in.bits = 0;
+	in.nBits = 0;
+	in.bOverrun = false;
+
+	size_t pos = 0;
+	bool bLast = false;
+	while(!bLast)
+	{
+		bLast = in.read(1) != 0;
+		unsigned int type = in.read(2);
+
+		if(type == 0)
+		{
+			// Stored blocks start on a byte boundary.
+			in.bits = 0;
+			in.nBits = 0;
+			if(in.end - in.src < 4)
+				return false;
+			unsigned int length = in.src[0] | (in.src[1] << 8);
+			unsigned int check = in.src[2] | (in.src[3] << 8);
+			in.src += 4;
+			if(length != (~check & 0xFFFF) || (size_t)(in.end - in.src) < length || length > dstSize - pos)
+				return false;
+			memcpy(dst + pos, in.src, length);
+			in.src += length;
+			pos += length;
+		}
+		else if(type == 1 || type == 2)
+		{
+			HuffmanTable lengths, distances;
+			if(type == 1)
+				buildFixedTables(lengths, distances);
+			else if(!readDynamicTables(in, lengths, distances))
+				return false;
+
+			if(!inflateBlock(in, lengths, distances, dst, dstSize, pos))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return pos == dstSize;
+}
@@ -0,0 +1,30 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+
+// Decompresses a raw deflate stream (RFC 1951), as stored in
+// zip archives, into a buffer of the size given by the archive.
+// Returns false if the data is corrupt or does not fill out
+// exactly.
+bool inflateRaw(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize);
+
+#endif
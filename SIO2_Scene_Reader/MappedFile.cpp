@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "MappedFile.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Empty files cannot be mapped, they get this instead.
+static const unsigned char g_cEmpty[1] = { 0 };
+
+MappedFile::MappedFile()
+{
+	m_pData = NULL;
+	m_nSize = 0;
+#ifdef WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#else
+	m_fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+
+#ifdef WIN32
+	m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(m_hFile, &size))
+	{
+		close();
+		return false;
+	}
+	m_nSize = (size_t)size.QuadPart;
+	if(m_nSize == 0)
+	{
+		m_pData = g_cEmpty;
+		return true;
+	}
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(m_hMapping == NULL)
+	{
+		close();
+		return false;
+	}
+	m_pData = (const unsigned char *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if(m_fd < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(m_fd, &info) != 0)
+	{
+		close();
+		return false;
+	}
+	m_nSize = (size_t)info.st_size;
+	if(m_nSize == 0)
+	{
+		m_pData = g_cEmpty;
+		return true;
+	}
+
+	void *view = mmap(NULL, m_nSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	m_pData = view == MAP_FAILED ? NULL : (const unsigned char *)view;
+#endif
+
+	if(m_pData == NULL)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	bool bMapped = m_pData != NULL && m_pData != g_cEmpty;
+#ifdef WIN32
+	if(bMapped)
+		UnmapViewOfFile(m_pData);
+	if(m_hMapping != NULL)
+		CloseHandle(m_hMapping);
+	if(m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if(bMapped)
+		munmap((void *)m_pData, m_nSize);
+	if(m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+#endif
+	m_pData = NULL;
+	m_nSize = 0;
+}
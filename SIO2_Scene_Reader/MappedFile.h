@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+// Read only view of a whole file mapped into memory.
+class MappedFile
+{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool open(const std::string &path);
+		void close();
+
+		const unsigned char *data() const { return m_pData; }
+		size_t size() const { return m_nSize; }
+
+	protected:
+		// Not copyable, it owns the mapping.
+		MappedFile(const MappedFile &);
+		MappedFile &operator=(const MappedFile &);
+
+		const unsigned char *m_pData;
+		size_t m_nSize;
+#ifdef WIN32
+		HANDLE m_hFile;
+		HANDLE m_hMapping;
+#else
+		int m_fd;
+#endif
+};
+
+#endif
@@ -0,0 +1,188 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SioScene.h"
+#include "WorkerPool.h"
+
+// Loads an exported scene the way a player would and reports how
+// long parsing takes for each kind of record.
+
+static const char *g_cUsage =
+"Usage: SIO2_ReaderBenchmark <scene folder | file.sio2> [options]\n"
+"\n"
+"  -repeat n     Load the scene n times and keep the fastest (default 5)\n"
+"  -validate     Check counts and names the records refer to\n"
+"  -json file    Also write the results as JSON\n";
+
+struct BenchmarkResult
+{
+	double fBest[SIO_RECORD_TYPES];
+	double fBestTotal;
+	double fBestMap;
+	double fBestInflate;
+};
+
+static double megabytesPerSecond(size_t nBytes, double fSeconds)
+{
+	return fSeconds > 0 ? nBytes / (1024.0 * 1024.0) / fSeconds : 0;
+}
+
+static void writeJson(const std::string &fileName, const std::string &path, const SioScene &scene,
+	const BenchmarkResult &result, unsigned int nRepeat, const std::vector<std::string> &problems)
+{
+	std::ofstream out(fileName.c_str());
+	if(!out)
+	{
+		fprintf(stderr, "Could not write %s\n", fileName.c_str());
+		return;
+	}
+
+	out<<"{\n";
+	out<<"\t\"scene\": \"";
+	for(unsigned int i=0; i<path.length(); i++)
+	{
+		if(path[i] == '\\' || path[i] == '"')
+			out<<'\\';
+		out<<path[i];
+	}
+	out<<"\",\n";
+	out<<"\t\"repeat\": "<<nRepeat<<",\n";
+	out<<"\t\"fileBytes\": "<<scene.m_nFileBytes<<",\n";
+	out<<"\t\"totalSeconds\": "<<result.fBestTotal<<",\n";
+	out<<"\t\"mapSeconds\": "<<result.fBestMap<<",\n";
+	out<<"\t\"inflateSeconds\": "<<result.fBestInflate<<",\n";
+	out<<"\t\"records\": {\n";
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		const SioLoadStats &stats = scene.m_stats[i];
+		out<<"\t\t\""<<sioRecordTypeName(i)<<"\": { \"count\": "<<stats.nRecords
+			<<", \"bytes\": "<<stats.nBytes
+			<<", \"parseSeconds\": "<<result.fBest[i]<<" }"
+			<<(i + 1 < SIO_RECORD_TYPES ? "," : "")<<"\n";
+	}
+	out<<"\t},\n";
+	out<<"\t\"problems\": "<<problems.size()<<"\n";
+	out<<"}\n";
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2)
+	{
+		fputs(g_cUsage, stderr);
+		return 1;
+	}
+
+	std::string path = argv[1];
+	unsigned int nRepeat = 5;
+	bool bValidate = false;
+	std::string jsonFile;
+	for(int i=2; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-repeat") == 0 && i + 1 < argc)
+			nRepeat = (unsigned int)atoi(argv[++i]);
+		else if(strcmp(argv[i], "-validate") == 0)
+			bValidate = true;
+		else if(strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			jsonFile = argv[++i];
+		else
+		{
+			fputs(g_cUsage, stderr);
+			return 1;
+		}
+	}
+	if(nRepeat < 1)
+		nRepeat = 1;
+
+	// The first load also warms the file cache, the best of the
+	// runs is what parsing costs.
+	SioScene scene;
+	BenchmarkResult result;
+	for(unsigned int run=0; run<nRepeat; run++)
+	{
+		std::string error;
+		double fStart = getTimeSeconds();
+		if(!scene.load(path, error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		double fTotal = getTimeSeconds() - fStart;
+
+		for(int i=0; i<SIO_RECORD_TYPES; i++)
+		{
+			if(run == 0 || scene.m_stats[i].fParseSeconds < result.fBest[i])
+				result.fBest[i] = scene.m_stats[i].fParseSeconds;
+		}
+		if(run == 0 || fTotal < result.fBestTotal)
+			result.fBestTotal = fTotal;
+		if(run == 0 || scene.m_fMapSeconds < result.fBestMap)
+			result.fBestMap = scene.m_fMapSeconds;
+		if(run == 0 || scene.m_fInflateSeconds < result.fBestInflate)
+			result.fBestInflate = scene.m_fInflateSeconds;
+	}
+
+	printf("%s, %u bytes, best of %u\n\n", path.c_str(), (unsigned int)scene.m_nFileBytes, nRepeat);
+	printf("%-10s %8s %12s %10s %10s\n", "record", "count", "bytes", "parse ms", "MB/s");
+	size_t nTotalBytes = 0;
+	double fTotalParse = 0;
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		const SioLoadStats &stats = scene.m_stats[i];
+		printf("%-10s %8u %12u %10.3f %10.1f\n", sioRecordTypeName(i), stats.nRecords, (unsigned int)stats.nBytes,
+			result.fBest[i] * 1000, megabytesPerSecond(stats.nBytes, result.fBest[i]));
+		nTotalBytes += stats.nBytes;
+		fTotalParse += result.fBest[i];
+	}
+	printf("%-10s %8u %12u %10.3f %10.1f\n\n", "all", (unsigned int)scene.m_vRecords.size(), (unsigned int)nTotalBytes,
+		fTotalParse * 1000, megabytesPerSecond(nTotalBytes, fTotalParse));
+
+	size_t nVertices = 0, nIndices = 0, nFrames = 0;
+	for(unsigned int i=0; i<scene.m_vRecords.size(); i++)
+	{
+		const SioRecord &r = scene.m_vRecords[i];
+		nVertices += r.vertexCount();
+		nFrames += r.frames.size();
+		for(unsigned int g=0; g<r.groups.size(); g++)
+			nIndices += r.groups[g].indices.size();
+	}
+	printf("Map %.3f ms, inflate %.3f ms, load %.3f ms\n", result.fBestMap * 1000,
+		result.fBestInflate * 1000, result.fBestTotal * 1000);
+	printf("%u vertices, %u indices, %u frames, %u other files\n", (unsigned int)nVertices,
+		(unsigned int)nIndices, (unsigned int)nFrames, (unsigned int)scene.m_vOtherFiles.size());
+
+	std::vector<std::string> problems;
+	if(bValidate)
+	{
+		scene.validate(problems);
+		printf("\n%u problems\n", (unsigned int)problems.size());
+		for(unsigned int i=0; i<problems.size(); i++)
+			printf("  %s\n", problems[i].c_str());
+	}
+
+	if(!jsonFile.empty())
+		writeJson(jsonFile, path, scene, result, nRepeat, problems);
+
+	return problems.empty() ? 0 : 2;
+}
@@ -0,0 +1,828 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#include "SioScene.h"
+
+#include <math.h>
+#include <string.h>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "Inflate.h"
+#include "MappedFile.h"
+#include "WorkerPool.h"
+
+#ifndef WIN32
+#include <dirent.h>
+#endif
+
+// Folders of the scene holding records, in SioRecordType order.
+static const char *g_cRecordDirs[SIO_RECORD_TYPES] = { "camera", "lamp", "material", "object", "ipo" };
+
+// Folders copied as they are.
+static const char *g_cOtherDirs[] = { "image", "sound", "script" };
+
+// Most values a key( ... ) line has outside of the properties.
+const int g_nMaxLineValues = 16;
+
+const char *sioRecordTypeName(int type)
+{
+	return type >= 0 && type < SIO_RECORD_TYPES ? g_cRecordDirs[type] : "unknown";
+}
+
+const SioProperty *SioRecord::find(const char *key) const
+{
+	for(unsigned int i=0; i<properties.size(); i++)
+	{
+		if(properties[i].key == key)
+			return &properties[i];
+	}
+	return NULL;
+}
+
+void SioRecord::getTriangles(unsigned int group, std::vector<unsigned int> &triangles) const
+{
+	triangles.clear();
+	const SioVertexGroup &g = groups[group];
+	if(!g.bStrips)
+	{
+		triangles.assign(g.indices.begin(), g.indices.end() - g.indices.size() % 3);
+		return;
+	}
+
+	const SioProperty *restart = find("strip_restart");
+	unsigned int nRestart = restart != NULL && !restart->values.empty() ? (unsigned int)restart->values[0] : 0xFFFFFFFF;
+
+	// Every other triangle of a strip is flipped to keep the winding.
+	size_t start = 0;
+	for(size_t i=0; i+2<g.indices.size(); i++)
+	{
+		const unsigned int *s = &g.indices[i];
+		if(s[0] == nRestart || s[1] == nRestart || s[2] == nRestart)
+		{
+			if(s[0] == nRestart)
+				start = i + 1;
+			continue;
+		}
+		if(s[0] == s[1] || s[1] == s[2] || s[0] == s[2])
+			continue;
+
+		bool bOdd = ((i - start) & 1) != 0;
+		triangles.push_back(bOdd ? s[1] : s[0]);
+		triangles.push_back(bOdd ? s[0] : s[1]);
+		triangles.push_back(s[2]);
+	}
+}
+
+static const double g_fPow10[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const char *parseSioNumber(const char *p, const char *end, double &value)
+{
+	const char *start = p;
+	bool bNegative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		bNegative = *p == '-';
+		p++;
+	}
+
+	// Up to 19 digits fit the mantissa, the rest only scale it.
+	unsigned long long mantissa = 0;
+	int nDigits = 0;
+	int exponent = 0;
+	bool bAny = false;
+	for(; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		bAny = true;
+		if(nDigits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if(mantissa > 0)
+				nDigits++;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if(p < end && *p == '.')
+	{
+		for(p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			bAny = true;
+			if(nDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if(mantissa > 0)
+					nDigits++;
+				exponent--;
+			}
+		}
+	}
+	if(!bAny)
+		return start;
+
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *e = p + 1;
+		bool bNegativeExp = false;
+		if(e < end && (*e == '-' || *e == '+'))
+		{
+			bNegativeExp = *e == '-';
+			e++;
+		}
+		if(e < end && *e >= '0' && *e <= '9')
+		{
+			int n = 0;
+			for(; e < end && *e >= '0' && *e <= '9'; e++)
+			{
+				if(n < 10000)
+					n = n * 10 + (*e - '0');
+			}
+			exponent += bNegativeExp ? -n : n;
+			p = e;
+		}
+	}
+
+	// Exact for the short values the exporter writes.
+	double result = (double)mantissa;
+	if(exponent < 0 && exponent >= -22)
+		result /= g_fPow10[-exponent];
+	else if(exponent > 0 && exponent <= 22)
+		result *= g_fPow10[exponent];
+	else if(exponent != 0)
+		result *= pow(10.0, exponent);
+
+	value = bNegative ? -result : result;
+	return p;
+}
+
+namespace
+{
+
+// Walks the text of one record file.
+struct SioParser
+{
+	const char *p;
+	const char *end;
+	int nLine;
+
+	void skipSpace()
+	{
+		for(; p < end; p++)
+		{
+			if(*p == '\n')
+				nLine++;
+			else if(*p != ' ' && *p != '\t' && *p != '\r')
+				break;
+		}
+	}
+
+	bool readKey(const char *&key, size_t &length)
+	{
+		key = p;
+		while(p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
+			p++;
+		length = p - key;
+		return length > 0;
+	}
+
+	bool expect(char c)
+	{
+		skipSpace();
+		if(p >= end || *p != c)
+			return false;
+		p++;
+		return true;
+	}
+
+	bool readString(std::string &text)
+	{
+		p++;
+		const char *start = p;
+		while(p < end && *p != '"' && *p != '\n')
+			p++;
+		if(p >= end || *p != '"')
+			return false;
+		text.assign(start, p - start);
+		p++;
+		return true;
+	}
+
+	// Reads the arguments up to the closing bracket. Numbers
+	// past nMax are read and dropped.
+	bool readArgs(float *values, int nMax, int &nValues, std::string *text)
+	{
+		nValues = 0;
+		for(;;)
+		{
+			skipSpace();
+			if(p >= end)
+				return false;
+			if(*p == ')')
+			{
+				p++;
+				return true;
+			}
+			if(*p == '"')
+			{
+				std::string dropped;
+				if(!readString(text ? *text : dropped))
+					return false;
+				continue;
+			}
+
+			double value;
+			const char *next = parseSioNumber(p, end, value);
+			if(next == p)
+				return false;
+			p = next;
+			if(nValues < nMax)
+				values[nValues] = (float)value;
+			nValues++;
+		}
+	}
+};
+
+bool keyIs(const char *key, size_t length, const char *name)
+{
+	return strlen(name) == length && memcmp(key, name, length) == 0;
+}
+
+}
+
+SioScene::SioScene()
+{
+	clear();
+}
+
+void SioScene::clear()
+{
+	m_vRecords.clear();
+	m_vOtherFiles.clear();
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		m_stats[i].nRecords = 0;
+		m_stats[i].nBytes = 0;
+		m_stats[i].fParseSeconds = 0;
+	}
+	m_fMapSeconds = 0;
+	m_fInflateSeconds = 0;
+	m_nFileBytes = 0;
+}
+
+bool SioScene::parse(const char *text, size_t size, const std::string &fileName, std::string &error)
+{
+	SioParser in;
+	in.p = text;
+	in.end = text + size;
+	in.nLine = 1;
+
+	std::ostringstream message;
+	const char *key;
+	size_t keyLength;
+
+	// type( "dir/name" ) {
+	in.skipSpace();
+	SioRecord record;
+	record.nDeclaredFrames = 0;
+	if(!in.readKey(key, keyLength))
+	{
+		message<<fileName<<"("<<in.nLine<<"): expected a record";
+		error = message.str();
+		return false;
+	}
+
+	int type = -1;
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		if(keyIs(key, keyLength, g_cRecordDirs[i]))
+			type = i;
+	}
+	if(type < 0)
+	{
+		message<<fileName<<"("<<in.nLine<<"): unknown record "<<std::string(key, keyLength);
+		error = message.str();
+		return false;
+	}
+	record.type = (SioRecordType)type;
+
+	float values[g_nMaxLineValues];
+	int nValues;
+	if(!in.expect('(') || !in.readArgs(values, g_nMaxLineValues, nValues, &record.name) || !in.expect('{'))
+	{
+		message<<fileName<<"("<<in.nLine<<"): bad record header";
+		error = message.str();
+		return false;
+	}
+
+	m_vRecords.push_back(record);
+	SioRecord &r = m_vRecords.back();
+	SioVertexGroup *group = NULL;
+	SioFrame *frame = NULL;
+
+	for(;;)
+	{
+		in.skipSpace();
+		if(in.p >= in.end)
+		{
+			message<<fileName<<"("<<in.nLine<<"): missing }";
+			error = message.str();
+			return false;
+		}
+		if(*in.p == '}')
+			break;
+
+		if(!in.readKey(key, keyLength) || !in.expect('('))
+		{
+			message<<fileName<<"("<<in.nLine<<"): expected key( ... )";
+			error = message.str();
+			return false;
+		}
+
+		// The geometry lines come by the thousand, they go
+		// straight into arrays. Anything else is a property.
+		std::string text;
+		bool bOk;
+		if(keyIs(key, keyLength, "vert"))
+		{
+			bOk = in.readArgs(values, 3, nValues, NULL) && nValues == 3;
+			r.vertices.insert(r.vertices.end(), values, values + 3);
+		}
+		else if(keyIs(key, keyLength, "vnor"))
+		{
+			bOk = in.readArgs(values, 3, nValues, NULL) && nValues == 3;
+			r.normals.insert(r.normals.end(), values, values + 3);
+		}
+		else if(keyIs(key, keyLength, "vcol"))
+		{
+			bOk = in.readArgs(values, 4, nValues, NULL) && nValues == 4;
+			r.colors.insert(r.colors.end(), values, values + 4);
+		}
+		else if(keyIs(key, keyLength, "uv0") || keyIs(key, keyLength, "uv1"))
+		{
+			bOk = in.readArgs(values, 2, nValues, NULL) && nValues == 2;
+			std::vector<float> &uv = key[2] == '0' ? r.uv0 : r.uv1;
+			uv.insert(uv.end(), values, values + 2);
+		}
+		else if(keyIs(key, keyLength, "vtan"))
+		{
+			bOk = in.readArgs(values, 4, nValues, NULL) && nValues == 4;
+			r.tangents.insert(r.tangents.end(), values, values + 4);
+		}
+		else if(keyIs(key, keyLength, "ind") || keyIs(key, keyLength, "sind"))
+		{
+			// Strips are written three to a line, the last may be short.
+			bOk = in.readArgs(values, 3, nValues, NULL) && nValues >= 1 && nValues <= 3 && group != NULL;
+			if(bOk)
+			{
+				for(int i=0; i<nValues; i++)
+					group->indices.push_back((unsigned int)values[i]);
+			}
+		}
+		else if(keyIs(key, keyLength, "fvert"))
+		{
+			bOk = in.readArgs(values, 3, nValues, NULL) && nValues == 3 && frame != NULL;
+			if(bOk)
+				frame->vertices.insert(frame->vertices.end(), values, values + 3);
+		}
+		else if(keyIs(key, keyLength, "fnor"))
+		{
+			bOk = in.readArgs(values, 3, nValues, NULL) && nValues == 3 && frame != NULL;
+			if(bOk)
+				frame->normals.insert(frame->normals.end(), values, values + 3);
+		}
+		else if(keyIs(key, keyLength, "vgroup"))
+		{
+			bOk = in.readArgs(values, g_nMaxLineValues, nValues, &text);
+			r.groups.push_back(SioVertexGroup());
+			group = &r.groups.back();
+			group->name = text;
+			group->bStrips = false;
+			group->nDeclared = 0;
+		}
+		else if(keyIs(key, keyLength, "mname") && group != NULL)
+		{
+			bOk = in.readArgs(values, g_nMaxLineValues, nValues, &text);
+			group->materials.push_back(text);
+		}
+		else if((keyIs(key, keyLength, "n_ind") || keyIs(key, keyLength, "n_sind")) && group != NULL)
+		{
+			bOk = in.readArgs(values, 1, nValues, NULL) && nValues == 1;
+			group->nDeclared = (unsigned int)values[0];
+			group->bStrips = key[2] == 's';
+			group->indices.reserve(group->nDeclared);
+		}
+		else if(keyIs(key, keyLength, "n_frame"))
+		{
+			bOk = in.readArgs(values, 1, nValues, NULL) && nValues == 1;
+			r.nDeclaredFrames = (unsigned int)values[0];
+			r.frames.reserve(r.nDeclaredFrames);
+		}
+		else if(keyIs(key, keyLength, "frame"))
+		{
+			bOk = in.readArgs(values, 1, nValues, &text) && nValues == 1;
+			r.frames.push_back(SioFrame());
+			frame = &r.frames.back();
+			frame->time = values[0];
+			frame->name = text;
+			if(r.frames.size() > 1)
+			{
+				frame->vertices.reserve(r.frames[0].vertices.size());
+				frame->normals.reserve(r.frames[0].normals.size());
+			}
+		}
+		else
+		{
+			r.properties.push_back(SioProperty());
+			SioProperty &property = r.properties.back();
+			property.key.assign(key, keyLength);
+			bOk = in.readArgs(values, g_nMaxLineValues, nValues, &property.text);
+			property.values.assign(values, values + (nValues < g_nMaxLineValues ? nValues : g_nMaxLineValues));
+		}
+
+		if(!bOk)
+		{
+			message<<fileName<<"("<<in.nLine<<"): bad "<<std::string(key, keyLength)<<" line";
+			error = message.str();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SioScene::loadEntry(const std::string &name, const char *text, size_t size, std::string &error)
+{
+	// Only the last folder counts, archives may be zipped
+	// with the scene folder around them.
+	size_t slash = name.find_last_of('/');
+	size_t dirStart = slash == std::string::npos || slash == 0 ? std::string::npos : name.find_last_of('/', slash - 1);
+	dirStart = dirStart == std::string::npos ? 0 : dirStart + 1;
+	std::string relative = name.substr(dirStart);
+	std::string dir = slash == std::string::npos ? "" : name.substr(dirStart, slash - dirStart);
+
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		if(dir != g_cRecordDirs[i])
+			continue;
+
+		double fStart = getTimeSeconds();
+		size_t nRecords = m_vRecords.size();
+		if(!parse(text, size, relative, error))
+			return false;
+
+		// Counted by what the header says it is.
+		int type = nRecords < m_vRecords.size() ? m_vRecords.back().type : i;
+		m_stats[type].nRecords++;
+		m_stats[type].nBytes += size;
+		m_stats[type].fParseSeconds += getTimeSeconds() - fStart;
+		return true;
+	}
+
+	m_vOtherFiles.push_back(relative);
+	return true;
+}
+
+#ifdef WIN32
+static void listFiles(const std::string &dir, std::vector<std::string> &files)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE hFind = FindFirstFileA((dir + "/*").c_str(), &data);
+	if(hFind == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			files.push_back(data.cFileName);
+	}
+	while(FindNextFileA(hFind, &data));
+	FindClose(hFind);
+}
+#else
+static void listFiles(const std::string &dir, std::vector<std::string> &files)
+{
+	DIR *handle = opendir(dir.c_str());
+	if(handle == NULL)
+		return;
+	struct dirent *entry;
+	while((entry = readdir(handle)) != NULL)
+	{
+		struct stat info;
+		std::string path = dir + "/" + entry->d_name;
+		if(stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+			files.push_back(entry->d_name);
+	}
+	closedir(handle);
+}
+#endif
+
+bool SioScene::loadFolder(const std::string &path, std::string &error)
+{
+	for(int i=0; i<SIO_RECORD_TYPES; i++)
+	{
+		std::vector<std::string> files;
+		listFiles(path + "/" + g_cRecordDirs[i], files);
+		for(unsigned int f=0; f<files.size(); f++)
+		{
+			std::string name = std::string(g_cRecordDirs[i]) + "/" + files[f];
+
+			double fStart = getTimeSeconds();
+			MappedFile file;
+			if(!file.open(path + "/" + name))
+			{
+				error = "Could not open " + path + "/" + name;
+				return false;
+			}
+			m_fMapSeconds += getTimeSeconds() - fStart;
+			m_nFileBytes += file.size();
+
+			if(!loadEntry(name, (const char *)file.data(), file.size(), error))
+				return false;
+		}
+	}
+
+	for(unsigned int i=0; i<sizeof(g_cOtherDirs) / sizeof(g_cOtherDirs[0]); i++)
+	{
+		std::vector<std::string> files;
+		listFiles(path + "/" + g_cOtherDirs[i], files);
+		for(unsigned int f=0; f<files.size(); f++)
+			m_vOtherFiles.push_back(std::string(g_cOtherDirs[i]) + "/" + files[f]);
+	}
+	return true;
+}
+
+static unsigned int readU16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int readU32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+bool SioScene::loadArchive(const std::string &path, std::string &error)
+{
+	double fStart = getTimeSeconds();
+	MappedFile file;
+	if(!file.open(path))
+	{
+		error = "Could not open " + path;
+		return false;
+	}
+	m_fMapSeconds += getTimeSeconds() - fStart;
+	m_nFileBytes += file.size();
+
+	const unsigned char *data = file.data();
+	size_t size = file.size();
+
+	// The end of central directory record, behind a comment
+	// of up to 64 KB.
+	size_t eocd = 0;
+	bool bFound = false;
+	for(size_t back = 22; back <= size && back <= 22 + 65535; back++)
+	{
+		if(readU32(data + size - back) == 0x06054b50)
+		{
+			eocd = size - back;
+			bFound = true;
+			break;
+		}
+	}
+	if(!bFound)
+	{
+		error = path + " is not a zip archive";
+		return false;
+	}
+
+	unsigned int nEntries = readU16(data + eocd + 10);
+	size_t pos = readU32(data + eocd + 16);
+	std::vector<unsigned char> inflated;
+
+	for(unsigned int i=0; i<nEntries; i++)
+	{
+		if(pos + 46 > size || readU32(data + pos) != 0x02014b50)
+		{
+			error = path + ": bad central directory";
+			return false;
+		}
+
+		unsigned int method = readU16(data + pos + 10);
+		size_t compressedSize = readU32(data + pos + 20);
+		size_t uncompressedSize = readU32(data + pos + 24);
+		unsigned int nameLength = readU16(data + pos + 28);
+		unsigned int extraLength = readU16(data + pos + 30);
+		unsigned int commentLength = readU16(data + pos + 32);
+		size_t localOffset = readU32(data + pos + 42);
+		if(pos + 46 + nameLength > size)
+		{
+			error = path + ": bad central directory";
+			return false;
+		}
+		std::string name((const char *)data + pos + 46, nameLength);
+		pos += 46 + nameLength + extraLength + commentLength;
+
+		// Folders.
+		if(name.empty() || name[name.length() - 1] == '/')
+			continue;
+
+		if(localOffset + 30 > size || readU32(data + localOffset) != 0x04034b50)
+		{
+			error = path + ": bad local header for " + name;
+			return false;
+		}
+		size_t dataOffset = localOffset + 30 + readU16(data + localOffset + 26) + readU16(data + localOffset + 28);
+		if(dataOffset + compressedSize > size)
+		{
+			error = path + ": " + name + " runs past the end";
+			return false;
+		}
+
+		const unsigned char *entry = data + dataOffset;
+		if(method == 8)
+		{
+			double fInflateStart = getTimeSeconds();
+			inflated.resize(uncompressedSize + 1);
+			if(!inflateRaw(entry, compressedSize, &inflated[0], uncompressedSize))
+			{
+				error = path + ": could not inflate " + name;
+				return false;
+			}
+			m_fInflateSeconds += getTimeSeconds() - fInflateStart;
+			entry = &inflated[0];
+		}
+		else if(method != 0)
+		{
+			std::ostringstream message;
+			message<<path<<": "<<name<<" uses compression method "<<method;
+			error = message.str();
+			return false;
+		}
+
+		if(!loadEntry(name, (const char *)entry, uncompressedSize, error))
+			return false;
+	}
+
+	return true;
+}
+
+bool SioScene::load(const std::string &path, std::string &error)
+{
+	clear();
+
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+	{
+		error = "Could not find " + path;
+		return false;
+	}
+	if(info.st_mode & S_IFDIR)
+		return loadFolder(path, error);
+	return loadArchive(path, error);
+}
+
+const SioRecord *SioScene::find(const std::string &name) const
+{
+	for(unsigned int i=0; i<m_vRecords.size(); i++)
+	{
+		if(m_vRecords[i].name == name)
+			return &m_vRecords[i];
+	}
+	return NULL;
+}
+
+bool SioScene::hasFile(const std::string &name) const
+{
+	for(unsigned int i=0; i<m_vOtherFiles.size(); i++)
+	{
+		if(m_vOtherFiles[i] == name)
+			return true;
+	}
+	return false;
+}
+
+unsigned int SioScene::validate(std::vector<std::string> &problems) const
+{
+	size_t nStart = problems.size();
+
+	for(unsigned int i=0; i<m_vRecords.size(); i++)
+	{
+		const SioRecord &r = m_vRecords[i];
+		std::string prefix = r.name + ": ";
+
+		if(r.type == SIO_MATERIAL)
+		{
+			const char *textures[2] = { "tname0", "tname1" };
+			for(int t=0; t<2; t++)
+			{
+				const SioProperty *tname = r.find(textures[t]);
+				if(tname != NULL && !tname->text.empty() && !hasFile(tname->text))
+					problems.push_back(prefix + textures[t] + " " + tname->text + " is not in the scene");
+			}
+			continue;
+		}
+		if(r.type != SIO_OBJECT)
+			continue;
+
+		const char *links[3] = { "instname", "link", "lod" };
+		for(int l=0; l<3; l++)
+		{
+			const SioProperty *link = r.find(links[l]);
+			if(link != NULL && find(link->text) == NULL)
+				problems.push_back(prefix + links[l] + " " + link->text + " is not in the scene");
+		}
+
+		unsigned int nVerts = r.vertexCount();
+		if(r.vertices.size() != nVerts * 3
+			|| (!r.colors.empty() && r.colors.size() != nVerts * 4)
+			|| (!r.normals.empty() && r.normals.size() != nVerts * 3)
+			|| (!r.uv0.empty() && r.uv0.size() != nVerts * 2)
+			|| (!r.uv1.empty() && r.uv1.size() != nVerts * 2)
+			|| (!r.tangents.empty() && r.tangents.size() != nVerts * 4))
+		{
+			problems.push_back(prefix + "vcol, vnor, uv or vtan counts do not match vert");
+		}
+
+		// The first value is the size of the vertex buffer, colours
+		// take a byte per channel and the rest a float. Values are
+		// read as floats, so large sizes are only close.
+		const SioProperty *vbo = r.find("vbo_offset");
+		if(vbo != NULL && !vbo->values.empty() && nVerts > 0)
+		{
+			double expected = (double)(r.vertices.size() + r.normals.size() + r.uv0.size() + r.uv1.size() + r.tangents.size()) * 4
+				+ r.colors.size();
+			if(fabs(vbo->values[0] - expected) > expected * 1e-6)
+				problems.push_back(prefix + "vbo_offset size does not match the vertices");
+		}
+
+		const SioProperty *restart = r.find("strip_restart");
+		unsigned int nRestart = restart != NULL && !restart->values.empty() ? (unsigned int)restart->values[0] : 0xFFFFFFFF;
+
+		for(unsigned int g=0; g<r.groups.size(); g++)
+		{
+			const SioVertexGroup &group = r.groups[g];
+			if(group.indices.size() != group.nDeclared)
+			{
+				std::ostringstream s;
+				s<<prefix<<"vgroup "<<group.name<<" declares "<<group.nDeclared<<" indices and has "<<group.indices.size();
+				problems.push_back(s.str());
+			}
+			if(!group.bStrips && group.indices.size() % 3 != 0)
+				problems.push_back(prefix + "vgroup " + group.name + " index list is not whole triangles");
+
+			for(unsigned int n=0; n<group.indices.size(); n++)
+			{
+				if(group.indices[n] >= nVerts && !(group.bStrips && group.indices[n] == nRestart))
+				{
+					problems.push_back(prefix + "vgroup " + group.name + " has indices past the last vertex");
+					break;
+				}
+			}
+
+			for(unsigned int m=0; m<group.materials.size(); m++)
+			{
+				if(find(group.materials[m]) == NULL)
+					problems.push_back(prefix + "mname " + group.materials[m] + " is not in the scene");
+			}
+		}
+
+		if(r.nDeclaredFrames != r.frames.size())
+			problems.push_back(prefix + "n_frame does not match the frames");
+		for(unsigned int f=1; f<r.frames.size(); f++)
+		{
+			if(r.frames[f].vertices.size() != r.frames[0].vertices.size())
+			{
+				problems.push_back(prefix + "frames have different vertex counts");
+				break;
+			}
+		}
+		for(unsigned int f=0; f<r.frames.size(); f++)
+		{
+			if(!r.frames[f].normals.empty() && r.frames[f].normals.size() != r.frames[f].vertices.size())
+			{
+				problems.push_back(prefix + "fnor count does not match fvert");
+				break;
+			}
+		}
+	}
+
+	return (unsigned int)(problems.size() - nStart);
+}
@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2009 Frank Hernandez
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//////////////////////////////////////////////////////////////////////////////
+#ifndef SIOSCENE_H
+#define SIOSCENE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Reads back what the exporter writes, from the scene folder or
+// from the zipped .sio2 file, to check it and to time how long a
+// loader spends parsing each kind of record.
+
+enum SioRecordType
+{
+	SIO_CAMERA,
+	SIO_LAMP,
+	SIO_MATERIAL,
+	SIO_OBJECT,
+	SIO_IPO,
+	SIO_RECORD_TYPES
+};
+
+const char *sioRecordTypeName(int type);
+
+// A key( values ) line other than the geometry.
+struct SioProperty
+{
+	std::string key;
+	std::vector<float> values;
+	// Quoted argument, such as the name in instname.
+	std::string text;
+};
+
+struct SioVertexGroup
+{
+	std::string name;
+	std::vector<std::string> materials;
+	// From ind, or from sind when bStrips is set.
+	std::vector<unsigned int> indices;
+	bool bStrips;
+	// Count given by n_ind or n_sind.
+	unsigned int nDeclared;
+};
+
+struct SioFrame
+{
+	float time;
+	std::string name;
+	std::vector<float> vertices;
+	// From fnor, 3 values from -127 to 127 per vertex, may be empty.
+	std::vector<float> normals;
+};
+
+struct SioRecord
+{
+	SioRecordType type;
+	// As written in the header, e.g. object/Cube.
+	std::string name;
+	std::vector<SioProperty> properties;
+
+	// Objects only.
+	std::vector<float> vertices;
+	std::vector<float> colors;
+	std::vector<float> normals;
+	std::vector<float> uv0;
+	std::vector<float> uv1;
+	// From vtan, xyz and the bitangent sign, may be empty.
+	std::vector<float> tangents;
+	std::vector<SioVertexGroup> groups;
+	unsigned int nDeclaredFrames;
+	std::vector<SioFrame> frames;
+
+	const SioProperty *find(const char *key) const;
+	unsigned int vertexCount() const { return (unsigned int)(vertices.size() / 3); }
+
+	// Triangles of a vertex group, 3 indices each, with strips
+	// unrolled and their degenerate triangles dropped.
+	void getTriangles(unsigned int group, std::vector<unsigned int> &triangles) const;
+};
+
+// What loading took, per record type.
+struct SioLoadStats
+{
+	unsigned int nRecords;
+	size_t nBytes;
+	double fParseSeconds;
+};
+
+class SioScene
+{
+	public:
+		SioScene();
+
+		// A scene folder or a .sio2 archive.
+		bool load(const std::string &path, std::string &error);
+		void clear();
+
+		// Parses one file. The text does not need to end with a
+		// null, so it can be read from a mapped file in place.
+		bool parse(const char *text, size_t size, const std::string &fileName, std::string &error);
+
+		const SioRecord *find(const std::string &name) const;
+		bool hasFile(const std::string &name) const;
+
+		// Checks the counts and the names objects and materials
+		// refer to. Returns the number of problems found.
+		unsigned int validate(std::vector<std::string> &problems) const;
+
+		std::vector<SioRecord> m_vRecords;
+		// Files kept as they are, such as images, by path in the scene.
+		std::vector<std::string> m_vOtherFiles;
+
+		SioLoadStats m_stats[SIO_RECORD_TYPES];
+		// Opening and mapping the files, and inflating the
+		// compressed ones.
+		double m_fMapSeconds;
+		double m_fInflateSeconds;
+		size_t m_nFileBytes;
+
+	protected:
+		bool loadFolder(const std::string &path, std::string &error);
+		bool loadArchive(const std::string &path, std::string &error);
+		bool loadEntry(const std::string &name, const char *text, size_t size, std::string &error);
+};
+
+// Parses a decimal number as written by the exporter, with an
+// optional sign, fraction and exponent. Returns the character
+// after it, or p if there is no number there.
+const char *parseSioNumber(const char *p, const char *end, double &value);
+
+#endif